@@ -683,7 +683,7 @@ int loadAppendOnlyFile(char *filename) {
         serverLog(LL_NOTICE,"Reading RDB preamble from AOF file...");
         if (fseek(fp,0,SEEK_SET) == -1) goto readerr;
         rioInitWithFile(&rdb,fp);
-        if (rdbLoadRio(&rdb,NULL) != C_OK) {
+        if (rdbLoadRio(&rdb,NULL,server.db) != C_OK) {
             serverLog(LL_WARNING,"Error reading the RDB preamble of the AOF file, AOF loading aborted");
             goto readerr;
         } else {
@@ -833,8 +833,31 @@ int rioWriteBulkObject(rio *r, robj *obj) {
      * in a child process when this function is called). */
     if (obj->encoding == OBJ_ENCODING_INT) {
         return rioWriteBulkLongLong(r,(long)obj->ptr);
+    } else if (obj->encoding == OBJ_ENCODING_DOUBLE) {
+        char buf[OBJ_DOUBLE_STR_SIZE];
+        int len = getDoubleEncodedString(obj,buf,sizeof(buf));
+        return rioWriteBulkString(r,buf,len);
     } else if (sdsEncodedObject(obj)) {
         return rioWriteBulkString(r,obj->ptr,sdslen(obj->ptr));
+    } else if (obj->encoding == OBJ_ENCODING_CHUNKED) {
+        chunkedString *cs = obj->ptr;
+        size_t offset = 0;
+
+        if (rioWriteBulkCount(r,'$',cs->len) == 0) return 0;
+        while (offset < cs->len) {
+            size_t avail;
+            unsigned char *p = chunkedStringSpan(cs,offset,&avail);
+
+            if (rioWrite(r,p,avail) == 0) return 0;
+            offset += avail;
+        }
+        if (rioWrite(r,"\r\n",2) == 0) return 0;
+        return 1;
+    } else if (obj->encoding == OBJ_ENCODING_COMPRESSED) {
+        robj *dec = getDecodedObject(obj);
+        int retval = rioWriteBulkString(r,dec->ptr,sdslen(dec->ptr));
+        decrRefCount(dec);
+        return retval;
     } else {
         serverPanic("Unknown string encoding");
     }
@@ -961,14 +984,14 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
             if (++count == AOF_REWRITE_ITEMS_PER_CMD) count = 0;
             items--;
         }
-    } else if (o->encoding == OBJ_ENCODING_SKIPLIST) {
+    } else if (zsetIsLargeEncoding(o->encoding)) {
         zset *zs = o->ptr;
         dictIterator *di = dictGetIterator(zs->dict);
         dictEntry *de;
 
         while((de = dictNext(di)) != NULL) {
             sds ele = dictGetKey(de);
-            double *score = dictGetVal(de);
+            double score = zsetDictGetScore(o,de);
 
             if (count == 0) {
                 int cmd_items = (items > AOF_REWRITE_ITEMS_PER_CMD) ?
@@ -978,7 +1001,7 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
                 if (rioWriteBulkString(r,"ZADD",4) == 0) return 0;
                 if (rioWriteBulkObject(r,key) == 0) return 0;
             }
-            if (rioWriteBulkDouble(r,*score) == 0) return 0;
+            if (rioWriteBulkDouble(r,score) == 0) return 0;
             if (rioWriteBulkString(r,ele,sdslen(ele)) == 0) return 0;
             if (++count == AOF_REWRITE_ITEMS_PER_CMD) count = 0;
             items--;
@@ -1078,6 +1101,7 @@ ssize_t aofReadDiffFromParent(void) {
 int rewriteAppendOnlyFileRio(rio *aof) {
     dictIterator *di = NULL;
     dictEntry *de;
+    robj *tiered = NULL;
     size_t processed = 0;
     long long now = mstime();
     int j;
@@ -1108,6 +1132,13 @@ int rewriteAppendOnlyFileRio(rio *aof) {
             /* If this key is already expired skip it */
             if (expiretime != -1 && expiretime < now) continue;
 
+            /* Values spilled to the tiering file are rewritten from a
+             * temporary copy. */
+            if (o->encoding == OBJ_ENCODING_TIERED) {
+                if ((tiered = tieringReadValue(o)) == NULL) goto werr;
+                o = tiered;
+            }
+
             /* Save the key and associated value */
             if (o->type == OBJ_STRING) {
                 /* Emit a SET command */
@@ -1136,6 +1167,10 @@ int rewriteAppendOnlyFileRio(rio *aof) {
                 if (rioWriteBulkObject(aof,&key) == 0) goto werr;
                 if (rioWriteBulkLongLong(aof,expiretime) == 0) goto werr;
             }
+            if (tiered) {
+                decrRefCount(tiered);
+                tiered = NULL;
+            }
             /* Read some diff from the parent process from time to time. */
             if (aof->processed_bytes > processed+AOF_READ_DIFF_INTERVAL_BYTES) {
                 processed = aof->processed_bytes;
@@ -1149,6 +1184,7 @@ int rewriteAppendOnlyFileRio(rio *aof) {
 
 werr:
     if (di) dictReleaseIterator(di);
+    if (tiered) decrRefCount(tiered);
     return C_ERR;
 }
 
@@ -1361,6 +1397,8 @@ int rewriteAppendOnlyFileBackground(void) {
         /* Child */
         closeListeningSockets(0);
         redisSetProcTitle("redis-aof-rewrite");
+        /* There are no bio threads in the child. */
+        quicklistSetAsyncCompress(NULL);
         snprintf(tmpfile,256,"temp-rewriteaof-bg-%d.aof", (int) getpid());
         if (rewriteAppendOnlyFile(tmpfile) == C_OK) {
             size_t private_dirty = zmalloc_get_private_dirty(-1);
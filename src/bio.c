@@ -1,5 +1,5 @@
 /* Background I/O service for Redis.
- * 三个线程，处理三种后台任务，使用线程mutex进行同步，每一种任务有一个列表，对应的mutex,
+ * 每种后台任务有一个或多个线程，每个线程有一个无锁的多生产者单消费者队列。
  *
  * This file implements operations that we need to perform in the background.
  * Currently there is only a single operation, that is a background close(2)
@@ -17,13 +17,16 @@
  * ------
  *
  * The design is trivial, we have a structure representing a job to perform
- * and a different thread and job queue for every job type.
- * Every thread wait for new jobs in its queue, and process every job
- * sequentially.
+ * and one or more worker threads for every job type, as configured with the
+ * bio-threads directive. Every worker has its own job queue, an intrusive
+ * multi producer single consumer queue that can be appended to without
+ * locking, and processes its jobs sequentially. A new job is queued to the
+ * worker of its type with the fewest pending jobs. Mutexes are only used by
+ * idle workers waiting for new jobs, and by bioWaitStepOfType().
  *
  * Jobs of the same type are guaranteed to be processed from the least
  * recently inserted to the most recently inserted (older jobs processed
- * first).
+ * first) only when the type has a single worker, that is the default.
  *
  * Currently there is no way for the creator of the job to be notified about
  * the completion of the operation, this will only be added when/if needed.
@@ -62,28 +65,78 @@
 #include "server.h"
 #include "bio.h"
 
-static pthread_t bio_threads[BIO_NUM_OPS];
-static pthread_mutex_t bio_mutex[BIO_NUM_OPS];
-static pthread_cond_t bio_newjob_cond[BIO_NUM_OPS];
-static pthread_cond_t bio_step_cond[BIO_NUM_OPS];
-static list *bio_jobs[BIO_NUM_OPS];
-/* The following array is used to hold the number of pending jobs for every
- * OP type. This allows us to export the bioPendingJobsOfType() API that is
- * useful when the main thread wants to perform some operation that may involve
- * objects shared with the background thread. The main thread will just wait
- * that there are no longer jobs of this type to be executed before performing
- * the sensible operation. This data is also useful for reporting. */
-static unsigned long long bio_pending[BIO_NUM_OPS];
+/* The job queues need atomic exchanges: every operation below is a full
+ * memory barrier, that is what the idle workers wake up protocol needs. */
+#if defined(__ATOMIC_SEQ_CST)
+#define bioAtomicLoad(ptr) __atomic_load_n((ptr),__ATOMIC_SEQ_CST)
+#define bioAtomicStore(ptr,val) __atomic_store_n((ptr),(val),__ATOMIC_SEQ_CST)
+#define bioAtomicExchange(ptr,val) \
+    __atomic_exchange_n((ptr),(val),__ATOMIC_SEQ_CST)
+#define bioAtomicAdd(ptr,val) __atomic_add_fetch((ptr),(val),__ATOMIC_SEQ_CST)
+#elif defined(HAVE_ATOMIC)
+#define bioAtomicLoad(ptr) __sync_val_compare_and_swap((ptr),*(ptr),*(ptr))
+#define bioAtomicStore(ptr,val) do { \
+    __sync_synchronize(); \
+    *(ptr) = (val); \
+    __sync_synchronize(); \
+} while(0)
+#define bioAtomicExchange(ptr,val) \
+    (__sync_synchronize(), __sync_lock_test_and_set((ptr),(val)))
+#define bioAtomicAdd(ptr,val) __sync_add_and_fetch((ptr),(val))
+#else
+#error "The background jobs queues need atomic builtins"
+#endif
 
 /* This structure represents a background Job. It is only used locally to this
  * file as the API does not expose the internals at all. */
 struct bio_job {
-    time_t time; /* Time at which the job was created. */
+    struct bio_job *next;   /* Next job in the worker queue. */
+    long long created;      /* ustime() at which the job was created. */
     /* Job specific arguments pointers. If we need to pass more than three
      * arguments we can just pass a pointer to a structure or alike. */
     void *arg1, *arg2, *arg3;
 };
 
+/* A worker thread and its queue. Jobs are pushed at 'head' by any thread,
+ * and popped at 'tail' by the worker only. The queue always contains at
+ * least one job, so 'stub' is queued again when the last one is popped. */
+typedef struct bioWorker {
+    pthread_t thread;
+    int type;
+    struct bio_job *head;
+    struct bio_job *tail;
+    struct bio_job stub;
+    /* Queued jobs plus the one being processed. */
+    unsigned long long pending;
+    /* Set by the worker before waiting for new jobs. */
+    int sleeping;
+    pthread_mutex_t mutex;
+    pthread_cond_t newjob_cond;
+} bioWorker;
+
+static bioWorker *bio_workers[BIO_NUM_OPS];
+static int bio_workers_num[BIO_NUM_OPS];
+static int bio_initialized = 0;
+
+/* Used by bioWaitStepOfType() to wait for the completion of a job. The
+ * workers only signal the condition when there are waiters. */
+static pthread_mutex_t bio_step_mutex[BIO_NUM_OPS];
+static pthread_cond_t bio_step_cond[BIO_NUM_OPS];
+static int bio_step_waiters[BIO_NUM_OPS];
+
+/* Counters reported by INFO, see bioGetStatsOfType(). */
+static unsigned long long bio_processed[BIO_NUM_OPS];
+static unsigned long long bio_wait_usec[BIO_NUM_OPS];
+static unsigned long long bio_run_usec[BIO_NUM_OPS];
+
+static char *bio_type_names[BIO_NUM_OPS] = {
+    "close-file",
+    "aof-fsync",
+    "lazy-free",
+    "quicklist-compress",
+    "tiering-read"
+};
+
 void *bioProcessBackgroundJobs(void *arg);
 void lazyfreeFreeObjectFromBioThread(robj *o);
 void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2);
@@ -93,21 +146,92 @@ void lazyfreeFreeSlotsMapFromBioThread(zskiplist *sl);
  * main thread. */
 #define REDIS_THREAD_STACK_SIZE (1024*1024*4)
 
-/* Initialize the background system, spawning the thread. */
+/* Return the job type with the specified name, or -1 if there is none. */
+int bioGetTypeByName(const char *name) {
+    int j;
+
+    for (j = 0; j < BIO_NUM_OPS; j++)
+        if (!strcasecmp(name,bio_type_names[j])) return j;
+    return -1;
+}
+
+const char *bioGetTypeName(int type) {
+    return bio_type_names[type];
+}
+
+/* Set the number of workers processing the jobs of the specified type.
+ * This is only possible before bioInit() spawns the threads: C_ERR is
+ * returned otherwise, or if 'workers' is out of range. */
+int bioSetWorkersOfType(int type, int workers) {
+    if (bio_initialized || workers < 1 || workers > BIO_MAX_WORKERS)
+        return C_ERR;
+    bio_workers_num[type] = workers;
+    return C_OK;
+}
+
+int bioWorkersOfType(int type) {
+    return bio_workers_num[type] ? bio_workers_num[type] : BIO_DEFAULT_WORKERS;
+}
+
+/* Append 'job' to the queue of worker 'w'. Can be called by any thread. */
+static void bioQueuePush(bioWorker *w, struct bio_job *job) {
+    struct bio_job *prev;
+
+    job->next = NULL;
+    prev = bioAtomicExchange(&w->head,job);
+    /* Until the link is set the worker can't see 'job' and the ones queued
+     * after it, and considers the queue empty. */
+    bioAtomicStore(&prev->next,job);
+}
+
+/* Pop the least recently pushed job from the queue of worker 'w', or return
+ * NULL if the queue is empty. Only called by the worker itself. */
+static struct bio_job *bioQueuePop(bioWorker *w) {
+    struct bio_job *tail = w->tail, *next = bioAtomicLoad(&tail->next);
+
+    if (tail == &w->stub) {
+        if (next == NULL) return NULL;
+        w->tail = tail = next;
+        next = bioAtomicLoad(&next->next);
+    }
+    if (next) {
+        w->tail = next;
+        return tail;
+    }
+    /* 'tail' is the last job, unless a push is in progress. */
+    if (tail != bioAtomicLoad(&w->head)) return NULL;
+    bioQueuePush(w,&w->stub);
+    next = bioAtomicLoad(&tail->next);
+    if (next) {
+        w->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/* Initialize the background system, spawning the threads. */
 void bioInit(void) {
     pthread_attr_t attr;
     pthread_t thread;
     size_t stacksize;
-    int j;
+    int j, i;
 
     /* Initialization of state vars and objects */
     for (j = 0; j < BIO_NUM_OPS; j++) {
-        pthread_mutex_init(&bio_mutex[j],NULL);
-        pthread_cond_init(&bio_newjob_cond[j],NULL);
+        bio_workers_num[j] = bioWorkersOfType(j);
+        bio_workers[j] = zcalloc(sizeof(bioWorker)*bio_workers_num[j]);
+        for (i = 0; i < bio_workers_num[j]; i++) {
+            bioWorker *w = bio_workers[j]+i;
+
+            w->type = j;
+            w->head = w->tail = &w->stub;
+            pthread_mutex_init(&w->mutex,NULL);
+            pthread_cond_init(&w->newjob_cond,NULL);
+        }
+        pthread_mutex_init(&bio_step_mutex[j],NULL);
         pthread_cond_init(&bio_step_cond[j],NULL);
-        bio_jobs[j] = listCreate();
-        bio_pending[j] = 0;
     }
+    bio_initialized = 1;
 
     /* Set the stack size as by default it may be small in some system */
     pthread_attr_init(&attr);
@@ -117,50 +241,78 @@ void bioInit(void) {
     pthread_attr_setstacksize(&attr, stacksize);
 
     /* Ready to spawn our threads. We use the single argument the thread
-     * function accepts in order to pass the job ID the thread is
-     * responsible of. */
+     * function accepts in order to pass the worker the thread runs. */
     for (j = 0; j < BIO_NUM_OPS; j++) {
-        void *arg = (void*)(unsigned long) j;
-        if (pthread_create(&thread,&attr,bioProcessBackgroundJobs,arg) != 0) {
-            serverLog(LL_WARNING,"Fatal: Can't initialize Background Jobs.");
-            exit(1);
+        for (i = 0; i < bio_workers_num[j]; i++) {
+            bioWorker *w = bio_workers[j]+i;
+
+            if (pthread_create(&thread,&attr,bioProcessBackgroundJobs,w) != 0) {
+                serverLog(LL_WARNING,"Fatal: Can't initialize Background Jobs.");
+                exit(1);
+            }
+            w->thread = thread;
         }
-        bio_threads[j] = thread;
     }
 }
 
 void bioCreateBackgroundJob(int type, void *arg1, void *arg2, void *arg3) {
     struct bio_job *job = zmalloc(sizeof(*job));
+    bioWorker *w = bio_workers[type];
+    int j;
 
-    job->time = time(NULL);
+    job->created = ustime();
     job->arg1 = arg1;
     job->arg2 = arg2;
     job->arg3 = arg3;
-    pthread_mutex_lock(&bio_mutex[type]);
-    listAddNodeTail(bio_jobs[type],job);
-    bio_pending[type]++;
-    pthread_cond_signal(&bio_newjob_cond[type]);
-    pthread_mutex_unlock(&bio_mutex[type]);
+
+    /* Pick the worker with the fewest pending jobs, so that a slow job,
+     * like freeing a huge object, does not delay the following ones. */
+    for (j = 1; j < bio_workers_num[type] && bioAtomicLoad(&w->pending); j++) {
+        bioWorker *other = bio_workers[type]+j;
+
+        if (bioAtomicLoad(&other->pending) < bioAtomicLoad(&w->pending))
+            w = other;
+    }
+    bioAtomicAdd(&w->pending,1);
+    bioQueuePush(w,job);
+
+    /* Wake up the worker if it is waiting for jobs. It sets 'sleeping'
+     * before checking the queue a last time, so either it sees the job or
+     * we see it sleeping. */
+    if (bioAtomicLoad(&w->sleeping)) {
+        pthread_mutex_lock(&w->mutex);
+        pthread_cond_signal(&w->newjob_cond);
+        pthread_mutex_unlock(&w->mutex);
+    }
 }
 
-void *bioProcessBackgroundJobs(void *arg) {
+/* Return the next job of worker 'w', waiting for one if needed. */
+static struct bio_job *bioWaitJob(bioWorker *w) {
     struct bio_job *job;
-    unsigned long type = (unsigned long) arg;
-    sigset_t sigset;
 
-    /* Check that the type is within the right interval. */
-    if (type >= BIO_NUM_OPS) {
-        serverLog(LL_WARNING,
-            "Warning: bio thread started with wrong type %lu",type);
-        return NULL;
+    while ((job = bioQueuePop(w)) == NULL) {
+        pthread_mutex_lock(&w->mutex);
+        bioAtomicStore(&w->sleeping,1);
+        if ((job = bioQueuePop(w)) == NULL)
+            pthread_cond_wait(&w->newjob_cond,&w->mutex);
+        bioAtomicStore(&w->sleeping,0);
+        pthread_mutex_unlock(&w->mutex);
+        if (job) break;
     }
+    return job;
+}
+
+void *bioProcessBackgroundJobs(void *arg) {
+    struct bio_job *job;
+    bioWorker *w = arg;
+    int type = w->type;
+    sigset_t sigset;
 
     /* Make the thread killable at any time, so that bioKillThreads()
      * can work reliably. */
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
 
-    pthread_mutex_lock(&bio_mutex[type]);
     /* Block SIGALRM so we are sure that only the main thread will
      * receive the watchdog signal. */
     sigemptyset(&sigset);
@@ -170,19 +322,10 @@ void *bioProcessBackgroundJobs(void *arg) {
             "Warning: can't mask SIGALRM in bio.c thread: %s", strerror(errno));
 
     while(1) {
-        listNode *ln;
+        long long start, end;
 
-        /* The loop always starts with the lock hold. */
-        if (listLength(bio_jobs[type]) == 0) {
-            pthread_cond_wait(&bio_newjob_cond[type],&bio_mutex[type]);
-            continue;
-        }
-        /* Pop the job from the queue. */
-        ln = listFirst(bio_jobs[type]);
-        job = ln->value;
-        /* It is now possible to unlock the background system as we know have
-         * a stand alone job structure to process.*/
-        pthread_mutex_unlock(&bio_mutex[type]);
+        job = bioWaitJob(w);
+        start = ustime();
 
         /* Process the job accordingly to its type. */
         if (type == BIO_CLOSE_FILE) {
@@ -200,28 +343,39 @@ void *bioProcessBackgroundJobs(void *arg) {
                 lazyfreeFreeDatabaseFromBioThread(job->arg2,job->arg3);
             else if (job->arg3)
                 lazyfreeFreeSlotsMapFromBioThread(job->arg3);
+        } else if (type == BIO_QUICKLIST_COMPRESS) {
+            quicklistCompressJobRun(job->arg1);
+        } else if (type == BIO_TIERING_READ) {
+            tieringReadJobRun(job->arg1);
         } else {
             serverPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
+        end = ustime();
+        bioAtomicAdd(&bio_processed[type],1);
+        bioAtomicAdd(&bio_wait_usec[type],
+            (unsigned long long)(start > job->created ? start-job->created : 0));
+        bioAtomicAdd(&bio_run_usec[type],
+            (unsigned long long)(end > start ? end-start : 0));
         zfree(job);
+        bioAtomicAdd(&w->pending,-1);
 
         /* Unblock threads blocked on bioWaitStepOfType() if any. */
-        pthread_cond_broadcast(&bio_step_cond[type]);
-
-        /* Lock again before reiterating the loop, if there are no longer
-         * jobs to process we'll block again in pthread_cond_wait(). */
-        pthread_mutex_lock(&bio_mutex[type]);
-        listDelNode(bio_jobs[type],ln);
-        bio_pending[type]--;
+        if (bioAtomicLoad(&bio_step_waiters[type])) {
+            pthread_mutex_lock(&bio_step_mutex[type]);
+            pthread_cond_broadcast(&bio_step_cond[type]);
+            pthread_mutex_unlock(&bio_step_mutex[type]);
+        }
     }
 }
 
 /* Return the number of pending jobs of the specified type. */
 unsigned long long bioPendingJobsOfType(int type) {
-    unsigned long long val;
-    pthread_mutex_lock(&bio_mutex[type]);
-    val = bio_pending[type];
-    pthread_mutex_unlock(&bio_mutex[type]);
+    unsigned long long val = 0;
+    int j;
+
+    if (!bio_initialized) return 0;
+    for (j = 0; j < bio_workers_num[type]; j++)
+        val += bioAtomicLoad(&bio_workers[type][j].pending);
     return val;
 }
 
@@ -237,32 +391,59 @@ unsigned long long bioPendingJobsOfType(int type) {
  */
 unsigned long long bioWaitStepOfType(int type) {
     unsigned long long val;
-    pthread_mutex_lock(&bio_mutex[type]);
-    val = bio_pending[type];
+    pthread_mutex_lock(&bio_step_mutex[type]);
+    bioAtomicAdd(&bio_step_waiters[type],1);
+    val = bioPendingJobsOfType(type);
     if (val != 0) {
-        pthread_cond_wait(&bio_step_cond[type],&bio_mutex[type]);
-        val = bio_pending[type];
+        pthread_cond_wait(&bio_step_cond[type],&bio_step_mutex[type]);
+        val = bioPendingJobsOfType(type);
     }
-    pthread_mutex_unlock(&bio_mutex[type]);
+    bioAtomicAdd(&bio_step_waiters[type],-1);
+    pthread_mutex_unlock(&bio_step_mutex[type]);
     return val;
 }
 
+/* Fill 'stats' with the number of workers, pending jobs and the counters of
+ * the jobs processed since the last bioResetStats() call for 'type'. */
+void bioGetStatsOfType(int type, bioStats *stats) {
+    stats->workers = bio_workers_num[type];
+    stats->pending = bioPendingJobsOfType(type);
+    stats->processed = bioAtomicLoad(&bio_processed[type]);
+    stats->wait_usec = bioAtomicLoad(&bio_wait_usec[type]);
+    stats->run_usec = bioAtomicLoad(&bio_run_usec[type]);
+}
+
+void bioResetStats(void) {
+    int j;
+
+    for (j = 0; j < BIO_NUM_OPS; j++) {
+        bioAtomicStore(&bio_processed[j],0);
+        bioAtomicStore(&bio_wait_usec[j],0);
+        bioAtomicStore(&bio_run_usec[j],0);
+    }
+}
+
 /* Kill the running bio threads in an unclean way. This function should be
  * used only when it's critical to stop the threads for some reason.
  * Currently Redis does this only on crash (for instance on SIGSEGV) in order
  * to perform a fast memory check without other threads messing with memory. */
 void bioKillThreads(void) {
-    int err, j;
+    int err, j, i;
 
+    if (!bio_initialized) return;
     for (j = 0; j < BIO_NUM_OPS; j++) {
-        if (pthread_cancel(bio_threads[j]) == 0) {
-            if ((err = pthread_join(bio_threads[j],NULL)) != 0) {
-                serverLog(LL_WARNING,
-                    "Bio thread for job type #%d can be joined: %s",
-                        j, strerror(err));
-            } else {
-                serverLog(LL_WARNING,
-                    "Bio thread for job type #%d terminated",j);
+        for (i = 0; i < bio_workers_num[j]; i++) {
+            pthread_t thread = bio_workers[j][i].thread;
+
+            if (pthread_cancel(thread) == 0) {
+                if ((err = pthread_join(thread,NULL)) != 0) {
+                    serverLog(LL_WARNING,
+                        "Bio thread #%d for job type #%d can be joined: %s",
+                            i, j, strerror(err));
+                } else {
+                    serverLog(LL_WARNING,
+                        "Bio thread #%d for job type #%d terminated",i,j);
+                }
             }
         }
     }
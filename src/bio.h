@@ -27,6 +27,15 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+/* Counters of a job type, see bioGetStatsOfType(). */
+typedef struct bioStats {
+    int workers;                    /* Threads processing the jobs. */
+    unsigned long long pending;     /* Jobs queued or being processed. */
+    unsigned long long processed;   /* Jobs completed. */
+    unsigned long long wait_usec;   /* Time the completed jobs were queued. */
+    unsigned long long run_usec;    /* Time spent processing them. */
+} bioStats;
+
 /* Exported API */
 void bioInit(void);
 void bioCreateBackgroundJob(int type, void *arg1, void *arg2, void *arg3);
@@ -34,9 +43,20 @@ unsigned long long bioPendingJobsOfType(int type);
 unsigned long long bioWaitStepOfType(int type);
 time_t bioOlderJobOfType(int type);
 void bioKillThreads(void);
+int bioGetTypeByName(const char *name);
+const char *bioGetTypeName(int type);
+int bioSetWorkersOfType(int type, int workers);
+int bioWorkersOfType(int type);
+void bioGetStatsOfType(int type, bioStats *stats);
+void bioResetStats(void);
 
 /* Background job opcodes */
 #define BIO_CLOSE_FILE    0 /* Deferred close(2) syscall. */
 #define BIO_AOF_FSYNC     1 /* Deferred AOF fsync. */
 #define BIO_LAZY_FREE     2 /* Deferred objects freeing. */
-#define BIO_NUM_OPS       3
+#define BIO_QUICKLIST_COMPRESS 3 /* Compression of quicklist nodes. */
+#define BIO_TIERING_READ  4 /* Read back of values from the tiering file. */
+#define BIO_NUM_OPS       5
+
+#define BIO_DEFAULT_WORKERS 1   /* Threads per job type, see bio-threads. */
+#define BIO_MAX_WORKERS   64
@@ -474,22 +474,80 @@ int getBitfieldTypeFromArgument(client *c, robj *o, int *sign, int *bits) {
  * bits to a string object. The command creates or pad with zeroes the string
  * so that the 'maxbit' bit can be addressed. The object is finally
  * returned. Otherwise if the key holds a wrong type NULL is returned and
- * an error is sent to the client. */
+ * an error is sent to the client.
+ *
+ * The returned object is either a raw string or, if it is larger than
+ * string-chunk-threshold, a chunked string. */
 robj *lookupStringForBitCommand(client *c, size_t maxbit) {
     size_t byte = maxbit >> 3;
     robj *o = lookupKeyWrite(c->db,c->argv[1]);
 
     if (o == NULL) {
-        o = createObject(OBJ_STRING,sdsnewlen(NULL, byte+1));
+        if (stringNeedsChunking(byte+1))
+            o = createChunkedStringObject(NULL,byte+1);
+        else
+            o = createObject(OBJ_STRING,sdsnewlen(NULL, byte+1));
         dbAdd(c->db,c->argv[1],o);
     } else {
         if (checkType(c,o,OBJ_STRING)) return NULL;
-        o = dbUnshareStringValue(c->db,c->argv[1],o);
-        o->ptr = sdsgrowzero(o->ptr,byte+1);
+        if (o->encoding == OBJ_ENCODING_CHUNKED ||
+            stringNeedsChunking(byte+1))
+        {
+            o = dbChunkStringValue(c->db,c->argv[1],o);
+            chunkedStringGrowZero(o->ptr,byte+1);
+        } else {
+            o = dbUnshareStringValue(c->db,c->argv[1],o);
+            o->ptr = sdsgrowzero(o->ptr,byte+1);
+        }
     }
     return o;
 }
 
+/* Count the set bits in the 'count' bytes of the chunked string 'cs'
+ * starting at 'offset'. */
+static long long chunkedStringPopcount(chunkedString *cs, size_t offset,
+                                       size_t count)
+{
+    long long bits = 0;
+
+    while (count) {
+        size_t avail;
+        unsigned char *p = chunkedStringSpan(cs,offset,&avail);
+
+        if (avail > count) avail = count;
+        bits += redisPopcount(p,avail);
+        offset += avail;
+        count -= avail;
+    }
+    return bits;
+}
+
+/* Like redisBitpos() but searching the 'count' bytes of the chunked string
+ * 'cs' starting at 'offset'. The returned position is relative to
+ * 'offset'. */
+static long chunkedStringBitpos(chunkedString *cs, size_t offset,
+                                size_t count, int bit)
+{
+    size_t skipped = 0;
+
+    while (count) {
+        size_t avail;
+        unsigned char *p = chunkedStringSpan(cs,offset,&avail);
+        long pos;
+
+        if (avail > count) avail = count;
+        pos = redisBitpos(p,avail,bit);
+        /* When looking for clear bits redisBitpos() returns the first bit
+         * after the range if they are all set. */
+        if (pos != -1 && (size_t)pos < avail*8)
+            return (long)(skipped*8)+pos;
+        offset += avail;
+        skipped += avail;
+        count -= avail;
+    }
+    return bit ? -1 : (long)(skipped*8);
+}
+
 /* Return a pointer to the string object content, and stores its length
  * in 'len'. The user is required to pass (likely stack allocated) buffer
  * 'llbuf' of at least LONG_STR_SIZE bytes. Such a buffer is used in the case
@@ -528,6 +586,7 @@ void setbitCommand(client *c) {
     size_t bitoffset;
     ssize_t byte, bit;
     int byteval, bitval;
+    uint8_t *p;
     long on;
 
     if (getBitOffsetFromArgument(c,c->argv[2],&bitoffset,0,0) != C_OK)
@@ -546,14 +605,20 @@ void setbitCommand(client *c) {
 
     /* Get current values */
     byte = bitoffset >> 3;
-    byteval = ((uint8_t*)o->ptr)[byte];
+    if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        size_t avail;
+        p = chunkedStringSpan(o->ptr,byte,&avail);
+    } else {
+        p = (uint8_t*)o->ptr+byte;
+    }
+    byteval = *p;
     bit = 7 - (bitoffset & 0x7);
     bitval = byteval & (1 << bit);
 
     /* Update byte with new bit value and return original value */
     byteval &= ~(1 << bit);
     byteval |= ((on & 0x1) << bit);
-    ((uint8_t*)o->ptr)[byte] = byteval;
+    *p = byteval;
     signalModifiedKey(c->db,c->argv[1]);
     notifyKeyspaceEvent(NOTIFY_STRING,"setbit",c->argv[1],c->db->id);
     server.dirty++;
@@ -576,6 +641,16 @@ void getbitCommand(client *c) {
 
     byte = bitoffset >> 3;
     bit = 7 - (bitoffset & 0x7);
+    if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        chunkedString *cs = o->ptr;
+        size_t avail;
+
+        if (byte < cs->len)
+            bitval = *chunkedStringSpan(cs,byte,&avail) & (1 << bit);
+        addReply(c, bitval ? shared.cone : shared.czero);
+        return;
+    }
+    o = dbFlattenStringValue(c->db,c->argv[1],o);
     if (sdsEncodedObject(o)) {
         if (byte < sdslen(o->ptr))
             bitval = ((uint8_t*)o->ptr)[byte] & (1 << bit);
@@ -775,7 +850,14 @@ void bitcountCommand(client *c) {
     /* Lookup, check for type, and return 0 for non existing keys. */
     if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL ||
         checkType(c,o,OBJ_STRING)) return;
-    p = getObjectReadOnlyString(o,&strlen,llbuf);
+    if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        /* Counted chunk by chunk below. */
+        p = NULL;
+        strlen = stringObjectLen(o);
+    } else {
+        o = dbFlattenStringValue(c->db,c->argv[1],o);
+        p = getObjectReadOnlyString(o,&strlen,llbuf);
+    }
 
     /* Parse start/end range if any. */
     if (c->argc == 4) {
@@ -810,7 +892,10 @@ void bitcountCommand(client *c) {
     } else {
         long bytes = end-start+1;
 
-        addReplyLongLong(c,redisPopcount(p+start,bytes));
+        if (p == NULL)
+            addReplyLongLong(c,chunkedStringPopcount(o->ptr,start,bytes));
+        else
+            addReplyLongLong(c,redisPopcount(p+start,bytes));
     }
 }
 
@@ -839,7 +924,14 @@ void bitposCommand(client *c) {
         return;
     }
     if (checkType(c,o,OBJ_STRING)) return;
-    p = getObjectReadOnlyString(o,&strlen,llbuf);
+    if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        /* Searched chunk by chunk below. */
+        p = NULL;
+        strlen = stringObjectLen(o);
+    } else {
+        o = dbFlattenStringValue(c->db,c->argv[1],o);
+        p = getObjectReadOnlyString(o,&strlen,llbuf);
+    }
 
     /* Parse start/end range if any. */
     if (c->argc == 4 || c->argc == 5) {
@@ -874,7 +966,8 @@ void bitposCommand(client *c) {
         addReplyLongLong(c, -1);
     } else {
         long bytes = end-start+1;
-        long pos = redisBitpos(p+start,bytes,bit);
+        long pos = p ? redisBitpos(p+start,bytes,bit) :
+                       chunkedStringBitpos(o->ptr,start,bytes,bit);
 
         /* If we are looking for clear bits, and the user specified an exact
          * range with start-end, we can't consider the right of the range as
@@ -995,6 +1088,8 @@ void bitfieldCommand(client *c) {
          * if it's not a string. */
         o = lookupKeyRead(c->db,c->argv[1]);
         if (o != NULL && checkType(c,o,OBJ_STRING)) return;
+        if (o != NULL && o->encoding != OBJ_ENCODING_CHUNKED)
+            o = dbFlattenStringValue(c->db,c->argv[1],o);
     } else {
         /* Lookup by making room up to the farest bit reached by
          * this operation. */
@@ -1016,6 +1111,20 @@ void bitfieldCommand(client *c) {
              * for simplicity. SET return value is the previous value so
              * we need fetch & store as well. */
 
+            /* Chunked strings are operated on a copy of the few bytes
+             * spanned by the bitfield, written back at the end. */
+            unsigned char *p = o->ptr, chunkbuf[9];
+            uint64_t offset = thisop->offset;
+            size_t byte = 0, count = 0;
+
+            if (o->encoding == OBJ_ENCODING_CHUNKED) {
+                byte = offset >> 3;
+                count = ((offset & 7) + thisop->bits + 7) / 8;
+                chunkedStringRead(o->ptr,byte,chunkbuf,count);
+                p = chunkbuf;
+                offset -= byte*8;
+            }
+
             /* We need two different but very similar code paths for signed
              * and unsigned operations, since the set of functions to get/set
              * the integers and the used variables types are different. */
@@ -1023,7 +1132,7 @@ void bitfieldCommand(client *c) {
                 int64_t oldval, newval, wrapped, retval;
                 int overflow;
 
-                oldval = getSignedBitfield(o->ptr,thisop->offset,
+                oldval = getSignedBitfield(p,offset,
                         thisop->bits);
 
                 if (thisop->opcode == BITFIELDOP_INCRBY) {
@@ -1044,7 +1153,7 @@ void bitfieldCommand(client *c) {
                  * NULL to signal the condition. */
                 if (!(overflow && thisop->owtype == BFOVERFLOW_FAIL)) {
                     addReplyLongLong(c,retval);
-                    setSignedBitfield(o->ptr,thisop->offset,
+                    setSignedBitfield(p,offset,
                                       thisop->bits,newval);
                 } else {
                     addReply(c,shared.nullbulk);
@@ -1053,7 +1162,7 @@ void bitfieldCommand(client *c) {
                 uint64_t oldval, newval, wrapped, retval;
                 int overflow;
 
-                oldval = getUnsignedBitfield(o->ptr,thisop->offset,
+                oldval = getUnsignedBitfield(p,offset,
                         thisop->bits);
 
                 if (thisop->opcode == BITFIELDOP_INCRBY) {
@@ -1073,12 +1182,13 @@ void bitfieldCommand(client *c) {
                  * NULL to signal the condition. */
                 if (!(overflow && thisop->owtype == BFOVERFLOW_FAIL)) {
                     addReplyLongLong(c,retval);
-                    setUnsignedBitfield(o->ptr,thisop->offset,
+                    setUnsignedBitfield(p,offset,
                                         thisop->bits,newval);
                 } else {
                     addReply(c,shared.nullbulk);
                 }
             }
+            if (p == chunkbuf) chunkedStringWrite(o->ptr,byte,chunkbuf,count);
             changes++;
         } else {
             /* GET */
@@ -1087,7 +1197,7 @@ void bitfieldCommand(client *c) {
             unsigned char *src = NULL;
             char llbuf[LONG_STR_SIZE];
 
-            if (o != NULL)
+            if (o != NULL && o->encoding != OBJ_ENCODING_CHUNKED)
                 src = getObjectReadOnlyString(o,&strlen,llbuf);
 
             /* For GET we use a trick: before executing the operation
@@ -1097,6 +1207,12 @@ void bitfieldCommand(client *c) {
             memset(buf,0,9);
             int i;
             size_t byte = thisop->offset >> 3;
+            if (o != NULL && o->encoding == OBJ_ENCODING_CHUNKED) {
+                chunkedString *cs = o->ptr;
+                if (byte < cs->len)
+                    chunkedStringRead(cs,byte,buf,
+                        cs->len-byte < 9 ? cs->len-byte : 9);
+            }
             for (i = 0; i < 9; i++) {
                 if (src == NULL || i+byte >= (size_t)strlen) break;
                 buf[i] = src[i+byte];
@@ -122,6 +122,11 @@ void processUnblockedClients(void) {
          * client is not blocked before to proceed, but things may change and
          * the code is conceptually more correct this way. */
         if (!(c->flags & CLIENT_BLOCKED)) {
+            /* Clients blocked before the execution of their command, like
+             * the ones waiting for values in the tiering file, process it
+             * again before the rest of the input buffer. */
+            if (c->flags & CLIENT_PENDING_COMMAND &&
+                processPendingCommand(c) == C_ERR) continue;
             if (c->querybuf && sdslen(c->querybuf) > 0) {
                 processInputBuffer(c);
             }
@@ -138,6 +143,8 @@ void unblockClient(client *c) {
         unblockClientWaitingReplicas(c);
     } else if (c->btype == BLOCKED_MODULE) {
         unblockClientFromModule(c);
+    } else if (c->btype == BLOCKED_TIERING) {
+        tieringUnblockClient(c);
     } else {
         serverPanic("Unknown btype in unblockClient().");
     }
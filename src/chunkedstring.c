@@ -0,0 +1,243 @@
+/* Chunked strings implementation, see chunkedstring.h. */
+
+#include <string.h>
+#include "chunkedstring.h"
+#include "zmalloc.h"
+
+#define CHUNK_SIZE CHUNKED_STRING_CHUNK_SIZE
+
+/* Add a chunk at the end of the string, zero filled if 'zero' is true.
+ * The length of the string is not changed. */
+static void chunkedStringAddChunk(chunkedString *cs, int zero) {
+    if (cs->count == cs->alloc) {
+        cs->alloc = cs->alloc ? cs->alloc*2 : 4;
+        cs->chunks = zrealloc(cs->chunks,sizeof(unsigned char*)*cs->alloc);
+    }
+    cs->chunks[cs->count++] = zero ? zcalloc(CHUNK_SIZE) : zmalloc(CHUNK_SIZE);
+}
+
+/* Create a chunked string holding a copy of the 'len' bytes at 'p', or
+ * 'len' zero bytes if 'p' is NULL. */
+chunkedString *chunkedStringNew(const void *p, size_t len) {
+    chunkedString *cs = zmalloc(sizeof(*cs));
+
+    cs->len = 0;
+    cs->count = 0;
+    cs->alloc = 0;
+    cs->chunks = NULL;
+    if (p)
+        chunkedStringAppend(cs,p,len);
+    else
+        chunkedStringGrowZero(cs,len);
+    return cs;
+}
+
+chunkedString *chunkedStringDup(const chunkedString *cs) {
+    chunkedString *dup = zmalloc(sizeof(*dup));
+    size_t j;
+
+    dup->len = cs->len;
+    dup->count = cs->count;
+    dup->alloc = cs->count;
+    dup->chunks = cs->count ?
+        zmalloc(sizeof(unsigned char*)*cs->count) : NULL;
+    for (j = 0; j < cs->count; j++) {
+        dup->chunks[j] = zmalloc(CHUNK_SIZE);
+        memcpy(dup->chunks[j],cs->chunks[j],CHUNK_SIZE);
+    }
+    return dup;
+}
+
+void chunkedStringFree(chunkedString *cs) {
+    size_t j;
+
+    for (j = 0; j < cs->count; j++) zfree(cs->chunks[j]);
+    zfree(cs->chunks);
+    zfree(cs);
+}
+
+/* Append 'len' bytes at 'p' to the string. Existing chunks are never
+ * moved, only the last one is filled before adding new chunks. */
+void chunkedStringAppend(chunkedString *cs, const void *p, size_t len) {
+    const unsigned char *src = p;
+
+    while (len) {
+        size_t idx = cs->len / CHUNK_SIZE, ofs = cs->len % CHUNK_SIZE;
+        size_t n = CHUNK_SIZE-ofs;
+
+        if (idx == cs->count) chunkedStringAddChunk(cs,0);
+        if (n > len) n = len;
+        memcpy(cs->chunks[idx]+ofs,src,n);
+        cs->len += n;
+        src += n;
+        len -= n;
+    }
+}
+
+/* Grow the string to 'len' bytes, padding it with zero bytes. Nothing is
+ * done if the string is already at least 'len' bytes long. */
+void chunkedStringGrowZero(chunkedString *cs, size_t len) {
+    size_t ofs = cs->len % CHUNK_SIZE;
+
+    if (len <= cs->len) return;
+    /* The tail of the last chunk holds undefined bytes. */
+    if (ofs) memset(cs->chunks[cs->count-1]+ofs,0,CHUNK_SIZE-ofs);
+    while (cs->count*CHUNK_SIZE < len) chunkedStringAddChunk(cs,1);
+    cs->len = len;
+}
+
+/* Overwrite 'len' bytes at 'offset' with the bytes at 'p', growing the
+ * string with zero padding if needed. */
+void chunkedStringWrite(chunkedString *cs, size_t offset, const void *p,
+                        size_t len)
+{
+    const unsigned char *src = p;
+
+    chunkedStringGrowZero(cs,offset+len);
+    while (len) {
+        size_t avail;
+        unsigned char *dst = chunkedStringSpan(cs,offset,&avail);
+
+        if (avail > len) avail = len;
+        memcpy(dst,src,avail);
+        offset += avail;
+        src += avail;
+        len -= avail;
+    }
+}
+
+/* Copy 'len' bytes at 'offset' into 'buf'. The range must be inside the
+ * string. */
+void chunkedStringRead(const chunkedString *cs, size_t offset, void *buf,
+                       size_t len)
+{
+    unsigned char *dst = buf;
+
+    while (len) {
+        size_t avail;
+        unsigned char *src = chunkedStringSpan(cs,offset,&avail);
+
+        if (avail > len) avail = len;
+        memcpy(dst,src,avail);
+        offset += avail;
+        dst += avail;
+        len -= avail;
+    }
+}
+
+/* Return a pointer to the byte at 'offset', that must be inside the
+ * string, and set '*avail' to the number of string bytes stored
+ * contiguously from there, that is, up to the end of the chunk or of the
+ * string. Callers iterate over a range of the string this way:
+ *
+ * while (len) {
+ *     p = chunkedStringSpan(cs,offset,&avail);
+ *     if (avail > len) avail = len;
+ *     ... process 'avail' bytes at 'p' ...
+ *     offset += avail; len -= avail;
+ * }
+ */
+unsigned char *chunkedStringSpan(const chunkedString *cs, size_t offset,
+                                 size_t *avail)
+{
+    size_t idx = offset / CHUNK_SIZE, ofs = offset % CHUNK_SIZE;
+
+    *avail = CHUNK_SIZE-ofs;
+    if (*avail > cs->len-offset) *avail = cs->len-offset;
+    return cs->chunks[idx]+ofs;
+}
+
+/* Return the number of bytes allocated for the string. */
+size_t chunkedStringAllocSize(const chunkedString *cs) {
+    return sizeof(*cs)+sizeof(unsigned char*)*cs->alloc+
+           CHUNK_SIZE*cs->count;
+}
+
+#ifdef REDIS_TEST
+#include <stdio.h>
+#include <stdlib.h>
+
+#define UNUSED(x) (void)(x)
+int chunkedStringTest(int argc, char *argv[]) {
+    UNUSED(argc);
+    UNUSED(argv);
+    size_t maxlen = CHUNK_SIZE*8, flatlen = 0;
+    unsigned char *flat = zcalloc(maxlen), *buf = zmalloc(maxlen);
+    unsigned char *src = zmalloc(maxlen);
+    chunkedString *cs = chunkedStringNew(NULL,0), *dup;
+    int j, errors = 0;
+
+    for (j = 0; j < (int)maxlen; j++) src[j] = rand();
+
+    /* Apply the same random operations to a flat buffer and to the chunked
+     * string, checking that the content is always the same. */
+    for (j = 0; j < 20000 && !errors; j++) {
+        size_t offset, len = rand() % (CHUNK_SIZE*2);
+
+        switch (rand() % 4) {
+        case 0:
+            if (flatlen+len > maxlen) break;
+            chunkedStringAppend(cs,src,len);
+            memcpy(flat+flatlen,src,len);
+            flatlen += len;
+            break;
+        case 1:
+            offset = rand() % (flatlen+CHUNK_SIZE);
+            if (offset+len > maxlen) break;
+            chunkedStringWrite(cs,offset,src+1,len);
+            if (offset > flatlen) memset(flat+flatlen,0,offset-flatlen);
+            memcpy(flat+offset,src+1,len);
+            if (offset+len > flatlen) flatlen = offset+len;
+            break;
+        case 2:
+            offset = flatlen + rand() % CHUNK_SIZE;
+            if (offset > maxlen) break;
+            chunkedStringGrowZero(cs,offset);
+            if (offset > flatlen) {
+                memset(flat+flatlen,0,offset-flatlen);
+                flatlen = offset;
+            }
+            break;
+        case 3:
+            /* Start again from time to time, to test short strings too. */
+            if (rand() % 20) break;
+            chunkedStringFree(cs);
+            len %= CHUNK_SIZE/4;
+            cs = chunkedStringNew(src,len);
+            memcpy(flat,src,len);
+            flatlen = len;
+            break;
+        }
+
+        if (cs->len != flatlen) {
+            printf("chunkedstring: length %zu, expected %zu\n",
+                cs->len, flatlen);
+            errors++;
+        }
+        if (flatlen) {
+            offset = rand() % flatlen;
+            len = rand() % (flatlen-offset+1);
+            chunkedStringRead(cs,offset,buf,len);
+            if (memcmp(buf,flat+offset,len) != 0) {
+                printf("chunkedstring: read mismatch at %zu+%zu\n",
+                    offset, len);
+                errors++;
+            }
+        }
+    }
+
+    dup = chunkedStringDup(cs);
+    chunkedStringRead(dup,0,buf,dup->len);
+    if (dup->len != flatlen || memcmp(buf,flat,flatlen) != 0) {
+        printf("chunkedstring: dup mismatch\n");
+        errors++;
+    }
+    chunkedStringFree(dup);
+    chunkedStringFree(cs);
+    zfree(flat);
+    zfree(buf);
+    zfree(src);
+    printf("chunkedstring: %s\n", errors ? "FAILED" : "ok");
+    return errors ? 1 : 0;
+}
+#endif
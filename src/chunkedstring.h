@@ -0,0 +1,44 @@
+/* Chunked strings: a byte string stored as an array of fixed size chunks.
+ *
+ * Appending to a chunked string never moves the bytes already stored, so
+ * growing a very large value by small appends costs O(appended bytes)
+ * instead of an occasional realloc() copy of the whole value, and the
+ * unused space is at most one chunk instead of the sds greedy
+ * preallocation. Since all the chunks have the same size, the chunk
+ * holding a given offset is found with a division.
+ *
+ * Every chunk but the last is full. The bytes of the last chunk after the
+ * end of the string are undefined. */
+
+#ifndef __CHUNKEDSTRING_H
+#define __CHUNKEDSTRING_H
+
+#include <stddef.h>
+
+#define CHUNKED_STRING_CHUNK_SIZE (16*1024)
+
+typedef struct chunkedString {
+    size_t len;             /* Length of the string in bytes. */
+    size_t count;           /* Number of chunks in use. */
+    size_t alloc;           /* Number of slots allocated in 'chunks'. */
+    unsigned char **chunks; /* CHUNKED_STRING_CHUNK_SIZE bytes each. */
+} chunkedString;
+
+chunkedString *chunkedStringNew(const void *p, size_t len);
+chunkedString *chunkedStringDup(const chunkedString *cs);
+void chunkedStringFree(chunkedString *cs);
+void chunkedStringAppend(chunkedString *cs, const void *p, size_t len);
+void chunkedStringGrowZero(chunkedString *cs, size_t len);
+void chunkedStringWrite(chunkedString *cs, size_t offset, const void *p,
+                        size_t len);
+void chunkedStringRead(const chunkedString *cs, size_t offset, void *buf,
+                       size_t len);
+unsigned char *chunkedStringSpan(const chunkedString *cs, size_t offset,
+                                 size_t *avail);
+size_t chunkedStringAllocSize(const chunkedString *cs);
+
+#ifdef REDIS_TEST
+int chunkedStringTest(int argc, char *argv[]);
+#endif
+
+#endif
@@ -30,6 +30,7 @@
 
 #include "server.h"
 #include "cluster.h"
+#include "bio.h"
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -84,6 +85,12 @@ configEnum supervised_mode_enum[] = {
     {NULL, 0}
 };
 
+configEnum hash_function_enum[] = {
+    {"siphash", HASH_FUNCTION_SIPHASH},
+    {"wyhash", HASH_FUNCTION_WYHASH},
+    {NULL, 0}
+};
+
 configEnum aof_fsync_enum[] = {
     {"everysec", AOF_FSYNC_EVERYSEC},
     {"always", AOF_FSYNC_ALWAYS},
@@ -91,6 +98,18 @@ configEnum aof_fsync_enum[] = {
     {NULL, 0}
 };
 
+configEnum list_compress_codec_enum[] = {
+    {"lzf", QUICKLIST_CODEC_LZF},
+    {"lz4", QUICKLIST_CODEC_LZ4},
+    {NULL, 0}
+};
+
+configEnum zset_large_encoding_enum[] = {
+    {"skiplist", OBJ_ENCODING_SKIPLIST},
+    {"btree", OBJ_ENCODING_BTREE},
+    {NULL, 0}
+};
+
 /* Output buffer limits presets. */
 clientBufferLimitsConfig clientBufferLimitsDefaults[CLIENT_TYPE_OBUF_COUNT] = {
     {0, 0, 0}, /* normal */
@@ -155,6 +174,35 @@ void resetServerSaveParams(void) {
     server.saveparamslen = 0;
 }
 
+/* Set the maxmemory-db limit of the DB 'dbid', 0 meaning no limit. The per
+ * DB memory accounting is active only as long as some DB has a limit. */
+void setDbMaxmemory(int dbid, unsigned long long bytes) {
+    int j, accounting = 0;
+
+    if (dbid >= server.maxmemory_db_len) {
+        server.maxmemory_db = zrealloc(server.maxmemory_db,
+            sizeof(unsigned long long)*(dbid+1));
+        for (j = server.maxmemory_db_len; j <= dbid; j++)
+            server.maxmemory_db[j] = 0;
+        server.maxmemory_db_len = dbid+1;
+    }
+    server.maxmemory_db[dbid] = bytes;
+    for (j = 0; j < server.maxmemory_db_len; j++)
+        if (server.maxmemory_db[j]) accounting = 1;
+
+    /* At startup the DBs don't exist yet: they are counted after
+     * loading the dataset. */
+    if (accounting == server.db_memory_accounting || server.db == NULL) {
+        server.db_memory_accounting = accounting;
+        return;
+    }
+    server.db_memory_accounting = accounting;
+    if (accounting)
+        dbMemoryRecount();
+    else
+        dbMemoryResolvePending();
+}
+
 void queueLoadModule(sds path, sds *argv, int argc) {
     int i;
     struct moduleLoadQueueEntry *loadmod;
@@ -328,6 +376,41 @@ void loadServerConfigFromString(char *config) {
                 err = "maxmemory-samples must be 1 or greater";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"maxmemory-soft-watermark") && argc == 2) {
+            server.maxmemory_soft_watermark = atoi(argv[1]);
+            if (server.maxmemory_soft_watermark < 0 ||
+                server.maxmemory_soft_watermark > 100)
+            {
+                err = "maxmemory-soft-watermark must be between 0 and 100";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lfu-admission-filter") && argc == 2) {
+            if ((server.lfu_admission_filter = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"maxmemory-mrc") && argc == 2) {
+            if ((server.maxmemory_mrc = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"value-tiering") && argc == 2) {
+            if ((server.value_tiering = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"value-tiering-file") && argc == 2) {
+            zfree(server.value_tiering_file);
+            server.value_tiering_file = zstrdup(argv[1]);
+        } else if (!strcasecmp(argv[0],"value-tiering-min-idle") && argc == 2) {
+            server.value_tiering_min_idle = strtoll(argv[1],NULL,10);
+            if (server.value_tiering_min_idle < 0) {
+                err = "value-tiering-min-idle must be 0 or greater";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"value-tiering-min-size") && argc == 2) {
+            server.value_tiering_min_size = memtoll(argv[1],NULL);
+            if (server.value_tiering_min_size < 0) {
+                err = "value-tiering-min-size must be 0 or greater";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"lfu-log-factor") && argc == 2) {
             server.lfu_log_factor = atoi(argv[1]);
             if (server.maxmemory_samples < 0) {
@@ -407,6 +490,10 @@ void loadServerConfigFromString(char *config) {
             if ((server.activerehashing = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"active-expire-index") && argc == 2) {
+            if ((server.active_expire_index = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"lazyfree-lazy-eviction") && argc == 2) {
             if ((server.lazyfree_lazy_eviction = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -423,6 +510,10 @@ void loadServerConfigFromString(char *config) {
             if ((server.repl_slave_lazy_flush = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"slave-async-load") && argc == 2) {
+            if ((server.repl_slave_async_load = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"activedefrag") && argc == 2) {
             if ((server.active_defrag_enabled = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -545,12 +636,36 @@ void loadServerConfigFromString(char *config) {
             server.list_max_ziplist_size = atoi(argv[1]);
         } else if (!strcasecmp(argv[0],"list-compress-depth") && argc == 2) {
             server.list_compress_depth = atoi(argv[1]);
+        } else if (!strcasecmp(argv[0],"list-compress-codec") && argc == 2) {
+            server.list_compress_codec =
+                configEnumGetValue(list_compress_codec_enum,argv[1]);
+            if (server.list_compress_codec == INT_MIN) {
+                err = "Invalid list compress codec. Must be one of lzf or lz4";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"list-compress-async") && argc == 2) {
+            if ((server.list_compress_async = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"set-max-intset-entries") && argc == 2) {
             server.set_max_intset_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-entries") && argc == 2) {
             server.zset_max_ziplist_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-value") && argc == 2) {
             server.zset_max_ziplist_value = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"zset-large-encoding") && argc == 2) {
+            server.zset_large_encoding =
+                configEnumGetValue(zset_large_encoding_enum,argv[1]);
+            if (server.zset_large_encoding == INT_MIN) {
+                err = "argument must be 'skiplist' or 'btree'";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"string-compress-threshold") && argc == 2) {
+            server.string_compress_threshold = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"string-chunk-threshold") && argc == 2) {
+            server.string_chunk_threshold = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"string-intern-max-len") && argc == 2) {
+            server.string_intern_max_len = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"hll-sparse-max-bytes") && argc == 2) {
             server.hll_sparse_max_bytes = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"rename-command") && argc == 3) {
@@ -669,6 +784,25 @@ void loadServerConfigFromString(char *config) {
             server.client_obuf_limits[class].hard_limit_bytes = hard;
             server.client_obuf_limits[class].soft_limit_bytes = soft;
             server.client_obuf_limits[class].soft_limit_seconds = soft_seconds;
+        } else if (!strcasecmp(argv[0],"bio-threads") && argc == 3) {
+            int type = bioGetTypeByName(argv[1]);
+
+            if (type == -1) {
+                err = "Unrecognized background job type"; goto loaderr;
+            }
+            if (bioSetWorkersOfType(type,atoi(argv[2])) == C_ERR) {
+                err = "Invalid number of background threads"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"maxmemory-db") && argc == 3) {
+            int dbid = atoi(argv[1]);
+            long long bytes = memtoll(argv[2],NULL);
+
+            /* The DB ID is checked against the number of databases by
+             * initServer(), since "databases" may follow. */
+            if (dbid < 0 || bytes < 0) {
+                err = "Invalid maxmemory-db parameters"; goto loaderr;
+            }
+            setDbMaxmemory(dbid,bytes);
         } else if (!strcasecmp(argv[0],"stop-writes-on-bgsave-error") &&
                    argc == 2) {
             if ((server.stop_writes_on_bgsave_err = yesnotoi(argv[1])) == -1) {
@@ -713,6 +847,14 @@ void loadServerConfigFromString(char *config) {
                     "Allowed values: 'upstart', 'systemd', 'auto', or 'no'";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"hash-function") && argc == 2) {
+            server.hash_function =
+                configEnumGetValue(hash_function_enum,argv[1]);
+            if (server.hash_function == INT_MIN) {
+                err = "Invalid hash function. "
+                    "Allowed values: 'siphash' or 'wyhash'";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"loadmodule") && argc >= 2) {
             queueLoadModule(argv[1],&argv[2],argc-2);
         } else if (!strcasecmp(argv[0],"sentinel")) {
@@ -889,6 +1031,16 @@ void configSetCommand(client *c) {
                 return;
             }
         }
+    } config_set_special_field("value-tiering") {
+        int enable = yesnotoi(o->ptr);
+
+        if (enable == -1) goto badfmt;
+        if (enable && tieringOpenFiles() == C_ERR) {
+            addReplyError(c,
+                "Unable to open the value tiering file. Check server logs.");
+            return;
+        }
+        server.value_tiering = enable;
     } config_set_special_field("save") {
         int vlen, j;
         sds *v = sdssplitlen(o->ptr,sdslen(o->ptr)," ",1,&vlen);
@@ -923,6 +1075,38 @@ void configSetCommand(client *c) {
             appendServerSaveParams(seconds, changes);
         }
         sdsfreesplitres(v,vlen);
+    } config_set_special_field("maxmemory-db") {
+        int vlen, j;
+        sds *v = sdssplitlen(o->ptr,sdslen(o->ptr)," ",1,&vlen);
+
+        /* We need pairs of <dbid> <bytes>, the DBs not listed keep their
+         * limit. */
+        if (vlen & 1) {
+            sdsfreesplitres(v,vlen);
+            goto badfmt;
+        }
+        for (j = 0; j < vlen; j++) {
+            char *eptr;
+            long long val;
+
+            if ((j & 1) == 0) {
+                val = strtoll(v[j], &eptr, 10);
+                if (eptr[0] != '\0' || val < 0 || val >= server.dbnum) {
+                    sdsfreesplitres(v,vlen);
+                    goto badfmt;
+                }
+            } else {
+                val = memtoll(v[j], &err);
+                if (err || val < 0) {
+                    sdsfreesplitres(v,vlen);
+                    goto badfmt;
+                }
+            }
+        }
+        /* Finally set the new config */
+        for (j = 0; j < vlen; j += 2)
+            setDbMaxmemory(atoi(v[j]),memtoll(v[j+1],NULL));
+        sdsfreesplitres(v,vlen);
     } config_set_special_field("dir") {
         if (chdir((char*)o->ptr) == -1) {
             addReplyErrorFormat(c,"Changing directory: %s", strerror(errno));
@@ -1021,6 +1205,15 @@ void configSetCommand(client *c) {
       "protected-mode",server.protected_mode) {
     } config_set_bool_field(
       "stop-writes-on-bgsave-error",server.stop_writes_on_bgsave_err) {
+    } config_set_bool_field(
+      "active-expire-index",server.active_expire_index) {
+        expireIndexSetEnabled(server.active_expire_index);
+    } config_set_bool_field(
+      "lfu-admission-filter",server.lfu_admission_filter) {
+        admissionSetEnabled(server.lfu_admission_filter);
+    } config_set_bool_field(
+      "maxmemory-mrc",server.maxmemory_mrc) {
+        mrcSetEnabled(server.maxmemory_mrc);
     } config_set_bool_field(
       "lazyfree-lazy-eviction",server.lazyfree_lazy_eviction) {
     } config_set_bool_field(
@@ -1029,8 +1222,13 @@ void configSetCommand(client *c) {
       "lazyfree-lazy-server-del",server.lazyfree_lazy_server_del) {
     } config_set_bool_field(
       "slave-lazy-flush",server.repl_slave_lazy_flush) {
+    } config_set_bool_field(
+      "slave-async-load",server.repl_slave_async_load) {
     } config_set_bool_field(
       "no-appendfsync-on-rewrite",server.aof_no_fsync_on_rewrite) {
+    } config_set_bool_field(
+      "list-compress-async",server.list_compress_async) {
+        listTypeUpdateCompressOptions();
 
     /* Numerical fields.
      * config_set_numerical_field(name,var,min,max) */
@@ -1038,6 +1236,10 @@ void configSetCommand(client *c) {
       "tcp-keepalive",server.tcpkeepalive,0,LLONG_MAX) {
     } config_set_numerical_field(
       "maxmemory-samples",server.maxmemory_samples,1,LLONG_MAX) {
+    } config_set_numerical_field(
+      "maxmemory-soft-watermark",server.maxmemory_soft_watermark,0,100) {
+    } config_set_numerical_field(
+      "value-tiering-min-idle",server.value_tiering_min_idle,0,LLONG_MAX) {
     } config_set_numerical_field(
       "lfu-log-factor",server.lfu_log_factor,0,LLONG_MAX) {
     } config_set_numerical_field(
@@ -1050,6 +1252,8 @@ void configSetCommand(client *c) {
       "active-defrag-threshold-upper",server.active_defrag_threshold_upper,0,1000) {
     } config_set_memory_field(
       "active-defrag-ignore-bytes",server.active_defrag_ignore_bytes) {
+    } config_set_memory_field(
+      "value-tiering-min-size",server.value_tiering_min_size) {
     } config_set_numerical_field(
       "active-defrag-cycle-min",server.active_defrag_cycle_min,1,99) {
     } config_set_numerical_field(
@@ -1072,6 +1276,12 @@ void configSetCommand(client *c) {
       "zset-max-ziplist-entries",server.zset_max_ziplist_entries,0,LLONG_MAX) {
     } config_set_numerical_field(
       "zset-max-ziplist-value",server.zset_max_ziplist_value,0,LLONG_MAX) {
+    } config_set_numerical_field(
+      "string-compress-threshold",server.string_compress_threshold,0,LLONG_MAX) {
+    } config_set_numerical_field(
+      "string-chunk-threshold",server.string_chunk_threshold,0,LLONG_MAX) {
+    } config_set_numerical_field(
+      "string-intern-max-len",server.string_intern_max_len,0,LLONG_MAX) {
     } config_set_numerical_field(
       "hll-sparse-max-bytes",server.hll_sparse_max_bytes,0,LLONG_MAX) {
     } config_set_numerical_field(
@@ -1145,6 +1355,11 @@ void configSetCommand(client *c) {
       "maxmemory-policy",server.maxmemory_policy,maxmemory_policy_enum) {
     } config_set_enum_field(
       "appendfsync",server.aof_fsync,aof_fsync_enum) {
+    } config_set_enum_field(
+      "zset-large-encoding",server.zset_large_encoding,zset_large_encoding_enum) {
+    } config_set_enum_field(
+      "list-compress-codec",server.list_compress_codec,list_compress_codec_enum) {
+        listTypeUpdateCompressOptions();
 
     /* Everyhing else is an error... */
     } config_set_else {
@@ -1210,6 +1425,7 @@ void configGetCommand(client *c) {
 
     /* String values */
     config_get_string_field("dbfilename",server.rdb_filename);
+    config_get_string_field("value-tiering-file",server.value_tiering_file);
     config_get_string_field("requirepass",server.requirepass);
     config_get_string_field("masterauth",server.masterauth);
     config_get_string_field("cluster-announce-ip",server.cluster_announce_ip);
@@ -1221,6 +1437,9 @@ void configGetCommand(client *c) {
     /* Numerical values */
     config_get_numerical_field("maxmemory",server.maxmemory);
     config_get_numerical_field("maxmemory-samples",server.maxmemory_samples);
+    config_get_numerical_field("maxmemory-soft-watermark",server.maxmemory_soft_watermark);
+    config_get_numerical_field("value-tiering-min-idle",server.value_tiering_min_idle);
+    config_get_numerical_field("value-tiering-min-size",server.value_tiering_min_size);
     config_get_numerical_field("timeout",server.maxidletime);
     config_get_numerical_field("active-defrag-threshold-lower",server.active_defrag_threshold_lower);
     config_get_numerical_field("active-defrag-threshold-upper",server.active_defrag_threshold_upper);
@@ -1291,6 +1510,10 @@ void configGetCommand(client *c) {
     config_get_bool_field("rdbcompression", server.rdb_compression);
     config_get_bool_field("rdbchecksum", server.rdb_checksum);
     config_get_bool_field("activerehashing", server.activerehashing);
+    config_get_bool_field("active-expire-index", server.active_expire_index);
+    config_get_bool_field("maxmemory-mrc", server.maxmemory_mrc);
+    config_get_bool_field("lfu-admission-filter", server.lfu_admission_filter);
+    config_get_bool_field("value-tiering", server.value_tiering);
     config_get_bool_field("activedefrag", server.active_defrag_enabled);
     config_get_bool_field("protected-mode", server.protected_mode);
     config_get_bool_field("repl-disable-tcp-nodelay",
@@ -1309,8 +1532,12 @@ void configGetCommand(client *c) {
             server.lazyfree_lazy_expire);
     config_get_bool_field("lazyfree-lazy-server-del",
             server.lazyfree_lazy_server_del);
+    config_get_bool_field("list-compress-async",
+            server.list_compress_async);
     config_get_bool_field("slave-lazy-flush",
             server.repl_slave_lazy_flush);
+    config_get_bool_field("slave-async-load",
+            server.repl_slave_async_load);
 
     /* Enum values */
     config_get_enum_field("maxmemory-policy",
@@ -1323,6 +1550,18 @@ void configGetCommand(client *c) {
             server.aof_fsync,aof_fsync_enum);
     config_get_enum_field("syslog-facility",
             server.syslog_facility,syslog_facility_enum);
+    config_get_enum_field("hash-function",
+            server.hash_function,hash_function_enum);
+    config_get_enum_field("zset-large-encoding",
+            server.zset_large_encoding,zset_large_encoding_enum);
+    config_get_numerical_field("string-compress-threshold",
+            server.string_compress_threshold);
+    config_get_numerical_field("string-chunk-threshold",
+            server.string_chunk_threshold);
+    config_get_numerical_field("string-intern-max-len",
+            server.string_intern_max_len);
+    config_get_enum_field("list-compress-codec",
+            server.list_compress_codec,list_compress_codec_enum);
 
     /* Everything we can't handle with macros follows. */
 
@@ -1375,6 +1614,34 @@ void configGetCommand(client *c) {
         sdsfree(buf);
         matches++;
     }
+    if (stringmatch(pattern,"maxmemory-db",1)) {
+        sds buf = sdsempty();
+        int j;
+
+        for (j = 0; j < server.maxmemory_db_len; j++) {
+            if (!server.maxmemory_db[j]) continue;
+            if (sdslen(buf)) buf = sdscatlen(buf," ",1);
+            buf = sdscatprintf(buf,"%d %llu",j,server.maxmemory_db[j]);
+        }
+        addReplyBulkCString(c,"maxmemory-db");
+        addReplyBulkCString(c,buf);
+        sdsfree(buf);
+        matches++;
+    }
+    if (stringmatch(pattern,"bio-threads",1)) {
+        sds buf = sdsempty();
+        int j;
+
+        for (j = 0; j < BIO_NUM_OPS; j++) {
+            if (j) buf = sdscatlen(buf," ",1);
+            buf = sdscatprintf(buf,"%s %d",
+                    bioGetTypeName(j),bioWorkersOfType(j));
+        }
+        addReplyBulkCString(c,"bio-threads");
+        addReplyBulkCString(c,buf);
+        sdsfree(buf);
+        matches++;
+    }
     if (stringmatch(pattern,"unixsocketperm",1)) {
         char buf[32];
         snprintf(buf,sizeof(buf),"%o",server.unixsocketperm);
@@ -1786,6 +2053,40 @@ void rewriteConfigClientoutputbufferlimitOption(struct rewriteConfigState *state
     }
 }
 
+/* Rewrite the maxmemory-db option, one line for every DB with a limit. */
+void rewriteConfigMaxmemoryDbOption(struct rewriteConfigState *state) {
+    char *option = "maxmemory-db";
+    int j;
+
+    for (j = 0; j < server.maxmemory_db_len; j++) {
+        char bytes[64];
+        sds line;
+
+        if (!server.maxmemory_db[j]) continue;
+        rewriteConfigFormatMemory(bytes,sizeof(bytes),server.maxmemory_db[j]);
+        line = sdscatprintf(sdsempty(),"%s %d %s",option,j,bytes);
+        rewriteConfigRewriteLine(state,option,line,1);
+    }
+    /* Mark the option as processed in case there are no limits. */
+    rewriteConfigMarkAsProcessed(state,option);
+}
+
+/* Rewrite the bio-threads option, one line for every job type. */
+void rewriteConfigBioThreadsOption(struct rewriteConfigState *state) {
+    char *option = "bio-threads";
+    int j;
+
+    for (j = 0; j < BIO_NUM_OPS; j++) {
+        int workers = bioWorkersOfType(j);
+        int force = workers != BIO_DEFAULT_WORKERS;
+        sds line;
+
+        line = sdscatprintf(sdsempty(),"%s %s %d",
+                option,bioGetTypeName(j),workers);
+        rewriteConfigRewriteLine(state,option,line,force);
+    }
+}
+
 /* Rewrite the bind option. */
 void rewriteConfigBindOption(struct rewriteConfigState *state) {
     int force = 1;
@@ -1992,6 +2293,7 @@ int rewriteConfig(char *path) {
     rewriteConfigBytesOption(state,"maxmemory",server.maxmemory,CONFIG_DEFAULT_MAXMEMORY);
     rewriteConfigEnumOption(state,"maxmemory-policy",server.maxmemory_policy,maxmemory_policy_enum,CONFIG_DEFAULT_MAXMEMORY_POLICY);
     rewriteConfigNumericalOption(state,"maxmemory-samples",server.maxmemory_samples,CONFIG_DEFAULT_MAXMEMORY_SAMPLES);
+    rewriteConfigNumericalOption(state,"maxmemory-soft-watermark",server.maxmemory_soft_watermark,CONFIG_DEFAULT_MAXMEMORY_SOFT_WATERMARK);
     rewriteConfigNumericalOption(state,"active-defrag-threshold-lower",server.active_defrag_threshold_lower,CONFIG_DEFAULT_DEFRAG_THRESHOLD_LOWER);
     rewriteConfigNumericalOption(state,"active-defrag-threshold-upper",server.active_defrag_threshold_upper,CONFIG_DEFAULT_DEFRAG_THRESHOLD_UPPER);
     rewriteConfigBytesOption(state,"active-defrag-ignore-bytes",server.active_defrag_ignore_bytes,CONFIG_DEFAULT_DEFRAG_IGNORE_BYTES);
@@ -2018,23 +2320,40 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"hash-max-ziplist-value",server.hash_max_ziplist_value,OBJ_HASH_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"list-max-ziplist-size",server.list_max_ziplist_size,OBJ_LIST_MAX_ZIPLIST_SIZE);
     rewriteConfigNumericalOption(state,"list-compress-depth",server.list_compress_depth,OBJ_LIST_COMPRESS_DEPTH);
+    rewriteConfigEnumOption(state,"list-compress-codec",server.list_compress_codec,list_compress_codec_enum,OBJ_LIST_COMPRESS_CODEC);
+    rewriteConfigYesNoOption(state,"list-compress-async",server.list_compress_async,CONFIG_DEFAULT_LIST_COMPRESS_ASYNC);
     rewriteConfigNumericalOption(state,"set-max-intset-entries",server.set_max_intset_entries,OBJ_SET_MAX_INTSET_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-entries",server.zset_max_ziplist_entries,OBJ_ZSET_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-value",server.zset_max_ziplist_value,OBJ_ZSET_MAX_ZIPLIST_VALUE);
+    rewriteConfigEnumOption(state,"zset-large-encoding",server.zset_large_encoding,zset_large_encoding_enum,OBJ_ZSET_LARGE_ENCODING);
+    rewriteConfigBytesOption(state,"string-compress-threshold",server.string_compress_threshold,OBJ_STRING_COMPRESS_THRESHOLD);
+    rewriteConfigBytesOption(state,"string-chunk-threshold",server.string_chunk_threshold,OBJ_STRING_CHUNK_THRESHOLD);
+    rewriteConfigBytesOption(state,"string-intern-max-len",server.string_intern_max_len,OBJ_STRING_INTERN_MAX_LEN);
     rewriteConfigNumericalOption(state,"hll-sparse-max-bytes",server.hll_sparse_max_bytes,CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES);
     rewriteConfigYesNoOption(state,"activerehashing",server.activerehashing,CONFIG_DEFAULT_ACTIVE_REHASHING);
+    rewriteConfigYesNoOption(state,"active-expire-index",server.active_expire_index,CONFIG_DEFAULT_ACTIVE_EXPIRE_INDEX);
+    rewriteConfigYesNoOption(state,"maxmemory-mrc",server.maxmemory_mrc,CONFIG_DEFAULT_MAXMEMORY_MRC);
+    rewriteConfigYesNoOption(state,"lfu-admission-filter",server.lfu_admission_filter,CONFIG_DEFAULT_LFU_ADMISSION_FILTER);
+    rewriteConfigYesNoOption(state,"value-tiering",server.value_tiering,CONFIG_DEFAULT_VALUE_TIERING);
+    rewriteConfigStringOption(state,"value-tiering-file",server.value_tiering_file,CONFIG_DEFAULT_VALUE_TIERING_FILE);
+    rewriteConfigNumericalOption(state,"value-tiering-min-idle",server.value_tiering_min_idle,CONFIG_DEFAULT_VALUE_TIERING_MIN_IDLE);
+    rewriteConfigBytesOption(state,"value-tiering-min-size",server.value_tiering_min_size,CONFIG_DEFAULT_VALUE_TIERING_MIN_SIZE);
     rewriteConfigYesNoOption(state,"activedefrag",server.active_defrag_enabled,CONFIG_DEFAULT_ACTIVE_DEFRAG);
     rewriteConfigYesNoOption(state,"protected-mode",server.protected_mode,CONFIG_DEFAULT_PROTECTED_MODE);
     rewriteConfigClientoutputbufferlimitOption(state);
+    rewriteConfigMaxmemoryDbOption(state);
+    rewriteConfigBioThreadsOption(state);
     rewriteConfigNumericalOption(state,"hz",server.hz,CONFIG_DEFAULT_HZ);
     rewriteConfigYesNoOption(state,"aof-rewrite-incremental-fsync",server.aof_rewrite_incremental_fsync,CONFIG_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC);
     rewriteConfigYesNoOption(state,"aof-load-truncated",server.aof_load_truncated,CONFIG_DEFAULT_AOF_LOAD_TRUNCATED);
     rewriteConfigYesNoOption(state,"aof-use-rdb-preamble",server.aof_use_rdb_preamble,CONFIG_DEFAULT_AOF_USE_RDB_PREAMBLE);
     rewriteConfigEnumOption(state,"supervised",server.supervised_mode,supervised_mode_enum,SUPERVISED_NONE);
+    rewriteConfigEnumOption(state,"hash-function",server.hash_function,hash_function_enum,CONFIG_DEFAULT_HASH_FUNCTION);
     rewriteConfigYesNoOption(state,"lazyfree-lazy-eviction",server.lazyfree_lazy_eviction,CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION);
     rewriteConfigYesNoOption(state,"lazyfree-lazy-expire",server.lazyfree_lazy_expire,CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE);
     rewriteConfigYesNoOption(state,"lazyfree-lazy-server-del",server.lazyfree_lazy_server_del,CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL);
     rewriteConfigYesNoOption(state,"slave-lazy-flush",server.repl_slave_lazy_flush,CONFIG_DEFAULT_SLAVE_LAZY_FLUSH);
+    rewriteConfigYesNoOption(state,"slave-async-load",server.repl_slave_async_load,CONFIG_DEFAULT_SLAVE_ASYNC_LOAD);
 
     /* Rewrite Sentinel config if in Sentinel mode. */
     if (server.sentinel_mode) rewriteConfigSentinelOption(state);
@@ -43,9 +43,21 @@
  * lookupKeyWrite() and lookupKeyReadWithFlags(). */
 robj *lookupKey(redisDb *db, robj *key, int flags) {
     dictEntry *de = dictFind(db->dict,key->ptr);
+
+    /* The admission filter counts the accesses to the missing keys too. */
+    if (server.lfu_admission_filter &&
+        server.maxmemory_policy & MAXMEMORY_FLAG_LFU &&
+        !(flags & LOOKUP_NOTOUCH))
+    {
+        admissionRecordAccess(db,key);
+    }
     if (de) {
         robj *val = dictGetVal(de);
 
+        /* Values spilled to the tiering file are read back on access. */
+        if (val->encoding == OBJ_ENCODING_TIERED)
+            val = tieringLoadKey(db,key,val);
+
         /* Update the access time for the ageing algorithm.
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
@@ -122,6 +134,8 @@ robj *lookupKeyReadWithFlags(redisDb *db, robj *key, int flags) {
         server.stat_keyspace_misses++;
     else
         server.stat_keyspace_hits++;
+    if (server.maxmemory_mrc && !(flags & LOOKUP_NOTOUCH))
+        mrcKeyAccess(db,key,val,1);
     return val;
 }
 
@@ -137,8 +151,13 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
  * Returns the linked value object if the key exists or NULL if the key
  * does not exist in the specified DB. */
 robj *lookupKeyWrite(redisDb *db, robj *key) {
+    robj *val;
+
     expireIfNeeded(db,key);
-    return lookupKey(db,key,LOOKUP_NONE);
+    val = lookupKey(db,key,LOOKUP_NONE);
+    if (server.maxmemory_mrc && val) mrcKeyAccess(db,key,val,0);
+    if (val && dbMemoryAccounting()) dbMemoryTrackWrite(db,key,val);
+    return val;
 }
 
 robj *lookupKeyReadOrReply(client *c, robj *key, robj *reply) {
@@ -164,6 +183,13 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
     serverAssertWithInfo(NULL,key,retval == DICT_OK);
     if (val->type == OBJ_LIST) signalListAsReady(db, key);
     if (server.cluster_enabled) slotToKeyAdd(key);
+    if (dbMemoryAccounting()) dbMemoryLink(db,key,val);
+    if (server.maxmemory_mrc) mrcKeyAccess(db,key,val,0);
+    if (server.lfu_admission_filter && server.maxmemory &&
+        server.maxmemory_policy & MAXMEMORY_FLAG_LFU && !server.loading)
+    {
+        admissionAddCandidate(db,key);
+    }
  }
 
 /* Overwrite an existing key with a new value. Incrementing the reference
@@ -173,16 +199,25 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
  * The program is aborted if the key was not already present. */
 void dbOverwrite(redisDb *db, robj *key, robj *val) {
     dictEntry *de = dictFind(db->dict,key->ptr);
+    robj *old;
 
     serverAssertWithInfo(NULL,key,de != NULL);
-    if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
-        robj *old = dictGetVal(de);
-        int saved_lru = old->lru;
-        dictReplace(db->dict, key->ptr, val);
-        val->lru = saved_lru;
-    } else {
-        dictReplace(db->dict, key->ptr, val);
+    old = dictGetVal(de);
+    if (dbMemoryAccounting()) {
+        dbMemoryUnlink(db,key,old);
+        dbMemoryLink(db,key,val);
     }
+    if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) val->lru = old->lru;
+
+    /* Set the new value before releasing the old one, that with
+     * lazyfree-lazy-server-del may be freed in background like the
+     * values of the keys removed by dbDelete(). */
+    dictSetVal(db->dict,de,val);
+    if (server.lazyfree_lazy_server_del)
+        freeObjAsync(old);
+    else
+        decrRefCount(old);
+    if (server.maxmemory_mrc) mrcKeyAccess(db,key,val,0);
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -236,9 +271,14 @@ robj *dbRandomKey(redisDb *db) {
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
 int dbSyncDelete(redisDb *db, robj *key) {
+    if (server.maxmemory_mrc) mrcKeyDelete(db,key);
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
-    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+    if (dictSize(db->expires) > 0) dbDeleteExpire(db,key->ptr);
+    if (dbMemoryAccounting()) {
+        dictEntry *de = dictFind(db->dict,key->ptr);
+        if (de) dbMemoryUnlink(db,key,dictGetVal(de));
+    }
     if (dictDelete(db->dict,key->ptr) == DICT_OK) {
         if (server.cluster_enabled) slotToKeyDel(key);
         return 1;
@@ -283,7 +323,13 @@ int dbDelete(redisDb *db, robj *key) {
  */
 robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
     serverAssert(o->type == OBJ_STRING);
-    if (o->refcount != 1 || o->encoding != OBJ_ENCODING_RAW) {
+    if (o->encoding == OBJ_ENCODING_COMPRESSED ||
+        o->encoding == OBJ_ENCODING_CHUNKED)
+    {
+        /* Decoding already gives us a new raw object. */
+        o = getDecodedObject(o);
+        dbOverwrite(db,key,o);
+    } else if (o->refcount != 1 || o->encoding != OBJ_ENCODING_RAW) {
         robj *decoded = getDecodedObject(o);
         o = createRawStringObject(decoded->ptr, sdslen(decoded->ptr));
         decrRefCount(decoded);
@@ -292,6 +338,40 @@ robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
     return o;
 }
 
+/* Operations reading the bytes of the string in place, like bit operations
+ * and HyperLogLogs, call this function to get the string stored at 'key' as
+ * a contiguous array of bytes. Compressed, chunked and double encoded
+ * strings are stored again as plain strings, since they are likely to be
+ * accessed in the same way again. Other strings are returned as they are. */
+robj *dbFlattenStringValue(redisDb *db, robj *key, robj *o) {
+    serverAssert(o->type == OBJ_STRING);
+    if (o->encoding == OBJ_ENCODING_COMPRESSED ||
+        o->encoding == OBJ_ENCODING_CHUNKED ||
+        o->encoding == OBJ_ENCODING_DOUBLE)
+    {
+        o = getDecodedObject(o);
+        dbOverwrite(db,key,o);
+    }
+    return o;
+}
+
+/* Like dbUnshareStringValue(), but the returned object is an unshared
+ * OBJ_ENCODING_CHUNKED string, that the caller can modify in place. This is
+ * used by commands growing strings over string-chunk-threshold. */
+robj *dbChunkStringValue(redisDb *db, robj *key, robj *o) {
+    serverAssert(o->type == OBJ_STRING);
+    if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        if (o->refcount == 1) return o;
+        o = dupStringObject(o);
+    } else {
+        robj *decoded = getDecodedObject(o);
+        o = createChunkedStringObject(decoded->ptr,sdslen(decoded->ptr));
+        decrRefCount(decoded);
+    }
+    dbOverwrite(db,key,o);
+    return o;
+}
+
 /* Remove all keys from all the databases in a Redis server.
  * If callback is given the function is called from time to time to
  * signal that work is in progress.
@@ -315,14 +395,21 @@ long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
         return -1;
     }
 
+    /* The values modified by the current command may be released. */
+    dbMemoryResolvePending();
     for (j = 0; j < server.dbnum; j++) {
         if (dbnum != -1 && dbnum != j) continue;
         removed += dictSize(server.db[j].dict);
+        server.db[j].used_memory = 0;
         if (async) {
             emptyDbAsync(&server.db[j]);
         } else {
             dictEmpty(server.db[j].dict,callback);
             dictEmpty(server.db[j].expires,callback);
+            if (server.db[j].expires_index) {
+                raxFree(server.db[j].expires_index);
+                server.db[j].expires_index = raxNew();
+            }
         }
     }
     if (server.cluster_enabled) {
@@ -333,6 +420,7 @@ long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
         }
     }
     if (dbnum == -1) flushSlaveKeysWithExpireList();
+    if (server.maxmemory_mrc) mrcEmptyCaches();
     return removed;
 }
 
@@ -343,6 +431,170 @@ int selectDb(client *c, int id) {
     return C_OK;
 }
 
+/*-----------------------------------------------------------------------------
+ * Per DB memory accounting
+ *
+ * When at least one DB has a maxmemory-db limit every DB tracks in
+ * db->used_memory an estimate, computed with objectComputeSize(), of the
+ * memory used by its keys. Keys added, overwritten or deleted are accounted
+ * immediately, while values modified in place (a list receiving a push, a
+ * string receiving an APPEND, ...) are accounted after the command: the size
+ * of every value looked up for writing is remembered, and the difference
+ * with its final size is applied by dbMemoryResolvePending() once call()
+ * returns. Nothing is tracked while loading, the DBs are recounted when the
+ * loading is done.
+ *----------------------------------------------------------------------------*/
+
+#define DB_MEMORY_PENDING_MAX 1024
+
+typedef struct dbMemoryPending {
+    redisDb *db;
+    robj *key;
+    robj *val;      /* NULL if the value left the DB in the meantime. */
+    size_t size;    /* Size of the value when it was looked up. */
+} dbMemoryPending;
+
+static dbMemoryPending *DbMemoryPending = NULL;
+static int DbMemoryPendingCount = 0, DbMemoryPendingAlloc = 0;
+
+/* Estimate the memory used by a key: the value, the key name and the entry
+ * of the main dictionary. The overhead of the key name sds header is
+ * approximated with the one of the smallest header type. */
+size_t dbKeyMemory(robj *key, robj *val) {
+    return objectComputeSize(val,OBJ_COMPUTE_SIZE_DEF_SAMPLES)+
+           sizeof(struct sdshdr8)+sdslen(key->ptr)+1+sizeof(dictEntry);
+}
+
+static void dbMemoryAdd(redisDb *db, long long delta) {
+    db->used_memory += delta;
+    /* Sampled sizes are not always the same for the same value, so the
+     * counter could drift below zero after many deletions. */
+    if (db->used_memory < 0) db->used_memory = 0;
+}
+
+static dbMemoryPending *dbMemoryFindPending(redisDb *db, robj *key,
+                                            robj *val)
+{
+    int j;
+
+    for (j = 0; j < DbMemoryPendingCount; j++) {
+        dbMemoryPending *p = DbMemoryPending+j;
+
+        /* Shared objects can be the value of many keys, so the key name
+         * is checked as well. */
+        if (p->val == val && p->db == db &&
+            sdscmp(p->key->ptr,key->ptr) == 0) return p;
+    }
+    return NULL;
+}
+
+/* Remember the size of the value 'val' of 'key', that the caller is going
+ * to modify, so that the change is accounted at the end of the command.
+ * The remembered size is returned. */
+size_t dbMemoryTrackWrite(redisDb *db, robj *key, robj *val) {
+    dbMemoryPending *p;
+
+    if ((p = dbMemoryFindPending(db,key,val)) != NULL) return p->size;
+    /* Values can also be modified outside call(), for instance when
+     * serving the clients blocked on lists: don't let the array grow. */
+    if (DbMemoryPendingCount == DB_MEMORY_PENDING_MAX)
+        dbMemoryResolvePending();
+    if (DbMemoryPendingCount == DbMemoryPendingAlloc) {
+        DbMemoryPendingAlloc = DbMemoryPendingAlloc ?
+                               DbMemoryPendingAlloc*2 : 16;
+        DbMemoryPending = zrealloc(DbMemoryPending,
+            sizeof(dbMemoryPending)*DbMemoryPendingAlloc);
+    }
+    p = DbMemoryPending+DbMemoryPendingCount++;
+    p->db = db;
+    p->key = key;
+    incrRefCount(key);
+    p->val = val;
+    p->size = dbKeyMemory(key,val);
+    return p->size;
+}
+
+/* Return the size 'val' is accounted with in 'db': the one it had when it
+ * was looked up for writing if the current command is modifying it,
+ * otherwise its current size. The pending entry is discarded since the
+ * value is about to leave the DB. */
+static size_t dbMemoryForget(redisDb *db, robj *key, robj *val) {
+    dbMemoryPending *p = dbMemoryFindPending(db,key,val);
+
+    if (p) {
+        p->val = NULL;
+        return p->size;
+    }
+    return dbKeyMemory(key,val);
+}
+
+/* Account the values modified in place since they were looked up for
+ * writing. Called by call() after every command and before sleeping. */
+void dbMemoryResolvePending(void) {
+    int j;
+
+    for (j = 0; j < DbMemoryPendingCount; j++) {
+        dbMemoryPending *p = DbMemoryPending+j;
+
+        if (p->val) {
+            dictEntry *de = dictFind(p->db->dict,p->key->ptr);
+
+            if (de && dictGetVal(de) == p->val) {
+                dbMemoryAdd(p->db,(long long)dbKeyMemory(p->key,p->val)-
+                                  (long long)p->size);
+            }
+        }
+        decrRefCount(p->key);
+    }
+    DbMemoryPendingCount = 0;
+}
+
+/* Account a key added to the DB. */
+void dbMemoryLink(redisDb *db, robj *key, robj *val) {
+    dbMemoryAdd(db,dbMemoryTrackWrite(db,key,val));
+}
+
+/* Account a key removed from the DB. */
+void dbMemoryUnlink(redisDb *db, robj *key, robj *val) {
+    dbMemoryAdd(db,-(long long)dbMemoryForget(db,key,val));
+}
+
+/* Compute again the memory used by every DB scanning all the keys. This is
+ * done when the accounting is enabled and after loading a dataset. */
+void dbMemoryRecount(void) {
+    int j;
+
+    dbMemoryResolvePending();
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+        dictIterator *di = dictGetIterator(db->dict);
+        dictEntry *de;
+        robj keyobj;
+
+        db->used_memory = 0;
+        while((de = dictNext(di)) != NULL) {
+            initStaticStringObject(keyobj,dictGetKey(de));
+            db->used_memory += dbKeyMemory(&keyobj,dictGetVal(de));
+        }
+        dictReleaseIterator(di);
+    }
+}
+
+/* Return the ID of the first DB using more memory than its maxmemory-db
+ * limit, or -1 if all the DBs are within their limit. */
+int dbMemoryOverLimit(void) {
+    int j;
+
+    if (!server.db_memory_accounting) return -1;
+    for (j = 0; j < server.dbnum; j++) {
+        unsigned long long limit = server.maxmemory_db[j];
+
+        if (limit && (unsigned long long)server.db[j].used_memory > limit)
+            return j;
+    }
+    return -1;
+}
+
 /*-----------------------------------------------------------------------------
  * Hooks for key space changes.
  *
@@ -541,7 +793,7 @@ void scanCallback(void *privdata, const dictEntry *de) {
     } else if (o->type == OBJ_ZSET) {
         sds sdskey = dictGetKey(de);
         key = createStringObject(sdskey,sdslen(sdskey));
-        val = createStringObjectFromLongDouble(*(double*)dictGetVal(de),0);
+        val = createStringObjectFromLongDouble(zsetDictGetScore(o,de),0);
     } else {
         serverPanic("Type not handled in SCAN callback.");
     }
@@ -645,7 +897,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
     } else if (o->type == OBJ_HASH && o->encoding == OBJ_ENCODING_HT) {
         ht = o->ptr;
         count *= 2; /* We return key / value for this type. */
-    } else if (o->type == OBJ_ZSET && o->encoding == OBJ_ENCODING_SKIPLIST) {
+    } else if (o->type == OBJ_ZSET && zsetIsLargeEncoding(o->encoding)) {
         zset *zs = o->ptr;
         ht = zs->dict;
         count *= 2; /* We return key / value for this type. */
@@ -957,6 +1209,8 @@ int dbSwapDatabases(int id1, int id2) {
     if (id1 < 0 || id1 >= server.dbnum ||
         id2 < 0 || id2 >= server.dbnum) return C_ERR;
     if (id1 == id2) return C_OK;
+    /* The pending values are looked up by DB. */
+    dbMemoryResolvePending();
     redisDb aux = server.db[id1];
     redisDb *db1 = &server.db[id1], *db2 = &server.db[id2];
 
@@ -965,11 +1219,15 @@ int dbSwapDatabases(int id1, int id2) {
      * remain in the same DB they were. */
     db1->dict = db2->dict;
     db1->expires = db2->expires;
+    db1->expires_index = db2->expires_index;
     db1->avg_ttl = db2->avg_ttl;
+    db1->used_memory = db2->used_memory;
 
     db2->dict = aux.dict;
     db2->expires = aux.expires;
+    db2->expires_index = aux.expires_index;
     db2->avg_ttl = aux.avg_ttl;
+    db2->used_memory = aux.used_memory;
 
     /* Now we need to handle clients blocked on lists: as an effect
      * of swapping the two DBs, a client that was waiting for list
@@ -982,9 +1240,75 @@ int dbSwapDatabases(int id1, int id2) {
      * if needed. */
     scanDatabaseForReadyLists(db1);
     scanDatabaseForReadyLists(db2);
+    if (server.maxmemory_mrc) mrcEmptyCaches();
     return C_OK;
 }
 
+/* Create an array of server.dbnum empty DBs, used by slave-async-load to
+ * load the dataset received from the master while the clients are still
+ * served from server.db. */
+redisDb *dbCreateTempDbs(void) {
+    redisDb *tempdbs = zmalloc(sizeof(redisDb)*server.dbnum);
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        tempdbs[j].dict = dictCreate(&dbDictType,NULL);
+        tempdbs[j].expires = dictCreate(&keyptrDictType,NULL);
+        tempdbs[j].expires_index =
+            server.active_expire_index ? raxNew() : NULL;
+        tempdbs[j].blocking_keys = dictCreate(&keylistDictType,NULL);
+        tempdbs[j].ready_keys = dictCreate(&objectKeyPointerValueDictType,NULL);
+        tempdbs[j].watched_keys = dictCreate(&keylistDictType,NULL);
+        tempdbs[j].id = j;
+        tempdbs[j].avg_ttl = 0;
+        tempdbs[j].used_memory = 0;
+    }
+    return tempdbs;
+}
+
+/* Replace the keyspace of every DB with the one of the same temporary DB,
+ * that receives the old one instead, like SWAPDB does. The clients keep
+ * pointing to server.db, so they see the new dataset at once. */
+void dbSwapWithTempDbs(redisDb *tempdbs) {
+    int j;
+
+    dbMemoryResolvePending();
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb aux = server.db[j];
+        redisDb *db = &server.db[j], *tempdb = &tempdbs[j];
+
+        db->dict = tempdb->dict;
+        db->expires = tempdb->expires;
+        db->expires_index = tempdb->expires_index;
+        db->avg_ttl = tempdb->avg_ttl;
+        db->used_memory = tempdb->used_memory;
+
+        tempdb->dict = aux.dict;
+        tempdb->expires = aux.expires;
+        tempdb->expires_index = aux.expires_index;
+        tempdb->avg_ttl = aux.avg_ttl;
+        tempdb->used_memory = aux.used_memory;
+
+        scanDatabaseForReadyLists(db);
+    }
+    flushSlaveKeysWithExpireList();
+    if (server.maxmemory_mrc) mrcEmptyCaches();
+}
+
+/* Free the temporary DBs and the dataset they hold, that is released in
+ * the lazyfree thread since it may be as big as the one just loaded. */
+void dbReleaseTempDbs(redisDb *tempdbs) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        freeDbKeyspaceAsync(&tempdbs[j]);
+        dictRelease(tempdbs[j].blocking_keys);
+        dictRelease(tempdbs[j].ready_keys);
+        dictRelease(tempdbs[j].watched_keys);
+    }
+    zfree(tempdbs);
+}
+
 /* SWAPDB db1 db2 */
 void swapdbCommand(client *c) {
     long id1, id2;
@@ -1022,7 +1346,20 @@ int removeExpire(redisDb *db, robj *key) {
     /* An expire may only be removed if there is a corresponding entry in the
      * main dict. Otherwise, the key will never be freed. */
     serverAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
-    return dictDelete(db->expires,key->ptr) == DICT_OK;
+    return dbDeleteExpire(db,key->ptr);
+}
+
+/* Low level function removing the expire of 'key' from the expires
+ * dictionary and from the TTL index. Returns 1 if the key had an expire,
+ * otherwise 0. */
+int dbDeleteExpire(redisDb *db, sds key) {
+    dictEntry *de = dictUnlink(db->expires,key);
+
+    if (de == NULL) return 0;
+    if (db->expires_index)
+        expireIndexDel(db,key,dictGetSignedIntegerVal(de));
+    dictFreeUnlinkedEntry(db->expires,de);
+    return 1;
 }
 
 /* Set an expire to the specified key. If the expire is set in the context
@@ -1035,7 +1372,18 @@ void setExpire(client *c, redisDb *db, robj *key, long long when) {
     /* Reuse the sds from the main dict in the expire dict */
     kde = dictFind(db->dict,key->ptr);
     serverAssertWithInfo(NULL,key,kde != NULL);
-    de = dictAddOrFind(db->expires,dictGetKey(kde));
+    if (db->expires_index) {
+        dictEntry *existing;
+
+        de = dictAddRaw(db->expires,dictGetKey(kde),&existing);
+        if (de == NULL) {
+            de = existing;
+            expireIndexDel(db,dictGetKey(kde),dictGetSignedIntegerVal(de));
+        }
+        expireIndexAdd(db,dictGetKey(kde),when);
+    } else {
+        de = dictAddOrFind(db->expires,dictGetKey(kde));
+    }
     dictSetSignedIntegerVal(de,when);
 
     int writable_slave = server.masterhost && server.repl_slave_ro == 0;
@@ -1082,14 +1430,68 @@ void propagateExpire(redisDb *db, robj *key, int lazy) {
     decrRefCount(argv[1]);
 }
 
+/* Expired keys not yet propagated by propagateExpireBatched(). */
+static struct {
+    int dbid;
+    int lazy;
+    int argc;
+    robj *argv[1+EXPIRE_PROPAGATE_BATCH_SIZE];
+} expireBatch = {0,0,0,{NULL}};
+
+/* Propagate the pending expires as a single DEL (or UNLINK) command. */
+void propagatePendingExpires(void) {
+    int j;
+
+    if (expireBatch.argc == 0) return;
+    expireBatch.argv[0] = expireBatch.lazy ? shared.unlink : shared.del;
+    incrRefCount(expireBatch.argv[0]);
+
+    if (server.aof_state != AOF_OFF)
+        feedAppendOnlyFile(server.delCommand,expireBatch.dbid,
+                           expireBatch.argv,expireBatch.argc);
+    replicationFeedSlaves(server.slaves,expireBatch.dbid,
+                          expireBatch.argv,expireBatch.argc);
+
+    for (j = 0; j < expireBatch.argc; j++)
+        decrRefCount(expireBatch.argv[j]);
+    expireBatch.argc = 0;
+}
+
+/* Like propagateExpire(), but the keys are accumulated and propagated as a
+ * multi key DEL (or UNLINK) per database, so that when many keys expire at
+ * the same time the AOF and the slaves receive a few large commands instead
+ * of one command per key.
+ *
+ * The caller must call propagatePendingExpires() before anything else can
+ * be propagated, in order to retain the ordering of the operations: this
+ * is used by the active expire cycles, where no other command is executed
+ * while keys are expired. */
+void propagateExpireBatched(redisDb *db, robj *key, int lazy) {
+    if (expireBatch.argc &&
+        (expireBatch.dbid != db->id || expireBatch.lazy != lazy ||
+         expireBatch.argc == EXPIRE_PROPAGATE_BATCH_SIZE+1))
+    {
+        propagatePendingExpires();
+    }
+    if (expireBatch.argc == 0) {
+        expireBatch.dbid = db->id;
+        expireBatch.lazy = lazy;
+        expireBatch.argc = 1; /* argv[0] is set when propagating. */
+    }
+    incrRefCount(key);
+    expireBatch.argv[expireBatch.argc++] = key;
+}
+
 int expireIfNeeded(redisDb *db, robj *key) {
     mstime_t when = getExpire(db,key);
     mstime_t now;
 
     if (when < 0) return 0; /* No expire for this key */
 
-    /* Don't expire anything while loading. It will be done later. */
-    if (server.loading) return 0;
+    /* Don't expire anything while loading. It will be done later. A slave
+     * loading a full sync payload aside still serves the old dataset, and
+     * should not serve its logically expired keys. */
+    if (server.loading && !server.async_loading) return 0;
 
     /* If we are in the context of a Lua script, we claim that time is
      * blocked to when the Lua script started. This way a key can expire
@@ -1236,6 +1638,29 @@ int *evalGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys)
     return keys;
 }
 
+/* Helper function to extract keys from the following commands:
+ * SINTERCARD <num-keys> <key> <key> ... <key> [LIMIT <limit>] */
+int *sintercardGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys) {
+    int i, num, *keys;
+    UNUSED(cmd);
+
+    num = atoi(argv[1]->ptr);
+    /* Sanity check. Don't return any key if the command is going to
+     * reply with syntax error. */
+    if (num < 1 || num > (argc-2)) {
+        *numkeys = 0;
+        return NULL;
+    }
+
+    keys = zmalloc(sizeof(int)*num);
+    *numkeys = num;
+
+    /* Add all key positions for argv[2...n] to keys[] */
+    for (i = 0; i < num; i++) keys[i] = 2+i;
+
+    return keys;
+}
+
 /* Helper function to extract keys from the SORT command.
  *
  * SORT <sort-key> ... STORE <store-key> ...
@@ -136,7 +136,7 @@ void computeDatasetDigest(unsigned char *final) {
         /* Iterate this DB writing every entry */
         while((de = dictNext(di)) != NULL) {
             sds key;
-            robj *keyobj, *o;
+            robj *keyobj, *o, *tiered = NULL;
             long long expiretime;
 
             memset(digest,0,20); /* This key-val digest */
@@ -147,6 +147,13 @@ void computeDatasetDigest(unsigned char *final) {
 
             o = dictGetVal(de);
 
+            /* Spilled values are digested from a temporary copy, so that
+             * spilling a value does not change the digest. */
+            if (o->encoding == OBJ_ENCODING_TIERED) {
+                o = tiered = tieringReadValue(o);
+                serverAssert(o != NULL);
+            }
+
             aux = htonl(o->type);
             mixDigest(digest,&aux,sizeof(aux));
             expiretime = getExpire(db,keyobj);
@@ -199,21 +206,21 @@ void computeDatasetDigest(unsigned char *final) {
                             mixDigest(eledigest,buf,strlen(buf));
                         }
 
-                        snprintf(buf,sizeof(buf),"%.17g",score);
+                        d2gstring(buf,sizeof(buf),score,17);
                         mixDigest(eledigest,buf,strlen(buf));
                         xorDigest(digest,eledigest,20);
                         zzlNext(zl,&eptr,&sptr);
                     }
-                } else if (o->encoding == OBJ_ENCODING_SKIPLIST) {
+                } else if (zsetIsLargeEncoding(o->encoding)) {
                     zset *zs = o->ptr;
                     dictIterator *di = dictGetIterator(zs->dict);
                     dictEntry *de;
 
                     while((de = dictNext(di)) != NULL) {
                         sds sdsele = dictGetKey(de);
-                        double *score = dictGetVal(de);
+                        double score = zsetDictGetScore(o,de);
 
-                        snprintf(buf,sizeof(buf),"%.17g",*score);
+                        d2gstring(buf,sizeof(buf),score,17);
                         memset(eledigest,0,20);
                         mixDigest(eledigest,sdsele,sdslen(sdsele));
                         mixDigest(eledigest,buf,strlen(buf));
@@ -247,6 +254,7 @@ void computeDatasetDigest(unsigned char *final) {
             /* We can finally xor the key-val digest to the final digest */
             xorDigest(final,digest,20);
             decrRefCount(keyobj);
+            if (tiered) decrRefCount(tiered);
         }
         dictReleaseIterator(di);
     }
@@ -299,6 +307,8 @@ void debugCommand(client *c) {
         "structsize -- Return the size of different Redis core C structures.");
         blen++; addReplyStatus(c,
         "htstats <dbid> -- Return hash table statistics of the specified Redis database.");
+        blen++; addReplyStatus(c,
+        "tiering-spill <key> -- Spill the value of <key> to the value tiering file.");
         setDeferredMultiBulkLength(c,blenp,blen);
     } else if (!strcasecmp(c->argv[1]->ptr,"segfault")) {
         *((char*)-1) = 'x';
@@ -397,7 +407,8 @@ void debugCommand(client *c) {
             "encoding:%s serializedlength:%zu "
             "lru:%d lru_seconds_idle:%llu%s",
             (void*)val, val->refcount,
-            strenc, rdbSavedObjectLen(val),
+            strenc, val->encoding == OBJ_ENCODING_TIERED ?
+                tieringSerializedLen(val) : rdbSavedObjectLen(val),
             val->lru, estimateObjectIdleTime(val)/1000, extra);
     } else if (!strcasecmp(c->argv[1]->ptr,"sdslen") && c->argc == 3) {
         dictEntry *de;
@@ -436,6 +447,11 @@ void debugCommand(client *c) {
             ziplistRepr(o->ptr);
             addReplyStatus(c,"Ziplist structure printed on stdout");
         }
+    } else if (!strcasecmp(c->argv[1]->ptr,"tiering-spill") && c->argc == 3) {
+        if (tieringSpillKey(c->db,c->argv[2]) == C_OK)
+            addReply(c,shared.ok);
+        else
+            addReplyError(c,"Value not spilled. Is value-tiering enabled?");
     } else if (!strcasecmp(c->argv[1]->ptr,"populate") &&
                c->argc >= 3 && c->argc <= 5) {
         long keys, j;
@@ -587,6 +603,7 @@ void serverLogObjectDebugInfo(const robj *o) {
     serverLog(LL_WARNING,"Object type: %d", o->type);
     serverLog(LL_WARNING,"Object encoding: %d", o->encoding);
     serverLog(LL_WARNING,"Object refcount: %d", o->refcount);
+    if (o->encoding == OBJ_ENCODING_TIERED) return;
     if (o->type == OBJ_STRING && sdsEncodedObject(o)) {
         serverLog(LL_WARNING,"Object raw string len: %zu", sdslen(o->ptr));
         if (sdslen(o->ptr) < 4096) {
@@ -125,7 +125,34 @@ robj *activeDefragStringOb(robj* ob, int *defragged) {
                 ret->ptr = (void*)((intptr_t)ret + ofs);
                 (*defragged)++;
             }
-        } else if (ob->encoding!=OBJ_ENCODING_INT) {
+        } else if (ob->encoding==OBJ_ENCODING_CHUNKED) {
+            chunkedString *cs = ob->ptr;
+            void *newptr;
+            size_t j;
+
+            for (j = 0; j < cs->count; j++) {
+                if ((newptr = activeDefragAlloc(cs->chunks[j]))) {
+                    cs->chunks[j] = newptr;
+                    (*defragged)++;
+                }
+            }
+            if ((newptr = activeDefragAlloc(cs->chunks))) {
+                cs->chunks = newptr;
+                (*defragged)++;
+            }
+            if ((newptr = activeDefragAlloc(cs))) {
+                ob->ptr = newptr;
+                (*defragged)++;
+            }
+        } else if (ob->encoding==OBJ_ENCODING_COMPRESSED) {
+            void *newptr = activeDefragAlloc(ob->ptr);
+            if (newptr) {
+                ob->ptr = newptr;
+                (*defragged)++;
+            }
+        } else if (ob->encoding!=OBJ_ENCODING_INT &&
+                   ob->encoding!=OBJ_ENCODING_DOUBLE &&
+                   ob->encoding!=OBJ_ENCODING_TIERED) {
             serverPanic("Unknown string encoding");
         }
     }
@@ -300,7 +327,13 @@ int defragKey(redisDb *db, dictEntry *de) {
         ob = newob;
     }
 
-    if (ob->type == OBJ_STRING) {
+    if (ob->encoding == OBJ_ENCODING_TIERED) {
+        /* The value is in the tiering file: the robj of the stub was
+         * handled above, just move its tieredValue. */
+        void *newptr = activeDefragAlloc(ob->ptr);
+        if (newptr)
+            defragged++, ob->ptr = newptr;
+    } else if (ob->type == OBJ_STRING) {
         /* Already handled in activeDefragStringOb. */
     } else if (ob->type == OBJ_LIST) {
         if (ob->encoding == OBJ_ENCODING_QUICKLIST) {
@@ -308,7 +341,15 @@ int defragKey(redisDb *db, dictEntry *de) {
             quicklistNode *node = ql->head, *newnode;
             if ((newql = activeDefragAlloc(ql)))
                 defragged++, ob->ptr = ql = newql;
+            /* The skip index references nodes we are about to move. */
+            quicklistSkipIndexInvalidate(ql);
             while (node) {
+                /* Nodes being compressed in background are referenced by
+                 * their compression job: leave them alone. */
+                if (node->encoding == QUICKLIST_NODE_ENCODING_PENDING) {
+                    node = node->next;
+                    continue;
+                }
                 if ((newnode = activeDefragAlloc(node))) {
                     if (newnode->prev)
                         newnode->prev->next = newnode;
@@ -382,6 +423,27 @@ int defragKey(redisDb *db, dictEntry *de) {
             }
             dictReleaseIterator(di);
             dictDefragTables(&zs->dict);
+        } else if (ob->encoding == OBJ_ENCODING_BTREE) {
+            /* Only the elements are moved: the B+tree nodes are large
+             * allocations that are rarely fragmented. */
+            zset *zs = (zset*)ob->ptr;
+            zset *newzs;
+            if ((newzs = activeDefragAlloc(zs)))
+                defragged++, ob->ptr = zs = newzs;
+            d = zs->dict;
+            di = dictGetIterator(d);
+            while((de = dictNext(di)) != NULL) {
+                sds sdsele = dictGetKey(de);
+                sds *ref = zbtFindElement(zs->zbt,dictGetDoubleVal(de),sdsele);
+                serverAssert(ref != NULL);
+                if ((newsds = activeDefragSds(sdsele))) {
+                    defragged++, de->key = newsds;
+                    *ref = newsds;
+                }
+                defragged += dictIterDefragEntry(di);
+            }
+            dictReleaseIterator(di);
+            dictDefragTables(&zs->dict);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -45,6 +45,7 @@
 
 #include "dict.h"
 #include "zmalloc.h"
+#include "wyhash.h"
 #ifndef DICT_BENCHMARK_MAIN
 #include "redisassert.h"
 #else
@@ -72,9 +73,15 @@ static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
 /* -------------------------- hash functions -------------------------------- */
 
 static uint8_t dict_hash_function_seed[16];
+#ifdef WYHASH_ENABLED
+static wyhashKey dict_wyhash_key;
+#endif
 
 void dictSetHashFunctionSeed(uint8_t *seed) {
     memcpy(dict_hash_function_seed,seed,sizeof(dict_hash_function_seed));
+#ifdef WYHASH_ENABLED
+    wyhash_init_key(&dict_wyhash_key,dict_hash_function_seed);
+#endif
 }
 
 uint8_t *dictGetHashFunctionSeed(void) {
@@ -95,6 +102,27 @@ uint64_t dictGenCaseHashFunction(const unsigned char *buf, int len) {
     return siphash_nocase(buf,len,dict_hash_function_seed);
 }
 
+/* The wyhash variants are keyed with the same seed and are much faster
+ * with short keys. Every dictType selects the function to use with its
+ * hashFunction callback: note that a dictionary must always be hashed with
+ * the same function. Without 128 bit multiplications they are the same as
+ * the SipHash ones. */
+uint64_t dictGenWyHashFunction(const void *key, int len) {
+#ifdef WYHASH_ENABLED
+    return wyhash(key,len,&dict_wyhash_key);
+#else
+    return dictGenHashFunction(key,len);
+#endif
+}
+
+uint64_t dictGenWyCaseHashFunction(const unsigned char *buf, int len) {
+#ifdef WYHASH_ENABLED
+    return wyhash_nocase(buf,len,&dict_wyhash_key);
+#else
+    return dictGenCaseHashFunction(buf,len);
+#endif
+}
+
 /* ----------------------------- API implementation ------------------------- */
 
 /* Reset a hash table already initialized with ht_init().
@@ -1114,6 +1142,10 @@ uint64_t hashCallback(const void *key) {
     return dictGenHashFunction((unsigned char*)key, sdslen((char*)key));
 }
 
+uint64_t wyHashCallback(const void *key) {
+    return dictGenWyHashFunction((unsigned char*)key, sdslen((char*)key));
+}
+
 int compareCallback(void *privdata, const void *key1, const void *key2) {
     int l1,l2;
     DICT_NOTUSED(privdata);
@@ -1145,18 +1177,67 @@ dictType BenchmarkDictType = {
     printf(msg ": %ld items in %lld ms\n", count, elapsed); \
 } while(0);
 
-/* dict-benchmark [count] */
+/* Time the hash functions over keys with lengths in [minlen,maxlen]. */
+static void benchmarkHashFunctions(const char *name, int minlen, int maxlen) {
+    static const struct {
+        const char *name;
+        uint64_t (*fn)(const void*, int);
+    } funcs[] = {
+        {"siphash", dictGenHashFunction},
+        {"siphash-nocase", (uint64_t (*)(const void*, int))dictGenCaseHashFunction},
+        {"wyhash", dictGenWyHashFunction},
+        {"wyhash-nocase", (uint64_t (*)(const void*, int))dictGenWyCaseHashFunction},
+    };
+    int nkeys = 4096, rounds = 500, j, k, f;
+    unsigned char *keys = malloc((size_t)nkeys*maxlen);
+    int *lens = malloc(sizeof(int)*nkeys);
+    long long start, elapsed;
+    uint64_t sum = 0;
+
+    for (j = 0; j < nkeys; j++) {
+        lens[j] = minlen + rand() % (maxlen-minlen+1);
+        for (k = 0; k < lens[j]; k++) keys[(size_t)j*maxlen+k] = rand();
+    }
+    for (f = 0; f < (int)(sizeof(funcs)/sizeof(funcs[0])); f++) {
+        start = timeInMilliseconds();
+        for (k = 0; k < rounds; k++)
+            for (j = 0; j < nkeys; j++)
+                sum += funcs[f].fn(keys+(size_t)j*maxlen,lens[j]);
+        elapsed = timeInMilliseconds()-start;
+        printf("%-14s %-16s %6.1f ns/hash\n", name, funcs[f].name,
+            (double)elapsed*1000000/((double)nkeys*rounds));
+    }
+    if (sum == 0) printf("\n"); /* Don't let the loops be optimized away. */
+    free(keys);
+    free(lens);
+}
+
+/* dict-benchmark [count] [siphash|wyhash] */
 int main(int argc, char **argv) {
     long j;
     long long start, elapsed;
-    dict *dict = dictCreate(&BenchmarkDictType,NULL);
+    dict *dict;
     long count = 0;
+    uint8_t seed[16];
+
+    for (j = 0; j < 16; j++) seed[j] = rand();
+    dictSetHashFunctionSeed(seed);
 
-    if (argc == 2) {
+    if (argc >= 2) {
         count = strtol(argv[1],NULL,10);
     } else {
         count = 5000000;
     }
+    if (argc >= 3 && !strcmp(argv[2],"wyhash"))
+        BenchmarkDictType.hashFunction = wyHashCallback;
+    dict = dictCreate(&BenchmarkDictType,NULL);
+
+    benchmarkHashFunctions("len 1-8",1,8);
+    benchmarkHashFunctions("len 9-16",9,16);
+    benchmarkHashFunctions("len 17-32",17,32);
+    benchmarkHashFunctions("len 33-64",33,64);
+    benchmarkHashFunctions("len 65-256",65,256);
+    benchmarkHashFunctions("len 1024",1024,1024);
 
     start_benchmark();
     for (j = 0; j < count; j++) {
@@ -347,6 +347,8 @@ void dictGetStats(char *buf, size_t bufsize, dict *d);
  */
 uint64_t dictGenHashFunction(const void *key, int len);
 uint64_t dictGenCaseHashFunction(const unsigned char *buf, int len);
+uint64_t dictGenWyHashFunction(const void *key, int len);
+uint64_t dictGenWyCaseHashFunction(const unsigned char *buf, int len);
 /**
  * 清空字典
  * @param d
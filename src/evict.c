@@ -59,8 +59,10 @@ struct evictionPoolEntry {
 };
 
 static struct evictionPoolEntry *EvictionPoolLRU;
-
-unsigned long LFUDecrAndReturn(robj *o);
+/* Pool used to evict keys from a single DB over its maxmemory-db limit.
+ * It only contains keys of the DB EvictionPoolDbId. */
+static struct evictionPoolEntry *EvictionPoolDb;
+static int EvictionPoolDbId = -1;
 
 /* ----------------------------------------------------------------------------
  * Implementation of eviction, aging and LRU
@@ -138,7 +140,7 @@ unsigned long long estimateObjectIdleTime(robj *o) {
  * evicted in the whole database. */
 
 /* Create a new eviction pool. */
-void evictionPoolAlloc(void) {
+static struct evictionPoolEntry *evictionPoolCreate(void) {
     struct evictionPoolEntry *ep;
     int j;
 
@@ -149,7 +151,24 @@ void evictionPoolAlloc(void) {
         ep[j].cached = sdsnewlen(NULL,EVPOOL_CACHED_SDS_SIZE);
         ep[j].dbid = 0;
     }
-    EvictionPoolLRU = ep;
+    return ep;
+}
+
+/* Remove all the keys from the pool. */
+static void evictionPoolEmpty(struct evictionPoolEntry *pool) {
+    int j;
+
+    for (j = 0; j < EVPOOL_SIZE; j++) {
+        if (pool[j].key && pool[j].key != pool[j].cached)
+            sdsfree(pool[j].key);
+        pool[j].key = NULL;
+        pool[j].idle = 0;
+    }
+}
+
+void evictionPoolAlloc(void) {
+    EvictionPoolLRU = evictionPoolCreate();
+    EvictionPoolDb = evictionPoolCreate();
 }
 
 /* This is an helper function for freeMemoryIfNeeded(), it is used in order
@@ -346,6 +365,151 @@ unsigned long LFUDecrAndReturn(robj *o) {
     return counter;
 }
 
+/* ----------------------------------------------------------------------------
+ * TinyLFU admission filter
+ * --------------------------------------------------------------------------*/
+
+/* With the LFU policies every new key starts with the LFU_INIT_VAL counter,
+ * so a burst of keys written just once, like the ones of a batch job, can
+ * evict keys accessed many times whose counter did not grow yet. When
+ * lfu-admission-filter is enabled the access frequency of all the keys,
+ * including the missing ones, is tracked in a count-min sketch, and every
+ * time a key is evicted the most recently added key is compared with it:
+ * if the new key is not accessed more often than the eviction candidate,
+ * the new key is evicted instead, so it is not admitted in the dataset at
+ * the expense of a warmer key.
+ *
+ * The sketch counters are halved every ADMISSION_SKETCH_WIDTH*10 accesses,
+ * so the frequency refers to the recent accesses. */
+
+#define ADMISSION_SKETCH_DEPTH 4        /* Rows of the sketch. */
+#define ADMISSION_SKETCH_WIDTH 65536    /* Counters per row. */
+#define ADMISSION_CANDIDATES 64         /* Recently added keys tracked. */
+
+static uint8_t *AdmissionSketch;        /* DEPTH rows of WIDTH counters. */
+static long long AdmissionSamples;      /* Accesses since the last aging. */
+
+/* Circular buffer of the keys recently added to the dataset. */
+static struct admissionCandidate {
+    sds key;
+    int dbid;
+} *AdmissionCandidates;
+static int AdmissionHead, AdmissionCount;
+
+/* Allocate the sketch and the candidates buffer, or release them if
+ * 'enabled' is false. Called when lfu-admission-filter is changed. */
+void admissionSetEnabled(int enabled) {
+    int j;
+
+    if (enabled && AdmissionSketch == NULL) {
+        AdmissionSketch = zcalloc(ADMISSION_SKETCH_DEPTH*ADMISSION_SKETCH_WIDTH);
+        AdmissionCandidates =
+            zcalloc(sizeof(struct admissionCandidate)*ADMISSION_CANDIDATES);
+        AdmissionSamples = 0;
+        AdmissionHead = AdmissionCount = 0;
+    } else if (!enabled && AdmissionSketch != NULL) {
+        for (j = 0; j < ADMISSION_CANDIDATES; j++)
+            sdsfree(AdmissionCandidates[j].key);
+        zfree(AdmissionCandidates);
+        zfree(AdmissionSketch);
+        AdmissionCandidates = NULL;
+        AdmissionSketch = NULL;
+    }
+}
+
+/* Return the hash used to index the sketch rows: every row uses 16 bits. */
+static uint64_t admissionHash(int dbid, sds key) {
+    return dictGenHashFunction(key,sdslen(key)) ^
+           ((uint64_t)dbid * 0x9e3779b97f4a7c15ULL);
+}
+
+/* Return the estimated access frequency of the key with hash 'h'. */
+static int admissionEstimate(uint64_t h) {
+    int j, min = 255;
+
+    for (j = 0; j < ADMISSION_SKETCH_DEPTH; j++) {
+        uint8_t *row = AdmissionSketch+j*ADMISSION_SKETCH_WIDTH;
+        int count = row[(h >> (j*16)) & (ADMISSION_SKETCH_WIDTH-1)];
+        if (count < min) min = count;
+    }
+    return min;
+}
+
+/* Count an access to 'key'. Only the counters equal to the current estimate
+ * are incremented (conservative update), that reduces the overestimation
+ * caused by the collisions. */
+void admissionRecordAccess(redisDb *db, robj *key) {
+    uint64_t h = admissionHash(db->id,key->ptr);
+    int j, min = admissionEstimate(h);
+
+    if (min < 255) {
+        for (j = 0; j < ADMISSION_SKETCH_DEPTH; j++) {
+            uint8_t *row = AdmissionSketch+j*ADMISSION_SKETCH_WIDTH;
+            uint8_t *count = row+((h >> (j*16)) & (ADMISSION_SKETCH_WIDTH-1));
+            if (*count == min) (*count)++;
+        }
+    }
+    if (++AdmissionSamples == (long long)ADMISSION_SKETCH_WIDTH*10) {
+        for (j = 0; j < ADMISSION_SKETCH_DEPTH*ADMISSION_SKETCH_WIDTH; j++)
+            AdmissionSketch[j] >>= 1;
+        AdmissionSamples = 0;
+    }
+}
+
+/* Remember that 'key' was just added to the dataset, so that it has to
+ * compete with the next eviction candidate to stay in the dataset. */
+void admissionAddCandidate(redisDb *db, robj *key) {
+    struct admissionCandidate *ac = AdmissionCandidates+AdmissionHead;
+
+    if (ac->key) sdsfree(ac->key);
+    ac->key = sdsdup(key->ptr);
+    ac->dbid = db->id;
+    AdmissionHead = (AdmissionHead+1) % ADMISSION_CANDIDATES;
+    if (AdmissionCount < ADMISSION_CANDIDATES) AdmissionCount++;
+}
+
+/* Given the key selected for eviction 'bestkey' in the DB '*dbid', return
+ * the key that should really be evicted: the most recently added key that
+ * still exists and can be evicted, if it is not accessed more often than
+ * 'bestkey', otherwise 'bestkey' itself. '*dbid' is updated accordingly.
+ * Every new key takes part in a single comparison. */
+static sds admissionFilter(sds bestkey, int *dbid) {
+    uint64_t best_h = admissionHash(*dbid,bestkey);
+
+    while (AdmissionCount) {
+        struct admissionCandidate *ac;
+        redisDb *db;
+        dictEntry *de;
+        sds newkey;
+
+        AdmissionHead = (AdmissionHead+ADMISSION_CANDIDATES-1) %
+                        ADMISSION_CANDIDATES;
+        AdmissionCount--;
+        ac = AdmissionCandidates+AdmissionHead;
+        db = server.db+ac->dbid;
+
+        /* Skip the keys already deleted and the ones that the policy does
+         * not allow to evict. */
+        if (server.maxmemory_policy & MAXMEMORY_FLAG_ALLKEYS)
+            de = dictFind(db->dict,ac->key);
+        else
+            de = dictFind(db->expires,ac->key);
+        if (de == NULL) continue;
+        newkey = dictGetKey(de);
+        if (ac->dbid == *dbid && sdscmp(newkey,bestkey) == 0) continue;
+
+        if (admissionEstimate(admissionHash(ac->dbid,newkey)) <=
+            admissionEstimate(best_h))
+        {
+            *dbid = ac->dbid;
+            server.stat_admission_rejected++;
+            return newkey;
+        }
+        break; /* The new key is admitted. */
+    }
+    return bestkey;
+}
+
 /* ----------------------------------------------------------------------------
  * The external API for eviction: freeMemroyIfNeeded() is called by the
  * server when there is data to add in order to make space if needed.
@@ -374,10 +538,170 @@ size_t freeMemoryGetNotCountedMemory(void) {
     return overhead;
 }
 
+/* Return the used memory as counted by maxmemory, that is, without the
+ * AOF and slaves buffers. */
+static size_t freeMemoryGetUsedMemory(void) {
+    size_t mem_used = zmalloc_used_memory();
+    size_t overhead = freeMemoryGetNotCountedMemory();
+    return (mem_used > overhead) ? mem_used-overhead : 0;
+}
+
+/* Select the best key to evict according to the maxmemory policy. The
+ * key name stored in the database is returned, and '*dbid' is set to the
+ * ID of its database. NULL is returned if there are no keys to evict.
+ *
+ * If 'seldb' is not -1 only the keys of the DB 'seldb' are considered. */
+static sds evictionSelectKey(int seldb, int *dbid) {
+    static int next_db = 0;
+    int j, k, i;
+    sds bestkey = NULL;
+    redisDb *db;
+    dict *dict;
+    dictEntry *de;
+
+    if (server.maxmemory_policy & (MAXMEMORY_FLAG_LRU|MAXMEMORY_FLAG_LFU) ||
+        server.maxmemory_policy == MAXMEMORY_VOLATILE_TTL)
+    {
+        struct evictionPoolEntry *pool = EvictionPoolLRU;
+
+        if (seldb != -1) {
+            pool = EvictionPoolDb;
+            if (EvictionPoolDbId != seldb) {
+                evictionPoolEmpty(pool);
+                EvictionPoolDbId = seldb;
+            }
+        }
+
+        while(bestkey == NULL) {
+            unsigned long total_keys = 0, keys;
+
+            /* We don't want to make local-db choices when expiring keys,
+             * so to start populate the eviction pool sampling keys from
+             * every DB. */
+            for (i = 0; i < server.dbnum; i++) {
+                if (seldb != -1 && i != seldb) continue;
+                db = server.db+i;
+                dict = (server.maxmemory_policy & MAXMEMORY_FLAG_ALLKEYS) ?
+                        db->dict : db->expires;
+                if ((keys = dictSize(dict)) != 0) {
+                    evictionPoolPopulate(i, dict, db->dict, pool);
+                    total_keys += keys;
+                }
+            }
+            if (!total_keys) break; /* No keys to evict. */
+
+            /* Go backward from best to worst element to evict. */
+            for (k = EVPOOL_SIZE-1; k >= 0; k--) {
+                if (pool[k].key == NULL) continue;
+                *dbid = pool[k].dbid;
+
+                if (server.maxmemory_policy & MAXMEMORY_FLAG_ALLKEYS) {
+                    de = dictFind(server.db[pool[k].dbid].dict,
+                        pool[k].key);
+                } else {
+                    de = dictFind(server.db[pool[k].dbid].expires,
+                        pool[k].key);
+                }
+
+                /* Remove the entry from the pool. */
+                if (pool[k].key != pool[k].cached)
+                    sdsfree(pool[k].key);
+                pool[k].key = NULL;
+                pool[k].idle = 0;
+
+                /* If the key exists, is our pick. Otherwise it is
+                 * a ghost and we need to try the next element. */
+                if (de) {
+                    bestkey = dictGetKey(de);
+                    if (server.lfu_admission_filter && seldb == -1 &&
+                        server.maxmemory_policy & MAXMEMORY_FLAG_LFU)
+                    {
+                        bestkey = admissionFilter(bestkey,dbid);
+                    }
+                    break;
+                } else {
+                    /* Ghost... Iterate again. */
+                }
+            }
+        }
+    }
+
+    /* volatile-random and allkeys-random policy */
+    else if (server.maxmemory_policy == MAXMEMORY_ALLKEYS_RANDOM ||
+             server.maxmemory_policy == MAXMEMORY_VOLATILE_RANDOM)
+    {
+        /* When evicting a random key, we try to evict a key for
+         * each DB, so we use the static 'next_db' variable to
+         * incrementally visit all DBs. */
+        for (i = 0; i < server.dbnum; i++) {
+            j = (seldb != -1) ? seldb : (++next_db) % server.dbnum;
+            db = server.db+j;
+            dict = (server.maxmemory_policy == MAXMEMORY_ALLKEYS_RANDOM) ?
+                    db->dict : db->expires;
+            if (dictSize(dict) != 0) {
+                de = dictGetRandomKey(dict);
+                bestkey = dictGetKey(de);
+                *dbid = j;
+                break;
+            }
+        }
+    }
+    return bestkey;
+}
+
+/* Set while evicting a key: mrcKeyDelete() leaves the evicted keys in the
+ * simulated caches, that work as a ghost cache. */
+static int MRCEvicting = 0;
+
+/* Evict the key 'bestkey' of the DB 'dbid', releasing the value in a
+ * background thread if 'lazy' is true. When 'batched' is true the
+ * deletion is propagated with propagateExpireBatched(). The time spent
+ * deleting the key is removed from the 'latency' of the caller eviction
+ * cycle, since it is reported as a different event.
+ *
+ * Returns the amount of memory released by the deletion. */
+static long long evictionDeleteKey(int dbid, sds bestkey, int lazy,
+                                   int batched, mstime_t *latency)
+{
+    redisDb *db = server.db+dbid;
+    robj *keyobj = createStringObject(bestkey,sdslen(bestkey));
+    mstime_t eviction_latency;
+    long long delta;
+
+    if (batched)
+        propagateExpireBatched(db,keyobj,lazy);
+    else
+        propagateExpire(db,keyobj,lazy);
+    /* We compute the amount of memory freed by db*Delete() alone.
+     * It is possible that actually the memory needed to propagate
+     * the DEL in AOF and replication link is greater than the one
+     * we are freeing removing the key, but we can't account for
+     * that otherwise we would never exit the loop.
+     *
+     * AOF and Output buffer memory will be freed eventually so
+     * we only care about memory used by the key space. */
+    delta = (long long) zmalloc_used_memory();
+    latencyStartMonitor(eviction_latency);
+    MRCEvicting = 1;
+    if (lazy)
+        dbAsyncDelete(db,keyobj);
+    else
+        dbSyncDelete(db,keyobj);
+    MRCEvicting = 0;
+    latencyEndMonitor(eviction_latency);
+    latencyAddSampleIfNeeded("eviction-del",eviction_latency);
+    latencyRemoveNestedEvent(*latency,eviction_latency);
+    delta -= (long long) zmalloc_used_memory();
+    server.stat_evictedkeys++;
+    notifyKeyspaceEvent(NOTIFY_EVICTED, "evicted",
+        keyobj, db->id);
+    decrRefCount(keyobj);
+    return delta;
+}
+
 int freeMemoryIfNeeded(void) {
     size_t mem_reported, mem_used, mem_tofree, mem_freed;
-    mstime_t latency, eviction_latency;
-    long long delta;
+    mstime_t latency;
     int slaves = listLength(server.slaves);
 
     /* Check if we are over the memory usage limit. If we are not, no need
@@ -403,116 +727,21 @@ int freeMemoryIfNeeded(void) {
 
     latencyStartMonitor(latency);
     while (mem_freed < mem_tofree) {
-        int j, k, i, keys_freed = 0;
-        static int next_db = 0;
-        sds bestkey = NULL;
-        int bestdbid;
-        redisDb *db;
-        dict *dict;
-        dictEntry *de;
-
-        if (server.maxmemory_policy & (MAXMEMORY_FLAG_LRU|MAXMEMORY_FLAG_LFU) ||
-            server.maxmemory_policy == MAXMEMORY_VOLATILE_TTL)
-        {
-            struct evictionPoolEntry *pool = EvictionPoolLRU;
-
-            while(bestkey == NULL) {
-                unsigned long total_keys = 0, keys;
-
-                /* We don't want to make local-db choices when expiring keys,
-                 * so to start populate the eviction pool sampling keys from
-                 * every DB. */
-                for (i = 0; i < server.dbnum; i++) {
-                    db = server.db+i;
-                    dict = (server.maxmemory_policy & MAXMEMORY_FLAG_ALLKEYS) ?
-                            db->dict : db->expires;
-                    if ((keys = dictSize(dict)) != 0) {
-                        evictionPoolPopulate(i, dict, db->dict, pool);
-                        total_keys += keys;
-                    }
-                }
-                if (!total_keys) break; /* No keys to evict. */
-
-                /* Go backward from best to worst element to evict. */
-                for (k = EVPOOL_SIZE-1; k >= 0; k--) {
-                    if (pool[k].key == NULL) continue;
-                    bestdbid = pool[k].dbid;
-
-                    if (server.maxmemory_policy & MAXMEMORY_FLAG_ALLKEYS) {
-                        de = dictFind(server.db[pool[k].dbid].dict,
-                            pool[k].key);
-                    } else {
-                        de = dictFind(server.db[pool[k].dbid].expires,
-                            pool[k].key);
-                    }
+        int keys_freed = 0;
+        sds bestkey;
+        int bestdbid, seldb;
 
-                    /* Remove the entry from the pool. */
-                    if (pool[k].key != pool[k].cached)
-                        sdsfree(pool[k].key);
-                    pool[k].key = NULL;
-                    pool[k].idle = 0;
-
-                    /* If the key exists, is our pick. Otherwise it is
-                     * a ghost and we need to try the next element. */
-                    if (de) {
-                        bestkey = dictGetKey(de);
-                        break;
-                    } else {
-                        /* Ghost... Iterate again. */
-                    }
-                }
-            }
-        }
-
-        /* volatile-random and allkeys-random policy */
-        else if (server.maxmemory_policy == MAXMEMORY_ALLKEYS_RANDOM ||
-                 server.maxmemory_policy == MAXMEMORY_VOLATILE_RANDOM)
-        {
-            /* When evicting a random key, we try to evict a key for
-             * each DB, so we use the static 'next_db' variable to
-             * incrementally visit all DBs. */
-            for (i = 0; i < server.dbnum; i++) {
-                j = (++next_db) % server.dbnum;
-                db = server.db+j;
-                dict = (server.maxmemory_policy == MAXMEMORY_ALLKEYS_RANDOM) ?
-                        db->dict : db->expires;
-                if (dictSize(dict) != 0) {
-                    de = dictGetRandomKey(dict);
-                    bestkey = dictGetKey(de);
-                    bestdbid = j;
-                    break;
-                }
-            }
-        }
+        /* The DBs over their maxmemory-db limit are the first to lose
+         * keys, so that a single DB can't evict the keys of the others. */
+        seldb = dbMemoryOverLimit();
+        bestkey = evictionSelectKey(seldb,&bestdbid);
+        if (bestkey == NULL && seldb != -1)
+            bestkey = evictionSelectKey(-1,&bestdbid);
 
         /* Finally remove the selected key. */
-        if (bestkey) {
-            db = server.db+bestdbid;
-            robj *keyobj = createStringObject(bestkey,sdslen(bestkey));
-            propagateExpire(db,keyobj,server.lazyfree_lazy_eviction);
-            /* We compute the amount of memory freed by db*Delete() alone.
-             * It is possible that actually the memory needed to propagate
-             * the DEL in AOF and replication link is greater than the one
-             * we are freeing removing the key, but we can't account for
-             * that otherwise we would never exit the loop.
-             *
-             * AOF and Output buffer memory will be freed eventually so
-             * we only care about memory used by the key space. */
-            delta = (long long) zmalloc_used_memory();
-            latencyStartMonitor(eviction_latency);
-            if (server.lazyfree_lazy_eviction)
-                dbAsyncDelete(db,keyobj);
-            else
-                dbSyncDelete(db,keyobj);
-            latencyEndMonitor(eviction_latency);
-            latencyAddSampleIfNeeded("eviction-del",eviction_latency);
-            latencyRemoveNestedEvent(latency,eviction_latency);
-            delta -= (long long) zmalloc_used_memory();
-            mem_freed += delta;
-            server.stat_evictedkeys++;
-            notifyKeyspaceEvent(NOTIFY_EVICTED, "evicted",
-                keyobj, db->id);
-            decrRefCount(keyobj);
+        if (bestkey != NULL) {
+            mem_freed += evictionDeleteKey(bestdbid,bestkey,
+                server.lazyfree_lazy_eviction,0,&latency);
             keys_freed++;
 
             /* When the memory to free starts to be big enough, we may
@@ -529,10 +758,7 @@ int freeMemoryIfNeeded(void) {
              * across the dbAsyncDelete() call, while the thread can
              * release the memory all the time. */
             if (server.lazyfree_lazy_eviction && !(keys_freed % 16)) {
-                overhead = freeMemoryGetNotCountedMemory();
-                mem_used = zmalloc_used_memory();
-                mem_used = (mem_used > overhead) ? mem_used-overhead : 0;
-                if (mem_used <= server.maxmemory) {
+                if (freeMemoryGetUsedMemory() <= server.maxmemory) {
                     mem_freed = mem_tofree;
                 }
             }
@@ -560,3 +786,407 @@ cant_free:
     return C_ERR;
 }
 
+/* Evict keys from 'db' while its memory usage, as estimated by the per DB
+ * accounting, is over its maxmemory-db limit. The keys are selected with the
+ * maxmemory policy, considering only the keys of 'db'.
+ *
+ * Returns C_OK if the DB is within its limit, otherwise C_ERR if the keys
+ * that can be evicted according to the policy were not enough. */
+int freeDbMemoryIfNeeded(redisDb *db) {
+    unsigned long long limit;
+    mstime_t latency;
+    int bestdbid;
+    sds bestkey;
+
+    if (!server.db_memory_accounting) return C_OK;
+    limit = server.maxmemory_db[db->id];
+    if (!limit || (unsigned long long)db->used_memory <= limit) return C_OK;
+    if (server.maxmemory_policy == MAXMEMORY_NO_EVICTION) return C_ERR;
+
+    latencyStartMonitor(latency);
+    /* The memory of the deleted keys is subtracted immediately, even when
+     * it is released by the lazyfree thread. */
+    while ((unsigned long long)db->used_memory > limit &&
+           (bestkey = evictionSelectKey(db->id,&bestdbid)) != NULL)
+    {
+        evictionDeleteKey(bestdbid,bestkey,server.lazyfree_lazy_eviction,0,
+            &latency);
+    }
+    latencyEndMonitor(latency);
+    latencyAddSampleIfNeeded("eviction-cycle",latency);
+    return ((unsigned long long)db->used_memory <= limit) ? C_OK : C_ERR;
+}
+
+/* ----------------------------------------------------------------------------
+ * Background eviction
+ * --------------------------------------------------------------------------*/
+
+/* When maxmemory-soft-watermark is set, keys start to be evicted before
+ * sleeping in the event loop as soon as the used memory crosses the given
+ * percentage of maxmemory, so that the clients rarely find the server over
+ * the hard limit, paying for the eviction with the latency of their writes.
+ * Since the function is called once per event loop iteration, the eviction
+ * rate follows the write traffic.
+ *
+ * The keys are selected exactly like in freeMemoryIfNeeded(), but the
+ * values are always released with lazyfree and every run is limited to
+ * EVICTION_BG_CYCLE_DURATION microseconds, to add very little latency to
+ * the clients served in the next iteration. Since the memory
+ * of the values released in the background thread is not reclaimed
+ * immediately, the run also stops when the lazyfree thread has a backlog,
+ * otherwise we may evict more keys than needed. */
+void evictionBackgroundCycle(void) {
+    size_t soft_limit, overhead;
+    long long start;
+    mstime_t latency;
+    int keys_freed = 0, bestdbid;
+    sds bestkey;
+
+    if (!server.maxmemory || !server.maxmemory_soft_watermark ||
+        server.maxmemory_soft_watermark >= 100 ||
+        server.maxmemory_policy == MAXMEMORY_NO_EVICTION) return;
+
+    soft_limit = (double)server.maxmemory/100*server.maxmemory_soft_watermark;
+    if (zmalloc_used_memory() <= soft_limit) return;
+    /* The buffers are not going to shrink while we evict, so their size
+     * is computed just once. */
+    overhead = freeMemoryGetNotCountedMemory();
+    soft_limit += overhead;
+    if (zmalloc_used_memory() <= soft_limit) return;
+
+    start = ustime();
+
+    latencyStartMonitor(latency);
+    while ((bestkey = evictionSelectKey(-1,&bestdbid)) != NULL) {
+        evictionDeleteKey(bestdbid,bestkey,1,1,&latency);
+        server.stat_evictedkeys_bg++;
+        keys_freed++;
+
+        if ((keys_freed % 16) == 0) {
+            if (ustime()-start > EVICTION_BG_CYCLE_DURATION) break;
+            if (bioPendingJobsOfType(BIO_LAZY_FREE)) break;
+        }
+        if (zmalloc_used_memory() <= soft_limit) break;
+    }
+    propagatePendingExpires();
+    latencyEndMonitor(latency);
+    latencyAddSampleIfNeeded("eviction-background",latency);
+}
+
+
+/* ----------------------------------------------------------------------------
+ * Miss ratio curve estimation
+ * --------------------------------------------------------------------------*/
+
+/* When maxmemory-mrc is enabled, Redis simulates the keyspace hit ratio the
+ * server would have with a maxmemory setting from half to twice the current
+ * one, in order to help sizing it. Without maxmemory the current used
+ * memory is used as reference.
+ *
+ * Simulating full size caches would cost as much memory as the dataset, so
+ * only the keys whose hash falls in 1/MRC_SAMPLE_RATE of the hash space are
+ * tracked, and each simulated cache is scaled down by the same factor. Since
+ * the sampling depends only on the key name, every access to a sampled key
+ * is simulated, and the hit ratio of the scaled down caches approximates
+ * the one of the full size caches.
+ *
+ * The simulated caches store a fingerprint of the key, the estimated size
+ * of the key and the value, and an object header holding the same LRU/LFU
+ * metadata of the real objects, so that the entries are aged and evicted
+ * with the functions and the policy used for the real keys. The keys evicted
+ * from the dataset are still found in the larger caches, that work as a
+ * ghost cache: accessing them again counts as a hit for those sizes. */
+
+#define MRC_SAMPLE_RATE 64
+#define MRC_CACHES 6
+static const double MRCSizeRatios[MRC_CACHES] = {0.5,0.75,1,1.25,1.5,2};
+
+typedef struct mrcEntry {
+    uint64_t fingerprint;
+    size_t size;        /* Estimated memory used by the key in the dataset. */
+    robj meta;          /* Only the 'lru' field is used. */
+} mrcEntry;
+
+typedef struct mrcCache {
+    dict *entries;      /* Set of mrcEntry structures. */
+    size_t used;        /* Sum of the entries sizes. */
+    long long hits;
+    long long misses;
+} mrcCache;
+
+static mrcCache *MRCCaches;
+static int MRCPolicy;   /* maxmemory-policy the caches were populated with. */
+static long long MRCSizeSum, MRCSizeCount; /* Estimated sizes of the keys. */
+
+static uint64_t mrcEntryHash(const void *key) {
+    return ((const mrcEntry*)key)->fingerprint;
+}
+
+static int mrcEntryCompare(void *privdata, const void *key1,
+                           const void *key2)
+{
+    DICT_NOTUSED(privdata);
+    return ((const mrcEntry*)key1)->fingerprint ==
+           ((const mrcEntry*)key2)->fingerprint;
+}
+
+static void mrcEntryDestructor(void *privdata, void *key) {
+    DICT_NOTUSED(privdata);
+    zfree(key);
+}
+
+/* The fingerprint is already a random hash, so it is used as it is. */
+static dictType mrcDictType = {
+    mrcEntryHash,               /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    mrcEntryCompare,            /* key compare */
+    mrcEntryDestructor,         /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* Remove all the keys from the simulated caches, keeping the stats. Called
+ * when the keys are removed or renamed in bulk, like by FLUSHALL or SWAPDB:
+ * since the fingerprints depend on the DB, accessing them again would be
+ * counted as a hit. */
+void mrcEmptyCaches(void) {
+    int j;
+
+    if (MRCCaches == NULL) return;
+    for (j = 0; j < MRC_CACHES; j++) {
+        dictEmpty(MRCCaches[j].entries,NULL);
+        MRCCaches[j].used = 0;
+    }
+}
+
+/* Empty the simulated caches and reset the stats. */
+static void mrcEmpty(void) {
+    mrcEmptyCaches();
+    MRCPolicy = server.maxmemory_policy;
+    MRCSizeSum = MRCSizeCount = 0;
+    mrcReset();
+}
+
+/* Create the simulated caches, or release them if 'enabled' is false.
+ * Called when maxmemory-mrc is changed. */
+void mrcSetEnabled(int enabled) {
+    int j;
+
+    if (enabled && MRCCaches == NULL) {
+        MRCCaches = zmalloc(sizeof(mrcCache)*MRC_CACHES);
+        for (j = 0; j < MRC_CACHES; j++)
+            MRCCaches[j].entries = dictCreate(&mrcDictType,NULL);
+        mrcEmpty();
+    } else if (!enabled && MRCCaches != NULL) {
+        for (j = 0; j < MRC_CACHES; j++)
+            dictRelease(MRCCaches[j].entries);
+        zfree(MRCCaches);
+        MRCCaches = NULL;
+    }
+}
+
+/* Reset the hits and misses stats. The content of the simulated caches
+ * is retained, so that the new stats are not affected by a cold start. */
+void mrcReset(void) {
+    int j;
+
+    for (j = 0; j < MRC_CACHES; j++) {
+        MRCCaches[j].hits = 0;
+        MRCCaches[j].misses = 0;
+    }
+}
+
+/* Return the fingerprint of the key, or 0 if the key is not sampled. */
+static uint64_t mrcFingerprint(redisDb *db, robj *key) {
+    uint64_t fp = dictGenHashFunction(key->ptr,sdslen(key->ptr));
+
+    fp ^= (uint64_t)db->id * 0x9e3779b97f4a7c15ULL;
+    if (fp >= UINT64_MAX/MRC_SAMPLE_RATE) return 0;
+    return fp ? fp : 1;
+}
+
+/* Return the dataset memory of the simulated cache with ratio 1. */
+static size_t mrcReferenceMemory(void) {
+    size_t ref = server.maxmemory ? server.maxmemory : zmalloc_used_memory();
+
+    if (ref < server.initial_memory_usage) return 0;
+    return ref-server.initial_memory_usage;
+}
+
+/* Return the capacity of the simulated cache with ratio 1. The size of the
+ * entries is estimated without the allocator and hash tables overhead, so
+ * the capacity is scaled by the ratio between the estimated size of the
+ * keys and the actual memory used per key. */
+static size_t mrcReferenceCapacity(void) {
+    size_t used = zmalloc_used_memory(), keys = 0;
+    double scale = 1;
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) keys += dictSize(server.db[j].dict);
+    if (keys && MRCSizeCount && used > server.initial_memory_usage) {
+        double actual = (double)(used-server.initial_memory_usage)/keys;
+        double estimated = (double)MRCSizeSum/MRCSizeCount;
+        scale = estimated/actual;
+    }
+    return mrcReferenceMemory()*scale/MRC_SAMPLE_RATE;
+}
+
+/* Evict an entry from the cache 'c', selecting it with the maxmemory
+ * policy among maxmemory-samples entries. For the random policies and for
+ * noeviction, where there is no access pattern to simulate, LRU is used. */
+static void mrcCacheEvict(mrcCache *c) {
+    dictEntry *samples[server.maxmemory_samples];
+    unsigned long long idle, bestidle = 0;
+    mrcEntry *e, *best = NULL;
+    int j, count;
+
+    if (MRCPolicy == MAXMEMORY_ALLKEYS_RANDOM ||
+        MRCPolicy == MAXMEMORY_VOLATILE_RANDOM)
+    {
+        count = 0;
+    } else {
+        count = dictGetSomeKeys(c->entries,samples,server.maxmemory_samples);
+        for (j = 0; j < count; j++) {
+            e = dictGetKey(samples[j]);
+            if (MRCPolicy & MAXMEMORY_FLAG_LFU)
+                idle = 255-LFUDecrAndReturn(&e->meta);
+            else
+                idle = estimateObjectIdleTime(&e->meta);
+            if (best == NULL || idle > bestidle) {
+                best = e;
+                bestidle = idle;
+            }
+        }
+    }
+    /* dictGetSomeKeys() may find nothing in a sparse table. */
+    if (count == 0) best = dictGetKey(dictGetRandomKey(c->entries));
+    c->used -= best->size;
+    dictDelete(c->entries,best);
+}
+
+/* Access the entry with fingerprint 'fp' in the cache 'c', and add it if
+ * missing when the key 'size' is known, then evict entries until the cache
+ * fits in 'capacity' bytes. Returns 1 if the entry was found. */
+static int mrcCacheAccess(mrcCache *c, uint64_t fp, size_t size,
+                          size_t capacity)
+{
+    mrcEntry *e, lookup;
+    dictEntry *de;
+    int found = 0;
+
+    lookup.fingerprint = fp;
+    if ((de = dictFind(c->entries,&lookup)) != NULL) {
+        e = dictGetKey(de);
+        if (MRCPolicy & MAXMEMORY_FLAG_LFU) {
+            unsigned long ldt = e->meta.lru >> 8;
+            unsigned long counter = LFULogIncr(e->meta.lru & 255);
+            e->meta.lru = (ldt << 8) | counter;
+        } else {
+            e->meta.lru = LRU_CLOCK();
+        }
+        if (size) {
+            c->used = c->used-e->size+size;
+            e->size = size;
+        }
+        found = 1;
+    } else if (size) {
+        e = zmalloc(sizeof(*e));
+        e->fingerprint = fp;
+        e->size = size;
+        if (MRCPolicy & MAXMEMORY_FLAG_LFU)
+            e->meta.lru = (LFUGetTimeInMinutes()<<8) | LFU_INIT_VAL;
+        else
+            e->meta.lru = LRU_CLOCK();
+        dictAdd(c->entries,e,NULL);
+        c->used += size;
+    }
+    while (c->used > capacity && dictSize(c->entries)) mrcCacheEvict(c);
+    return found;
+}
+
+/* Simulate an access to 'key', whose value is 'val' or NULL if the key
+ * does not exist. When 'count' is true the access is a read, and the hit
+ * or miss is accounted in the stats of the simulated caches, otherwise it
+ * just updates the entries, like a write does.
+ *
+ * Called by the lookup functions when maxmemory-mrc is enabled. */
+void mrcKeyAccess(redisDb *db, robj *key, robj *val, int count) {
+    uint64_t fp = mrcFingerprint(db,key);
+    size_t size = 0, ref;
+    int j;
+
+    if (fp == 0 || MRCCaches == NULL) return;
+    /* The entries metadata depends on the policy. */
+    if (MRCPolicy != server.maxmemory_policy) mrcEmpty();
+
+    if (val) {
+        size = objectComputeSize(val,OBJ_COMPUTE_SIZE_DEF_SAMPLES) +
+               sdsAllocSize(key->ptr) + sizeof(dictEntry);
+        MRCSizeSum += size;
+        /* Give more weight to the recent keys. */
+        if (++MRCSizeCount == 65536) {
+            MRCSizeSum /= 2;
+            MRCSizeCount /= 2;
+        }
+    }
+    ref = mrcReferenceCapacity();
+    for (j = 0; j < MRC_CACHES; j++) {
+        mrcCache *c = MRCCaches+j;
+        int found = mrcCacheAccess(c,fp,size,ref*MRCSizeRatios[j]);
+
+        if (!count) continue;
+        if (found)
+            c->hits++;
+        else
+            c->misses++;
+    }
+}
+
+/* Remove a deleted or expired key from the simulated caches, so that
+ * accessing it again is not counted as a hit. Called by dbSyncDelete() and
+ * dbAsyncDelete() even if the key does not exist, since it may be still in
+ * the simulated caches after being evicted. The keys evicted from the
+ * dataset are instead left in the simulated caches. */
+void mrcKeyDelete(redisDb *db, robj *key) {
+    uint64_t fp;
+    mrcEntry lookup, *e;
+    dictEntry *de;
+    int j;
+
+    if (MRCCaches == NULL || MRCEvicting) return;
+    if ((fp = mrcFingerprint(db,key)) == 0) return;
+    lookup.fingerprint = fp;
+    for (j = 0; j < MRC_CACHES; j++) {
+        mrcCache *c = MRCCaches+j;
+
+        if ((de = dictFind(c->entries,&lookup)) == NULL) continue;
+        e = dictGetKey(de);
+        c->used -= e->size;
+        dictDelete(c->entries,e);
+        if (htNeedsResize(c->entries)) dictResize(c->entries);
+    }
+}
+
+/* Reply to MEMORY MRC with an entry for every simulated size. */
+void mrcReply(client *c) {
+    size_t ref = mrcReferenceMemory();
+    int j;
+
+    addReplyMultiBulkLen(c,MRC_CACHES);
+    for (j = 0; j < MRC_CACHES; j++) {
+        mrcCache *cache = MRCCaches+j;
+        long long accesses = cache->hits+cache->misses;
+
+        addReplyMultiBulkLen(c,10);
+        addReplyBulkCString(c,"ratio");
+        addReplyDouble(c,MRCSizeRatios[j]);
+        addReplyBulkCString(c,"maxmemory");
+        addReplyLongLong(c,server.initial_memory_usage+ref*MRCSizeRatios[j]);
+        addReplyBulkCString(c,"hits");
+        addReplyLongLong(c,cache->hits);
+        addReplyBulkCString(c,"misses");
+        addReplyLongLong(c,cache->misses);
+        addReplyBulkCString(c,"hit-ratio");
+        addReplyDouble(c,accesses ? (double)cache->hits/accesses : 0);
+    }
+}
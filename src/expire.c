@@ -32,6 +32,92 @@
 
 #include "server.h"
 
+/*-----------------------------------------------------------------------------
+ * TTL ordered index of the keys with an expire.
+ *
+ * When active-expire-index is enabled, every DB has a radix tree with an
+ * element for each key with an expire: the unix time of the expire in
+ * milliseconds, as a 64 bit big endian number, followed by the key name.
+ * Iterating the tree returns the keys in expire order, so the active expire
+ * cycle can pop exactly the keys that are due, instead of sampling the
+ * expires dictionary at random and giving up when too few samples are
+ * expired. The cost is one more copy of the volatile key names.
+ *----------------------------------------------------------------------------*/
+
+#define EXPIRE_INDEX_TIME_LEN 8
+
+static void expireIndexUpdateKey(redisDb *db, sds key, long long when,
+                                 int add)
+{
+    unsigned char buf[64];
+    unsigned char *indexed = buf;
+    size_t keylen = sdslen(key);
+    uint64_t t = when < 0 ? 0 : when;
+    int j;
+
+    if (keylen+EXPIRE_INDEX_TIME_LEN > sizeof(buf))
+        indexed = zmalloc(keylen+EXPIRE_INDEX_TIME_LEN);
+    for (j = EXPIRE_INDEX_TIME_LEN-1; j >= 0; j--) {
+        indexed[j] = t & 0xff;
+        t >>= 8;
+    }
+    memcpy(indexed+EXPIRE_INDEX_TIME_LEN,key,keylen);
+    if (add) {
+        raxInsert(db->expires_index,indexed,keylen+EXPIRE_INDEX_TIME_LEN,
+                  NULL,NULL);
+    } else {
+        raxRemove(db->expires_index,indexed,keylen+EXPIRE_INDEX_TIME_LEN,
+                  NULL);
+    }
+    if (indexed != buf) zfree(indexed);
+}
+
+/* Return the expire time of an element of the index. */
+static long long expireIndexGetTime(unsigned char *indexed) {
+    uint64_t t = 0;
+    int j;
+
+    for (j = 0; j < EXPIRE_INDEX_TIME_LEN; j++) t = (t << 8) | indexed[j];
+    return t;
+}
+
+void expireIndexAdd(redisDb *db, sds key, long long when) {
+    expireIndexUpdateKey(db,key,when,1);
+}
+
+void expireIndexDel(redisDb *db, sds key, long long when) {
+    expireIndexUpdateKey(db,key,when,0);
+}
+
+/* Build the index of 'db' from its expires dictionary. */
+void expireIndexCreate(redisDb *db) {
+    dictIterator *di;
+    dictEntry *de;
+
+    db->expires_index = raxNew();
+    di = dictGetIterator(db->expires);
+    while((de = dictNext(di)) != NULL)
+        expireIndexAdd(db,dictGetKey(de),dictGetSignedIntegerVal(de));
+    dictReleaseIterator(di);
+}
+
+/* Create or release the index of all the DBs, when the active-expire-index
+ * option is changed at runtime. */
+void expireIndexSetEnabled(int enabled) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        if (enabled && db->expires_index == NULL) {
+            expireIndexCreate(db);
+        } else if (!enabled && db->expires_index != NULL) {
+            raxFree(db->expires_index);
+            db->expires_index = NULL;
+        }
+    }
+}
+
 /*-----------------------------------------------------------------------------
  * Incremental collection of expired keys.
  *
@@ -47,7 +133,9 @@
  * If the key is found to be expired, it is removed from the database and
  * 1 is returned. Otherwise no operation is performed and 0 is returned.
  *
- * When a key is expired, server.stat_expiredkeys is incremented.
+ * When a key is expired, server.stat_expiredkeys is incremented. The
+ * expire is propagated with propagateExpireBatched(), so the caller must
+ * call propagatePendingExpires() once done.
  *
  * The parameter 'now' is the current time in milliseconds as is passed
  * to the function to avoid too many gettimeofday() syscalls. */
@@ -57,7 +145,7 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
         sds key = dictGetKey(de);
         robj *keyobj = createStringObject(key,sdslen(key));
 
-        propagateExpire(db,keyobj,server.lazyfree_lazy_expire);
+        propagateExpireBatched(db,keyobj,server.lazyfree_lazy_expire);
         if (server.lazyfree_lazy_expire)
             dbAsyncDelete(db,keyobj);
         else
@@ -72,6 +160,104 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
     }
 }
 
+/* Counters of a single active expire cycle, see activeExpireCycle(). */
+typedef struct expireCycleStats {
+    long long reclaimed;    /* Keys reclaimed. */
+    long long backlog_keys; /* Estimated expired keys left in memory. */
+    long long backlog_ms;   /* Age of the oldest of them, if known. */
+} expireCycleStats;
+
+/* Update the average TTL of the keys of 'db', just for stats. */
+static void activeExpireUpdateAvgTTL(redisDb *db, long long ttl_sum,
+                                     int ttl_samples)
+{
+    long long avg_ttl;
+
+    if (ttl_samples == 0) return;
+    avg_ttl = ttl_sum/ttl_samples;
+
+    /* Do a simple running average with a few samples.
+     * We just use the current estimate with a weight of 2%
+     * and the previous estimate with a weight of 98%. */
+    if (db->avg_ttl == 0) db->avg_ttl = avg_ttl;
+    db->avg_ttl = (db->avg_ttl/50)*49 + (avg_ttl/50);
+}
+
+/* Expire the keys of 'db' that are due, popping them from the TTL index in
+ * expire order. The keys are collected in small batches, since the index
+ * can't be modified while it is iterated.
+ *
+ * Returns 1 if the time limit was reached before all the due keys were
+ * expired, otherwise 0. */
+static int activeExpireCycleFromIndex(redisDb *db, long long start,
+                                      long long timelimit, int *iteration,
+                                      expireCycleStats *stats)
+{
+    robj *batch[ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP];
+    long long now = mstime(), first = -1, last = -1, reclaimed = 0;
+    int count, j, timeout = 0;
+    raxIterator ri;
+
+    do {
+        count = 0;
+        raxStart(&ri,db->expires_index);
+        raxSeek(&ri,"^",NULL,0);
+        while (count < ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP &&
+               raxNext(&ri))
+        {
+            long long when = expireIndexGetTime(ri.key);
+
+            if (when >= now) break;
+            if (first == -1) first = when;
+            last = when;
+            batch[count++] = createStringObject(
+                (char*)ri.key+EXPIRE_INDEX_TIME_LEN,
+                ri.key_len-EXPIRE_INDEX_TIME_LEN);
+        }
+        raxStop(&ri);
+
+        for (j = 0; j < count; j++) {
+            dictEntry *de = dictFind(db->expires,batch[j]->ptr);
+            int expired = de && activeExpireCycleTryExpire(db,de,now);
+
+            /* The index must be in sync with the expires dictionary, or
+             * we would pop the same key forever. */
+            serverAssertWithInfo(NULL,batch[j],expired);
+            decrRefCount(batch[j]);
+        }
+        reclaimed += count;
+
+        (*iteration)++;
+        if ((*iteration & 0xf) == 0) { /* check once every 16 iterations. */
+            long long elapsed = ustime()-start;
+
+            latencyAddSampleIfNeeded("expire-cycle",elapsed/1000);
+            if (elapsed > timelimit) timeout = 1;
+        }
+    } while (count == ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP && !timeout);
+    stats->reclaimed += reclaimed;
+
+    /* If we stopped for the time limit, estimate how many due keys are left
+     * assuming their expire times are as dense as the ones just expired. */
+    if (timeout) {
+        raxStart(&ri,db->expires_index);
+        raxSeek(&ri,"^",NULL,0);
+        if (raxNext(&ri)) {
+            long long when = expireIndexGetTime(ri.key);
+
+            if (when < now) {
+                long long backlog = reclaimed*(now-when)/(last-first+1);
+
+                stats->backlog_keys += backlog ? backlog : 1;
+                if (now-when > stats->backlog_ms)
+                    stats->backlog_ms = now-when;
+            }
+        }
+        raxStop(&ri);
+    }
+    return timeout;
+}
+
 /* Try to expire a few timed out keys. The algorithm used is adaptive and
  * will use few CPU cycles if there are few expiring keys, otherwise
  * it will get more aggressive to avoid that too much memory is used by
@@ -104,6 +290,8 @@ void activeExpireCycle(int type) {
     int j, iteration = 0;
     int dbs_per_call = CRON_DBS_PER_CALL;
     long long start = ustime(), timelimit;
+    size_t used_memory = zmalloc_used_memory();
+    expireCycleStats stats = {0,0,0};
 
     if (type == ACTIVE_EXPIRE_CYCLE_FAST) {
         /* Don't start a fast cycle if the previous cycle did not exited
@@ -136,7 +324,8 @@ void activeExpireCycle(int type) {
         timelimit = ACTIVE_EXPIRE_CYCLE_FAST_DURATION; /* in microseconds. */
 
     for (j = 0; j < dbs_per_call; j++) {
-        int expired;
+        int expired = 0;
+        unsigned long sampled = 0;
         redisDb *db = server.db+(current_db % server.dbnum);
 
         /* Increment the DB now so we are sure if we run out of time
@@ -144,6 +333,37 @@ void activeExpireCycle(int type) {
          * distribute the time evenly across DBs. */
         current_db++;
 
+        /* With the TTL index there is no need to sample: pop the keys that
+         * are due, and sample only to update the average TTL. */
+        if (db->expires_index) {
+            if (dictSize(db->expires) == 0) {
+                db->avg_ttl = 0;
+                continue;
+            }
+            if (activeExpireCycleFromIndex(db,start,timelimit,&iteration,
+                                           &stats))
+            {
+                timelimit_exit = 1;
+                break;
+            }
+            if (type == ACTIVE_EXPIRE_CYCLE_SLOW && dictSize(db->expires)) {
+                long long now = mstime(), ttl_sum = 0;
+                int k, ttl_samples = 0;
+
+                for (k = 0; k < ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP; k++) {
+                    dictEntry *de = dictGetRandomKey(db->expires);
+                    long long ttl = dictGetSignedIntegerVal(de)-now;
+
+                    if (ttl > 0) {
+                        ttl_sum += ttl;
+                        ttl_samples++;
+                    }
+                }
+                activeExpireUpdateAvgTTL(db,ttl_sum,ttl_samples);
+            }
+            continue;
+        }
+
         /* Continue to expire if at the end of the cycle more than 25%
          * of the keys were expired. */
         do {
@@ -173,6 +393,7 @@ void activeExpireCycle(int type) {
 
             if (num > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP)
                 num = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP;
+            sampled = num;
 
             while (num--) {
                 dictEntry *de;
@@ -189,15 +410,8 @@ void activeExpireCycle(int type) {
             }
 
             /* Update the average TTL stats for this database. */
-            if (ttl_samples) {
-                long long avg_ttl = ttl_sum/ttl_samples;
-
-                /* Do a simple running average with a few samples.
-                 * We just use the current estimate with a weight of 2%
-                 * and the previous estimate with a weight of 98%. */
-                if (db->avg_ttl == 0) db->avg_ttl = avg_ttl;
-                db->avg_ttl = (db->avg_ttl/50)*49 + (avg_ttl/50);
-            }
+            activeExpireUpdateAvgTTL(db,ttl_sum,ttl_samples);
+            stats.reclaimed += expired;
 
             /* We can't block forever here even if there are many keys to
              * expire. So after a given amount of milliseconds return to the
@@ -209,11 +423,24 @@ void activeExpireCycle(int type) {
                 latencyAddSampleIfNeeded("expire-cycle",elapsed/1000);
                 if (elapsed > timelimit) timelimit_exit = 1;
             }
-            if (timelimit_exit) return;
             /* We don't repeat the cycle if there are less than 25% of keys
              * found expired in the current DB. */
-        } while (expired > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP/4);
+        } while (!timelimit_exit &&
+                 expired > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP/4);
+
+        /* Estimate the expired keys left from the last sample. */
+        if (expired && sampled)
+            stats.backlog_keys += dictSize(db->expires)*expired/sampled;
+        if (timelimit_exit) break;
     }
+    propagatePendingExpires();
+
+    used_memory -= zmalloc_used_memory();
+    server.stat_expire_cycle_keys = stats.reclaimed;
+    server.stat_expire_cycle_bytes =
+        (ssize_t)used_memory > 0 ? (long long)used_memory : 0;
+    server.stat_expire_cycle_backlog_keys = stats.backlog_keys;
+    server.stat_expire_cycle_backlog_ms = stats.backlog_ms;
 }
 
 /*-----------------------------------------------------------------------------
@@ -310,6 +537,7 @@ void expireSlaveKeys(void) {
         if ((cycles % 64) == 0 && mstime()-start > 1) break;
         if (dictSize(slaveKeysWithExpire) == 0) break;
     }
+    propagatePendingExpires();
 }
 
 /* Track keys that received an EXPIRE or similar command in the context
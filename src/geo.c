@@ -178,7 +178,7 @@ double extractDistanceOrReply(client *c, robj **argv,
  * the kilometer. */
 void addReplyDoubleDistance(client *c, double d) {
     char dbuf[128];
-    int dlen = snprintf(dbuf, sizeof(dbuf), "%.4f", d);
+    int dlen = d2fstring(dbuf, sizeof(dbuf), d, 4);
     addReplyBulkCBuffer(c, dbuf, dlen);
 }
 
@@ -279,6 +279,28 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
                 == C_ERR) sdsfree(ele);
             ln = ln->level[0].forward;
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreeCursor cur;
+        int valid;
+
+        if (zbtFirstInRange(zs->zbt, &range, &cur) == 0) {
+            /* Nothing exists starting at our min.  No results. */
+            return 0;
+        }
+
+        valid = 1;
+        while (valid) {
+            zbtreeEntry *e = zbtCursorEntry(&cur);
+            /* Abort when the element is no longer in range. */
+            if (!zslValueLteMax(e->score, &range))
+                break;
+
+            member = sdsdup(e->ele);
+            if (geoAppendIfWithinRadius(ga,lon,lat,radius,e->score,member)
+                == C_ERR) sdsfree(member);
+            valid = zbtNext(&cur);
+        }
     }
     return ga->used - origincount;
 }
@@ -636,15 +658,13 @@ void georadiusGeneric(client *c, int type) {
         }
 
         for (i = 0; i < returned_items; i++) {
-            zskiplistNode *znode;
             geoPoint *gp = ga->array+i;
             gp->dist /= conversion; /* Fix according to unit. */
             double score = storedist ? gp->dist : gp->score;
             size_t elelen = sdslen(gp->member);
 
             if (maxelelen < elelen) maxelelen = elelen;
-            znode = zslInsert(zs->zsl,score,gp->member);
-            serverAssert(dictAdd(zs->dict,gp->member,&znode->score) == DICT_OK);
+            serverAssert(zsetInsertNew(zs,score,gp->member) == C_OK);
             gp->member = NULL;
         }
 
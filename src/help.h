@@ -792,6 +792,11 @@ struct commandHelp {
     "Intersect multiple sets",
     3,
     "1.0.0" },
+    { "SINTERCARD",
+    "numkeys key [key ...] [LIMIT limit]",
+    "Count the elements of the intersection of multiple sets",
+    3,
+    "5.0.0" },
     { "SINTERSTORE",
     "destination key [key ...]",
     "Intersect multiple sets and store the resulting set in a key",
@@ -501,13 +501,13 @@ int hllDenseAdd(uint8_t *registers, unsigned char *ele, size_t elesize) {
     }
 }
 
-/* Compute SUM(2^-reg) in the dense representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
+/* Compute the register histogram in the dense representation: on return
+ * reghisto[v] is incremented by the number of registers set to 'v'.
+ * The histogram is all hllCount() needs to compute SUM(2^-reg) and the
+ * number of zero registers, and building it requires no floating point
+ * math in the inner loop. */
+void hllDenseRegHisto(uint8_t *registers, int *reghisto) {
+    int j;
 
     /* Redis default is to use 16384 registers 6 bits each. The code works
      * with other values by modifying the defines, but for our target value
@@ -518,29 +518,28 @@ double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
                       r10, r11, r12, r13, r14, r15;
         for (j = 0; j < 1024; j++) {
             /* Handle 16 registers per iteration. */
-            r0 = r[0] & 63; if (r0 == 0) ez++;
-            r1 = (r[0] >> 6 | r[1] << 2) & 63; if (r1 == 0) ez++;
-            r2 = (r[1] >> 4 | r[2] << 4) & 63; if (r2 == 0) ez++;
-            r3 = (r[2] >> 2) & 63; if (r3 == 0) ez++;
-            r4 = r[3] & 63; if (r4 == 0) ez++;
-            r5 = (r[3] >> 6 | r[4] << 2) & 63; if (r5 == 0) ez++;
-            r6 = (r[4] >> 4 | r[5] << 4) & 63; if (r6 == 0) ez++;
-            r7 = (r[5] >> 2) & 63; if (r7 == 0) ez++;
-            r8 = r[6] & 63; if (r8 == 0) ez++;
-            r9 = (r[6] >> 6 | r[7] << 2) & 63; if (r9 == 0) ez++;
-            r10 = (r[7] >> 4 | r[8] << 4) & 63; if (r10 == 0) ez++;
-            r11 = (r[8] >> 2) & 63; if (r11 == 0) ez++;
-            r12 = r[9] & 63; if (r12 == 0) ez++;
-            r13 = (r[9] >> 6 | r[10] << 2) & 63; if (r13 == 0) ez++;
-            r14 = (r[10] >> 4 | r[11] << 4) & 63; if (r14 == 0) ez++;
-            r15 = (r[11] >> 2) & 63; if (r15 == 0) ez++;
-
-            /* Additional parens will allow the compiler to optimize the
-             * code more with a loss of precision that is not very relevant
-             * here (floating point math is not commutative!). */
-            E += (PE[r0] + PE[r1]) + (PE[r2] + PE[r3]) + (PE[r4] + PE[r5]) +
-                 (PE[r6] + PE[r7]) + (PE[r8] + PE[r9]) + (PE[r10] + PE[r11]) +
-                 (PE[r12] + PE[r13]) + (PE[r14] + PE[r15]);
+            r0 = r[0] & 63;
+            r1 = (r[0] >> 6 | r[1] << 2) & 63;
+            r2 = (r[1] >> 4 | r[2] << 4) & 63;
+            r3 = (r[2] >> 2) & 63;
+            r4 = r[3] & 63;
+            r5 = (r[3] >> 6 | r[4] << 2) & 63;
+            r6 = (r[4] >> 4 | r[5] << 4) & 63;
+            r7 = (r[5] >> 2) & 63;
+            r8 = r[6] & 63;
+            r9 = (r[6] >> 6 | r[7] << 2) & 63;
+            r10 = (r[7] >> 4 | r[8] << 4) & 63;
+            r11 = (r[8] >> 2) & 63;
+            r12 = r[9] & 63;
+            r13 = (r[9] >> 6 | r[10] << 2) & 63;
+            r14 = (r[10] >> 4 | r[11] << 4) & 63;
+            r15 = (r[11] >> 2) & 63;
+
+            reghisto[r0]++; reghisto[r1]++; reghisto[r2]++; reghisto[r3]++;
+            reghisto[r4]++; reghisto[r5]++; reghisto[r6]++; reghisto[r7]++;
+            reghisto[r8]++; reghisto[r9]++; reghisto[r10]++; reghisto[r11]++;
+            reghisto[r12]++; reghisto[r13]++; reghisto[r14]++; reghisto[r15]++;
+
             r += 12;
         }
     } else {
@@ -548,17 +547,66 @@ double hllDenseSum(uint8_t *registers, double *PE, int *ezp) {
             unsigned long reg;
 
             HLL_DENSE_GET_REGISTER(reg,registers,j);
-            if (reg == 0) {
-                ez++;
-                /* Increment E at the end of the loop. */
-            } else {
-                E += PE[reg]; /* Precomputed 2^(-reg[j]). */
-            }
+            reghisto[reg]++;
+        }
+    }
+}
+
+/* Unpack the dense registers into the 'dst' array of HLL_REGISTERS bytes,
+ * one register per byte. With 6 bit registers every group of 3 bytes holds
+ * exactly 4 registers, so the fast path decodes 12 bytes into 16 registers
+ * per iteration without any conditional. */
+void hllDenseUnpack(uint8_t *dst, uint8_t *registers) {
+    int j;
+
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+        uint8_t *r = registers;
+        for (j = 0; j < 1024; j++) {
+            dst[0] = r[0] & 63;
+            dst[1] = (r[0] >> 6 | r[1] << 2) & 63;
+            dst[2] = (r[1] >> 4 | r[2] << 4) & 63;
+            dst[3] = (r[2] >> 2) & 63;
+            dst[4] = r[3] & 63;
+            dst[5] = (r[3] >> 6 | r[4] << 2) & 63;
+            dst[6] = (r[4] >> 4 | r[5] << 4) & 63;
+            dst[7] = (r[5] >> 2) & 63;
+            dst[8] = r[6] & 63;
+            dst[9] = (r[6] >> 6 | r[7] << 2) & 63;
+            dst[10] = (r[7] >> 4 | r[8] << 4) & 63;
+            dst[11] = (r[8] >> 2) & 63;
+            dst[12] = r[9] & 63;
+            dst[13] = (r[9] >> 6 | r[10] << 2) & 63;
+            dst[14] = (r[10] >> 4 | r[11] << 4) & 63;
+            dst[15] = (r[11] >> 2) & 63;
+            r += 12;
+            dst += 16;
+        }
+    } else {
+        for (j = 0; j < HLL_REGISTERS; j++) {
+            HLL_DENSE_GET_REGISTER(dst[j],registers,j);
+        }
+    }
+}
+
+/* The reverse of hllDenseUnpack(): pack the HLL_REGISTERS bytes of 'src',
+ * that must all be <= HLL_REGISTER_MAX, into the dense representation. */
+void hllDensePack(uint8_t *registers, uint8_t *src) {
+    int j;
+
+    if (HLL_REGISTERS == 16384 && HLL_BITS == 6) {
+        uint8_t *r = registers;
+        for (j = 0; j < 4096; j++) {
+            r[0] = src[0] | src[1] << 6;
+            r[1] = src[1] >> 2 | src[2] << 4;
+            r[2] = src[2] >> 4 | src[3] << 2;
+            r += 3;
+            src += 4;
+        }
+    } else {
+        for (j = 0; j < HLL_REGISTERS; j++) {
+            HLL_DENSE_SET_REGISTER(registers,j,src[j]);
         }
-        E += ez; /* Add 2^0 'ez' times. */
     }
-    *ezp = ez;
-    return E;
 }
 
 /* ================== Sparse representation implementation  ================= */
@@ -885,76 +933,63 @@ promote: /* Promote to dense representation. */
     return dense_retval;
 }
 
-/* Compute SUM(2^-reg) in the sparse representation.
- * PE is an array with a pre-computer table of values 2^-reg indexed by reg.
- * As a side effect the integer pointed by 'ezp' is set to the number
- * of zero registers. */
-double hllSparseSum(uint8_t *sparse, int sparselen, double *PE, int *ezp, int *invalid) {
-    double E = 0;
-    int ez = 0, idx = 0, runlen, regval;
+/* Compute the register histogram in the sparse representation, see
+ * hllDenseRegHisto() for more information. Runs of registers are accounted
+ * with a single increment. */
+void hllSparseRegHisto(uint8_t *sparse, int sparselen, int *invalid, int *reghisto) {
+    int idx = 0, runlen, regval;
     uint8_t *end = sparse+sparselen, *p = sparse;
 
     while(p < end) {
         if (HLL_SPARSE_IS_ZERO(p)) {
             runlen = HLL_SPARSE_ZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p++;
         } else if (HLL_SPARSE_IS_XZERO(p)) {
             runlen = HLL_SPARSE_XZERO_LEN(p);
             idx += runlen;
-            ez += runlen;
-            /* Increment E at the end of the loop. */
+            reghisto[0] += runlen;
             p += 2;
         } else {
             runlen = HLL_SPARSE_VAL_LEN(p);
             regval = HLL_SPARSE_VAL_VALUE(p);
             idx += runlen;
-            E += PE[regval]*runlen;
+            reghisto[regval] += runlen;
             p++;
         }
     }
     if (idx != HLL_REGISTERS && invalid) *invalid = 1;
-    E += ez; /* Add 2^0 'ez' times. */
-    *ezp = ez;
-    return E;
 }
 
 /* ========================= HyperLogLog Count ==============================
  * This is the core of the algorithm where the approximated count is computed.
- * The function uses the lower level hllDenseSum() and hllSparseSum() functions
- * as helpers to compute the SUM(2^-reg) part of the computation, which is
- * representation-specific, while all the rest is common. */
-
-/* Implements the SUM operation for uint8_t data type which is only used
- * internally as speedup for PFCOUNT with multiple keys. */
-double hllRawSum(uint8_t *registers, double *PE, int *ezp) {
-    double E = 0;
-    int j, ez = 0;
-    uint64_t *word = (uint64_t*) registers;
-    uint8_t *bytes;
+ * The function uses the lower level hllDenseRegHisto() and hllSparseRegHisto()
+ * functions as helpers to compute the histogram of the registers values,
+ * which is representation-specific, while all the rest is common. */
+
+/* Implements the register histogram for uint8_t data type which is only
+ * used internally as speedup for PFCOUNT with multiple keys. */
+void hllRawRegHisto(uint8_t *registers, int *reghisto) {
+    uint64_t word;
+    int j;
 
     for (j = 0; j < HLL_REGISTERS/8; j++) {
-        if (*word == 0) {
-            ez += 8;
+        memcpy(&word,registers,sizeof(word));
+        if (word == 0) {
+            reghisto[0] += 8;
         } else {
-            bytes = (uint8_t*) word;
-            if (bytes[0]) E += PE[bytes[0]]; else ez++;
-            if (bytes[1]) E += PE[bytes[1]]; else ez++;
-            if (bytes[2]) E += PE[bytes[2]]; else ez++;
-            if (bytes[3]) E += PE[bytes[3]]; else ez++;
-            if (bytes[4]) E += PE[bytes[4]]; else ez++;
-            if (bytes[5]) E += PE[bytes[5]]; else ez++;
-            if (bytes[6]) E += PE[bytes[6]]; else ez++;
-            if (bytes[7]) E += PE[bytes[7]]; else ez++;
+            reghisto[registers[0]]++;
+            reghisto[registers[1]]++;
+            reghisto[registers[2]]++;
+            reghisto[registers[3]]++;
+            reghisto[registers[4]]++;
+            reghisto[registers[5]]++;
+            reghisto[registers[6]]++;
+            reghisto[registers[7]]++;
         }
-        word++;
+        registers += 8;
     }
-    E += ez; /* 2^(-reg[j]) is 1 when m is 0, add it 'ez' times for every
-                zero register in the HLL. */
-    *ezp = ez;
-    return E;
 }
 
 /* Return the approximated cardinality of the set based on the harmonic
@@ -972,6 +1007,7 @@ uint64_t hllCount(struct hllhdr *hdr, int *invalid) {
     double m = HLL_REGISTERS;
     double E, alpha = 0.7213/(1+1.079/m);
     int j, ez; /* Number of registers equal to 0. */
+    int reghisto[HLL_REGISTER_MAX+1] = {0};
 
     /* We precompute 2^(-reg[j]) in a small table in order to
      * speedup the computation of SUM(2^-register[0..i]). */
@@ -986,18 +1022,24 @@ uint64_t hllCount(struct hllhdr *hdr, int *invalid) {
         initialized = 1;
     }
 
-    /* Compute SUM(2^-register[0..i]). */
+    /* Compute the histogram of the registers values. */
     if (hdr->encoding == HLL_DENSE) {
-        E = hllDenseSum(hdr->registers,PE,&ez);
+        hllDenseRegHisto(hdr->registers,reghisto);
     } else if (hdr->encoding == HLL_SPARSE) {
-        E = hllSparseSum(hdr->registers,
-                         sdslen((sds)hdr)-HLL_HDR_SIZE,PE,&ez,invalid);
+        hllSparseRegHisto(hdr->registers,
+                         sdslen((sds)hdr)-HLL_HDR_SIZE,invalid,reghisto);
     } else if (hdr->encoding == HLL_RAW) {
-        E = hllRawSum(hdr->registers,PE,&ez);
+        hllRawRegHisto(hdr->registers,reghisto);
     } else {
         serverPanic("Unknown HyperLogLog encoding in hllCount()");
     }
 
+    /* Compute SUM(2^-register[0..i]) from the histogram: at most 64
+     * multiplications regardless of the representation used. */
+    ez = reghisto[0];
+    E = 0;
+    for (j = HLL_REGISTER_MAX; j >= 0; j--) E += reghisto[j]*PE[j];
+
     /* Apply loglog-beta to the raw estimate. See:
      * "LogLog-Beta and More: A New Algorithm for Cardinality Estimation
      * Based on LogLog Counting" Jason Qin, Denys Kim, Yumei Tung
@@ -1026,6 +1068,31 @@ int hllAdd(robj *o, unsigned char *ele, size_t elesize) {
     }
 }
 
+/* Return the byte-wise MAX of two 64 bit words holding eight raw registers
+ * each. Registers never exceed 63, so setting the MSB of every byte of 'a'
+ * makes sure the subtraction never borrows from the next byte, and the MSB
+ * of every resulting byte is set only if the byte in 'a' is >= the one
+ * in 'b'. The MSBs are then widened into a 0x00 / 0xff selection mask. */
+#define HLL_WORD_MSB 0x8080808080808080ULL
+static inline uint64_t hllMaxWord(uint64_t a, uint64_t b) {
+    uint64_t mask = ((((a | HLL_WORD_MSB) - b) & HLL_WORD_MSB) >> 7) * 0xff;
+    return (a & mask) | (b & ~mask);
+}
+
+/* Set max[i] = MAX(max[i],regs[i]) for the HLL_REGISTERS bytes of the two
+ * raw registers arrays, handling eight registers for every word. */
+void hllMergeRaw(uint8_t *max, uint8_t *regs) {
+    uint64_t a, b;
+    int j;
+
+    for (j = 0; j < HLL_REGISTERS; j += 8) {
+        memcpy(&a,max+j,sizeof(a));
+        memcpy(&b,regs+j,sizeof(b));
+        a = hllMaxWord(a,b);
+        memcpy(max+j,&a,sizeof(a));
+    }
+}
+
 /* Merge by computing MAX(registers[i],hll[i]) the HyperLogLog 'hll'
  * with an array of uint8_t HLL_REGISTERS registers pointed by 'max'.
  *
@@ -1039,12 +1106,10 @@ int hllMerge(uint8_t *max, robj *hll) {
     int i;
 
     if (hdr->encoding == HLL_DENSE) {
-        uint8_t val;
+        uint8_t val[HLL_REGISTERS];
 
-        for (i = 0; i < HLL_REGISTERS; i++) {
-            HLL_DENSE_GET_REGISTER(val,hdr->registers,i);
-            if (val > max[i]) max[i] = val;
-        }
+        hllDenseUnpack(val,hdr->registers);
+        hllMergeRaw(max,val);
     } else {
         uint8_t *p = hll->ptr, *end = p + sdslen(hll->ptr);
         long runlen, regval;
@@ -1144,6 +1209,14 @@ invalid:
     return C_ERR;
 }
 
+/* HyperLogLogs are accessed in place: if the value at 'key' is a compressed
+ * or chunked string, store it as a raw string before checking if it is a
+ * valid HLL. */
+static robj *hllFlatten(client *c, robj *key, robj *o) {
+    if (o->type != OBJ_STRING) return o;
+    return dbFlattenStringValue(c->db,key,o);
+}
+
 /* PFADD var ele ele ele ... ele => :0 or :1 */
 void pfaddCommand(client *c) {
     robj *o = lookupKeyWrite(c->db,c->argv[1]);
@@ -1158,6 +1231,7 @@ void pfaddCommand(client *c) {
         dbAdd(c->db,c->argv[1],o);
         updated++;
     } else {
+        o = hllFlatten(c,c->argv[1],o);
         if (isHLLObjectOrReply(c,o) != C_OK) return;
         o = dbUnshareStringValue(c->db,c->argv[1],o);
     }
@@ -1184,6 +1258,22 @@ void pfaddCommand(client *c) {
     addReply(c, updated ? shared.cone : shared.czero);
 }
 
+/* Return the cardinality cached in the HLL header. The caller should make
+ * sure the cached value is valid with HLL_VALID_CACHE(). */
+static uint64_t hllGetCachedCard(struct hllhdr *hdr) {
+    uint64_t card;
+
+    card = (uint64_t)hdr->card[0];
+    card |= (uint64_t)hdr->card[1] << 8;
+    card |= (uint64_t)hdr->card[2] << 16;
+    card |= (uint64_t)hdr->card[3] << 24;
+    card |= (uint64_t)hdr->card[4] << 32;
+    card |= (uint64_t)hdr->card[5] << 40;
+    card |= (uint64_t)hdr->card[6] << 48;
+    card |= (uint64_t)hdr->card[7] << 56;
+    return card;
+}
+
 /* PFCOUNT var -> approximated cardinality of set. */
 void pfcountCommand(client *c) {
     robj *o;
@@ -1196,26 +1286,65 @@ void pfcountCommand(client *c) {
      * the cardinality of the merge of the N HLLs specified. */
     if (c->argc > 2) {
         uint8_t max[HLL_HDR_SIZE+HLL_REGISTERS], *registers;
-        int j;
+        robj **hlls = zmalloc(sizeof(robj*)*(c->argc-1));
+        int j, numhlls = 0, invalid = 0;
+
+        /* Collect and validate the HLLs, skipping non existing keys that
+         * we assume to be empty HLLs, and keys specified multiple times
+         * that would not change the union. */
+        for (j = 1; j < c->argc; j++) {
+            robj *o = lookupKeyRead(c->db,c->argv[j]);
+            int k;
+
+            if (o == NULL) continue;
+            o = hllFlatten(c,c->argv[j],o);
+            if (isHLLObjectOrReply(c,o) != C_OK) {
+                zfree(hlls);
+                return;
+            }
+            for (k = 0; k < numhlls; k++) if (hlls[k] == o) break;
+            if (k == numhlls) hlls[numhlls++] = o;
+        }
+
+        /* With a single source the union is the source itself: no need to
+         * merge anything, and we can use the cached cardinality if it is
+         * still valid. The cache is not updated here, since the multi key
+         * form never modifies the keys. */
+        if (numhlls <= 1) {
+            if (numhlls == 0) {
+                card = 0;
+            } else {
+                hdr = hlls[0]->ptr;
+                if (HLL_VALID_CACHE(hdr)) {
+                    card = hllGetCachedCard(hdr);
+                } else {
+                    card = hllCount(hdr,&invalid);
+                }
+            }
+            zfree(hlls);
+            if (invalid) {
+                addReplySds(c,sdsnew(invalid_hll_err));
+                return;
+            }
+            addReplyLongLong(c,card);
+            return;
+        }
 
         /* Compute an HLL with M[i] = MAX(M[i]_j). */
         memset(max,0,sizeof(max));
         hdr = (struct hllhdr*) max;
         hdr->encoding = HLL_RAW; /* Special internal-only encoding. */
         registers = max + HLL_HDR_SIZE;
-        for (j = 1; j < c->argc; j++) {
-            /* Check type and size. */
-            robj *o = lookupKeyRead(c->db,c->argv[j]);
-            if (o == NULL) continue; /* Assume empty HLL for non existing var.*/
-            if (isHLLObjectOrReply(c,o) != C_OK) return;
-
+        for (j = 0; j < numhlls; j++) {
             /* Merge with this HLL with our 'max' HHL by setting max[i]
              * to MAX(max[i],hll[i]). */
-            if (hllMerge(registers,o) == C_ERR) {
+            if (hllMerge(registers,hlls[j]) == C_ERR) {
+                zfree(hlls);
                 addReplySds(c,sdsnew(invalid_hll_err));
                 return;
             }
         }
+        zfree(hlls);
 
         /* Compute cardinality of the resulting set. */
         addReplyLongLong(c,hllCount(hdr,NULL));
@@ -1232,6 +1361,7 @@ void pfcountCommand(client *c) {
          * we would have a key as HLLADD creates it as a side effect. */
         addReply(c,shared.czero);
     } else {
+        o = hllFlatten(c,c->argv[1],o);
         if (isHLLObjectOrReply(c,o) != C_OK) return;
         o = dbUnshareStringValue(c->db,c->argv[1],o);
 
@@ -1239,14 +1369,7 @@ void pfcountCommand(client *c) {
         hdr = o->ptr;
         if (HLL_VALID_CACHE(hdr)) {
             /* Just return the cached value. */
-            card = (uint64_t)hdr->card[0];
-            card |= (uint64_t)hdr->card[1] << 8;
-            card |= (uint64_t)hdr->card[2] << 16;
-            card |= (uint64_t)hdr->card[3] << 24;
-            card |= (uint64_t)hdr->card[4] << 32;
-            card |= (uint64_t)hdr->card[5] << 40;
-            card |= (uint64_t)hdr->card[6] << 48;
-            card |= (uint64_t)hdr->card[7] << 56;
+            card = hllGetCachedCard(hdr);
         } else {
             int invalid = 0;
             /* Recompute it and update the cached value. */
@@ -1288,6 +1411,7 @@ void pfmergeCommand(client *c) {
         /* Check type and size. */
         robj *o = lookupKeyRead(c->db,c->argv[j]);
         if (o == NULL) continue; /* Assume empty HLL for non existing var. */
+        o = hllFlatten(c,c->argv[j],o);
         if (isHLLObjectOrReply(c,o) != C_OK) return;
 
         /* Merge with this HLL with our 'max' HHL by setting max[i]
@@ -1322,9 +1446,7 @@ void pfmergeCommand(client *c) {
     /* Write the resulting HLL to the destination HLL registers and
      * invalidate the cached value. */
     hdr = o->ptr;
-    for (j = 0; j < HLL_REGISTERS; j++) {
-        HLL_DENSE_SET_REGISTER(hdr->registers,j,max[j]);
-    }
+    hllDensePack(hdr->registers,max);
     HLL_INVALIDATE_CACHE(hdr);
 
     signalModifiedKey(c->db,c->argv[1]);
@@ -1347,6 +1469,8 @@ void pfselftestCommand(client *c) {
     struct hllhdr *hdr = (struct hllhdr*) bitcounters, *hdr2;
     robj *o = NULL;
     uint8_t bytecounters[HLL_REGISTERS];
+    uint8_t unpacked[HLL_REGISTERS], merged[HLL_REGISTERS];
+    uint8_t packed[HLL_DENSE_SIZE];
 
     /* Test 1: access registers.
      * The test is conceived to test that the different counters of our data
@@ -1373,6 +1497,34 @@ void pfselftestCommand(client *c) {
                 goto cleanup;
             }
         }
+
+        /* Check that the bulk unpack / pack / merge primitives agree with
+         * the register access macros. */
+        hllDenseUnpack(unpacked,hdr->registers);
+        if (memcmp(unpacked,bytecounters,HLL_REGISTERS) != 0) {
+            addReplyError(c,"TESTFAILED dense unpack mismatch");
+            goto cleanup;
+        }
+        memset(packed,0,HLL_DENSE_SIZE);
+        hllDensePack(packed,unpacked);
+        if (memcmp(packed,hdr->registers,HLL_DENSE_SIZE-HLL_HDR_SIZE) != 0) {
+            addReplyError(c,"TESTFAILED dense pack mismatch");
+            goto cleanup;
+        }
+        for (i = 0; i < HLL_REGISTERS; i++)
+            unpacked[i] = rand() & HLL_REGISTER_MAX;
+        memcpy(merged,bytecounters,HLL_REGISTERS);
+        hllMergeRaw(merged,unpacked);
+        for (i = 0; i < HLL_REGISTERS; i++) {
+            uint8_t expected = bytecounters[i] > unpacked[i] ?
+                               bytecounters[i] : unpacked[i];
+            if (merged[i] != expected) {
+                addReplyErrorFormat(c,
+                    "TESTFAILED Merged register %d should be %d but is %d",
+                    i, (int) expected, (int) merged[i]);
+                goto cleanup;
+            }
+        }
     }
 
     /* Test 2: approximation error.
@@ -1456,6 +1608,7 @@ void pfdebugCommand(client *c) {
         addReplyError(c,"The specified key does not exist");
         return;
     }
+    o = hllFlatten(c,c->argv[2],o);
     if (isHLLObjectOrReply(c,o) != C_OK) return;
     o = dbUnshareStringValue(c->db,c->argv[2],o);
     hdr = o->ptr;
@@ -106,6 +106,26 @@ intset *intsetNew(void) {
     return is;
 }
 
+/* Create an intset holding the "len" values of the array, that must be
+ * sorted in ascending order without duplicates. The encoding only depends
+ * on the smallest and the largest value, so the intset is allocated once. */
+intset *intsetNewFromSorted(const int64_t *values, uint32_t len) {
+    intset *is = intsetNew();
+    uint8_t enc = INTSET_ENC_INT16;
+    uint32_t j;
+
+    if (len) {
+        uint8_t minenc = _intsetValueEncoding(values[0]);
+        uint8_t maxenc = _intsetValueEncoding(values[len-1]);
+        enc = minenc > maxenc ? minenc : maxenc;
+    }
+    is->encoding = intrev32ifbe(enc);
+    is = zrealloc(is,sizeof(intset)+(size_t)len*enc);
+    for (j = 0; j < len; j++) _intsetSet(is,j,values[j]);
+    is->length = intrev32ifbe(len);
+    return is;
+}
+
 /* Resize the intset */
 static intset *intsetResize(intset *is, uint32_t len) {
     uint32_t size = len*intrev32ifbe(is->encoding);
@@ -261,6 +281,36 @@ uint8_t intsetFind(intset *is, int64_t value) {
     return valenc <= intrev32ifbe(is->encoding) && intsetSearch(is,value,NULL);
 }
 
+/* Like intsetSearch(), but the search starts at position "*pos", and all
+ * the elements before it must be smaller than "value". The range holding
+ * the value is found galloping forward (the probe distance doubles at every
+ * step), then a binary search is performed inside the range. The cost is
+ * logarithmic in the distance from the starting position, so looking up an
+ * ascending sequence of values, as it happens when intersecting intsets,
+ * costs about as much as a merge when the sets have similar sizes and about
+ * as much as a binary search per value when one of them is much smaller.
+ * "*pos" is set to the position of the first element >= "value". Return 1
+ * when the value is found, 0 otherwise. */
+uint8_t intsetSearchFrom(intset *is, int64_t value, uint32_t *pos) {
+    uint32_t len = intrev32ifbe(is->length);
+    uint32_t lo = *pos, hi = *pos, step = 1, mid;
+
+    while (hi < len && _intsetGet(is,hi) < value) {
+        lo = hi+1;
+        hi = (len-lo > step) ? lo+step : len;
+        if (step < UINT32_MAX/2) step <<= 1;
+    }
+    while (lo < hi) {
+        mid = lo+(hi-lo)/2;
+        if (_intsetGet(is,mid) < value)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    *pos = lo;
+    return lo < len && _intsetGet(is,lo) == value;
+}
+
 /* Return random member */
 int64_t intsetRandom(intset *is) {
     return _intsetGet(is,rand()%intrev32ifbe(is->length));
@@ -476,6 +526,42 @@ int intsetTest(int argc, char **argv) {
                num,size,usec()-start);
     }
 
+    printf("Search from position: "); {
+        uint32_t pos = 0, j;
+        int64_t v;
+        is = createSet(20,5000);
+        for (j = 0; j < intsetLen(is); j += rand() % 100 + 1) {
+            intsetGet(is,j,&v);
+            assert(intsetSearchFrom(is,v,&pos));
+            assert(pos == j);
+            intsetSearchFrom(is,v+1,&pos);
+            assert(pos == j+1);
+        }
+        pos = 0;
+        assert(!intsetSearchFrom(is,(1<<20)+1,&pos));
+        assert(pos == intsetLen(is));
+        ok();
+    }
+
+    printf("Create from sorted array: "); {
+        int64_t values[] = {-70000, -3, 0, 5, 40000, 4294967296LL};
+        uint32_t j;
+        int64_t v;
+        is = intsetNewFromSorted(values,4);
+        assert(intrev32ifbe(is->encoding) == INTSET_ENC_INT32);
+        is = intsetNewFromSorted(values+1,3);
+        assert(intrev32ifbe(is->encoding) == INTSET_ENC_INT16);
+        is = intsetNewFromSorted(values,6);
+        assert(intrev32ifbe(is->encoding) == INTSET_ENC_INT64);
+        assert(intsetLen(is) == 6);
+        for (j = 0; j < 6; j++) {
+            assert(intsetGet(is,j,&v) && v == values[j]);
+            assert(intsetFind(is,values[j]));
+        }
+        checkConsistency(is);
+        ok();
+    }
+
     printf("Stress add+delete: "); {
         int i, v1, v2;
         is = intsetNew();
@@ -45,6 +45,13 @@ typedef struct intset {
  * @return
  */
 intset *intsetNew(void);
+/**
+ * 根据已升序排列且无重复的整数数组创建整型集合，编码由最小值和最大值决定，只分配一次内存
+ * @param values 有序整数数组
+ * @param len 数组长度
+ * @return
+ */
+intset *intsetNewFromSorted(const int64_t *values, uint32_t len);
 /**
  * 插入一个整数到有序整型集合中 ，使用二分查找，找到值对应的位置,必要情况会升级（所有元素由16位升到32位）
  * @param is 整型集合
@@ -68,6 +75,14 @@ intset *intsetRemove(intset *is, int64_t value, int *success);
  * @return
  */
 uint8_t intsetFind(intset *is, int64_t value);
+/**
+ * 从指定位置开始查找整数，先倍增步长确定范围再二分查找，用于按升序依次查找多个值（例如求交集）
+ * @param is 整型集合
+ * @param value 查找的值
+ * @param pos 查找的起始位置，之前的元素都必须小于 value；返回时设置为第一个 >= value 的元素的位置
+ * @return 找到返回1，否则返回0
+ */
+uint8_t intsetSearchFrom(intset *is, int64_t value, uint32_t *pos);
 /**
  * 返回集合中一个随机元素
  * @param is
@@ -4,7 +4,15 @@
 #include "cluster.h"
 
 static size_t lazyfree_objects = 0;
+static size_t lazyfreed_objects = 0;
 pthread_mutex_t lazyfree_objects_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t lazyfreed_objects_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Values shared with the keyspace in use found by the lazyfree thread while
+ * releasing a keyspace, see lazyfreeDbValDestructor(): a list of raxes
+ * mapping every value pointer to the number of references to drop. */
+static list *lazyfree_shared_values = NULL;
+pthread_mutex_t lazyfree_shared_values_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* Return the number of currently pending objects to free. */
 size_t lazyfreeGetPendingObjectsCount(void) {
@@ -13,6 +21,18 @@ size_t lazyfreeGetPendingObjectsCount(void) {
     return aux;
 }
 
+/* Return the number of objects freed in background since the last
+ * CONFIG RESETSTAT. */
+size_t lazyfreeGetFreedObjectsCount(void) {
+    size_t aux;
+    atomicGet(lazyfreed_objects,aux);
+    return aux;
+}
+
+void lazyfreeResetStats(void) {
+    atomicSet(lazyfreed_objects,0);
+}
+
 /* Return the amount of work needed in order to free an object.
  * The return value is not always the actual number of allocations the
  * object is compoesd of, but a number proportional to it.
@@ -29,7 +49,9 @@ size_t lazyfreeGetPendingObjectsCount(void) {
  * For lists the funciton returns the number of elements in the quicklist
  * representing the list. */
 size_t lazyfreeGetFreeEffort(robj *obj) {
-    if (obj->type == OBJ_LIST) {
+    if (obj->encoding == OBJ_ENCODING_TIERED) {
+        return 1;
+    } else if (obj->type == OBJ_LIST) {
         quicklist *ql = obj->ptr;
         return ql->len;
     } else if (obj->type == OBJ_SET && obj->encoding == OBJ_ENCODING_HT) {
@@ -38,9 +60,15 @@ size_t lazyfreeGetFreeEffort(robj *obj) {
     } else if (obj->type == OBJ_ZSET && obj->encoding == OBJ_ENCODING_SKIPLIST){
         zset *zs = obj->ptr;
         return zs->zsl->length;
+    } else if (obj->type == OBJ_ZSET && obj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = obj->ptr;
+        return zs->zbt->length;
     } else if (obj->type == OBJ_HASH && obj->encoding == OBJ_ENCODING_HT) {
         dict *ht = obj->ptr;
         return dictSize(ht);
+    } else if (obj->type == OBJ_STRING && obj->encoding == OBJ_ENCODING_CHUNKED){
+        chunkedString *cs = obj->ptr;
+        return cs->count;
     } else {
         return 1; /* Everything else is a single allocation. */
     }
@@ -52,9 +80,11 @@ size_t lazyfreeGetFreeEffort(robj *obj) {
  * will be reclaimed in a different bio.c thread. */
 #define LAZYFREE_THRESHOLD 64
 int dbAsyncDelete(redisDb *db, robj *key) {
+    if (server.maxmemory_mrc) mrcKeyDelete(db,key);
+
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
-    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+    if (dictSize(db->expires) > 0) dbDeleteExpire(db,key->ptr);
 
     /* If the value is composed of a few allocations, to free in a lazy way
      * is actually just slower... So under a certain limit we just free
@@ -64,9 +94,13 @@ int dbAsyncDelete(redisDb *db, robj *key) {
         robj *val = dictGetVal(de);
         size_t free_effort = lazyfreeGetFreeEffort(val);
 
+        if (dbMemoryAccounting()) dbMemoryUnlink(db,key,val);
+
         /* If releasing the object is too much work, let's put it into the
-         * lazy free list. */
-        if (free_effort > LAZYFREE_THRESHOLD) {
+         * lazy free list. Objects still referenced elsewhere, like the value
+         * moved by RENAME, are just unreferenced here: the bio thread can't
+         * touch their reference count concurrently with the main thread. */
+        if (free_effort > LAZYFREE_THRESHOLD && val->refcount == 1) {
             atomicIncr(lazyfree_objects,1);
             bioCreateBackgroundJob(BIO_LAZY_FREE,val,NULL,NULL);
             dictSetVal(db->dict,de,NULL);
@@ -84,15 +118,45 @@ int dbAsyncDelete(redisDb *db, robj *key) {
     }
 }
 
+/* Release a value that was just removed from the keyspace, like the old
+ * value of a key overwritten by SET or SORT STORE. Like in dbAsyncDelete()
+ * only values composed of many allocations are freed in background, and
+ * only if nobody else is referencing them. */
+void freeObjAsync(robj *o) {
+    size_t free_effort = lazyfreeGetFreeEffort(o);
+    if (free_effort > LAZYFREE_THRESHOLD && o->refcount == 1) {
+        atomicIncr(lazyfree_objects,1);
+        bioCreateBackgroundJob(BIO_LAZY_FREE,o,NULL,NULL);
+    } else {
+        decrRefCount(o);
+    }
+}
+
 /* Empty a Redis DB asynchronously. What the function does actually is to
  * create a new empty set of hash tables and scheduling the old ones for
  * lazy freeing. */
 void emptyDbAsync(redisDb *db) {
-    dict *oldht1 = db->dict, *oldht2 = db->expires;
+    redisDb old = *db;
     db->dict = dictCreate(&dbDictType,NULL);
     db->expires = dictCreate(&keyptrDictType,NULL);
-    atomicIncr(lazyfree_objects,dictSize(oldht1));
-    bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,oldht1,oldht2);
+    if (db->expires_index) db->expires_index = raxNew();
+    freeDbKeyspaceAsync(&old);
+}
+
+/* Release the keys, the expires and the expires index of a DB that is no
+ * longer reachable, like the old dataset replaced by slave-async-load, in
+ * the lazyfree thread. The DB fields are left dangling. */
+void freeDbKeyspaceAsync(redisDb *db) {
+    /* Values like interned strings may still be referenced by the keyspace
+     * in use: let the lazyfree thread set them apart. */
+    db->dict->type = &lazyfreeDbDictType;
+    db->dict->privdata = raxNew();
+    atomicIncr(lazyfree_objects,dictSize(db->dict));
+    bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,db->dict,db->expires);
+    if (db->expires_index) {
+        atomicIncr(lazyfree_objects,db->expires_index->numele);
+        bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,NULL,db->expires_index);
+    }
 }
 
 /* Empty the slots-keys map of Redis CLuster by creating a new empty one
@@ -111,9 +175,33 @@ void slotToKeyFlushAsync(void) {
  * updating the count of objects to release. */
 void lazyfreeFreeObjectFromBioThread(robj *o) {
     decrRefCount(o);
+    atomicIncr(lazyfreed_objects,1);
     atomicDecr(lazyfree_objects,1);
 }
 
+/* Value destructor of the keyspaces released by the lazyfree thread. The
+ * main thread keeps updating the reference count of the values also
+ * referenced by the keyspace in use, like the interned strings shared with
+ * the keys of other DBs or with the intern pool: so the references to these
+ * values are only counted in the rax 'privdata', and dropped later by the
+ * main thread in lazyfreeReleaseSharedValues(). A value with a count of one
+ * is only referenced by the keyspace being released, so the main thread
+ * can't reach it, and its count can't change while we read it. */
+void lazyfreeDbValDestructor(void *privdata, void *val) {
+    rax *shared = privdata;
+    robj *o = val;
+    uintptr_t refs;
+
+    if (o == NULL) return;
+    if (o->refcount == 1) {
+        decrRefCount(o);
+    } else if (o->refcount != OBJ_SHARED_REFCOUNT) {
+        refs = (uintptr_t)raxFind(shared,(unsigned char*)&o,sizeof(o));
+        if ((void*)refs == raxNotFound) refs = 0;
+        raxInsert(shared,(unsigned char*)&o,sizeof(o),(void*)(refs+1),NULL);
+    }
+}
+
 /* Release a database from the lazyfree thread. The 'db' pointer is the
  * database which was substitutied with a fresh one in the main thread
  * when the database was logically deleted. 'sl' is a skiplist used by
@@ -121,8 +209,20 @@ void lazyfreeFreeObjectFromBioThread(robj *o) {
  * may be NULL if Redis Cluster is disabled. */
 void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2) {
     size_t numkeys = dictSize(ht1);
+    rax *shared = ht1->privdata;
+
     dictRelease(ht1);
     dictRelease(ht2);
+    if (shared->numele) {
+        pthread_mutex_lock(&lazyfree_shared_values_mutex);
+        if (lazyfree_shared_values == NULL)
+            lazyfree_shared_values = listCreate();
+        listAddNodeTail(lazyfree_shared_values,shared);
+        pthread_mutex_unlock(&lazyfree_shared_values_mutex);
+    } else {
+        raxFree(shared);
+    }
+    atomicIncr(lazyfreed_objects,numkeys);
     atomicDecr(lazyfree_objects,numkeys);
 }
 
@@ -131,5 +231,38 @@ void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2) {
 void lazyfreeFreeSlotsMapFromBioThread(rax *rt) {
     size_t len = rt->numele;
     raxFree(rt);
+    atomicIncr(lazyfreed_objects,len);
     atomicDecr(lazyfree_objects,len);
 }
+
+/* Called by databasesCron(): drop the references to the shared values found
+ * by the lazyfree thread while releasing keyspaces. */
+void lazyfreeReleaseSharedValues(void) {
+    list *values;
+    listNode *ln;
+    raxIterator ri;
+
+    pthread_mutex_lock(&lazyfree_shared_values_mutex);
+    values = lazyfree_shared_values;
+    lazyfree_shared_values = NULL;
+    pthread_mutex_unlock(&lazyfree_shared_values_mutex);
+    if (values == NULL) return;
+
+    while ((ln = listFirst(values)) != NULL) {
+        rax *shared = listNodeValue(ln);
+
+        raxStart(&ri,shared);
+        raxSeek(&ri,"^",NULL,0);
+        while (raxNext(&ri)) {
+            uintptr_t refs = (uintptr_t)ri.data;
+            robj *o;
+
+            memcpy(&o,ri.key,sizeof(o));
+            while (refs--) decrRefCount(o);
+        }
+        raxStop(&ri);
+        raxFree(shared);
+        listDelNode(values,ln);
+    }
+    listRelease(values);
+}
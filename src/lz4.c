@@ -0,0 +1,248 @@
+/* Minimal implementation of the LZ4 block format, see lz4.h.
+ *
+ * A compressed block is a sequence of sequences, each one composed of:
+ *
+ * token: 1 byte, the high 4 bits are the literals length, the low 4 bits
+ *        are the match length minus LZ4_MIN_MATCH. A value of 15 means that
+ *        more length bytes follow (see below).
+ * [literals length bytes]: added to the length while they are 255.
+ * literals: the bytes to copy verbatim.
+ * offset: 2 bytes little endian, the distance of the match back in the
+ *         output.
+ * [match length bytes]: like the literals length bytes.
+ *
+ * The last sequence only has literals and ends the block. The format also
+ * requires the last LZ4_LAST_LITERALS bytes to be literals, and the last
+ * match to start at least LZ4_MFLIMIT bytes before the end of the input.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "lz4.h"
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MFLIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_LOG 11
+#define LZ4_SKIP_TRIGGER 6 /* Search faster in incompressible data. */
+
+static inline uint32_t lz4Read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v,p,sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz4Hash(uint32_t seq) {
+    return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Write a length in the 255 bytes continuation format used for lengths
+ * not fitting the token nibble. */
+static inline unsigned char *lz4WriteLength(unsigned char *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+unsigned int lz4_compress(const void *const in_data, unsigned int in_len,
+                          void *out_data, unsigned int out_len)
+{
+    const unsigned char *in = in_data;
+    const unsigned char *ip = in, *anchor = in, *iend = in + in_len;
+    unsigned char *op = out_data, *oend = op + out_len, *token;
+    uint32_t table[1 << LZ4_HASH_LOG];
+    size_t litlen, mlen;
+
+    if (in_len > LZ4_MFLIMIT) {
+        const unsigned char *mflimit = iend - LZ4_MFLIMIT;
+        const unsigned char *matchlimit = iend - LZ4_LAST_LITERALS;
+
+        memset(table,0,sizeof(table));
+        ip++;
+        while (ip < mflimit) {
+            uint32_t seq = lz4Read32(ip), h = lz4Hash(seq);
+            const unsigned char *ref = in + table[h];
+
+            table[h] = ip - in;
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET ||
+                lz4Read32(ref) != seq)
+            {
+                ip += 1 + ((ip - anchor) >> LZ4_SKIP_TRIGGER);
+                continue;
+            }
+
+            /* Extend the match backward and forward. */
+            while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const unsigned char *mp = ip + LZ4_MIN_MATCH;
+            const unsigned char *rp = ref + LZ4_MIN_MATCH;
+            while (mp < matchlimit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            litlen = ip - anchor;
+            mlen = mp - ip - LZ4_MIN_MATCH;
+            if ((size_t)(oend - op) < 1 + litlen + litlen/255 + 1 + 2 +
+                                      mlen/255 + 1)
+                return 0;
+
+            token = op++;
+            if (litlen >= 15) {
+                *token = 15 << 4;
+                op = lz4WriteLength(op,litlen-15);
+            } else {
+                *token = litlen << 4;
+            }
+            memcpy(op,anchor,litlen);
+            op += litlen;
+            *op++ = (ip - ref) & 0xff;
+            *op++ = (ip - ref) >> 8;
+            if (mlen >= 15) {
+                *token |= 15;
+                op = lz4WriteLength(op,mlen-15);
+            } else {
+                *token |= mlen;
+            }
+
+            ip = anchor = mp;
+            /* Hash the position just before the end of the match, so that
+             * repeated patterns are found again immediately. */
+            if (ip < mflimit)
+                table[lz4Hash(lz4Read32(ip-2))] = ip - 2 - in;
+        }
+    }
+
+    /* Last literals. */
+    litlen = iend - anchor;
+    if ((size_t)(oend - op) < 1 + litlen + litlen/255 + 1) return 0;
+    if (litlen >= 15) {
+        *op++ = 15 << 4;
+        op = lz4WriteLength(op,litlen-15);
+    } else {
+        *op++ = litlen << 4;
+    }
+    memcpy(op,anchor,litlen);
+    op += litlen;
+    return op - (unsigned char *)out_data;
+}
+
+unsigned int lz4_decompress(const void *const in_data, unsigned int in_len,
+                            void *out_data, unsigned int out_len)
+{
+    const unsigned char *ip = in_data, *iend = ip + in_len;
+    unsigned char *out = out_data, *op = out, *oend = out + out_len;
+    size_t len, offset;
+    unsigned char b;
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+
+        /* Literals. */
+        len = token >> 4;
+        if (len == 15) {
+            do {
+                if (ip >= iend) return 0;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (size_t)(iend - ip) || len > (size_t)(oend - op)) return 0;
+        if (len <= 16 && iend - ip >= 16 && oend - op >= 16) {
+            /* Fast path for short literals: copy a fixed size block, the
+             * excess is overwritten by the next sequence. */
+            memcpy(op,ip,16);
+        } else {
+            memcpy(op,ip,len);
+        }
+        op += len;
+        ip += len;
+        if (ip == iend) break; /* The last sequence has no match. */
+
+        /* Match. */
+        if (iend - ip < 2) return 0;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out)) return 0;
+        len = token & 15;
+        if (len == 15) {
+            do {
+                if (ip >= iend) return 0;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > (size_t)(oend - op)) return 0;
+
+        const unsigned char *ref = op - offset;
+        if (offset >= 8 && (size_t)(oend - op) >= len + 8) {
+            /* Copy in 8 bytes blocks, writing at most 7 bytes in excess.
+             * Blocks never overlap since offset >= 8. */
+            unsigned char *cpy = op + len;
+            do {
+                memcpy(op,ref,8);
+                op += 8;
+                ref += 8;
+            } while (op < cpy);
+            op = cpy;
+        } else if (offset >= len) {
+            memcpy(op,ref,len);
+            op += len;
+        } else {
+            /* Overlapping match: the pattern repeats itself. */
+            while (len--) *op++ = *ref++;
+        }
+    }
+    return op - out;
+}
+
+#ifdef REDIS_TEST
+#include <stdio.h>
+#include <stdlib.h>
+
+#define UNUSED(x) (void)(x)
+int lz4Test(int argc, char *argv[]) {
+    UNUSED(argc);
+    UNUSED(argv);
+    static unsigned char in[65536], comp[65536+65536/255+16], out[65536];
+    unsigned int j, len, clen, dlen, errors = 0;
+
+    for (j = 0; j < 2000; j++) {
+        unsigned int k, alphabet = 1 + rand() % 256;
+        len = rand() % sizeof(in);
+        /* Mix runs, repeated chunks and noise with a variable alphabet. */
+        for (k = 0; k < len; k++) {
+            switch (rand() % 3) {
+            case 0: in[k] = rand() % alphabet; break;
+            case 1: in[k] = k ? in[k-1] : 0; break;
+            default: in[k] = k >= 100 ? in[k-100] : (unsigned char)k; break;
+            }
+        }
+        clen = lz4_compress(in,len,comp,sizeof(comp));
+        if (clen == 0) {
+            printf("lz4: compression failed for len %u\n", len);
+            errors++;
+            continue;
+        }
+        dlen = lz4_decompress(comp,clen,out,len);
+        if (dlen != len || memcmp(in,out,len) != 0) {
+            printf("lz4: round trip mismatch for len %u\n", len);
+            errors++;
+        }
+        /* A truncated output buffer must be detected. */
+        if (len > 0 && lz4_decompress(comp,clen,out,len-1) != 0) {
+            printf("lz4: undetected short output buffer for len %u\n", len);
+            errors++;
+        }
+    }
+    printf("lz4: %s\n", errors ? "FAILED" : "ok");
+    return errors ? 1 : 0;
+}
+#endif
@@ -0,0 +1,32 @@
+/* Minimal implementation of the LZ4 block format.
+ *
+ * Only the raw block format is implemented (no frames, no checksums): this
+ * is used to compress quicklist nodes, where the uncompressed length is
+ * stored by the caller, exactly like we do with LZF. Compared to LZF the
+ * LZ4 format is a bit faster to compress and much faster to decompress,
+ * since literals and matches are copied in long runs.
+ *
+ * The API mimics the LZF one:
+ *
+ * lz4_compress() compresses 'in_len' bytes at 'in_data' into 'out_data',
+ * writing at most 'out_len' bytes. It returns the compressed length, or 0
+ * if the output buffer is not large enough.
+ *
+ * lz4_decompress() decompresses 'in_len' bytes at 'in_data' into 'out_data',
+ * writing at most 'out_len' bytes. It returns the decompressed length, or 0
+ * if the input is corrupted or the output buffer is not large enough.
+ */
+
+#ifndef __LZ4_H
+#define __LZ4_H
+
+unsigned int lz4_compress(const void *const in_data, unsigned int in_len,
+                          void *out_data, unsigned int out_len);
+unsigned int lz4_decompress(const void *const in_data, unsigned int in_len,
+                            void *out_data, unsigned int out_len);
+
+#ifdef REDIS_TEST
+int lz4Test(int argc, char *argv[]);
+#endif
+
+#endif
@@ -144,6 +144,7 @@ struct RedisModuleKey {
     uint32_t zstart;        /* Start pos for positional ranges. */
     uint32_t zend;          /* End pos for positional ranges. */
     void *zcurrent;         /* Zset iterator current node. */
+    zbtreeCursor zcursor;   /* B+tree position, zcurrent points here. */
     int zer;                /* Zset iterator end reached flag
                                (true if end was reached). */
 };
@@ -1744,6 +1745,12 @@ int zsetInitScoreRange(RedisModuleKey *key, double min, double max, int minex, i
         zskiplist *zsl = zs->zsl;
         key->zcurrent = first ? zslFirstInRange(zsl,zrs) :
                                 zslLastInRange(zsl,zrs);
+    } else if (key->value->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = key->value->ptr;
+        unsigned long rank;
+        rank = first ? zbtFirstInRange(zs->zbt,zrs,&key->zcursor) :
+                       zbtLastInRange(zs->zbt,zrs,&key->zcursor);
+        key->zcurrent = rank ? &key->zcursor : NULL;
     } else {
         serverPanic("Unsupported zset encoding");
     }
@@ -1808,6 +1815,12 @@ int zsetInitLexRange(RedisModuleKey *key, RedisModuleString *min, RedisModuleStr
         zskiplist *zsl = zs->zsl;
         key->zcurrent = first ? zslFirstInLexRange(zsl,zlrs) :
                                 zslLastInLexRange(zsl,zlrs);
+    } else if (key->value->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = key->value->ptr;
+        unsigned long rank;
+        rank = first ? zbtFirstInLexRange(zs->zbt,zlrs,&key->zcursor) :
+                       zbtLastInLexRange(zs->zbt,zlrs,&key->zcursor);
+        key->zcurrent = rank ? &key->zcursor : NULL;
     } else {
         serverPanic("Unsupported zset encoding");
     }
@@ -1858,6 +1871,10 @@ RedisModuleString *RM_ZsetRangeCurrentElement(RedisModuleKey *key, double *score
         zskiplistNode *ln = key->zcurrent;
         if (score) *score = ln->score;
         str = createStringObject(ln->ele,sdslen(ln->ele));
+    } else if (key->value->encoding == OBJ_ENCODING_BTREE) {
+        zbtreeEntry *e = zbtCursorEntry(&key->zcursor);
+        if (score) *score = e->score;
+        str = createStringObject(e->ele,sdslen(e->ele));
     } else {
         serverPanic("Unsupported zset encoding");
     }
@@ -1923,6 +1940,28 @@ int RM_ZsetRangeNext(RedisModuleKey *key) {
             key->zcurrent = next;
             return 1;
         }
+    } else if (key->value->encoding == OBJ_ENCODING_BTREE) {
+        zbtreeCursor next = key->zcursor;
+        if (!zbtNext(&next)) {
+            key->zer = 1;
+            return 0;
+        } else {
+            /* Are we still within the range? */
+            zbtreeEntry *e = zbtCursorEntry(&next);
+            if (key->ztype == REDISMODULE_ZSET_RANGE_SCORE &&
+                !zslValueLteMax(e->score,&key->zrs))
+            {
+                key->zer = 1;
+                return 0;
+            } else if (key->ztype == REDISMODULE_ZSET_RANGE_LEX) {
+                if (!zslLexValueLteMax(e->ele,&key->zlrs)) {
+                    key->zer = 1;
+                    return 0;
+                }
+            }
+            key->zcursor = next;
+            return 1;
+        }
     } else {
         serverPanic("Unsupported zset encoding");
     }
@@ -1986,6 +2025,28 @@ int RM_ZsetRangePrev(RedisModuleKey *key) {
             key->zcurrent = prev;
             return 1;
         }
+    } else if (key->value->encoding == OBJ_ENCODING_BTREE) {
+        zbtreeCursor prev = key->zcursor;
+        if (!zbtPrev(&prev)) {
+            key->zer = 1;
+            return 0;
+        } else {
+            /* Are we still within the range? */
+            zbtreeEntry *e = zbtCursorEntry(&prev);
+            if (key->ztype == REDISMODULE_ZSET_RANGE_SCORE &&
+                !zslValueGteMin(e->score,&key->zrs))
+            {
+                key->zer = 1;
+                return 0;
+            } else if (key->ztype == REDISMODULE_ZSET_RANGE_LEX) {
+                if (!zslLexValueGteMin(e->ele,&key->zlrs)) {
+                    key->zer = 1;
+                    return 0;
+                }
+            }
+            key->zcursor = prev;
+            return 1;
+        }
     } else {
         serverPanic("Unsupported zset encoding");
     }
@@ -137,6 +137,7 @@ client *createClient(int fd) {
     c->bpop.target = NULL;
     c->bpop.numreplicas = 0;
     c->bpop.reploffset = 0;
+    c->bpop.tiering_reads = 0;
     c->woff = 0;
     c->watched_keys = listCreate();
     c->pubsub_channels = dictCreate(&objectKeyPointerValueDictType,NULL);
@@ -364,6 +365,19 @@ void addReply(client *c, robj *obj) {
         if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != C_OK)
             _addReplyObjectToList(c,obj);
         decrRefCount(obj);
+    } else if (obj->encoding == OBJ_ENCODING_COMPRESSED) {
+        obj = getDecodedObject(obj);
+        if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != C_OK)
+            _addReplyObjectToList(c,obj);
+        decrRefCount(obj);
+    } else if (obj->encoding == OBJ_ENCODING_CHUNKED) {
+        chunkedString *cs = obj->ptr;
+        addReplyChunkedString(c,cs,0,cs->len);
+    } else if (obj->encoding == OBJ_ENCODING_DOUBLE) {
+        char buf[OBJ_DOUBLE_STR_SIZE];
+        int len = getDoubleEncodedString(obj,buf,sizeof(buf));
+
+        addReplyString(c,buf,len);
     } else {
         serverPanic("Wrong obj->encoding in addReply()");
     }
@@ -489,7 +503,7 @@ void addReplyDouble(client *c, double d) {
          * different way, so better to handle it in an explicit way. */
         addReplyBulkCString(c, d > 0 ? "inf" : "-inf");
     } else {
-        dlen = snprintf(dbuf,sizeof(dbuf),"%.17g",d);
+        dlen = d2gstring(dbuf,sizeof(dbuf),d,17);
         slen = snprintf(sbuf,sizeof(sbuf),"$%d\r\n%s\r\n",dlen,dbuf);
         addReplyString(c,sbuf,slen);
     }
@@ -550,6 +564,10 @@ void addReplyBulkLen(client *c, robj *obj) {
 
     if (sdsEncodedObject(obj)) {
         len = sdslen(obj->ptr);
+    } else if (obj->encoding == OBJ_ENCODING_COMPRESSED ||
+               obj->encoding == OBJ_ENCODING_CHUNKED ||
+               obj->encoding == OBJ_ENCODING_DOUBLE) {
+        len = stringObjectLen(obj);
     } else {
         long n = (long)obj->ptr;
 
@@ -572,6 +590,14 @@ void addReplyBulkLen(client *c, robj *obj) {
 
 /* Add a Redis Object as a bulk reply */
 void addReplyBulk(client *c, robj *obj) {
+    if (obj->encoding == OBJ_ENCODING_DOUBLE) {
+        /* Format the double only once, for both the length and the body. */
+        char buf[OBJ_DOUBLE_STR_SIZE];
+        int len = getDoubleEncodedString(obj,buf,sizeof(buf));
+
+        addReplyBulkCBuffer(c,buf,len);
+        return;
+    }
     addReplyBulkLen(c,obj);
     addReply(c,obj);
     addReply(c,shared.crlf);
@@ -584,6 +610,20 @@ void addReplyBulkCBuffer(client *c, const void *p, size_t len) {
     addReply(c,shared.crlf);
 }
 
+/* Add 'len' bytes of the chunked string 'cs' starting at 'offset' to the
+ * reply, one chunk at a time, without flattening the string. */
+void addReplyChunkedString(client *c, chunkedString *cs, size_t offset, size_t len) {
+    while (len) {
+        size_t avail;
+        unsigned char *p = chunkedStringSpan(cs,offset,&avail);
+
+        if (avail > len) avail = len;
+        addReplyString(c,(char*)p,avail);
+        offset += avail;
+        len -= avail;
+    }
+}
+
 /* Add sds to reply (takes ownership of sds and frees it) */
 void addReplyBulkSds(client *c, sds s)  {
     addReplySds(c,sdscatfmt(sdsempty(),"$%u\r\n",
@@ -1324,8 +1364,10 @@ void processInputBuffer(client *c) {
         /* Return if clients are paused. */
         if (!(c->flags & CLIENT_SLAVE) && clientsArePaused()) break;
 
-        /* Immediately abort if the client is in the middle of something. */
-        if (c->flags & CLIENT_BLOCKED) break;
+        /* Immediately abort if the client is in the middle of something.
+         * A command left pending while clients are paused is processed by
+         * processUnblockedClients() when the pause ends. */
+        if (c->flags & (CLIENT_BLOCKED|CLIENT_PENDING_COMMAND)) break;
 
         /* CLIENT_CLOSE_AFTER_REPLY closes the connection once the reply is
          * written to the client. Make sure to not let the reply grow after
@@ -1361,7 +1403,9 @@ void processInputBuffer(client *c) {
                     /* Update the applied replication offset of our master. */
                     c->reploff = c->read_reploff - sdslen(c->querybuf);
                 }
-                resetClient(c);
+                /* Don't reset clients that will execute the command again
+                 * once unblocked. */
+                if (!(c->flags & CLIENT_PENDING_COMMAND)) resetClient(c);
             }
             /* freeMemoryIfNeeded may flush slave output buffers. This may result
              * into a slave, that may be the active client, to be freed. */
@@ -1371,6 +1415,26 @@ void processInputBuffer(client *c) {
     server.current_client = NULL;
 }
 
+/* Process again the command of a client flagged with CLIENT_PENDING_COMMAND,
+ * that was blocked by processCommand() before its execution. Like in
+ * processInputBuffer() nothing is executed while clients are paused: the
+ * client stays flagged, and it is queued again when the pause ends. Returns
+ * C_ERR if the client was freed in the meantime. */
+int processPendingCommand(client *c) {
+    if (!(c->flags & CLIENT_SLAVE) && clientsArePaused()) return C_OK;
+    c->flags &= ~CLIENT_PENDING_COMMAND;
+    if (c->flags & (CLIENT_CLOSE_AFTER_REPLY|CLIENT_CLOSE_ASAP)) {
+        resetClient(c);
+        return C_OK;
+    }
+    server.current_client = c;
+    if (processCommand(c) == C_OK && server.current_client &&
+        !(c->flags & CLIENT_PENDING_COMMAND)) resetClient(c);
+    if (server.current_client == NULL) return C_ERR;
+    server.current_client = NULL;
+    return C_OK;
+}
+
 /**
  * 读取client的连接中数据，读取完成后，调用processInputBuffer
  * @param el
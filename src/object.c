@@ -29,6 +29,7 @@
  */
 
 #include "server.h"
+#include "lzf.h"
 #include <math.h>
 #include <ctype.h>
 
@@ -144,6 +145,110 @@ robj *createStringObjectFromLongLong(long long value) {
     return o;
 }
 
+/* Return true if the exact decimal expansion of the finite double 'd' has
+ * at most 15 significant digits and at most 'maxfrac' digits after the
+ * point. Such a double is exactly the number printed by d2shortstring(),
+ * so converting it to a long double gives the same result of parsing its
+ * string representation with strtold(). */
+static int doubleIsShortDecimal(double d, int maxfrac) {
+    static const uint64_t pow5[] = {
+        1ULL, 5ULL, 25ULL, 125ULL, 625ULL, 3125ULL, 15625ULL, 78125ULL,
+        390625ULL, 1953125ULL, 9765625ULL, 48828125ULL, 244140625ULL,
+        1220703125ULL, 6103515625ULL, 30517578125ULL, 152587890625ULL,
+        762939453125ULL, 3814697265625ULL, 19073486328125ULL,
+        95367431640625ULL, 476837158203125ULL, 2384185791015625ULL
+    };
+    uint64_t mantissa;
+    int exp, frac;
+
+    if (d == 0) return 1;
+    /* d = mantissa * 2^(exp-53) with an odd mantissa, that is, d has
+     * 'frac' binary digits after the point, and as many decimal digits
+     * since d*10^frac = mantissa*5^frac is an integer. */
+    mantissa = (uint64_t)ldexp(fabs(frexp(d,&exp)),53);
+    exp -= 53;
+    while (!(mantissa & 1)) {
+        mantissa >>= 1;
+        exp++;
+    }
+    if (exp >= 0) return fabs(d) < 1e15;
+    frac = -exp;
+    if (frac > maxfrac || frac >= (int)(sizeof(pow5)/sizeof(pow5[0])))
+        return 0;
+    return mantissa <= 999999999999999ULL/pow5[frac];
+}
+
+/* Return true if the string is exactly what d2shortstring() prints for
+ * some finite double, setting '*dp' to such double. This is the condition
+ * for a string to be stored with the OBJ_ENCODING_DOUBLE encoding.
+ *
+ * Plain decimals like "3.14", that are the common case, are recognized
+ * without calling strtod() and d2shortstring(): with no more than 15
+ * significant digits, no redundant zeros and a value of at least 1e-4 the
+ * string is printed back in the same way (see d2shortstring()), and since
+ * both the digits and the power of ten are exact doubles, dividing them
+ * gives the correctly rounded value. The string must be null terminated. */
+static int stringToEncodableDouble(const char *s, size_t len, double *dp) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19
+    };
+    const char *p = s, *end = s+len, *dot = NULL;
+    int neg = (*s == '-'), sigdigits = 0, zeros = 0;
+    uint64_t r = 0;
+    char buf[OBJ_DOUBLE_STR_SIZE];
+    double d;
+    char *eptr;
+
+    if (len == 0 || len >= OBJ_DOUBLE_STR_SIZE) return 0;
+    for (p = s+neg; p < end; p++) {
+        if (*p == '.' && !dot) {
+            dot = p;
+        } else if (isdigit(*p)) {
+            if (r == 0 && *p == '0') {
+                zeros++; /* Leading zeros, including the one before '.' */
+            } else {
+                r = r*10+(*p-'0');
+                if (++sigdigits > 15) break;
+            }
+        } else {
+            break;
+        }
+    }
+    /* Only "0" may start with a zero, the fractional part can't end with
+     * a zero, and values under 1e-4 are printed by %g in the exponential
+     * notation, that is, "0.0001" is the smallest number with this form. */
+    if (p == end && r != 0 && dot && dot > s+neg && dot < end-1 &&
+        end[-1] != '0' && (s[neg] != '0' || (dot == s+neg+1 && zeros <= 4)))
+    {
+        d = (double)r/pow10[end-dot-1];
+        *dp = neg ? -d : d;
+        return 1;
+    }
+
+    /* Slow path: only numbers in exponential notation or with 16 or 17
+     * significant digits can still be printed back in the same way. Long
+     * outputs of INCRBYFLOAT like "0.30000000000000004441" never are. */
+    sigdigits = 0;
+    for (p = s; p < end; p++) {
+        if (*p == 'e') {
+            sigdigits = -1;
+        } else if (isdigit(*p)) {
+            if (sigdigits >= 0 && (sigdigits || *p != '0') && ++sigdigits > 17)
+                return 0;
+        } else if (*p != '.' && *p != '-' && *p != '+') {
+            return 0;
+        }
+    }
+    errno = 0;
+    d = fastStrtod(s,&eptr);
+    if (eptr != end || errno != 0 || !isfinite(d) ||
+        d2shortstring(buf,sizeof(buf),d) != (int)len ||
+        memcmp(buf,s,len) != 0) return 0;
+    *dp = d;
+    return 1;
+}
+
 /* Create a string object from a long double. If humanfriendly is non-zero
  * it does not use exponential format and trims trailing zeroes at the end,
  * however this results in loss of precision. Otherwise exp format is used
@@ -152,10 +257,47 @@ robj *createStringObjectFromLongLong(long long value) {
  * The 'humanfriendly' option is used for INCRBYFLOAT and HINCRBYFLOAT. */
 robj *createStringObjectFromLongDouble(long double value, int humanfriendly) {
     char buf[256];
-    int len = ld2string(buf,sizeof(buf),value,humanfriendly);
+    int len;
+
+    /* If the value is a double whose decimal representation is short and
+     * exact, ld2string() and the double encoding print it the same way,
+     * so we can skip the formatting and the parsing of the string. */
+    if (humanfriendly && sizeof(void*) >= sizeof(double)) {
+        double d = value;
+
+        if ((long double)d == value &&
+            (d == 0 || (fabs(d) >= 1e-4 && fabs(d) < 1e15)) &&
+            doubleIsShortDecimal(d,17))
+            return createDoubleStringObject(d);
+    }
+    len = ld2string(buf,sizeof(buf),value,humanfriendly);
     return createStringObject(buf,len);
 }
 
+/* Create a string object with encoding OBJ_ENCODING_DOUBLE, storing the
+ * double directly in the ptr field. The caller must make sure that the
+ * platform pointers are large enough to hold a double. */
+robj *createDoubleStringObject(double value) {
+    robj *o = createObject(OBJ_STRING,NULL);
+    o->encoding = OBJ_ENCODING_DOUBLE;
+    memcpy(&o->ptr,&value,sizeof(value));
+    return o;
+}
+
+/* Return the value of an OBJ_ENCODING_DOUBLE string object. */
+double getDoubleEncodedValue(const robj *o) {
+    double value;
+    memcpy(&value,&o->ptr,sizeof(value));
+    return value;
+}
+
+/* Write the string representation of an OBJ_ENCODING_DOUBLE string object
+ * into 'buf', that should be at least OBJ_DOUBLE_STR_SIZE bytes, and
+ * return its length. This is the same string the object was created from. */
+int getDoubleEncodedString(const robj *o, char *buf, size_t len) {
+    return d2shortstring(buf,len,getDoubleEncodedValue(o));
+}
+
 /* Duplicate a string object, with the guarantee that the returned object
  * has the same encoding as the original one.
  *
@@ -179,12 +321,179 @@ robj *dupStringObject(const robj *o) {
         d->encoding = OBJ_ENCODING_INT;
         d->ptr = o->ptr;
         return d;
+    case OBJ_ENCODING_COMPRESSED: {
+        compressedString *cs = o->ptr;
+        return createCompressedStringObject(cs->data,cs->clen,cs->len);
+    }
+    case OBJ_ENCODING_CHUNKED:
+        d = createObject(OBJ_STRING,chunkedStringDup(o->ptr));
+        d->encoding = OBJ_ENCODING_CHUNKED;
+        return d;
+    case OBJ_ENCODING_DOUBLE:
+        d = createObject(OBJ_STRING, NULL);
+        d->encoding = OBJ_ENCODING_DOUBLE;
+        d->ptr = o->ptr;
+        return d;
     default:
         serverPanic("Wrong encoding.");
         break;
     }
 }
 
+/* Create a string object with encoding OBJ_ENCODING_COMPRESSED, copying
+ * 'clen' bytes of LZF data that decompress to a string of 'len' bytes. */
+robj *createCompressedStringObject(const void *data, size_t clen, size_t len) {
+    compressedString *cs = zmalloc(sizeof(*cs)+clen);
+    robj *o;
+
+    cs->len = len;
+    cs->clen = clen;
+    memcpy(cs->data,data,clen);
+    o = createObject(OBJ_STRING,cs);
+    o->encoding = OBJ_ENCODING_COMPRESSED;
+    return o;
+}
+
+/* Try to compress a string value that is going to be stored in the
+ * keyspace. Returns a new OBJ_ENCODING_COMPRESSED object, or NULL if the
+ * string is shorter than string-compress-threshold or if compressing it
+ * does not save at least a quarter of its size, since we pay for
+ * decompression at every access. The original object is not modified. */
+robj *tryCompressStringObject(robj *o) {
+    compressedString *cs;
+    size_t len, clen;
+    robj *c;
+
+    if (server.string_compress_threshold == 0 || !sdsEncodedObject(o))
+        return NULL;
+    len = sdslen(o->ptr);
+    if (len < server.string_compress_threshold || len <= 4) return NULL;
+
+    cs = zmalloc(sizeof(*cs)+len-len/4);
+    if ((clen = lzf_compress(o->ptr,len,cs->data,len-len/4)) == 0) {
+        zfree(cs);
+        return NULL;
+    }
+    cs = zrealloc(cs,sizeof(*cs)+clen);
+    cs->len = len;
+    cs->clen = clen;
+    c = createObject(OBJ_STRING,cs);
+    c->encoding = OBJ_ENCODING_COMPRESSED;
+    return c;
+}
+
+/* Create a string object with encoding OBJ_ENCODING_CHUNKED holding a copy
+ * of the 'len' bytes at 'ptr', or 'len' zero bytes if 'ptr' is NULL. */
+robj *createChunkedStringObject(const char *ptr, size_t len) {
+    robj *o = createObject(OBJ_STRING,chunkedStringNew(ptr,len));
+    o->encoding = OBJ_ENCODING_CHUNKED;
+    return o;
+}
+
+/* Return true if a string growing to 'len' bytes should be stored with the
+ * chunked encoding, see the string-chunk-threshold option. */
+int stringNeedsChunking(size_t len) {
+    return server.string_chunk_threshold &&
+           len > server.string_chunk_threshold;
+}
+
+/* ===================== Interned string values ============================
+ *
+ * When string-intern-max-len is set, short string values written by the SET
+ * family of commands are looked up in server.intern_pool, so that identical
+ * values share a single object, like it happens for small integers with
+ * shared.integers. Shared objects are never modified in place: all the code
+ * writing a string value in place calls dbUnshareStringValue() first, that
+ * copies the value if its reference count is greater than one.
+ *
+ * The pool holds a reference to every object: internPoolCron() scans the
+ * pool incrementally releasing the objects no longer referenced elsewhere. */
+
+/* Return a new reference to the object of the intern pool with the same
+ * content of 'o', adding 'o' to the pool if there is no such object yet.
+ * NULL is returned if the object is not eligible for interning. */
+robj *tryInternStringObject(robj *o) {
+    dictEntry *de;
+    robj *shared;
+
+    if (server.string_intern_max_len == 0 || !sdsEncodedObject(o) ||
+        sdslen(o->ptr) > server.string_intern_max_len) return NULL;
+
+    /* Like for shared integers, a shared value can't hold the LRU or LFU
+     * information of the single keys. */
+    if (server.maxmemory &&
+        (server.maxmemory_policy & MAXMEMORY_FLAG_NO_SHARED_INTEGERS))
+        return NULL;
+
+    if ((de = dictFind(server.intern_pool,o)) != NULL) {
+        shared = dictGetKey(de);
+        server.stat_intern_hits++;
+    } else {
+        shared = o;
+        dictAdd(server.intern_pool,shared,NULL);
+        incrRefCount(shared);
+    }
+    incrRefCount(shared);
+    return shared;
+}
+
+#define INTERN_POOL_CRON_BUCKETS 100 /* Buckets scanned per cron call. */
+
+typedef struct internPoolScanData {
+    robj **unused;              /* Objects only referenced by the pool. */
+    unsigned long numunused;
+    unsigned long long refs;    /* References to the pooled objects. */
+} internPoolScanData;
+
+void internPoolScanCallback(void *privdata, const dictEntry *de) {
+    internPoolScanData *data = privdata;
+    robj *o = dictGetKey(de);
+
+    if (o->refcount == 1) {
+        data->unused = zrealloc(data->unused,
+            sizeof(robj*)*(data->numunused+1));
+        data->unused[data->numunused++] = o;
+    } else {
+        data->refs += o->refcount-1;
+    }
+}
+
+/* Called by databasesCron(): scan a few buckets of the intern pool,
+ * releasing the objects only referenced by the pool itself. At the end of
+ * every full scan server.intern_pool_refs is updated with the number of
+ * references to the pooled objects, used to report the dedup ratio. */
+void internPoolCron(void) {
+    static unsigned long cursor = 0;
+    static unsigned long long refs = 0;
+    internPoolScanData data = {NULL,0,0};
+    unsigned long j;
+    int buckets = INTERN_POOL_CRON_BUCKETS;
+
+    if (dictSize(server.intern_pool) == 0) {
+        cursor = 0;
+        refs = 0;
+        server.intern_pool_refs = 0;
+        return;
+    }
+
+    /* Objects are deleted after the scan, since deleting entries could
+     * rehash the table while it is scanned. */
+    do {
+        cursor = dictScan(server.intern_pool,cursor,internPoolScanCallback,
+                          NULL,&data);
+    } while (cursor && --buckets);
+    for (j = 0; j < data.numunused; j++)
+        dictDelete(server.intern_pool,data.unused[j]);
+    zfree(data.unused);
+
+    refs += data.refs;
+    if (cursor == 0) {
+        server.intern_pool_refs = refs;
+        refs = 0;
+    }
+    if (htNeedsResize(server.intern_pool)) dictResize(server.intern_pool);
+}
+
 robj *createQuicklistObject(void) {
     quicklist *l = quicklistCreate();
     robj *o = createObject(OBJ_LIST,l);
@@ -220,14 +529,11 @@ robj *createHashObject(void) {
     return o;
 }
 
+/* Create a sorted set using the encoding configured for large sorted sets,
+ * see the zset-large-encoding option. */
 robj *createZsetObject(void) {
-    zset *zs = zmalloc(sizeof(*zs));
-    robj *o;
-
-    zs->dict = dictCreate(&zsetDictType,NULL);
-    zs->zsl = zslCreate();
-    o = createObject(OBJ_ZSET,zs);
-    o->encoding = OBJ_ENCODING_SKIPLIST;
+    robj *o = createObject(OBJ_ZSET,zsetCreate(server.zset_large_encoding));
+    o->encoding = server.zset_large_encoding;
     return o;
 }
 
@@ -248,6 +554,10 @@ robj *createModuleObject(moduleType *mt, void *value) {
 void freeStringObject(robj *o) {
     if (o->encoding == OBJ_ENCODING_RAW) {
         sdsfree(o->ptr);
+    } else if (o->encoding == OBJ_ENCODING_COMPRESSED) {
+        zfree(o->ptr);
+    } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        chunkedStringFree(o->ptr);
     }
 }
 
@@ -281,6 +591,12 @@ void freeZsetObject(robj *o) {
         zslFree(zs->zsl);
         zfree(zs);
         break;
+    case OBJ_ENCODING_BTREE:
+        zs = o->ptr;
+        dictRelease(zs->dict);
+        zbtFree(zs->zbt);
+        zfree(zs);
+        break;
     case OBJ_ENCODING_ZIPLIST:
         zfree(o->ptr);
         break;
@@ -315,6 +631,11 @@ void incrRefCount(robj *o) {
 
 void decrRefCount(robj *o) {
     if (o->refcount == 1) {
+        if (o->encoding == OBJ_ENCODING_TIERED) {
+            tieringFreeStub(o);
+            zfree(o);
+            return;
+        }
         switch(o->type) {
         case OBJ_STRING: freeStringObject(o); break;
         case OBJ_LIST: freeListObject(o); break;
@@ -372,6 +693,8 @@ int isObjectRepresentableAsLongLong(robj *o, long long *llval) {
     if (o->encoding == OBJ_ENCODING_INT) {
         if (llval) *llval = (long) o->ptr;
         return C_OK;
+    } else if (!sdsEncodedObject(o)) {
+        return getLongLongFromObject(o,llval);
     } else {
         return isSdsRepresentableAsLongLong(o->ptr,llval);
     }
@@ -424,6 +747,26 @@ robj *tryObjectEncoding(robj *o) {
         }
     }
 
+    /* Check if we can represent this string as a double, that is, if
+     * printing the double back gives exactly the same string, so that
+     * float values are stored and incremented without any parsing. */
+    if (sizeof(void*) >= sizeof(double) && len < OBJ_DOUBLE_STR_SIZE) {
+        double d;
+
+        if (stringToEncodableDouble(s,len,&d)) {
+            /* An EMBSTR object would keep the space of the string, so
+             * we replace it with a new object. */
+            if (o->encoding == OBJ_ENCODING_EMBSTR) {
+                decrRefCount(o);
+                return createDoubleStringObject(d);
+            }
+            sdsfree(o->ptr);
+            o->encoding = OBJ_ENCODING_DOUBLE;
+            memcpy(&o->ptr,&d,sizeof(d));
+            return o;
+        }
+    }
+
     /* If the string is small and is still RAW encoded,
      * try the EMBSTR encoding which is more efficient.
      * In this representation the object and the SDS string are allocated
@@ -471,6 +814,26 @@ robj *getDecodedObject(robj *o) {
         ll2string(buf,32,(long)o->ptr);
         dec = createStringObject(buf,strlen(buf));
         return dec;
+    } else if (o->type == OBJ_STRING && o->encoding == OBJ_ENCODING_DOUBLE) {
+        char buf[OBJ_DOUBLE_STR_SIZE];
+        int len = getDoubleEncodedString(o,buf,sizeof(buf));
+
+        return createStringObject(buf,len);
+    } else if (o->type == OBJ_STRING &&
+               o->encoding == OBJ_ENCODING_COMPRESSED) {
+        compressedString *cs = o->ptr;
+        sds s = sdsnewlen(NULL,cs->len);
+
+        if (lzf_decompress(cs->data,cs->clen,s,cs->len) != cs->len)
+            serverPanic("Corrupted compressed string");
+        return createObject(OBJ_STRING,s);
+    } else if (o->type == OBJ_STRING &&
+               o->encoding == OBJ_ENCODING_CHUNKED) {
+        chunkedString *cs = o->ptr;
+        sds s = sdsnewlen(NULL,cs->len);
+
+        chunkedStringRead(cs,0,s,cs->len);
+        return createObject(OBJ_STRING,s);
     } else {
         serverPanic("Unknown encoding type");
     }
@@ -493,9 +856,26 @@ int compareStringObjectsWithFlags(robj *a, robj *b, int flags) {
     size_t alen, blen, minlen;
 
     if (a == b) return 0;
+    if (a->encoding == OBJ_ENCODING_COMPRESSED ||
+        b->encoding == OBJ_ENCODING_COMPRESSED ||
+        a->encoding == OBJ_ENCODING_CHUNKED ||
+        b->encoding == OBJ_ENCODING_CHUNKED)
+    {
+        int cmp;
+
+        a = getDecodedObject(a);
+        b = getDecodedObject(b);
+        cmp = compareStringObjectsWithFlags(a,b,flags);
+        decrRefCount(a);
+        decrRefCount(b);
+        return cmp;
+    }
     if (sdsEncodedObject(a)) {
         astr = a->ptr;
         alen = sdslen(astr);
+    } else if (a->encoding == OBJ_ENCODING_DOUBLE) {
+        alen = getDoubleEncodedString(a,bufa,sizeof(bufa));
+        astr = bufa;
     } else {
         alen = ll2string(bufa,sizeof(bufa),(long) a->ptr);
         astr = bufa;
@@ -503,6 +883,9 @@ int compareStringObjectsWithFlags(robj *a, robj *b, int flags) {
     if (sdsEncodedObject(b)) {
         bstr = b->ptr;
         blen = sdslen(bstr);
+    } else if (b->encoding == OBJ_ENCODING_DOUBLE) {
+        blen = getDoubleEncodedString(b,bufb,sizeof(bufb));
+        bstr = bufb;
     } else {
         blen = ll2string(bufb,sizeof(bufb),(long) b->ptr);
         bstr = bufb;
@@ -534,10 +917,13 @@ int collateStringObjects(robj *a, robj *b) {
  * this function is faster then checking for (compareStringObject(a,b) == 0)
  * because it can perform some more optimization. */
 int equalStringObjects(robj *a, robj *b) {
-    if (a->encoding == OBJ_ENCODING_INT &&
-        b->encoding == OBJ_ENCODING_INT){
-        /* If both strings are integer encoded just check if the stored
-         * long is the same. */
+    if ((a->encoding == OBJ_ENCODING_INT &&
+         b->encoding == OBJ_ENCODING_INT) ||
+        (a->encoding == OBJ_ENCODING_DOUBLE &&
+         b->encoding == OBJ_ENCODING_DOUBLE)) {
+        /* If both strings are integer or double encoded just check if the
+         * stored value is the same. Doubles are compared bit by bit, so
+         * that 0 and -0 are different like their strings. */
         return a->ptr == b->ptr;
     } else {
         return compareStringObjects(a,b) == 0;
@@ -548,6 +934,13 @@ size_t stringObjectLen(robj *o) {
     serverAssertWithInfo(NULL,o,o->type == OBJ_STRING);
     if (sdsEncodedObject(o)) {
         return sdslen(o->ptr);
+    } else if (o->encoding == OBJ_ENCODING_COMPRESSED) {
+        return ((compressedString*)o->ptr)->len;
+    } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        return ((chunkedString*)o->ptr)->len;
+    } else if (o->encoding == OBJ_ENCODING_DOUBLE) {
+        char buf[OBJ_DOUBLE_STR_SIZE];
+        return getDoubleEncodedString(o,buf,sizeof(buf));
     } else {
         return sdigits10((long)o->ptr);
     }
@@ -563,7 +956,7 @@ int getDoubleFromObject(const robj *o, double *target) {
         serverAssertWithInfo(NULL,o,o->type == OBJ_STRING);
         if (sdsEncodedObject(o)) {
             errno = 0;
-            value = strtod(o->ptr, &eptr);
+            value = fastStrtod(o->ptr, &eptr);
             if (isspace(((const char*)o->ptr)[0]) ||
                 eptr[0] != '\0' ||
                 (errno == ERANGE &&
@@ -573,6 +966,14 @@ int getDoubleFromObject(const robj *o, double *target) {
                 return C_ERR;
         } else if (o->encoding == OBJ_ENCODING_INT) {
             value = (long)o->ptr;
+        } else if (o->encoding == OBJ_ENCODING_DOUBLE) {
+            value = getDoubleEncodedValue(o);
+        } else if (o->encoding == OBJ_ENCODING_COMPRESSED ||
+                   o->encoding == OBJ_ENCODING_CHUNKED) {
+            robj *dec = getDecodedObject((robj*)o);
+            int retval = getDoubleFromObject(dec,&value);
+            decrRefCount(dec);
+            if (retval != C_OK) return C_ERR;
         } else {
             serverPanic("Unknown string encoding");
         }
@@ -611,6 +1012,25 @@ int getLongDoubleFromObject(robj *o, long double *target) {
                 return C_ERR;
         } else if (o->encoding == OBJ_ENCODING_INT) {
             value = (long)o->ptr;
+        } else if (o->encoding == OBJ_ENCODING_DOUBLE) {
+            double d = getDoubleEncodedValue(o);
+
+            /* The long double nearest to the string may differ from the
+             * double, in that case we need to parse the string again. */
+            if (doubleIsShortDecimal(d,INT_MAX)) {
+                value = d;
+            } else {
+                char buf[OBJ_DOUBLE_STR_SIZE];
+
+                getDoubleEncodedString(o,buf,sizeof(buf));
+                value = strtold(buf,NULL);
+            }
+        } else if (o->encoding == OBJ_ENCODING_COMPRESSED ||
+                   o->encoding == OBJ_ENCODING_CHUNKED) {
+            robj *dec = getDecodedObject(o);
+            int retval = getLongDoubleFromObject(dec,&value);
+            decrRefCount(dec);
+            if (retval != C_OK) return C_ERR;
         } else {
             serverPanic("Unknown string encoding");
         }
@@ -644,6 +1064,18 @@ int getLongLongFromObject(robj *o, long long *target) {
             if (string2ll(o->ptr,sdslen(o->ptr),&value) == 0) return C_ERR;
         } else if (o->encoding == OBJ_ENCODING_INT) {
             value = (long)o->ptr;
+        } else if (o->encoding == OBJ_ENCODING_COMPRESSED ||
+                   o->encoding == OBJ_ENCODING_DOUBLE) {
+            /* Compressed strings are too long to be integers, and strings
+             * that are integers are never double encoded. */
+            return C_ERR;
+        } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+            chunkedString *cs = o->ptr;
+            char buf[LONG_STR_SIZE];
+
+            if (cs->len >= sizeof(buf)) return C_ERR;
+            chunkedStringRead(cs,0,buf,cs->len);
+            if (string2ll(buf,cs->len,&value) == 0) return C_ERR;
         } else {
             serverPanic("Unknown string encoding");
         }
@@ -692,6 +1124,11 @@ char *strEncoding(int encoding) {
     case OBJ_ENCODING_INTSET: return "intset";
     case OBJ_ENCODING_SKIPLIST: return "skiplist";
     case OBJ_ENCODING_EMBSTR: return "embstr";
+    case OBJ_ENCODING_BTREE: return "btree";
+    case OBJ_ENCODING_COMPRESSED: return "compressed";
+    case OBJ_ENCODING_CHUNKED: return "chunked";
+    case OBJ_ENCODING_DOUBLE: return "double";
+    case OBJ_ENCODING_TIERED: return "tiered";
     default: return "unknown";
     }
 }
@@ -702,7 +1139,6 @@ char *strEncoding(int encoding) {
  * Note that the returned value is just an approximation, especially in the
  * case of aggregated data types where only "sample_size" elements
  * are checked and averaged to estimate the total size. */
-#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5 /* Default sample size. */
 size_t objectComputeSize(robj *o, size_t sample_size) {
     sds ele, ele2;
     dict *d;
@@ -710,13 +1146,21 @@ size_t objectComputeSize(robj *o, size_t sample_size) {
     struct dictEntry *de;
     size_t asize = 0, elesize = 0, samples = 0;
 
-    if (o->type == OBJ_STRING) {
-        if(o->encoding == OBJ_ENCODING_INT) {
+    if (o->encoding == OBJ_ENCODING_TIERED) {
+        asize = sizeof(*o)+sizeof(tieredValue);
+    } else if (o->type == OBJ_STRING) {
+        if(o->encoding == OBJ_ENCODING_INT ||
+           o->encoding == OBJ_ENCODING_DOUBLE) {
             asize = sizeof(*o);
         } else if(o->encoding == OBJ_ENCODING_RAW) {
             asize = sdsAllocSize(o->ptr)+sizeof(*o);
         } else if(o->encoding == OBJ_ENCODING_EMBSTR) {
             asize = sdslen(o->ptr)+2+sizeof(*o);
+        } else if(o->encoding == OBJ_ENCODING_COMPRESSED) {
+            asize = sizeof(compressedString)+
+                    ((compressedString*)o->ptr)->clen+sizeof(*o);
+        } else if(o->encoding == OBJ_ENCODING_CHUNKED) {
+            asize = chunkedStringAllocSize(o->ptr)+sizeof(*o);
         } else {
             serverPanic("Unknown string encoding");
         }
@@ -725,11 +1169,13 @@ size_t objectComputeSize(robj *o, size_t sample_size) {
             quicklist *ql = o->ptr;
             quicklistNode *node = ql->head;
             asize = sizeof(*o)+sizeof(quicklist);
-            do {
-                elesize += sizeof(quicklistNode)+ziplistBlobLen(node->zl);
+            /* Lists are empty only while a command is populating them. */
+            while (node && samples < sample_size) {
+                elesize += sizeof(quicklistNode)+quicklistNodeBlobLen(node);
                 samples++;
-            } while ((node = node->next) && samples < sample_size);
-            asize += (double)elesize/samples*listTypeLength(o);
+                node = node->next;
+            }
+            if (samples) asize += (double)elesize/samples*ql->len;
         } else if (o->encoding == OBJ_ENCODING_ZIPLIST) {
             asize = sizeof(*o)+ziplistBlobLen(o->ptr);
         } else {
@@ -768,6 +1214,24 @@ size_t objectComputeSize(robj *o, size_t sample_size) {
                 znode = znode->level[0].forward;
             }
             if (samples) asize += (double)elesize/samples*dictSize(d);
+        } else if (o->encoding == OBJ_ENCODING_BTREE) {
+            d = ((zset*)o->ptr)->dict;
+            zbtreeLeaf *leaf = ((zset*)o->ptr)->zbt->head;
+            unsigned int j;
+            asize = sizeof(*o)+sizeof(zset)+sizeof(zbtree)+
+                    (sizeof(struct dictEntry*)*dictSlots(d));
+            /* Leaves are accounted proportionally to the entries they hold,
+             * inner nodes are only a small fraction of the tree. */
+            while(leaf != NULL && samples < sample_size) {
+                for (j = 0; j < leaf->hdr.count; j++) {
+                    elesize += sdsAllocSize(leaf->entries[j].ele);
+                    elesize += sizeof(struct dictEntry);
+                    samples++;
+                }
+                elesize += zmalloc_size(leaf);
+                leaf = leaf->next;
+            }
+            if (samples) asize += (double)elesize/samples*dictSize(d);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -1168,8 +1632,22 @@ void memoryCommand(client *c) {
         addReply(c, shared.ok);
         /* Nothing to do for other allocators. */
 #endif
+    } else if (!strcasecmp(c->argv[1]->ptr,"mrc") &&
+               (c->argc == 2 || c->argc == 3))
+    {
+        if (!server.maxmemory_mrc) {
+            addReplyError(c,"The miss ratio curve estimation is disabled, "
+                            "set maxmemory-mrc to yes to enable it");
+        } else if (c->argc == 2) {
+            mrcReply(c);
+        } else if (!strcasecmp(c->argv[2]->ptr,"reset")) {
+            mrcReset();
+            addReply(c,shared.ok);
+        } else {
+            addReply(c,shared.syntaxerr);
+        }
     } else if (!strcasecmp(c->argv[1]->ptr,"help") && c->argc == 2) {
-        addReplyMultiBulkLen(c,4);
+        addReplyMultiBulkLen(c,6);
         addReplyBulkCString(c,
 "MEMORY USAGE <key> [SAMPLES <count>] - Estimate memory usage of key");
         addReplyBulkCString(c,
@@ -1178,6 +1656,10 @@ void memoryCommand(client *c) {
 "MEMORY PURGE                         - Ask the allocator to release memory");
         addReplyBulkCString(c,
 "MEMORY MALLOC-STATS                  - Show allocator internal stats");
+        addReplyBulkCString(c,
+"MEMORY MRC                           - Estimate the hit ratio for other maxmemory sizes");
+        addReplyBulkCString(c,
+"MEMORY MRC RESET                     - Reset the hit ratio estimation");
     } else {
         addReplyError(c,"Syntax error. Try MEMORY HELP");
     }
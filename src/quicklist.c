@@ -29,11 +29,14 @@
  */
 
 #include <string.h> /* for memcpy */
+#include <limits.h> /* for ULONG_MAX */
 #include "quicklist.h"
 #include "zmalloc.h"
 #include "ziplist.h"
 #include "util.h" /* for ll2string */
 #include "lzf.h"
+#include "lz4.h"
+#include <pthread.h>
 
 #if defined(REDIS_TEST) || defined(REDIS_TEST_VERBOSE)
 #include <stdio.h> /* for printf (debug printing), snprintf (genstr) */
@@ -58,6 +61,22 @@ static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
  * resulted in a larger size than the original data. */
 #define MIN_COMPRESS_IMPROVE 8
 
+/* Codec used to compress nodes, and function used to submit compression
+ * jobs to a background thread (NULL to compress synchronously). These are
+ * process wide settings, see quicklistSetCompressCodec() and
+ * quicklistSetAsyncCompress(). */
+static int compress_codec = QUICKLIST_CODEC_LZF;
+static void (*async_compress)(quicklistCompressJob *job) = NULL;
+static int async_compress_used = 0;
+
+/* Completed compression jobs, waiting for quicklistCompressJobsDrain(). */
+static quicklistCompressJob *compress_jobs_done = NULL;
+static pthread_mutex_t compress_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Held while completed jobs are applied to their nodes, and while freeing
+ * quicklists, since that may happen in a different thread (lazy free). */
+static pthread_mutex_t compress_swap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* If not verbose testing, remove all debug printing. */
 #ifndef REDIS_TEST_VERBOSE
 #define D(...)
@@ -89,6 +108,8 @@ static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
 #define unlikely(x) (x)
 #endif
 
+REDIS_STATIC void __quicklistFreeNodeData(quicklistNode *node);
+
 /* Create a new quicklist.
  * Free with quicklistRelease(). */
 quicklist *quicklistCreate(void) {
@@ -100,6 +121,7 @@ quicklist *quicklistCreate(void) {
     quicklist->count = 0;
     quicklist->compress = 0;
     quicklist->fill = -2;
+    quicklist->skipidx = NULL;
     return quicklist;
 }
 
@@ -145,6 +167,7 @@ REDIS_STATIC quicklistNode *quicklistCreateNode(void) {
     node->encoding = QUICKLIST_NODE_ENCODING_RAW;
     node->container = QUICKLIST_NODE_CONTAINER_ZIPLIST;
     node->recompress = 0;
+    node->indexed = 0;
     return node;
 }
 
@@ -156,12 +179,15 @@ void quicklistRelease(quicklist *quicklist) {
     unsigned long len;
     quicklistNode *current, *next;
 
+    quicklistSkipIndexInvalidate(quicklist);
+    if (async_compress_used)
+        pthread_mutex_lock(&compress_swap_mutex);
     current = quicklist->head;
     len = quicklist->len;
     while (len--) {
         next = current->next;
 
-        zfree(current->zl);
+        __quicklistFreeNodeData(current);
         quicklist->count -= current->count;
 
         zfree(current);
@@ -169,11 +195,191 @@ void quicklistRelease(quicklist *quicklist) {
         quicklist->len--;
         current = next;
     }
+    if (async_compress_used)
+        pthread_mutex_unlock(&compress_swap_mutex);
     zfree(quicklist);
 }
 
+/* Discard the skip index of the quicklist, if any. Must be called by any
+ * operation changing the number of elements of nodes in the middle of the
+ * list, or adding / removing nodes in the middle of the list. The index
+ * will be built again by the next lookup that needs it. */
+void quicklistSkipIndexInvalidate(quicklist *quicklist) {
+    quicklistSkipIndex *si = quicklist->skipidx;
+    unsigned long j;
+
+    if (!si)
+        return;
+    for (j = 0; j < si->len; j++)
+        si->entries[j].node->indexed = 0;
+    zfree(si->entries);
+    zfree(si);
+    quicklist->skipidx = NULL;
+}
+
+/* Build the skip index of 'quicklist' walking all its nodes once. */
+REDIS_STATIC void _quicklistSkipIndexBuild(quicklist *quicklist) {
+    quicklistSkipIndex *si = zmalloc(sizeof(*si));
+    unsigned long pos = 0;
+    long long start = 0;
+
+    si->entries = zmalloc(sizeof(quicklistSkipIndexEntry) *
+                          (quicklist->len / QUICKLIST_SKIPINDEX_STRIDE + 1));
+    si->len = 0;
+    si->shift = 0;
+    for (quicklistNode *n = quicklist->head; n; n = n->next, pos++) {
+        if (pos && pos % QUICKLIST_SKIPINDEX_STRIDE == 0) {
+            si->entries[si->len].node = n;
+            si->entries[si->len].start = start;
+            si->len++;
+            n->indexed = 1;
+        }
+        start += n->count;
+    }
+    quicklist->skipidx = si;
+}
+
+/* Remove the first (if 'head' is true) or the last 'count' entries. */
+REDIS_STATIC void _quicklistSkipIndexDrop(quicklistSkipIndex *si,
+                                          unsigned long count, int head) {
+    unsigned long j, first = head ? 0 : si->len - count;
+
+    for (j = first; j < first + count; j++)
+        si->entries[j].node->indexed = 0;
+    if (head)
+        memmove(si->entries, si->entries + count,
+                sizeof(quicklistSkipIndexEntry) * (si->len - count));
+    si->len -= count;
+}
+
+/* Update the skip index before 'delta' elements are pushed (or popped,
+ * if negative) at the head of the list. All the nodes after the head are
+ * shifted by the same amount. The head node itself is never referenced by
+ * the index, since its start never changes: it can become indexed only
+ * when the nodes before it are deleted, in that case it is dropped. */
+REDIS_STATIC void _quicklistSkipIndexHeadUpdate(quicklist *quicklist,
+                                                long long delta) {
+    quicklistSkipIndex *si = quicklist->skipidx;
+
+    if (!si)
+        return;
+    if (quicklist->head && quicklist->head->indexed)
+        _quicklistSkipIndexDrop(si, 1, 1);
+    si->shift += delta;
+}
+
+/* Update the skip index before the 'extent' elements starting at index
+ * 'start' are deleted. Trimming the head or the tail of the list, as LTRIM
+ * does, only requires dropping the entries of the nodes being deleted or
+ * modified. Deleting a range in the middle discards the index. */
+REDIS_STATIC void _quicklistSkipIndexDelRange(quicklist *quicklist,
+                                              unsigned long long start,
+                                              unsigned long long extent) {
+    quicklistSkipIndex *si = quicklist->skipidx;
+    unsigned long count = 0;
+
+    if (!si)
+        return;
+    if (start + extent == quicklist->count) {
+        while (count < si->len &&
+               si->entries[si->len - count - 1].start + si->shift >=
+                   (long long)start)
+            count++;
+        _quicklistSkipIndexDrop(si, count, 0);
+    } else if (start == 0) {
+        while (count < si->len &&
+               si->entries[count].start + si->shift < (long long)extent)
+            count++;
+        _quicklistSkipIndexDrop(si, count, 1);
+        si->shift -= extent;
+    } else {
+        quicklistSkipIndexInvalidate(quicklist);
+    }
+}
+
+/* Called when a node referenced by the skip index is deleted. This is fine
+ * for the last entry, as it happens popping elements from the tail: the
+ * start of the other nodes does not change. */
+REDIS_STATIC void _quicklistSkipIndexNodeDeleted(quicklist *quicklist,
+                                                 quicklistNode *node) {
+    quicklistSkipIndex *si = quicklist->skipidx;
+
+    if (si && si->len && si->entries[si->len - 1].node == node)
+        _quicklistSkipIndexDrop(si, 1, 0);
+    else
+        quicklistSkipIndexInvalidate(quicklist);
+}
+
+/* Return the node to start from in order to find the element at index
+ * 'pos' (from the head) walking forward, and set '*start' to the index of
+ * its first element. The skip index is built if needed. */
+REDIS_STATIC quicklistNode *_quicklistSkipIndexSeek(quicklist *quicklist,
+                                                    unsigned long long pos,
+                                                    unsigned long long *start) {
+    quicklistSkipIndex *si;
+    unsigned long lo = 0, hi, mid;
+
+    if (!quicklist->skipidx)
+        _quicklistSkipIndexBuild(quicklist);
+    si = quicklist->skipidx;
+
+    /* Find the number of entries starting at or before 'pos'. */
+    hi = si->len;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (si->entries[mid].start + si->shift <= (long long)pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0) {
+        *start = 0;
+        return quicklist->head;
+    }
+    *start = si->entries[lo - 1].start + si->shift;
+    return si->entries[lo - 1].node;
+}
+
+/* Set the codec used to compress nodes from now on. Already compressed
+ * nodes keep their codec. */
+void quicklistSetCompressCodec(int codec) {
+    compress_codec = codec;
+}
+
+/* Compress interior nodes in a background thread: 'submit' is called with
+ * every new compression job, and should arrange for
+ * quicklistCompressJobRun() to be called in another thread. The results
+ * are applied to the nodes by quicklistCompressJobsDrain(), that must be
+ * called periodically by the main thread. Pass NULL to compress nodes
+ * synchronously. */
+void quicklistSetAsyncCompress(void (*submit)(quicklistCompressJob *job)) {
+    async_compress = submit;
+    if (submit)
+        async_compress_used = 1;
+}
+
+/* Compress 'sz' bytes at 'zl' with 'codec'. Returns NULL if compression
+ * fails or doesn't compress small enough. */
+REDIS_STATIC quicklistLZF *__quicklistCompressData(const unsigned char *zl,
+                                                   unsigned int sz, int codec) {
+    quicklistLZF *lzf = zmalloc(sizeof(*lzf) + sz);
+
+    if (codec == QUICKLIST_CODEC_LZ4)
+        lzf->sz = lz4_compress(zl, sz, lzf->compressed, sz);
+    else
+        lzf->sz = lzf_compress(zl, sz, lzf->compressed, sz);
+
+    /* The compressors abort/reject compression if value not compressable. */
+    if (lzf->sz == 0 || lzf->sz + MIN_COMPRESS_IMPROVE >= sz) {
+        zfree(lzf);
+        return NULL;
+    }
+    return zrealloc(lzf, sizeof(*lzf) + lzf->sz);
+}
+
 /* Compress the ziplist in 'node' and update encoding details.
- * Returns 1 if ziplist compressed successfully.
+ * Returns 1 if ziplist compressed successfully, or if its compression was
+ * handed to a background thread.
  * Returns 0 if compression failed or if ziplist too small to compress. */
 REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
 #ifdef REDIS_TEST
@@ -184,20 +390,30 @@ REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
     if (node->sz < MIN_COMPRESS_BYTES)
         return 0;
 
-    quicklistLZF *lzf = zmalloc(sizeof(*lzf) + node->sz);
+    if (async_compress) {
+        quicklistCompressJob *job = zmalloc(sizeof(*job));
+        job->node = node;
+        job->zl = node->zl;
+        job->sz = node->sz;
+        job->codec = compress_codec;
+        job->lzf = NULL;
+        job->next = NULL;
+        node->zl = (unsigned char *)job;
+        node->encoding = QUICKLIST_NODE_ENCODING_PENDING;
+        node->recompress = 0;
+        async_compress(job);
+        return 1;
+    }
 
-    /* Cancel if compression fails or doesn't compress small enough */
-    if (((lzf->sz = lzf_compress(node->zl, node->sz, lzf->compressed,
-                                 node->sz)) == 0) ||
-        lzf->sz + MIN_COMPRESS_IMPROVE >= node->sz) {
-        /* lzf_compress aborts/rejects compression if value not compressable. */
-        zfree(lzf);
+    quicklistLZF *lzf = __quicklistCompressData(node->zl, node->sz,
+                                                compress_codec);
+    if (!lzf)
         return 0;
-    }
-    lzf = zrealloc(lzf, sizeof(*lzf) + lzf->sz);
     zfree(node->zl);
     node->zl = (unsigned char *)lzf;
-    node->encoding = QUICKLIST_NODE_ENCODING_LZF;
+    node->encoding = compress_codec == QUICKLIST_CODEC_LZ4
+                         ? QUICKLIST_NODE_ENCODING_LZ4
+                         : QUICKLIST_NODE_ENCODING_LZF;
     node->recompress = 0;
     return 1;
 }
@@ -210,6 +426,24 @@ REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
         }                                                                      \
     } while (0)
 
+/* Decompress the data of a compressed node into a new buffer.
+ * Returns NULL on failure to decode. */
+REDIS_STATIC unsigned char *__quicklistDecompressData(const quicklistNode *node) {
+    quicklistLZF *lzf = (quicklistLZF *)node->zl;
+    unsigned char *decompressed = zmalloc(node->sz);
+    unsigned int len;
+
+    if (node->encoding == QUICKLIST_NODE_ENCODING_LZ4)
+        len = lz4_decompress(lzf->compressed, lzf->sz, decompressed, node->sz);
+    else
+        len = lzf_decompress(lzf->compressed, lzf->sz, decompressed, node->sz);
+    if (len == 0) {
+        zfree(decompressed);
+        return NULL;
+    }
+    return decompressed;
+}
+
 /* Uncompress the ziplist in 'node' and update encoding details.
  * Returns 1 on successful decode, 0 on failure to decode. */
 REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
@@ -217,14 +451,24 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
     node->attempted_compress = 0;
 #endif
 
-    void *decompressed = zmalloc(node->sz);
-    quicklistLZF *lzf = (quicklistLZF *)node->zl;
-    if (lzf_decompress(lzf->compressed, lzf->sz, decompressed, node->sz) == 0) {
+    if (node->encoding == QUICKLIST_NODE_ENCODING_PENDING) {
+        /* Cancel the background compression. The background thread may
+         * still be reading the ziplist, so we continue with a copy, and
+         * the original is released with the job. */
+        quicklistCompressJob *job = (quicklistCompressJob *)node->zl;
+        node->zl = zmalloc(node->sz);
+        memcpy(node->zl, job->zl, node->sz);
+        node->encoding = QUICKLIST_NODE_ENCODING_RAW;
+        job->node = NULL;
+        return 1;
+    }
+
+    unsigned char *decompressed = __quicklistDecompressData(node);
+    if (!decompressed) {
         /* Someone requested decompress, but we can't decompress.  Not good. */
-        zfree(decompressed);
         return 0;
     }
-    zfree(lzf);
+    zfree(node->zl);
     node->zl = decompressed;
     node->encoding = QUICKLIST_NODE_ENCODING_RAW;
     return 1;
@@ -233,7 +477,7 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 /* Decompress only compressed nodes. */
 #define quicklistDecompressNode(_node)                                         \
     do {                                                                       \
-        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+        if ((_node) && (_node)->encoding != QUICKLIST_NODE_ENCODING_RAW) {     \
             __quicklistDecompressNode((_node));                                \
         }                                                                      \
     } while (0)
@@ -241,12 +485,21 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 /* Force node to not be immediately re-compresable */
 #define quicklistDecompressNodeForUse(_node)                                   \
     do {                                                                       \
-        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+        if ((_node) && (_node)->encoding != QUICKLIST_NODE_ENCODING_RAW) {     \
             __quicklistDecompressNode((_node));                                \
             (_node)->recompress = 1;                                           \
         }                                                                      \
     } while (0)
 
+/* Free the ziplist of 'node', whatever its encoding. A pending compression
+ * job is cancelled, and will release the ziplist when completed. */
+REDIS_STATIC void __quicklistFreeNodeData(quicklistNode *node) {
+    if (node->encoding == QUICKLIST_NODE_ENCODING_PENDING)
+        ((quicklistCompressJob *)node->zl)->node = NULL;
+    else
+        zfree(node->zl);
+}
+
 /* Extract the raw LZF data from this quicklistNode.
  * Pointer to LZF data is assigned to '*data'.
  * Return value is the length of compressed LZF data. */
@@ -256,6 +509,73 @@ size_t quicklistGetLzf(const quicklistNode *node, void **data) {
     return lzf->sz;
 }
 
+/* Return the ziplist of 'node' for reading, without changing the node.
+ * If the node is compressed, the ziplist is decompressed into a new buffer
+ * and '*tofree' is set to 1: the caller should free it when done. */
+unsigned char *quicklistNodeGetZiplist(const quicklistNode *node, int *tofree) {
+    *tofree = 0;
+    if (node->encoding == QUICKLIST_NODE_ENCODING_RAW)
+        return node->zl;
+    if (node->encoding == QUICKLIST_NODE_ENCODING_PENDING)
+        return ((quicklistCompressJob *)node->zl)->zl;
+    *tofree = 1;
+    return __quicklistDecompressData(node);
+}
+
+/* Return the number of bytes used by the data of 'node'. */
+size_t quicklistNodeBlobLen(const quicklistNode *node) {
+    if (node->encoding == QUICKLIST_NODE_ENCODING_LZF ||
+        node->encoding == QUICKLIST_NODE_ENCODING_LZ4)
+        return sizeof(quicklistLZF) + ((quicklistLZF *)node->zl)->sz;
+    return node->sz;
+}
+
+/* Compress the node of 'job'. Called by the background thread, that only
+ * accesses the job itself, then queues it for quicklistCompressJobsDrain(). */
+void quicklistCompressJobRun(quicklistCompressJob *job) {
+    job->lzf = __quicklistCompressData(job->zl, job->sz, job->codec);
+
+    pthread_mutex_lock(&compress_jobs_mutex);
+    job->next = compress_jobs_done;
+    compress_jobs_done = job;
+    pthread_mutex_unlock(&compress_jobs_mutex);
+}
+
+/* Apply the completed compression jobs to their nodes, unless cancelled.
+ * Called by the main thread. If a quicklist is being freed by another
+ * thread we just retry at the next call. */
+void quicklistCompressJobsDrain(void) {
+    quicklistCompressJob *job, *next;
+
+    if (pthread_mutex_trylock(&compress_swap_mutex) != 0)
+        return;
+    pthread_mutex_lock(&compress_jobs_mutex);
+    job = compress_jobs_done;
+    compress_jobs_done = NULL;
+    pthread_mutex_unlock(&compress_jobs_mutex);
+
+    for (; job; job = next) {
+        quicklistNode *node = job->node;
+
+        next = job->next;
+        if (node && job->lzf) {
+            node->zl = (unsigned char *)job->lzf;
+            node->encoding = job->codec == QUICKLIST_CODEC_LZ4
+                                 ? QUICKLIST_NODE_ENCODING_LZ4
+                                 : QUICKLIST_NODE_ENCODING_LZF;
+            zfree(job->zl);
+        } else if (node) {
+            node->zl = job->zl;
+            node->encoding = QUICKLIST_NODE_ENCODING_RAW;
+        } else {
+            zfree(job->zl);
+            zfree(job->lzf);
+        }
+        zfree(job);
+    }
+    pthread_mutex_unlock(&compress_swap_mutex);
+}
+
 #define quicklistAllowsCompression(_ql) ((_ql)->compress != 0)
 
 /* Force 'quicklist' to meet compression guidelines set by compress depth.
@@ -479,6 +799,7 @@ REDIS_STATIC int _quicklistNodeAllowMerge(const quicklistNode *a,
  * Returns 1 if new head created. */
 int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
     quicklistNode *orig_head = quicklist->head;
+    _quicklistSkipIndexHeadUpdate(quicklist, 1);
     if (likely(
             _quicklistNodeAllowInsert(quicklist->head, quicklist->fill, sz))) {
         quicklist->head->zl =
@@ -578,6 +899,9 @@ quicklist *quicklistCreateFromZiplist(int fill, int compress,
 
 REDIS_STATIC void __quicklistDelNode(quicklist *quicklist,
                                      quicklistNode *node) {
+    if (node->indexed)
+        _quicklistSkipIndexNodeDeleted(quicklist, node);
+
     if (node->next)
         node->next->prev = node->prev;
     if (node->prev)
@@ -597,7 +921,7 @@ REDIS_STATIC void __quicklistDelNode(quicklist *quicklist,
 
     quicklist->count -= node->count;
 
-    zfree(node->zl);
+    __quicklistFreeNodeData(node);
     zfree(node);
     quicklist->len--;
 }
@@ -634,6 +958,7 @@ REDIS_STATIC int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
 void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry) {
     quicklistNode *prev = entry->node->prev;
     quicklistNode *next = entry->node->next;
+    quicklistSkipIndexInvalidate((quicklist *)entry->quicklist);
     int deleted_node = quicklistDelIndex((quicklist *)entry->quicklist,
                                          entry->node, &entry->zi);
 
@@ -836,6 +1161,9 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
     quicklistNode *node = entry->node;
     quicklistNode *new_node = NULL;
 
+    /* Inserting may split or merge nodes anywhere in the list. */
+    quicklistSkipIndexInvalidate(quicklist);
+
     if (!node) {
         /* we have no reference node, so let's create only node in the list */
         D("No node given!");
@@ -978,6 +1306,9 @@ int quicklistDelRange(quicklist *quicklist, const long start,
       count, extent);
     quicklistNode *node = entry.node;
 
+    _quicklistSkipIndexDelRange(
+        quicklist, start >= 0 ? start : (long)quicklist->count + start, extent);
+
     /* iterate over next nodes until everything is deleted. */
     while (extent) {
         quicklistNode *next = node->next;
@@ -1192,20 +1523,24 @@ quicklist *quicklistDup(quicklist *orig) {
          current = current->next) {
         quicklistNode *node = quicklistCreateNode();
 
-        if (current->encoding == QUICKLIST_NODE_ENCODING_LZF) {
+        if (current->encoding == QUICKLIST_NODE_ENCODING_LZF ||
+            current->encoding == QUICKLIST_NODE_ENCODING_LZ4) {
             quicklistLZF *lzf = (quicklistLZF *)current->zl;
             size_t lzf_sz = sizeof(*lzf) + lzf->sz;
             node->zl = zmalloc(lzf_sz);
             memcpy(node->zl, current->zl, lzf_sz);
-        } else if (current->encoding == QUICKLIST_NODE_ENCODING_RAW) {
+            node->encoding = current->encoding;
+        } else {
+            int tofree;
+            unsigned char *zl = quicklistNodeGetZiplist(current, &tofree);
             node->zl = zmalloc(current->sz);
-            memcpy(node->zl, current->zl, current->sz);
+            memcpy(node->zl, zl, current->sz);
+            node->encoding = QUICKLIST_NODE_ENCODING_RAW;
         }
 
         node->count = current->count;
         copy->count += node->count;
         node->sz = current->sz;
-        node->encoding = current->encoding;
 
         _quicklistInsertNodeAfter(copy, copy->tail, node);
     }
@@ -1227,6 +1562,7 @@ int quicklistIndex(const quicklist *quicklist, const long long idx,
     quicklistNode *n;
     unsigned long long accum = 0;
     unsigned long long index;
+    unsigned long steps = 0, maxsteps = ULONG_MAX;
     int forward = idx < 0 ? 0 : 1; /* < 0 -> reverse, 0+ -> forward */
 
     initEntry(entry);
@@ -1243,9 +1579,16 @@ int quicklistIndex(const quicklist *quicklist, const long long idx,
     if (index >= quicklist->count)
         return 0;
 
+    /* On long lists only walk a few nodes from the requested end, then
+     * switch to the skip index. */
+    if (quicklist->len >= QUICKLIST_SKIPINDEX_MIN_NODES)
+        maxsteps = QUICKLIST_SKIPINDEX_STRIDE;
+
     while (likely(n)) {
         if ((accum + n->count) > index) {
             break;
+        } else if (steps++ == maxsteps) {
+            break;
         } else {
             D("Skipping over (%p) %u at accum %lld", (void *)n, n->count,
               accum);
@@ -1254,6 +1597,20 @@ int quicklistIndex(const quicklist *quicklist, const long long idx,
         }
     }
 
+    if (n && (accum + n->count) <= index) {
+        /* The skip index works with positions from the head. It is just a
+         * cache, so we are allowed to build it on a const quicklist. */
+        unsigned long long pos = forward ? index : quicklist->count - 1 - index;
+        n = _quicklistSkipIndexSeek((struct quicklist *)quicklist, pos, &accum);
+        while ((accum + n->count) <= pos) {
+            accum += n->count;
+            n = n->next;
+        }
+        /* Back to the number of elements skipped from the requested end. */
+        if (!forward)
+            accum = quicklist->count - accum - n->count;
+    }
+
     if (!n)
         return 0;
 
@@ -1362,6 +1719,8 @@ int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
             if (sval)
                 *sval = vlong;
         }
+        if (where == QUICKLIST_HEAD)
+            _quicklistSkipIndexHeadUpdate(quicklist, -1);
         quicklistDelIndex(quicklist, node, &p);
         return 1;
     }
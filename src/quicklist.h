@@ -36,27 +36,30 @@
 /* quicklistNode is a 32 byte struct describing a ziplist for a quicklist.
  * We use bit fields keep the quicklistNode at 32 bytes.
  * count: 16 bits, max 65536 (max zl bytes is 65k, so max count actually < 32k).
- * encoding: 2 bits, RAW=1, LZF=2.
+ * encoding: 3 bits, RAW=1, LZF=2, LZ4=3, PENDING=4.
  * container: 2 bits, NONE=1, ZIPLIST=2.
  * recompress: 1 bit, bool, true if node is temporarry decompressed for usage.
  * attempted_compress: 1 bit, boolean, used for verifying during testing.
- * extra: 12 bits, free for future use; pads out the remainder of 32 bits */
+ * indexed: 1 bit, boolean, true if the node is referenced by the skip index.
+ * extra: 8 bits, free for future use; pads out the remainder of 32 bits */
 typedef struct quicklistNode {
     struct quicklistNode *prev;
     struct quicklistNode *next;
     unsigned char *zl;
     unsigned int sz;             /* ziplist size in bytes */
     unsigned int count : 16;     /* count of items in ziplist */
-    unsigned int encoding : 2;   /* RAW==1 or LZF==2 */
+    unsigned int encoding : 3;   /* RAW==1, LZF==2, LZ4==3 or PENDING==4 */
     unsigned int container : 2;  /* NONE==1 or ZIPLIST==2 */
     unsigned int recompress : 1; /* was this node previous compressed? */
     unsigned int attempted_compress : 1; /* node can't compress; too small */
-    unsigned int extra : 10; /* more bits to steal for future usage */
+    unsigned int indexed : 1; /* node is referenced by the skip index */
+    unsigned int extra : 8; /* more bits to steal for future usage */
 } quicklistNode;
 
 /* quicklistLZF is a 4+N byte struct holding 'sz' followed by 'compressed'.
  * 'sz' is byte length of 'compressed' field.
- * 'compressed' is LZF data with total (compressed) length 'sz'
+ * 'compressed' is LZF or LZ4 data (depending on the node encoding) with
+ * total (compressed) length 'sz'
  * NOTE: uncompressed length is stored in quicklistNode->sz.
  * When quicklistNode->zl is compressed, node->zl points to a quicklistLZF */
 typedef struct quicklistLZF {
@@ -64,12 +67,47 @@ typedef struct quicklistLZF {
     char compressed[];
 } quicklistLZF;
 
-/* quicklist is a 32 byte struct (on 64-bit systems) describing a quicklist.
+/* quicklistCompressJob describes the compression of a node performed by a
+ * background thread. While the job is in progress the node encoding is
+ * PENDING and node->zl points to the job, which owns the raw ziplist: the
+ * background thread only reads 'zl', 'sz' and 'codec' and sets 'lzf'.
+ * If the node is accessed, modified or freed before the job completes,
+ * 'node' is set to NULL and the result is discarded. */
+typedef struct quicklistCompressJob {
+    quicklistNode *node;  /* Node to update, or NULL if cancelled. */
+    unsigned char *zl;    /* Raw ziplist of the node. */
+    unsigned int sz;      /* Size of 'zl' in bytes. */
+    int codec;            /* QUICKLIST_CODEC_* used for compression. */
+    quicklistLZF *lzf;    /* Compressed data, NULL if not compressible. */
+    struct quicklistCompressJob *next; /* Completed jobs list. */
+} quicklistCompressJob;
+
+/* quicklistSkipIndex is an auxiliary index over the nodes of long quicklists,
+ * used to find the node holding the element at a given index without
+ * walking the whole list. Every QUICKLIST_SKIPINDEX_STRIDE-th node (but
+ * never the head node) is referenced by an entry, sorted by position.
+ * 'start' + 'shift' is the index of the first element of the entry node:
+ * pushing or popping at the head only needs to update 'shift'.
+ * The index is built lazily on lookups and it is discarded by changes in
+ * the middle of the list, see quicklistSkipIndexInvalidate(). */
+typedef struct quicklistSkipIndexEntry {
+    quicklistNode *node;
+    long long start;
+} quicklistSkipIndexEntry;
+
+typedef struct quicklistSkipIndex {
+    quicklistSkipIndexEntry *entries;
+    unsigned long len;          /* number of entries */
+    long long shift;            /* added to the 'start' of every entry */
+} quicklistSkipIndex;
+
+/* quicklist is a 40 byte struct (on 64-bit systems) describing a quicklist.
  * 'count' is the number of total entries.
  * 'len' is the number of quicklist nodes.
  * 'compress' is: -1 if compression disabled, otherwise it's the number
  *                of quicklistNodes to leave uncompressed at ends of quicklist.
- * 'fill' is the user-requested (or default) fill factor. */
+ * 'fill' is the user-requested (or default) fill factor.
+ * 'skipidx' is the skip index, or NULL if not built. */
 typedef struct quicklist {
     quicklistNode *head;
     quicklistNode *tail;
@@ -77,6 +115,7 @@ typedef struct quicklist {
     unsigned int len;           /* number of quicklistNodes */
     int fill : 16;              /* fill factor for individual nodes */
     unsigned int compress : 16; /* depth of end nodes not to compress;0=off */
+    quicklistSkipIndex *skipidx; /* node index for long lists, or NULL */
 } quicklist;
 
 typedef struct quicklistIter {
@@ -103,6 +142,18 @@ typedef struct quicklistEntry {
 /* quicklist node encodings */
 #define QUICKLIST_NODE_ENCODING_RAW 1
 #define QUICKLIST_NODE_ENCODING_LZF 2
+#define QUICKLIST_NODE_ENCODING_LZ4 3
+#define QUICKLIST_NODE_ENCODING_PENDING 4 /* Background compression. */
+
+/* quicklist compression codecs */
+#define QUICKLIST_CODEC_LZF 0
+#define QUICKLIST_CODEC_LZ4 1
+
+/* The skip index is only built for quicklists with at least
+ * QUICKLIST_SKIPINDEX_MIN_NODES nodes, and references one node every
+ * QUICKLIST_SKIPINDEX_STRIDE nodes. */
+#define QUICKLIST_SKIPINDEX_MIN_NODES 128
+#define QUICKLIST_SKIPINDEX_STRIDE 16
 
 /* quicklist compression disable */
 #define QUICKLIST_NOCOMPRESS 0
@@ -112,7 +163,7 @@ typedef struct quicklistEntry {
 #define QUICKLIST_NODE_CONTAINER_ZIPLIST 2
 
 #define quicklistNodeIsCompressed(node)                                        \
-    ((node)->encoding == QUICKLIST_NODE_ENCODING_LZF)
+    ((node)->encoding != QUICKLIST_NODE_ENCODING_RAW)
 
 /* Prototypes */
 quicklist *quicklistCreate(void);
@@ -157,6 +208,13 @@ int quicklistPop(quicklist *quicklist, int where, unsigned char **data,
 unsigned int quicklistCount(const quicklist *ql);
 int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len);
 size_t quicklistGetLzf(const quicklistNode *node, void **data);
+unsigned char *quicklistNodeGetZiplist(const quicklistNode *node, int *tofree);
+size_t quicklistNodeBlobLen(const quicklistNode *node);
+void quicklistSetCompressCodec(int codec);
+void quicklistSetAsyncCompress(void (*submit)(quicklistCompressJob *job));
+void quicklistCompressJobRun(quicklistCompressJob *job);
+void quicklistCompressJobsDrain(void);
+void quicklistSkipIndexInvalidate(quicklist *quicklist);
 
 #ifdef REDIS_TEST
 int quicklistTest(int argc, char *argv[]);
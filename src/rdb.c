@@ -338,6 +338,26 @@ void *rdbLoadLzfStringObject(rio *rdb, int flags, size_t *lenptr) {
 
     if ((clen = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
     if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
+
+    /* String values that are long enough to be kept compressed in memory
+     * are loaded as they are, without decompressing the LZF blob. */
+    if ((flags & RDB_LOAD_COMPRESSED) && !plain && !sds && !rdbCheckMode &&
+        server.string_compress_threshold &&
+        len >= server.string_compress_threshold && clen <= len-len/4)
+    {
+        compressedString *cs = zmalloc(sizeof(*cs)+clen);
+        robj *o;
+
+        if (rioRead(rdb,cs->data,clen) == 0) {
+            zfree(cs);
+            return NULL;
+        }
+        cs->len = len;
+        cs->clen = clen;
+        o = createObject(OBJ_STRING,cs);
+        o->encoding = OBJ_ENCODING_COMPRESSED;
+        return o;
+    }
     if ((c = zmalloc(clen)) == NULL) goto err;
 
     /* Allocate our target according to the uncompressed size. */
@@ -429,6 +449,36 @@ int rdbSaveStringObject(rio *rdb, robj *obj) {
      * object is already integer encoded. */
     if (obj->encoding == OBJ_ENCODING_INT) {
         return rdbSaveLongLongAsStringObject(rdb,(long)obj->ptr);
+    } else if (obj->encoding == OBJ_ENCODING_DOUBLE) {
+        char buf[OBJ_DOUBLE_STR_SIZE];
+        int len = getDoubleEncodedString(obj,buf,sizeof(buf));
+        return rdbSaveRawString(rdb,(unsigned char*)buf,len);
+    } else if (obj->encoding == OBJ_ENCODING_COMPRESSED) {
+        compressedString *cs = obj->ptr;
+        return rdbSaveLzfBlob(rdb,cs->data,cs->clen,cs->len);
+    } else if (obj->encoding == OBJ_ENCODING_CHUNKED &&
+               !server.rdb_compression) {
+        /* Store verbatim, one chunk at a time. LZF needs a contiguous
+         * input, so when compression is enabled we flatten it below. */
+        chunkedString *cs = obj->ptr;
+        size_t offset = 0;
+        ssize_t n, nwritten;
+
+        if ((nwritten = rdbSaveLen(rdb,cs->len)) == -1) return -1;
+        while (offset < cs->len) {
+            size_t avail;
+            unsigned char *p = chunkedStringSpan(cs,offset,&avail);
+
+            if ((n = rdbWriteRaw(rdb,p,avail)) == -1) return -1;
+            nwritten += n;
+            offset += avail;
+        }
+        return nwritten;
+    } else if (obj->encoding == OBJ_ENCODING_CHUNKED) {
+        robj *dec = getDecodedObject(obj);
+        int retval = rdbSaveRawString(rdb,dec->ptr,sdslen(dec->ptr));
+        decrRefCount(dec);
+        return retval;
     } else {
         serverAssertWithInfo(NULL,obj,sdsEncodedObject(obj));
         return rdbSaveRawString(rdb,obj->ptr,sdslen(obj->ptr));
@@ -445,6 +495,9 @@ int rdbSaveStringObject(rio *rdb, robj *obj) {
  * RDB_LOAD_PLAIN: Return a plain string allocated with zmalloc()
  *                 instead of a Redis object with an sds in it.
  * RDB_LOAD_SDS: Return an SDS string instead of a Redis object.
+ * RDB_LOAD_COMPRESSED: If the string is LZF compressed on disk and is long
+ *                      enough for string-compress-threshold, return an
+ *                      OBJ_ENCODING_COMPRESSED object holding the blob.
  *
  * On I/O error NULL is returned.
  */
@@ -535,7 +588,7 @@ int rdbSaveDoubleValue(rio *rdb, double val) {
             ll2string((char*)buf+1,sizeof(buf)-1,(long long)val);
         else
 #endif
-            snprintf((char*)buf+1,sizeof(buf)-1,"%.17g",val);
+            d2gstring((char*)buf+1,sizeof(buf)-1,val,17);
         buf[0] = strlen((char*)buf+1);
         len = buf[0]+1;
     }
@@ -555,7 +608,7 @@ int rdbLoadDoubleValue(rio *rdb, double *val) {
     default:
         if (rioRead(rdb,buf,len) == 0) return -1;
         buf[len] = '\0';
-        sscanf(buf, "%lg", val);
+        *val = fastStrtod(buf,NULL);
         return 0;
     }
 }
@@ -611,7 +664,7 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
     case OBJ_ZSET:
         if (o->encoding == OBJ_ENCODING_ZIPLIST)
             return rdbSaveType(rdb,RDB_TYPE_ZSET_ZIPLIST);
-        else if (o->encoding == OBJ_ENCODING_SKIPLIST)
+        else if (zsetIsLargeEncoding(o->encoding))
             return rdbSaveType(rdb,RDB_TYPE_ZSET_2);
         else
             serverPanic("Unknown sorted set encoding");
@@ -657,13 +710,20 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
             nwritten += n;
 
             do {
-                if (quicklistNodeIsCompressed(node)) {
+                if (node->encoding == QUICKLIST_NODE_ENCODING_LZF) {
                     void *data;
                     size_t compress_len = quicklistGetLzf(node, &data);
                     if ((n = rdbSaveLzfBlob(rdb,data,compress_len,node->sz)) == -1) return -1;
                     nwritten += n;
                 } else {
-                    if ((n = rdbSaveRawString(rdb,node->zl,node->sz)) == -1) return -1;
+                    /* Other codecs are not part of the RDB format: save
+                     * the ziplist, that may be compressed again with LZF. */
+                    int tofree;
+                    unsigned char *zl = quicklistNodeGetZiplist(node,&tofree);
+                    if (zl == NULL) return -1;
+                    n = rdbSaveRawString(rdb,zl,node->sz);
+                    if (tofree) zfree(zl);
+                    if (n == -1) return -1;
                     nwritten += n;
                 }
             } while ((node = node->next));
@@ -728,6 +788,29 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
                 nwritten += n;
                 zn = zn->backward;
             }
+        } else if (o->encoding == OBJ_ENCODING_BTREE) {
+            zset *zs = o->ptr;
+            zbtree *zbt = zs->zbt;
+            zbtreeCursor cur;
+
+            if ((n = rdbSaveLen(rdb,zbt->length)) == -1) return -1;
+            nwritten += n;
+
+            /* Same order as the skiplist, see above. */
+            if (zbtLast(zbt,&cur)) {
+                do {
+                    zbtreeEntry *e = zbtCursorEntry(&cur);
+                    if ((n = rdbSaveRawString(rdb,
+                        (unsigned char*)e->ele,sdslen(e->ele))) == -1)
+                    {
+                        return -1;
+                    }
+                    nwritten += n;
+                    if ((n = rdbSaveBinaryDoubleValue(rdb,e->score)) == -1)
+                        return -1;
+                    nwritten += n;
+                } while (zbtPrev(&cur));
+            }
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -813,6 +896,20 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val,
         if (rdbSaveMillisecondTime(rdb,expiretime) == -1) return -1;
     }
 
+    /* Values spilled to the tiering file are copied as they are, since
+     * the record is the type followed by the serialized value. */
+    if (val->encoding == OBJ_ENCODING_TIERED) {
+        sds payload = tieringReadPayload(val);
+        int retval = -1;
+
+        if (payload &&
+            rdbWriteRaw(rdb,payload,1) != -1 &&
+            rdbSaveStringObject(rdb,key) != -1 &&
+            rdbWriteRaw(rdb,payload+1,sdslen(payload)-1) != -1) retval = 1;
+        sdsfree(payload);
+        return retval;
+    }
+
     /* Save type, key, value */
     if (rdbSaveObjectType(rdb,val) == -1) return -1;
     if (rdbSaveStringObject(rdb,key) == -1) return -1;
@@ -1111,8 +1208,17 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 
     if (rdbtype == RDB_TYPE_STRING) {
         /* Read string value */
-        if ((o = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
+        robj *c;
+
+        if ((o = rdbGenericLoadStringObject(rdb,
+                RDB_LOAD_ENC|RDB_LOAD_COMPRESSED,NULL)) == NULL) return NULL;
         o = tryObjectEncoding(o);
+        if ((c = tryInternStringObject(o)) != NULL ||
+            (c = tryCompressStringObject(o)) != NULL)
+        {
+            decrRefCount(o);
+            o = c;
+        }
     } else if (rdbtype == RDB_TYPE_LIST) {
         /* Read list value */
         if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
@@ -1185,7 +1291,6 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         while(zsetlen--) {
             sds sdsele;
             double score;
-            zskiplistNode *znode;
 
             if ((sdsele = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL))
                 == NULL) return NULL;
@@ -1199,8 +1304,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             /* Don't care about integer-encoded strings. */
             if (sdslen(sdsele) > maxelelen) maxelelen = sdslen(sdsele);
 
-            znode = zslInsert(zs->zsl,score,sdsele);
-            dictAdd(zs->dict,sdsele,&znode->score);
+            if (zsetInsertNew(zs,score,sdsele) == C_ERR) {
+                rdbExitReportCorruptRDB("Duplicate zset fields detected");
+            }
         }
 
         /* Convert *after* loading, since sorted sets are not stored ordered. */
@@ -1341,7 +1447,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 o->type = OBJ_ZSET;
                 o->encoding = OBJ_ENCODING_ZIPLIST;
                 if (zsetLength(o) > server.zset_max_ziplist_entries)
-                    zsetConvert(o,OBJ_ENCODING_SKIPLIST);
+                    zsetConvert(o,server.zset_large_encoding);
                 break;
             case RDB_TYPE_HASH_ZIPLIST:
                 o->type = OBJ_HASH;
@@ -1406,6 +1512,10 @@ void loadingProgress(off_t pos) {
 /* Loading finished */
 void stopLoading(void) {
     server.loading = 0;
+    /* The per DB memory is not accounted while loading. A dataset loaded
+     * aside is recounted once it replaces the old one. */
+    if (server.db_memory_accounting && !server.async_loading)
+        dbMemoryRecount();
 }
 
 /* Track loading progress in order to serve client's from time to time
@@ -1427,12 +1537,13 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
     }
 }
 
-/* Load an RDB file from the rio stream 'rdb'. On success C_OK is returned,
- * otherwise C_ERR is returned and 'errno' is set accordingly. */
-int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
+/* Load an RDB file from the rio stream 'rdb' into the array of DBs 'dbs',
+ * that is server.db unless a dataset is loaded aside. On success C_OK is
+ * returned, otherwise C_ERR is returned and 'errno' is set accordingly. */
+int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi, redisDb *dbs) {
     uint64_t dbid;
     int type, rdbver;
-    redisDb *db = server.db+0;
+    redisDb *db = dbs+0;
     char buf[1024];
     long long expiretime, now = mstime();
 
@@ -1490,7 +1601,7 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
                     "databases. Exiting\n", server.dbnum);
                 exit(1);
             }
-            db = server.db+dbid;
+            db = dbs+dbid;
             continue; /* Read type again. */
         } else if (type == RDB_OPCODE_RESIZEDB) {
             /* RESIZEDB: Hint about the size of the keys in the currently
@@ -1592,6 +1703,11 @@ eoferr: /* unexpected end of file is handled here with a fatal exit */
  * If you pass an 'rsi' structure initialied with RDB_SAVE_OPTION_INIT, the
  * loading code will fiil the information fields in the structure. */
 int rdbLoad(char *filename, rdbSaveInfo *rsi) {
+    return rdbLoadIntoDbs(filename,rsi,server.db);
+}
+
+/* Like rdbLoad() but the keys are added to the array of DBs 'dbs'. */
+int rdbLoadIntoDbs(char *filename, rdbSaveInfo *rsi, redisDb *dbs) {
     FILE *fp;
     rio rdb;
     int retval;
@@ -1599,7 +1715,7 @@ int rdbLoad(char *filename, rdbSaveInfo *rsi) {
     if ((fp = fopen(filename,"r")) == NULL) return C_ERR;
     startLoading(fp);
     rioInitWithFile(&rdb,fp);
-    retval = rdbLoadRio(&rdb,rsi);
+    retval = rdbLoadRio(&rdb,rsi,dbs);
     fclose(fp);
     stopLoading();
     return retval;
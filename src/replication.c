@@ -151,13 +151,16 @@ void feedReplicationBacklog(void *ptr, size_t len) {
 /* Wrapper for feedReplicationBacklog() that takes Redis string objects
  * as input. */
 void feedReplicationBacklogWithObject(robj *o) {
-    char llstr[LONG_STR_SIZE];
+    char llstr[OBJ_DOUBLE_STR_SIZE];
     void *p;
     size_t len;
 
     if (o->encoding == OBJ_ENCODING_INT) {
         len = ll2string(llstr,sizeof(llstr),(long)o->ptr);
         p = llstr;
+    } else if (o->encoding == OBJ_ENCODING_DOUBLE) {
+        len = getDoubleEncodedString(o,llstr,sizeof(llstr));
+        p = llstr;
     } else {
         len = sdslen(o->ptr);
         p = o->ptr;
@@ -321,6 +324,11 @@ void replicationFeedMonitors(client *c, list *monitors, int dictid, robj **argv,
     for (j = 0; j < argc; j++) {
         if (argv[j]->encoding == OBJ_ENCODING_INT) {
             cmdrepr = sdscatprintf(cmdrepr, "\"%ld\"", (long)argv[j]->ptr);
+        } else if (argv[j]->encoding == OBJ_ENCODING_DOUBLE) {
+            char buf[OBJ_DOUBLE_STR_SIZE];
+            int len = getDoubleEncodedString(argv[j],buf,sizeof(buf));
+
+            cmdrepr = sdscatprintf(cmdrepr, "\"%.*s\"", len, buf);
         } else {
             cmdrepr = sdscatrepr(cmdrepr,(char*)argv[j]->ptr,
                         sdslen(argv[j]->ptr));
@@ -1242,36 +1250,64 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
 
     if (eof_reached) {
         int aof_is_enabled = server.aof_state != AOF_OFF;
+        /* Redis Cluster maps the keys to the slots globally, so the new
+         * dataset can't be loaded aside there. */
+        int async_load = server.repl_slave_async_load &&
+                         !server.cluster_enabled;
+        redisDb *tempdbs = NULL;
 
         if (rename(server.repl_transfer_tmpfile,server.rdb_filename) == -1) {
             serverLog(LL_WARNING,"Failed trying to rename the temp DB into dump.rdb in MASTER <-> SLAVE synchronization: %s", strerror(errno));
             cancelReplicationHandshake();
             return;
         }
-        serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Flushing old data");
         /* We need to stop any AOFRW fork before flusing and parsing
          * RDB, otherwise we'll create a copy-on-write disaster. */
         if(aof_is_enabled) stopAppendOnly();
-        signalFlushedDb(-1);
-        emptyDb(
-            -1,
-            server.repl_slave_lazy_flush ? EMPTYDB_ASYNC : EMPTYDB_NO_FLAGS,
-            replicationEmptyDbCallback);
+        if (async_load) {
+            /* The old dataset keeps being served while loading, and is
+             * replaced only once the new one is complete. */
+            tempdbs = dbCreateTempDbs();
+            server.async_loading = 1;
+        } else {
+            serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Flushing old data");
+            signalFlushedDb(-1);
+            emptyDb(
+                -1,
+                server.repl_slave_lazy_flush ? EMPTYDB_ASYNC : EMPTYDB_NO_FLAGS,
+                replicationEmptyDbCallback);
+        }
         /* Before loading the DB into memory we need to delete the readable
          * handler, otherwise it will get called recursively since
          * rdbLoad() will call the event loop to process events from time to
          * time for non blocking loading. */
         aeDeleteFileEvent(server.el,server.repl_transfer_s,AE_READABLE);
-        serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Loading DB in memory");
+        serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Loading DB in memory%s",
+            async_load ? " while serving the old data" : "");
         rdbSaveInfo rsi = RDB_SAVE_INFO_INIT;
-        if (rdbLoad(server.rdb_filename,&rsi) != C_OK) {
+        if (rdbLoadIntoDbs(server.rdb_filename,&rsi,
+                           async_load ? tempdbs : server.db) != C_OK)
+        {
             serverLog(LL_WARNING,"Failed trying to load the MASTER synchronization DB from disk");
+            if (async_load) {
+                /* Discard what was loaded: the old dataset is retained. */
+                server.async_loading = 0;
+                dbReleaseTempDbs(tempdbs);
+            }
             cancelReplicationHandshake();
             /* Re-enable the AOF if we disabled it earlier, in order to restore
              * the original configuration. */
             if (aof_is_enabled) restartAOF();
             return;
         }
+        if (async_load) {
+            serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Replacing the old data with the loaded DB");
+            signalFlushedDb(-1);
+            dbSwapWithTempDbs(tempdbs);
+            dbReleaseTempDbs(tempdbs);
+            server.async_loading = 0;
+            if (server.db_memory_accounting) dbMemoryRecount();
+        }
         /* Final setup of the connected slave <- master link */
         zfree(server.repl_transfer_tmpfile);
         close(server.repl_transfer_fd);
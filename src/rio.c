@@ -346,6 +346,6 @@ size_t rioWriteBulkDouble(rio *r, double d) {
     char dbuf[128];
     unsigned int dlen;
 
-    dlen = snprintf(dbuf,sizeof(dbuf),"%.17g",d);
+    dlen = d2gstring(dbuf,sizeof(dbuf),d,17);
     return rioWriteBulkString(r,dbuf,dlen);
 }
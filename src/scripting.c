@@ -396,7 +396,7 @@ int luaRedisGenericCommand(lua_State *lua, int raise_error) {
              * since Lua uses a format specifier that loses precision. */
             lua_Number num = lua_tonumber(lua,j+1);
 
-            obj_len = snprintf(dbuf,sizeof(dbuf),"%.17g",(double)num);
+            obj_len = d2gstring(dbuf,sizeof(dbuf),(double)num,17);
             obj_s = dbuf;
         } else {
             obj_s = (char*)lua_tolstring(lua,j+1,&obj_len);
@@ -173,6 +173,7 @@ struct redisCommand redisCommandTable[] = {
     {"srandmember",srandmemberCommand,-2,"rR",0,NULL,1,1,1,0,0},
     {"sinter",sinterCommand,-2,"rS",0,NULL,1,-1,1,0,0},
     {"sinterstore",sinterstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
+    {"sintercard",sintercardCommand,-3,"r",0,sintercardGetKeys,0,0,0,0,0},
     {"sunion",sunionCommand,-2,"rS",0,NULL,1,-1,1,0,0},
     {"sunionstore",sunionstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
     {"sdiff",sdiffCommand,-2,"rS",0,NULL,1,-1,1,0,0},
@@ -507,6 +508,19 @@ uint64_t dictSdsCaseHash(const void *key) {
     return dictGenCaseHashFunction((unsigned char*)key, sdslen((char*)key));
 }
 
+uint64_t dictObjWyHash(const void *key) {
+    const robj *o = key;
+    return dictGenWyHashFunction(o->ptr, sdslen((sds)o->ptr));
+}
+
+uint64_t dictSdsWyHash(const void *key) {
+    return dictGenWyHashFunction((unsigned char*)key, sdslen((char*)key));
+}
+
+uint64_t dictSdsCaseWyHash(const void *key) {
+    return dictGenWyCaseHashFunction((unsigned char*)key, sdslen((char*)key));
+}
+
 int dictEncObjKeyCompare(void *privdata, const void *key1,
         const void *key2)
 {
@@ -525,29 +539,36 @@ int dictEncObjKeyCompare(void *privdata, const void *key1,
     return cmp;
 }
 
-uint64_t dictEncObjHash(const void *key) {
-    robj *o = (robj*) key;
-
+/* Hash the string value of 'o' with 'hashfn', whatever the encoding. */
+static uint64_t encObjHash(robj *o, uint64_t (*hashfn)(const void*, int)) {
     if (sdsEncodedObject(o)) {
-        return dictGenHashFunction(o->ptr, sdslen((sds)o->ptr));
+        return hashfn(o->ptr, sdslen((sds)o->ptr));
     } else {
         if (o->encoding == OBJ_ENCODING_INT) {
             char buf[32];
             int len;
 
             len = ll2string(buf,32,(long)o->ptr);
-            return dictGenHashFunction((unsigned char*)buf, len);
+            return hashfn((unsigned char*)buf, len);
         } else {
             uint64_t hash;
 
             o = getDecodedObject(o);
-            hash = dictGenHashFunction(o->ptr, sdslen((sds)o->ptr));
+            hash = hashfn(o->ptr, sdslen((sds)o->ptr));
             decrRefCount(o);
             return hash;
         }
     }
 }
 
+uint64_t dictEncObjHash(const void *key) {
+    return encObjHash((robj*)key,dictGenHashFunction);
+}
+
+uint64_t dictEncObjWyHash(const void *key) {
+    return encObjHash((robj*)key,dictGenWyHashFunction);
+}
+
 /* Generic hash table type where keys are Redis Objects, Values
  * dummy pointers. */
 dictType objectKeyPointerValueDictType = {
@@ -589,6 +610,18 @@ dictType dbDictType = {
     dictObjectDestructor   /* val destructor */
 };
 
+/* Type of the keyspace dictionaries released by the lazyfree thread, see
+ * freeDbKeyspaceAsync(). The privdata is a rax, used by the value
+ * destructor. */
+dictType lazyfreeDbDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    lazyfreeDbValDestructor     /* val destructor */
+};
+
 /* server.lua_scripts sha (as sds string) -> scripts (as robj) cache. */
 dictType shaScriptObjectDictType = {
     dictSdsCaseHash,            /* hash function */
@@ -609,9 +642,10 @@ dictType keyptrDictType = {
     NULL                        /* val destructor */
 };
 
-/* Command table. sds string -> command struct pointer. */
+/* Command table. sds string -> command struct pointer. The table is
+ * never modified by clients, so it always uses the faster hash function. */
 dictType commandTableDictType = {
-    dictSdsCaseHash,            /* hash function */
+    dictSdsCaseWyHash,          /* hash function */
     NULL,                       /* key dup */
     NULL,                       /* val dup */
     dictSdsKeyCaseCompare,      /* key compare */
@@ -892,6 +926,12 @@ void databasesCron(void) {
     if (server.active_defrag_enabled)
         activeDefragCycle();
 
+    /* Drop the references to the shared values of the keyspaces released
+     * in background, then release the interned values no longer referenced
+     * by keys. */
+    lazyfreeReleaseSharedValues();
+    internPoolCron();
+
     /* Perform hash tables rehashing if needed, but only if there are no
      * other processes saving the DB on disk. Otherwise rehashing is bad
      * as will cause a lot of copy-on-write of memory pages. */
@@ -979,6 +1019,8 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
                 server.stat_net_input_bytes);
         trackInstantaneousMetric(STATS_METRIC_NET_OUTPUT,
                 server.stat_net_output_bytes);
+        trackInstantaneousMetric(STATS_METRIC_EVICTED_BG,
+                server.stat_evictedkeys_bg);
     }
 
     /* We have just LRU_BITS bits per object for LRU information.
@@ -1042,6 +1084,9 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     /* Handle background operations on Redis databases. */
     databasesCron();
 
+    /* Spill cold values to the tiering file. */
+    tieringCron();
+
     /* Start a scheduled AOF rewrite if this was requested by the user while
      * a BGSAVE was in progress. */
     if (server.rdb_child_pid == -1 && server.aof_child_pid == -1 &&
@@ -1207,6 +1252,19 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     if (server.active_expire_enabled && server.masterhost == NULL)
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_FAST);
 
+    /* Evict some key if we are over the maxmemory soft watermark. */
+    evictionBackgroundCycle();
+
+    /* Account the values modified outside call(). */
+    if (server.db_memory_accounting) dbMemoryResolvePending();
+
+    /* Swap in the list nodes compressed in background. */
+    quicklistCompressJobsDrain();
+
+    /* Swap in the values read back from the tiering file, unblocking the
+     * clients waiting for them. */
+    tieringHandleCompletedReads();
+
     /* Send all the slaves an ACK request if at least one client blocked
      * during the previous event loop iteration. */
     if (server.get_ack_from_slaves) {
@@ -1395,6 +1453,7 @@ void initServerConfig(void) {
     server.client_max_querybuf_len = PROTO_MAX_QUERYBUF_LEN;
     server.saveparams = NULL;
     server.loading = 0;
+    server.async_loading = 0;
     server.logfile = zstrdup(CONFIG_DEFAULT_LOGFILE);
     server.syslog_enabled = CONFIG_DEFAULT_SYSLOG_ENABLED;
     server.syslog_ident = zstrdup(CONFIG_DEFAULT_SYSLOG_IDENT);
@@ -1402,6 +1461,7 @@ void initServerConfig(void) {
     server.daemonize = CONFIG_DEFAULT_DAEMONIZE;
     server.supervised = 0;
     server.supervised_mode = SUPERVISED_NONE;
+    server.hash_function = CONFIG_DEFAULT_HASH_FUNCTION;
     server.aof_state = AOF_OFF;
     server.aof_fsync = CONFIG_DEFAULT_AOF_FSYNC;
     server.aof_no_fsync_on_rewrite = CONFIG_DEFAULT_AOF_NO_FSYNC_ON_REWRITE;
@@ -1428,6 +1488,7 @@ void initServerConfig(void) {
     server.rdb_checksum = CONFIG_DEFAULT_RDB_CHECKSUM;
     server.stop_writes_on_bgsave_err = CONFIG_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = CONFIG_DEFAULT_ACTIVE_REHASHING;
+    server.active_expire_index = CONFIG_DEFAULT_ACTIVE_EXPIRE_INDEX;
     server.active_defrag_running = 0;
     server.notify_keyspace_events = 0;
     server.maxclients = CONFIG_DEFAULT_MAX_CLIENTS;
@@ -1435,15 +1496,31 @@ void initServerConfig(void) {
     server.maxmemory = CONFIG_DEFAULT_MAXMEMORY;
     server.maxmemory_policy = CONFIG_DEFAULT_MAXMEMORY_POLICY;
     server.maxmemory_samples = CONFIG_DEFAULT_MAXMEMORY_SAMPLES;
+    server.maxmemory_soft_watermark = CONFIG_DEFAULT_MAXMEMORY_SOFT_WATERMARK;
+    server.maxmemory_mrc = CONFIG_DEFAULT_MAXMEMORY_MRC;
+    server.maxmemory_db = NULL;
+    server.maxmemory_db_len = 0;
+    server.db_memory_accounting = 0;
     server.lfu_log_factor = CONFIG_DEFAULT_LFU_LOG_FACTOR;
     server.lfu_decay_time = CONFIG_DEFAULT_LFU_DECAY_TIME;
+    server.lfu_admission_filter = CONFIG_DEFAULT_LFU_ADMISSION_FILTER;
+    server.value_tiering = CONFIG_DEFAULT_VALUE_TIERING;
+    server.value_tiering_file = zstrdup(CONFIG_DEFAULT_VALUE_TIERING_FILE);
+    server.value_tiering_min_idle = CONFIG_DEFAULT_VALUE_TIERING_MIN_IDLE;
+    server.value_tiering_min_size = CONFIG_DEFAULT_VALUE_TIERING_MIN_SIZE;
     server.hash_max_ziplist_entries = OBJ_HASH_MAX_ZIPLIST_ENTRIES;
     server.hash_max_ziplist_value = OBJ_HASH_MAX_ZIPLIST_VALUE;
     server.list_max_ziplist_size = OBJ_LIST_MAX_ZIPLIST_SIZE;
     server.list_compress_depth = OBJ_LIST_COMPRESS_DEPTH;
+    server.list_compress_codec = OBJ_LIST_COMPRESS_CODEC;
+    server.list_compress_async = CONFIG_DEFAULT_LIST_COMPRESS_ASYNC;
     server.set_max_intset_entries = OBJ_SET_MAX_INTSET_ENTRIES;
     server.zset_max_ziplist_entries = OBJ_ZSET_MAX_ZIPLIST_ENTRIES;
     server.zset_max_ziplist_value = OBJ_ZSET_MAX_ZIPLIST_VALUE;
+    server.zset_large_encoding = OBJ_ZSET_LARGE_ENCODING;
+    server.string_compress_threshold = OBJ_STRING_COMPRESS_THRESHOLD;
+    server.string_chunk_threshold = OBJ_STRING_CHUNK_THRESHOLD;
+    server.string_intern_max_len = OBJ_STRING_INTERN_MAX_LEN;
     server.hll_sparse_max_bytes = CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES;
     server.shutdown_asap = 0;
     server.cluster_enabled = 0;
@@ -1484,6 +1561,7 @@ void initServerConfig(void) {
     server.repl_serve_stale_data = CONFIG_DEFAULT_SLAVE_SERVE_STALE_DATA;
     server.repl_slave_ro = CONFIG_DEFAULT_SLAVE_READ_ONLY;
     server.repl_slave_lazy_flush = CONFIG_DEFAULT_SLAVE_LAZY_FLUSH;
+    server.repl_slave_async_load = CONFIG_DEFAULT_SLAVE_ASYNC_LOAD;
     server.repl_down_since = 0; /* Never connected, repl is down since EVER. */
     server.repl_disable_tcp_nodelay = CONFIG_DEFAULT_REPL_DISABLE_TCP_NODELAY;
     server.repl_diskless_sync = CONFIG_DEFAULT_REPL_DISKLESS_SYNC;
@@ -1788,9 +1866,19 @@ void resetServerStats(void) {
     server.stat_numcommands = 0;
     server.stat_numconnections = 0;
     server.stat_expiredkeys = 0;
+    server.stat_expire_cycle_keys = 0;
+    server.stat_expire_cycle_bytes = 0;
+    server.stat_expire_cycle_backlog_keys = 0;
+    server.stat_expire_cycle_backlog_ms = 0;
     server.stat_evictedkeys = 0;
+    server.stat_evictedkeys_bg = 0;
+    server.stat_admission_rejected = 0;
+    server.stat_tiering_spilled = 0;
+    server.stat_tiering_loads_async = 0;
+    server.stat_tiering_loads_sync = 0;
     server.stat_keyspace_misses = 0;
     server.stat_keyspace_hits = 0;
+    server.stat_intern_hits = 0;
     server.stat_active_defrag_hits = 0;
     server.stat_active_defrag_misses = 0;
     server.stat_active_defrag_key_hits = 0;
@@ -1811,6 +1899,24 @@ void resetServerStats(void) {
     server.stat_net_input_bytes = 0;
     server.stat_net_output_bytes = 0;
     server.aof_delayed_fsync = 0;
+    lazyfreeResetStats();
+    bioResetStats();
+}
+
+/* Switch the dictionaries holding user data to the hash function selected
+ * by the hash-function option. All of them are created after the
+ * configuration is loaded, while the dictionaries created before, like the
+ * command table, keep their hash function. */
+void selectDictHashFunctions(void) {
+    if (server.hash_function != HASH_FUNCTION_WYHASH) return;
+    dbDictType.hashFunction = dictSdsWyHash;
+    lazyfreeDbDictType.hashFunction = dictSdsWyHash;
+    keyptrDictType.hashFunction = dictSdsWyHash;
+    setDictType.hashFunction = dictSdsWyHash;
+    zsetDictType.hashFunction = dictSdsWyHash;
+    hashDictType.hashFunction = dictSdsWyHash;
+    objectKeyPointerValueDictType.hashFunction = dictEncObjWyHash;
+    keylistDictType.hashFunction = dictObjWyHash;
 }
 
 /**
@@ -1829,6 +1935,8 @@ void resetServerStats(void) {
 void initServer(void) {
     int j;
 
+    selectDictHashFunctions();
+
     signal(SIGHUP, SIG_IGN);
     signal(SIGPIPE, SIG_IGN);
     setupSignalHandlers();
@@ -1864,6 +1972,22 @@ void initServer(void) {
     }
     server.db = zmalloc(sizeof(redisDb)*server.dbnum);
 
+    /* Every DB has a maxmemory-db entry, the config file may have set
+     * limits for DBs that don't exist. */
+    for (j = server.dbnum; j < server.maxmemory_db_len; j++) {
+        if (server.maxmemory_db[j]) {
+            serverLog(LL_WARNING,
+                "maxmemory-db: DB %d is out of range, there are %d "
+                "databases.", j, server.dbnum);
+            exit(1);
+        }
+    }
+    server.maxmemory_db = zrealloc(server.maxmemory_db,
+        sizeof(unsigned long long)*server.dbnum);
+    for (j = server.maxmemory_db_len; j < server.dbnum; j++)
+        server.maxmemory_db[j] = 0;
+    server.maxmemory_db_len = server.dbnum;
+
     /* Open the TCP listening socket for the user commands. */
     if (server.port != 0 &&
         listenToPort(server.port,server.ipfd,&server.ipfd_count) == C_ERR)
@@ -1891,13 +2015,20 @@ void initServer(void) {
     for (j = 0; j < server.dbnum; j++) {
         server.db[j].dict = dictCreate(&dbDictType,NULL);
         server.db[j].expires = dictCreate(&keyptrDictType,NULL);
+        server.db[j].expires_index =
+            server.active_expire_index ? raxNew() : NULL;
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&objectKeyPointerValueDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].id = j;
         server.db[j].avg_ttl = 0;
+        server.db[j].used_memory = 0;
     }
     evictionPoolAlloc(); /* Initialize the LRU keys pool. */
+    if (server.maxmemory_mrc) mrcSetEnabled(1);
+    if (server.lfu_admission_filter) admissionSetEnabled(1);
+    server.intern_pool = dictCreate(&objectKeyPointerValueDictType,NULL);
+    server.intern_pool_refs = 0;
     server.pubsub_channels = dictCreate(&keylistDictType,NULL);
     server.pubsub_patterns = listCreate();
     listSetFreeMethod(server.pubsub_patterns,freePubsubPattern);
@@ -1988,6 +2119,8 @@ void initServer(void) {
     slowlogInit();
     latencyMonitorInit();
     bioInit();
+    tieringInit();
+    listTypeUpdateCompressOptions();
     server.initial_memory_usage = zmalloc_used_memory();
 }
 
@@ -2279,6 +2412,7 @@ void call(client *c, int flags) {
     c->cmd->proc(c);
     duration = ustime()-start;
     dirty = server.dirty-dirty;
+    if (server.db_memory_accounting) dbMemoryResolvePending();
     if (dirty < 0) dirty = 0;
 
     /* When EVAL is called loading the AOF we don't want commands called
@@ -2459,8 +2593,12 @@ int processCommand(client *c) {
      *
      * First we try to free some memory if possible (if there are volatile
      * keys in the dataset). If there are not the only thing we can do
-     * is returning an error. */
-    if (server.maxmemory) {
+     * is returning an error.
+     *
+     * While a slave loads a full sync payload aside the memory is mostly
+     * used by the two datasets, and evicting keys from the old one that is
+     * about to be released would not help. */
+    if (server.maxmemory && !server.async_loading) {
         int retval = freeMemoryIfNeeded();
         /* freeMemoryIfNeeded may flush slave output buffers. This may result
          * into a slave, that may be the active client, to be freed. */
@@ -2475,6 +2613,16 @@ int processCommand(client *c) {
         }
     }
 
+    /* Handle the maxmemory-db limit of the client DB the same way. */
+    if (server.db_memory_accounting && !server.async_loading) {
+        int retval = freeDbMemoryIfNeeded(c->db);
+        if ((c->cmd->flags & CMD_DENYOOM) && retval == C_ERR) {
+            flagTransaction(c);
+            addReply(c, shared.oomerr);
+            return C_OK;
+        }
+    }
+
     /* Don't accept write commands if there are problems persisting on disk
      * and if this is a master instance. */
     if (((server.stop_writes_on_bgsave_err &&
@@ -2542,8 +2690,11 @@ int processCommand(client *c) {
     }
 
     /* Loading DB? Return an error if the command has not the
-     * CMD_LOADING flag. */
-    if (server.loading && !(c->cmd->flags & CMD_LOADING)) {
+     * CMD_LOADING flag. A slave loading a full sync payload aside still
+     * serves read only commands from the old dataset. */
+    if (server.loading && !(c->cmd->flags & CMD_LOADING) &&
+        !(server.async_loading && c->cmd->flags & CMD_READONLY))
+    {
         addReply(c, shared.loadingerr);
         return C_OK;
     }
@@ -2572,6 +2723,8 @@ int processCommand(client *c) {
         queueMultiCommand(c);
         addReply(c,shared.queued);
     } else {
+        /* Wait for the spilled values of the keys to be read back. */
+        if (tieringBlockForKeys(c)) return C_OK;
         call(c,CMD_CALL_FULL);
         c->woff = server.master_repl_offset;
         if (listLength(server.ready_keys))
@@ -3035,6 +3188,7 @@ sds genRedisInfoString(char *section) {
         const char *evict_policy = evictPolicyToString();
         long long memory_lua = (long long)lua_gc(server.lua,LUA_GCCOUNT,0)*1024;
         struct redisMemOverhead *mh = getMemoryOverheadData();
+        unsigned long long tiered_keys, tiered_bytes, tiering_file_size;
 
         /* Peak memory is updated from time to time by serverCron() so it
          * may happen that the instantaneous value is slightly bigger than
@@ -3074,7 +3228,10 @@ sds genRedisInfoString(char *section) {
             "mem_fragmentation_ratio:%.2f\r\n"
             "mem_allocator:%s\r\n"
             "active_defrag_running:%d\r\n"
-            "lazyfree_pending_objects:%zu\r\n",
+            "lazyfree_pending_objects:%zu\r\n"
+            "intern_pool_values:%lu\r\n"
+            "intern_pool_refs:%llu\r\n"
+            "intern_dedup_ratio:%.2f\r\n",
             zmalloc_used,
             hmem,
             server.resident_set_size,
@@ -3096,8 +3253,21 @@ sds genRedisInfoString(char *section) {
             mh->fragmentation,
             ZMALLOC_LIB,
             server.active_defrag_running,
-            lazyfreeGetPendingObjectsCount()
+            lazyfreeGetPendingObjectsCount(),
+            dictSize(server.intern_pool),
+            server.intern_pool_refs,
+            dictSize(server.intern_pool) ?
+                (double)server.intern_pool_refs/dictSize(server.intern_pool) :
+                0
         );
+        tieringGetInfo(&tiered_keys,&tiered_bytes,&tiering_file_size);
+        info = sdscatprintf(info,
+            "tiered_keys:%llu\r\n"
+            "tiered_bytes:%llu\r\n"
+            "tiering_file_size:%llu\r\n",
+            tiered_keys,
+            tiered_bytes,
+            tiering_file_size);
         freeMemoryOverheadData(mh);
     }
 
@@ -3107,6 +3277,7 @@ sds genRedisInfoString(char *section) {
         info = sdscatprintf(info,
             "# Persistence\r\n"
             "loading:%d\r\n"
+            "async_loading:%d\r\n"
             "rdb_changes_since_last_save:%lld\r\n"
             "rdb_bgsave_in_progress:%d\r\n"
             "rdb_last_save_time:%jd\r\n"
@@ -3123,6 +3294,7 @@ sds genRedisInfoString(char *section) {
             "aof_last_write_status:%s\r\n"
             "aof_last_cow_size:%zu\r\n",
             server.loading,
+            server.async_loading,
             server.dirty,
             server.rdb_child_pid != -1,
             (intmax_t)server.lastsave,
@@ -3208,7 +3380,14 @@ sds genRedisInfoString(char *section) {
             "sync_partial_ok:%lld\r\n"
             "sync_partial_err:%lld\r\n"
             "expired_keys:%lld\r\n"
+            "expire_cycle_keys:%lld\r\n"
+            "expire_cycle_bytes:%lld\r\n"
+            "expire_cycle_backlog_keys:%lld\r\n"
+            "expire_cycle_backlog_ms:%lld\r\n"
             "evicted_keys:%lld\r\n"
+            "evicted_keys_background:%lld\r\n"
+            "instantaneous_background_evictions_per_sec:%lld\r\n"
+            "admission_rejected_keys:%lld\r\n"
             "keyspace_hits:%lld\r\n"
             "keyspace_misses:%lld\r\n"
             "pubsub_channels:%ld\r\n"
@@ -3219,7 +3398,9 @@ sds genRedisInfoString(char *section) {
             "active_defrag_hits:%lld\r\n"
             "active_defrag_misses:%lld\r\n"
             "active_defrag_key_hits:%lld\r\n"
-            "active_defrag_key_misses:%lld\r\n",
+            "active_defrag_key_misses:%lld\r\n"
+            "intern_pool_hits:%lld\r\n"
+            "lazyfreed_objects:%zu\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),
@@ -3232,7 +3413,14 @@ sds genRedisInfoString(char *section) {
             server.stat_sync_partial_ok,
             server.stat_sync_partial_err,
             server.stat_expiredkeys,
+            server.stat_expire_cycle_keys,
+            server.stat_expire_cycle_bytes,
+            server.stat_expire_cycle_backlog_keys,
+            server.stat_expire_cycle_backlog_ms,
             server.stat_evictedkeys,
+            server.stat_evictedkeys_bg,
+            getInstantaneousMetric(STATS_METRIC_EVICTED_BG),
+            server.stat_admission_rejected,
             server.stat_keyspace_hits,
             server.stat_keyspace_misses,
             dictSize(server.pubsub_channels),
@@ -3243,7 +3431,16 @@ sds genRedisInfoString(char *section) {
             server.stat_active_defrag_hits,
             server.stat_active_defrag_misses,
             server.stat_active_defrag_key_hits,
-            server.stat_active_defrag_key_misses);
+            server.stat_active_defrag_key_misses,
+            server.stat_intern_hits,
+            lazyfreeGetFreedObjectsCount());
+        info = sdscatprintf(info,
+            "tiering_spilled_values:%lld\r\n"
+            "tiering_async_loads:%lld\r\n"
+            "tiering_sync_loads:%lld\r\n",
+            server.stat_tiering_spilled,
+            server.stat_tiering_loads_async,
+            server.stat_tiering_loads_sync);
     }
 
     /* Replication */
@@ -3389,6 +3586,27 @@ sds genRedisInfoString(char *section) {
         (float)c_ru.ru_utime.tv_sec+(float)c_ru.ru_utime.tv_usec/1000000);
     }
 
+    /* Background jobs */
+    if (allsections || defsections || !strcasecmp(section,"bio")) {
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Bio\r\n");
+        for (j = 0; j < BIO_NUM_OPS; j++) {
+            bioStats bs;
+            char name[32];
+            int k;
+
+            bioGetStatsOfType(j,&bs);
+            snprintf(name,sizeof(name),"%s",bioGetTypeName(j));
+            for (k = 0; name[k]; k++) if (name[k] == '-') name[k] = '_';
+            info = sdscatprintf(info,
+                "bio_%s:workers=%d,pending=%llu,processed=%llu,"
+                "wait_usec_per_job=%.2f,run_usec_per_job=%.2f\r\n",
+                name, bs.workers, bs.pending, bs.processed,
+                bs.processed ? (double)bs.wait_usec/bs.processed : 0,
+                bs.processed ? (double)bs.run_usec/bs.processed : 0);
+        }
+    }
+
     /* cmdtime */
     if (allsections || !strcasecmp(section,"commandstats")) {
         if (sections++) info = sdscat(info,"\r\n");
@@ -3423,7 +3641,15 @@ sds genRedisInfoString(char *section) {
 
             keys = dictSize(server.db[j].dict);
             vkeys = dictSize(server.db[j].expires);
-            if (keys || vkeys) {
+            if (server.db_memory_accounting &&
+                (keys || vkeys || server.maxmemory_db[j]))
+            {
+                info = sdscatprintf(info,
+                    "db%d:keys=%lld,expires=%lld,avg_ttl=%lld,"
+                    "used_memory=%lld,maxmemory=%llu\r\n",
+                    j, keys, vkeys, server.db[j].avg_ttl,
+                    server.db[j].used_memory, server.maxmemory_db[j]);
+            } else if (keys || vkeys) {
                 info = sdscatprintf(info,
                     "db%d:keys=%lld,expires=%lld,avg_ttl=%lld\r\n",
                     j, keys, vkeys, server.db[j].avg_ttl);
@@ -3861,6 +4087,10 @@ int main(int argc, char **argv) {
             return endianconvTest(argc, argv);
         } else if (!strcasecmp(argv[2], "crc64")) {
             return crc64Test(argc, argv);
+        } else if (!strcasecmp(argv[2], "lz4")) {
+            return lz4Test(argc, argv);
+        } else if (!strcasecmp(argv[2], "chunkedstring")) {
+            return chunkedStringTest(argc, argv);
         }
 
         return -1; /* test not found */
@@ -3874,6 +4104,7 @@ int main(int argc, char **argv) {
     // 设置内存异常处理
     setlocale(LC_COLLATE,"");
     zmalloc_set_oom_handler(redisOutOfMemoryHandler);
+    crc64_init();
     srand(time(NULL)^getpid());
     gettimeofday(&tv,NULL);
     char hashseed[16];
@@ -72,6 +72,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #include "sha1.h"
 #include "endianconv.h"
 #include "crc64.h"
+#include "lz4.h"
+#include "chunkedstring.h" /* Chunked strings */
 
 /* Error codes */
 #define C_OK                    0
@@ -134,6 +136,13 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_REPL_DISABLE_TCP_NODELAY 0
 #define CONFIG_DEFAULT_MAXMEMORY 0
 #define CONFIG_DEFAULT_MAXMEMORY_SAMPLES 5
+#define CONFIG_DEFAULT_MAXMEMORY_SOFT_WATERMARK 0 /* Background eviction off. */
+#define CONFIG_DEFAULT_MAXMEMORY_MRC 0
+#define CONFIG_DEFAULT_LFU_ADMISSION_FILTER 0
+#define CONFIG_DEFAULT_VALUE_TIERING 0
+#define CONFIG_DEFAULT_VALUE_TIERING_FILE "tiering.dat"
+#define CONFIG_DEFAULT_VALUE_TIERING_MIN_IDLE 3600 /* Seconds. */
+#define CONFIG_DEFAULT_VALUE_TIERING_MIN_SIZE 512  /* Bytes. */
 #define CONFIG_DEFAULT_LFU_LOG_FACTOR 10
 #define CONFIG_DEFAULT_LFU_DECAY_TIME 1
 #define CONFIG_DEFAULT_AOF_FILENAME "appendonly.aof"
@@ -141,6 +150,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_AOF_LOAD_TRUNCATED 1
 #define CONFIG_DEFAULT_AOF_USE_RDB_PREAMBLE 0
 #define CONFIG_DEFAULT_ACTIVE_REHASHING 1
+#define CONFIG_DEFAULT_ACTIVE_EXPIRE_INDEX 0
 #define CONFIG_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
 #define CONFIG_DEFAULT_MIN_SLAVES_TO_WRITE 0
 #define CONFIG_DEFAULT_MIN_SLAVES_MAX_LAG 10
@@ -150,6 +160,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_MIN_RESERVED_FDS 32
 #define CONFIG_DEFAULT_LATENCY_MONITOR_THRESHOLD 0
 #define CONFIG_DEFAULT_SLAVE_LAZY_FLUSH 0
+#define CONFIG_DEFAULT_SLAVE_ASYNC_LOAD 0
 #define CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION 0
 #define CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE 0
 #define CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL 0
@@ -164,6 +175,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #define ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP 20 /* Loopkups per loop. */
 #define ACTIVE_EXPIRE_CYCLE_FAST_DURATION 1000 /* Microseconds */
 #define ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC 25 /* CPU max % for keys collection */
+#define EVICTION_BG_CYCLE_DURATION 1000 /* Background eviction max usec. */
+#define EXPIRE_PROPAGATE_BATCH_SIZE 128 /* Max keys per propagated DEL. */
 #define ACTIVE_EXPIRE_CYCLE_SLOW 0
 #define ACTIVE_EXPIRE_CYCLE_FAST 1
 
@@ -172,7 +185,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #define STATS_METRIC_COMMAND 0      /* Number of commands executed. */
 #define STATS_METRIC_NET_INPUT 1    /* Bytes read to network .*/
 #define STATS_METRIC_NET_OUTPUT 2   /* Bytes written to network. */
-#define STATS_METRIC_COUNT 3
+#define STATS_METRIC_EVICTED_BG 3   /* Keys evicted in the background. */
+#define STATS_METRIC_COUNT 4
 
 /* Protocol and I/O related defines */
 #define PROTO_MAX_QUERYBUF_LEN  (1024*1024*1024) /* 1GB max query buffer. */
@@ -248,6 +262,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CLIENT_LUA_DEBUG (1<<25)  /* Run EVAL in debug mode. */
 #define CLIENT_LUA_DEBUG_SYNC (1<<26)  /* EVAL debugging without fork() */
 #define CLIENT_MODULE (1<<27) /* Non connected client used by some module. */
+#define CLIENT_PENDING_COMMAND (1<<28) /* The current command must be executed
+                                          again once the client is unblocked. */
 
 /* Client block type (btype field in client structure)
  * if CLIENT_BLOCKED flag is set. */
@@ -255,6 +271,7 @@ typedef long long mstime_t; /* millisecond time type. */
 #define BLOCKED_LIST 1    /* BLPOP & co. */
 #define BLOCKED_WAIT 2    /* WAIT for synchronous replication. */
 #define BLOCKED_MODULE 3  /* Blocked by a loadable module. */
+#define BLOCKED_TIERING 4 /* Waiting for values read back from tiering. */
 
 /* Client request types */
 #define PROTO_REQ_INLINE 1
@@ -329,11 +346,17 @@ typedef long long mstime_t; /* millisecond time type. */
 #define SUPERVISED_SYSTEMD 2
 #define SUPERVISED_UPSTART 3
 
+/* Hash function of the dictionaries holding user data. */
+#define HASH_FUNCTION_SIPHASH 0
+#define HASH_FUNCTION_WYHASH 1
+#define CONFIG_DEFAULT_HASH_FUNCTION HASH_FUNCTION_SIPHASH
+
 /* Anti-warning macro... */
 #define UNUSED(V) ((void) V)
 
 #define ZSKIPLIST_MAXLEVEL 32 /* Should be enough for 2^32 elements */
 #define ZSKIPLIST_P 0.25      /* Skiplist P = 1/4 */
+#define ZSET_BULK_LOAD_MIN 128 /* Min ZADD pairs to build new zsets in bulk */
 
 /* Append only defines */
 #define AOF_FSYNC_NO 0
@@ -347,10 +370,16 @@ typedef long long mstime_t; /* millisecond time type. */
 #define OBJ_SET_MAX_INTSET_ENTRIES 512
 #define OBJ_ZSET_MAX_ZIPLIST_ENTRIES 128
 #define OBJ_ZSET_MAX_ZIPLIST_VALUE 64
+#define OBJ_ZSET_LARGE_ENCODING OBJ_ENCODING_SKIPLIST
+#define OBJ_STRING_COMPRESS_THRESHOLD 0 /* Don't compress strings. */
+#define OBJ_STRING_CHUNK_THRESHOLD 0 /* Don't chunk strings. */
+#define OBJ_STRING_INTERN_MAX_LEN 0 /* Don't intern strings. */
 
 /* List defaults */
 #define OBJ_LIST_MAX_ZIPLIST_SIZE -2
 #define OBJ_LIST_COMPRESS_DEPTH 0
+#define OBJ_LIST_COMPRESS_CODEC QUICKLIST_CODEC_LZF
+#define CONFIG_DEFAULT_LIST_COMPRESS_ASYNC 0
 
 /* HyperLogLog defines */
 #define CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES 3000
@@ -554,6 +583,11 @@ typedef struct RedisModuleIO {
 #define OBJ_ENCODING_SKIPLIST 7  /* Encoded as skiplist */
 #define OBJ_ENCODING_EMBSTR 8  /* Embedded sds string encoding */
 #define OBJ_ENCODING_QUICKLIST 9 /* Encoded as linked list of ziplists */
+#define OBJ_ENCODING_BTREE 10  /* Encoded as order-statistic B+tree */
+#define OBJ_ENCODING_COMPRESSED 11 /* LZF compressed string */
+#define OBJ_ENCODING_CHUNKED 12 /* String split in fixed size chunks */
+#define OBJ_ENCODING_DOUBLE 13 /* Double stored in the ptr field */
+#define OBJ_ENCODING_TIERED 14 /* Value spilled to the tiering file */
 
 #define LRU_BITS 24
 #define LRU_CLOCK_MAX ((1<<LRU_BITS)-1) /* Max value of obj->lru */
@@ -570,6 +604,29 @@ typedef struct redisObject {
     void *ptr;
 } robj;
 
+/* Size of a buffer large enough for the string of OBJ_ENCODING_DOUBLE
+ * objects, see getDoubleEncodedString(). */
+#define OBJ_DOUBLE_STR_SIZE 32
+
+/* The ptr of OBJ_ENCODING_COMPRESSED string objects points to this
+ * structure. The data is in the LZF format, so that it can be saved and
+ * loaded as it is by RDB. */
+typedef struct compressedString {
+    size_t len;     /* Length of the uncompressed string. */
+    size_t clen;    /* Length of the compressed data. */
+    char data[];
+} compressedString;
+
+/* The ptr of OBJ_ENCODING_TIERED objects, of any type, points to this
+ * structure: the value itself is serialized in one of the tiering files,
+ * see tiering.c. */
+typedef struct tieredValue {
+    unsigned long long id;  /* Unique ID of the spilled value. */
+    off_t offset;           /* Offset of the record in the file. */
+    size_t len;             /* Length of the record, checksum included. */
+    int file;               /* Index of the tiering file. */
+} tieredValue;
+
 /* Macro used to initialize a Redis object allocated on the stack.
  * Note that this macro is taken near the structure definition to make sure
  * we'll update it when the structure is changed, to avoid bugs like
@@ -589,11 +646,15 @@ struct evictionPoolEntry; /* Defined in evict.c */
 typedef struct redisDb {
     dict *dict;                 /* The keyspace for this DB */
     dict *expires;              /* Timeout of keys with a timeout set */
+    rax *expires_index;         /* Keys with a timeout ordered by time, NULL
+                                   unless active-expire-index is enabled. */
     dict *blocking_keys;        /* Keys with clients waiting for data (BLPOP)*/
     dict *ready_keys;           /* Blocked keys that received a PUSH */
     dict *watched_keys;         /* WATCHED keys for MULTI/EXEC CAS */
     int id;                     /* Database ID */
     long long avg_ttl;          /* Average TTL, just for stats */
+    long long used_memory;      /* Estimated memory used by the keys, only
+                                   tracked if server.db_memory_accounting. */
 } redisDb;
 
 /* Client MULTI/EXEC state */
@@ -631,6 +692,9 @@ typedef struct blockingState {
     void *module_blocked_handle; /* RedisModuleBlockedClient structure.
                                     which is opaque for the Redis core, only
                                     handled in module.c. */
+
+    /* BLOCKED_TIERING */
+    int tiering_reads;      /* Number of values still being read back. */
 } blockingState;
 
 /* The following structure represents a node in the server.ready_keys list,
@@ -751,11 +815,71 @@ typedef struct zskiplist {
     int level;
 } zskiplist;
 
+/* Alternative encoding for large sorted sets: an order-statistic B+tree.
+ * Elements are stored inline in the leaves, sorted by (score,ele), and every
+ * inner node remembers how many elements are stored under each child, so
+ * that ranks can be computed while descending the tree. */
+#define ZBTREE_MAX_FANOUT 64
+#define ZBTREE_MIN_FANOUT (ZBTREE_MAX_FANOUT/4)
+#define ZBTREE_MAX_DEPTH 16
+
+typedef struct zbtreeEntry {
+    sds ele;
+    double score;
+} zbtreeEntry;
+
+/* Header shared by leaves and inner nodes. */
+typedef struct zbtreeNode {
+    unsigned int leaf:1;
+    unsigned int count:31;      /* Number of entries or children. */
+} zbtreeNode;
+
+typedef struct zbtreeLeaf {
+    zbtreeNode hdr;
+    struct zbtreeLeaf *prev, *next;
+    zbtreeEntry entries[ZBTREE_MAX_FANOUT];
+} zbtreeLeaf;
+
+/* keys[i] is a lower bound for all the elements under children[i], and is
+ * owned by the inner node. keys[0] is never used. */
+typedef struct zbtreeInner {
+    zbtreeNode hdr;
+    zbtreeEntry keys[ZBTREE_MAX_FANOUT];
+    unsigned long sizes[ZBTREE_MAX_FANOUT];
+    zbtreeNode *children[ZBTREE_MAX_FANOUT];
+} zbtreeInner;
+
+typedef struct zbtree {
+    zbtreeNode *root;
+    zbtreeLeaf *head, *tail;
+    unsigned long length;
+} zbtree;
+
+/* Position of an element inside the B+tree. Cursors are invalidated by
+ * any modification of the tree. */
+typedef struct zbtreeCursor {
+    zbtreeLeaf *leaf;
+    unsigned int idx;
+} zbtreeCursor;
+
+/* A zset uses either the skiplist or the B+tree to order its elements, the
+ * other pointer is NULL. With the B+tree encoding the dict values are the
+ * scores themselves (see dictGetDoubleVal()) instead of pointers to the
+ * scores stored inside the skiplist nodes. */
 typedef struct zset {
     dict *dict;
     zskiplist *zsl;
+    zbtree *zbt;
 } zset;
 
+/* Element of the array used to populate an empty zset in a single pass,
+ * see zsetBulkLoad(). 'de' is the entry of the element in the zset dict. */
+typedef struct zsetBulkEntry {
+    sds ele;
+    double score;
+    dictEntry *de;
+} zsetBulkEntry;
+
 typedef struct clientBufferLimitsConfig {
     unsigned long long hard_limit_bytes;
     unsigned long long soft_limit_bytes;
@@ -866,6 +990,7 @@ struct redisServer {
     unsigned int lruclock;      /* Clock for LRU eviction */
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
     int activerehashing;        /* Incremental rehash in serverCron() */
+    int active_expire_index;    /* Expire keys using a TTL ordered index. */
     int active_defrag_running;  /* Active defragmentation running (holds current scan aggressiveness) */
     char *requirepass;          /* Pass for AUTH command, or NULL */
     char *pidfile;              /* PID file path */
@@ -902,10 +1027,15 @@ struct redisServer {
     mstime_t clients_pause_end_time; /* Time when we undo clients_paused */
     char neterr[ANET_ERR_LEN];   /* Error buffer for anet.c */
     dict *migrate_cached_sockets;/* MIGRATE cached sockets */
+    dict *intern_pool;          /* Interned string values, see object.c */
+    unsigned long long intern_pool_refs; /* Refs to interned values at the
+                                            end of the last pool scan. */
     uint64_t next_client_id;    /* Next client unique ID. Incremental. */
     int protected_mode;         /* Don't accept external connections. */
     /* RDB / AOF loading information */
     int loading;                /* We are loading data from disk if true */
+    int async_loading;          /* Loading a full sync payload in temporary
+                                   DBs while serving the old dataset. */
     off_t loading_total_bytes;
     off_t loading_loaded_bytes;
     time_t loading_start_time;
@@ -919,8 +1049,21 @@ struct redisServer {
     long long stat_numconnections;  /* Number of connections received */
     long long stat_expiredkeys;     /* Number of expired keys */
     long long stat_evictedkeys;     /* Number of evicted keys (maxmemory) */
+    long long stat_evictedkeys_bg;  /* Keys evicted above the soft watermark */
+    long long stat_admission_rejected; /* New keys evicted by admission filter */
+    long long stat_tiering_spilled; /* Values spilled to the tiering file */
+    long long stat_tiering_loads_async; /* Values read back by the bio thread */
+    long long stat_tiering_loads_sync;  /* Values read back blocking the server */
+    long long stat_expire_cycle_keys;   /* Keys reclaimed by the last active
+                                           expire cycle. */
+    long long stat_expire_cycle_bytes;  /* Memory reclaimed by it. */
+    long long stat_expire_cycle_backlog_keys; /* Estimated number of expired
+                                                 keys left in memory. */
+    long long stat_expire_cycle_backlog_ms; /* How long ago the oldest of them
+                                               expired (TTL index only). */
     long long stat_keyspace_hits;   /* Number of successful lookups of keys */
     long long stat_keyspace_misses; /* Number of failed lookups of keys */
+    long long stat_intern_hits;     /* Values written sharing an interned one */
     long long stat_active_defrag_hits;      /* number of allocations moved */
     long long stat_active_defrag_misses;    /* number of allocations scanned but not moved */
     long long stat_active_defrag_key_hits;  /* number of keys with moved allocations */
@@ -964,6 +1107,7 @@ struct redisServer {
     int dbnum;                      /* Total number of configured DBs */
     int supervised;                 /* 1 if supervised, 0 otherwise. */
     int supervised_mode;            /* See SUPERVISED_* */
+    int hash_function;              /* See HASH_FUNCTION_* */
     int daemonize;                  /* True if running as a daemon */
     clientBufferLimitsConfig client_obuf_limits[CLIENT_TYPE_OBUF_COUNT];
     /* AOF persistence */
@@ -1087,6 +1231,7 @@ struct redisServer {
     char master_replid[CONFIG_RUN_ID_SIZE+1];  /* Master PSYNC runid. */
     long long master_initial_offset;           /* Master PSYNC offset. */
     int repl_slave_lazy_flush;          /* Lazy FLUSHALL before loading DB? */
+    int repl_slave_async_load;          /* Serve old DB while loading? */
     /* Replication script cache. */
     dict *repl_scriptcache_dict;        /* SHA1 all slaves are aware of. */
     list *repl_scriptcache_fifo;        /* First in, first out LRU eviction. */
@@ -1099,8 +1244,21 @@ struct redisServer {
     unsigned long long maxmemory;   /* Max number of memory bytes to use */
     int maxmemory_policy;           /* Policy for key eviction */
     int maxmemory_samples;          /* Pricision of random sampling */
+    int maxmemory_soft_watermark;   /* Background eviction start, % of maxmemory */
+    int maxmemory_mrc;              /* Estimate the miss ratio curve. */
+    unsigned long long *maxmemory_db; /* Per DB memory limits, 0 = none. */
+    int maxmemory_db_len;           /* Number of entries of maxmemory_db. */
+    int db_memory_accounting;       /* True if a per DB limit is set. */
     unsigned int lfu_log_factor;    /* LFU logarithmic counter factor. */
     unsigned int lfu_decay_time;    /* LFU counter decay factor. */
+    int lfu_admission_filter;       /* TinyLFU admission of the new keys. */
+    /* Value tiering */
+    int value_tiering;              /* Spill cold values to the tiering file. */
+    char *value_tiering_file;       /* Path of the tiering file. */
+    long long value_tiering_min_idle; /* Min idle time of spilled values. */
+    long long value_tiering_min_size; /* Min size of spilled values. */
+    int tiering_pipe[2];            /* Pipe used to awake the event loop when
+                                       the bio thread read back a value. */
     /* Blocked clients */
     unsigned int bpop_blocked_clients; /* Number of clients blocked by lists */
     list *unblocked_clients; /* list of clients to unblock before next loop */
@@ -1117,10 +1275,16 @@ struct redisServer {
     size_t set_max_intset_entries;
     size_t zset_max_ziplist_entries;
     size_t zset_max_ziplist_value;
+    int zset_large_encoding;        /* OBJ_ENCODING_SKIPLIST or _BTREE. */
+    size_t string_compress_threshold; /* Min len of compressed strings. */
+    size_t string_chunk_threshold; /* Len over which strings are chunked. */
+    size_t string_intern_max_len; /* Max len of interned string values. */
     size_t hll_sparse_max_bytes;
     /* List parameters */
     int list_max_ziplist_size;
     int list_compress_depth;
+    int list_compress_codec;        /* QUICKLIST_CODEC_LZF or _LZ4. */
+    int list_compress_async;        /* Compress nodes in a bio thread. */
     /* time cache */
     time_t unixtime;    /* Unix time sampled every cron cycle. */
     long long mstime;   /* Like 'unixtime' but with milliseconds resolution. */
@@ -1274,12 +1438,14 @@ extern dictType zsetDictType;
 extern dictType clusterNodesDictType;
 extern dictType clusterNodesBlackListDictType;
 extern dictType dbDictType;
+extern dictType lazyfreeDbDictType;
 extern dictType shaScriptObjectDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
 extern dictType replScriptCacheDictType;
 extern dictType keyptrDictType;
 extern dictType modulesDictType;
+extern dictType keylistDictType;
 
 /*-----------------------------------------------------------------------------
  * Functions prototypes
@@ -1316,6 +1482,7 @@ void closeTimedoutClients(void);
 void freeClient(client *c);
 void freeClientAsync(client *c);
 void resetClient(client *c);
+int processPendingCommand(client *c);
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
 void *addDeferredMultiBulkLength(client *c);
 void setDeferredMultiBulkLength(client *c, void *node, long length);
@@ -1328,6 +1495,7 @@ void addReplyString(client *c, const char *s, size_t len);
 void addReplyBulk(client *c, robj *obj);
 void addReplyBulkCString(client *c, const char *s);
 void addReplyBulkCBuffer(client *c, const void *p, size_t len);
+void addReplyChunkedString(client *c, chunkedString *cs, size_t offset, size_t len);
 void addReplyBulkLongLong(client *c, long long ll);
 void addReply(client *c, robj *obj);
 void addReplySds(client *c, sds s);
@@ -1337,6 +1505,7 @@ void addReplyStatus(client *c, const char *status);
 void addReplyDouble(client *c, double d);
 void addReplyHumanLongDouble(client *c, long double d);
 void addReplyLongLong(client *c, long long ll);
+void addReplyLongLongWithPrefix(client *c, long long ll, char prefix);
 void addReplyMultiBulkLen(client *c, long length);
 void copyClientOutputBuffer(client *dst, client *src);
 size_t sdsZmallocSize(sds s);
@@ -1390,6 +1559,7 @@ void listTypeInsert(listTypeEntry *entry, robj *value, int where);
 int listTypeEqual(listTypeEntry *entry, robj *o);
 void listTypeDelete(listTypeIterator *iter, listTypeEntry *entry);
 void listTypeConvert(robj *subject, int enc);
+void listTypeUpdateCompressOptions(void);
 void unblockClientWaitingData(client *c);
 void handleClientsBlockedOnLists(void);
 void popGenericCommand(client *c, int where);
@@ -1422,6 +1592,12 @@ robj *createStringObject(const char *ptr, size_t len);
 robj *createRawStringObject(const char *ptr, size_t len);
 robj *createEmbeddedStringObject(const char *ptr, size_t len);
 robj *dupStringObject(const robj *o);
+robj *createCompressedStringObject(const void *data, size_t clen, size_t len);
+robj *tryCompressStringObject(robj *o);
+robj *createChunkedStringObject(const char *ptr, size_t len);
+robj *tryInternStringObject(robj *o);
+void internPoolCron(void);
+int stringNeedsChunking(size_t len);
 int isSdsRepresentableAsLongLong(sds s, long long *llval);
 int isObjectRepresentableAsLongLong(robj *o, long long *llongval);
 robj *tryObjectEncoding(robj *o);
@@ -1429,6 +1605,9 @@ robj *getDecodedObject(robj *o);
 size_t stringObjectLen(robj *o);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongDouble(long double value, int humanfriendly);
+robj *createDoubleStringObject(double value);
+double getDoubleEncodedValue(const robj *o);
+int getDoubleEncodedString(const robj *o, char *buf, size_t len);
 robj *createQuicklistObject(void);
 robj *createZiplistObject(void);
 robj *createSetObject(void);
@@ -1450,6 +1629,8 @@ int compareStringObjects(robj *a, robj *b);
 int collateStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
 unsigned long long estimateObjectIdleTime(robj *o);
+#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5 /* Default sample size. */
+size_t objectComputeSize(robj *o, size_t sample_size);
 #define sdsEncodedObject(objptr) (objptr->encoding == OBJ_ENCODING_RAW || objptr->encoding == OBJ_ENCODING_EMBSTR)
 
 /* Synchronous I/O with timeout */
@@ -1546,6 +1727,7 @@ typedef struct {
 zskiplist *zslCreate(void);
 void zslFree(zskiplist *zsl);
 zskiplistNode *zslInsert(zskiplist *zsl, double score, sds ele);
+void zslBulkLoad(zskiplist *zsl, dict *d, zsetBulkEntry *entries, unsigned long count);
 unsigned char *zzlInsert(unsigned char *zl, sds ele, double score);
 int zslDelete(zskiplist *zsl, double score, sds ele, zskiplistNode **node);
 zskiplistNode *zslFirstInRange(zskiplist *zsl, zrangespec *range);
@@ -1576,9 +1758,60 @@ int zzlLexValueGteMin(unsigned char *p, zlexrangespec *spec);
 int zzlLexValueLteMax(unsigned char *p, zlexrangespec *spec);
 int zslLexValueGteMin(sds value, zlexrangespec *spec);
 int zslLexValueLteMax(sds value, zlexrangespec *spec);
+zbtree *zbtCreate(void);
+void zbtFree(zbtree *zbt);
+void zbtInsert(zbtree *zbt, double score, sds ele);
+void zbtBulkLoad(zbtree *zbt, zsetBulkEntry *entries, unsigned long count);
+int zbtDelete(zbtree *zbt, double score, sds ele, sds *oldele);
+unsigned long zbtFirstInRange(zbtree *zbt, zrangespec *range, zbtreeCursor *cur);
+unsigned long zbtLastInRange(zbtree *zbt, zrangespec *range, zbtreeCursor *cur);
+unsigned long zbtFirstInLexRange(zbtree *zbt, zlexrangespec *range, zbtreeCursor *cur);
+unsigned long zbtLastInLexRange(zbtree *zbt, zlexrangespec *range, zbtreeCursor *cur);
+unsigned long zbtGetRank(zbtree *zbt, double score, sds ele);
+int zbtGetElementByRank(zbtree *zbt, unsigned long rank, zbtreeCursor *cur);
+sds *zbtFindElement(zbtree *zbt, double score, sds ele);
+int zbtFirst(zbtree *zbt, zbtreeCursor *cur);
+int zbtLast(zbtree *zbt, zbtreeCursor *cur);
+int zbtNext(zbtreeCursor *cur);
+int zbtPrev(zbtreeCursor *cur);
+#define zbtCursorEntry(cur) (&(cur)->leaf->entries[(cur)->idx])
+#define zsetDictGetScore(zobj,de) ((zobj)->encoding == OBJ_ENCODING_BTREE ? \
+    dictGetDoubleVal(de) : *(double*)dictGetVal(de))
+int zsetIsLargeEncoding(int encoding);
+zset *zsetCreate(int encoding);
+int zsetInsertNew(zset *zs, double score, sds ele);
+void zsetBulkLoad(zset *zs, zsetBulkEntry *entries, unsigned long count);
+
+/* Value tiering */
+void tieringInit(void);
+int tieringOpenFiles(void);
+void tieringCron(void);
+int tieringSpillKey(redisDb *db, robj *key);
+size_t tieringSerializedLen(robj *stub);
+robj *tieringLoadKey(redisDb *db, robj *key, robj *stub);
+robj *tieringReadValue(robj *stub);
+sds tieringReadPayload(robj *stub);
+void tieringFreeStub(robj *stub);
+int tieringBlockForKeys(client *c);
+void tieringUnblockClient(client *c);
+void tieringReadJobRun(void *arg);
+void tieringHandleCompletedReads(void);
+void tieringGetInfo(unsigned long long *keys, unsigned long long *bytes,
+                    unsigned long long *file_size);
 
 /* Core functions */
 int freeMemoryIfNeeded(void);
+int freeDbMemoryIfNeeded(redisDb *db);
+void evictionBackgroundCycle(void);
+void admissionSetEnabled(int enabled);
+void admissionRecordAccess(redisDb *db, robj *key);
+void admissionAddCandidate(redisDb *db, robj *key);
+void mrcSetEnabled(int enabled);
+void mrcReset(void);
+void mrcKeyAccess(redisDb *db, robj *key, robj *val, int count);
+void mrcKeyDelete(redisDb *db, robj *key);
+void mrcEmptyCaches(void);
+void mrcReply(client *c);
 int processCommand(client *c);
 void setupSignalHandlers(void);
 struct redisCommand *lookupCommand(sds name);
@@ -1676,13 +1909,26 @@ sds keyspaceEventsFlagsToString(int flags);
 void loadServerConfig(char *filename, char *options);
 void appendServerSaveParams(time_t seconds, int changes);
 void resetServerSaveParams(void);
+void setDbMaxmemory(int dbid, unsigned long long bytes);
 struct rewriteConfigState; /* Forward declaration to export API. */
 void rewriteConfigRewriteLine(struct rewriteConfigState *state, const char *option, sds line, int force);
 int rewriteConfig(char *path);
 
 /* db.c -- Keyspace access API */
 int removeExpire(redisDb *db, robj *key);
+int dbDeleteExpire(redisDb *db, sds key);
 void propagateExpire(redisDb *db, robj *key, int lazy);
+void propagateExpireBatched(redisDb *db, robj *key, int lazy);
+void propagatePendingExpires(void);
+/* True if the per DB memory usage must be updated. */
+#define dbMemoryAccounting() (server.db_memory_accounting && !server.loading)
+size_t dbKeyMemory(robj *key, robj *val);
+size_t dbMemoryTrackWrite(redisDb *db, robj *key, robj *val);
+void dbMemoryLink(redisDb *db, robj *key, robj *val);
+void dbMemoryUnlink(redisDb *db, robj *key, robj *val);
+void dbMemoryResolvePending(void);
+void dbMemoryRecount(void);
+int dbMemoryOverLimit(void);
 int expireIfNeeded(redisDb *db, robj *key);
 long long getExpire(redisDb *db, robj *key);
 void setExpire(client *c, redisDb *db, robj *key, long long when);
@@ -1704,10 +1950,15 @@ robj *dbRandomKey(redisDb *db);
 int dbSyncDelete(redisDb *db, robj *key);
 int dbDelete(redisDb *db, robj *key);
 robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o);
+robj *dbFlattenStringValue(redisDb *db, robj *key, robj *o);
+robj *dbChunkStringValue(redisDb *db, robj *key, robj *o);
 
 #define EMPTYDB_NO_FLAGS 0      /* No flags. */
 #define EMPTYDB_ASYNC (1<<0)    /* Reclaim memory in another thread. */
 long long emptyDb(int dbnum, int flags, void(callback)(void*));
+redisDb *dbCreateTempDbs(void);
+void dbSwapWithTempDbs(redisDb *tempdbs);
+void dbReleaseTempDbs(redisDb *tempdbs);
 
 int selectDb(client *c, int id);
 void signalModifiedKey(redisDb *db, robj *key);
@@ -1722,15 +1973,22 @@ void slotToKeyAdd(robj *key);
 void slotToKeyDel(robj *key);
 void slotToKeyFlush(void);
 int dbAsyncDelete(redisDb *db, robj *key);
+void freeObjAsync(robj *o);
 void emptyDbAsync(redisDb *db);
+void freeDbKeyspaceAsync(redisDb *db);
+void lazyfreeDbValDestructor(void *privdata, void *val);
+void lazyfreeReleaseSharedValues(void);
 void slotToKeyFlushAsync(void);
 size_t lazyfreeGetPendingObjectsCount(void);
+size_t lazyfreeGetFreedObjectsCount(void);
+void lazyfreeResetStats(void);
 
 /* API to get key arguments from commands */
 int *getKeysFromCommand(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 void getKeysFreeResult(int *result);
 int *zunionInterGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys);
 int *evalGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
+int *sintercardGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 int *sortGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 int *migrateGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
 int *georadiusGetKeys(struct redisCommand *cmd, robj **argv, int argc, int *numkeys);
@@ -1775,15 +2033,21 @@ void expireSlaveKeys(void);
 void rememberSlaveKeyWithExpire(redisDb *db, robj *key);
 void flushSlaveKeysWithExpireList(void);
 size_t getSlaveKeyWithExpireCount(void);
+void expireIndexAdd(redisDb *db, sds key, long long when);
+void expireIndexDel(redisDb *db, sds key, long long when);
+void expireIndexCreate(redisDb *db);
+void expireIndexSetEnabled(int enabled);
 
 /* evict.c -- maxmemory handling and LRU eviction. */
 void evictionPoolAlloc(void);
 #define LFU_INIT_VAL 5
 unsigned long LFUGetTimeInMinutes(void);
 uint8_t LFULogIncr(uint8_t value);
+unsigned long LFUDecrAndReturn(robj *o);
 
 /* Keys hashing / comparison functions for dict.c hash tables. */
 uint64_t dictSdsHash(const void *key);
+uint64_t dictSdsWyHash(const void *key);
 int dictSdsKeyCompare(void *privdata, const void *key1, const void *key2);
 void dictSdsDestructor(void *privdata, void *val);
 
@@ -1851,6 +2115,7 @@ void spopCommand(client *c);
 void srandmemberCommand(client *c);
 void sinterCommand(client *c);
 void sinterstoreCommand(client *c);
+void sintercardCommand(client *c);
 void sunionCommand(client *c);
 void sunionstoreCommand(client *c);
 void sdiffCommand(client *c);
@@ -302,8 +302,8 @@ void sortCommand(client *c) {
     }
 
     /* Destructively convert encoded sorted sets for SORT. */
-    if (sortval->type == OBJ_ZSET)
-        zsetConvert(sortval, OBJ_ENCODING_SKIPLIST);
+    if (sortval->type == OBJ_ZSET && sortval->encoding == OBJ_ENCODING_ZIPLIST)
+        zsetConvert(sortval, server.zset_large_encoding);
 
     /* Objtain the length of the object to sort. */
     switch(sortval->type) {
@@ -388,6 +388,32 @@ void sortCommand(client *c) {
             j++;
         }
         setTypeReleaseIterator(si);
+    } else if (sortval->type == OBJ_ZSET && dontsort &&
+               sortval->encoding == OBJ_ENCODING_BTREE)
+    {
+        /* Same as the skiplist case below, seeking the first element to
+         * return by rank in the B+tree. */
+        zset *zs = sortval->ptr;
+        long zsetlen = zs->zbt->length;
+        zbtreeCursor cur;
+        zbtreeEntry *e;
+        int rangelen = vectorlen;
+
+        if (rangelen > 0)
+            serverAssertWithInfo(c,sortval,zbtGetElementByRank(zs->zbt,
+                desc ? zsetlen-start : start+1,&cur));
+
+        while(rangelen--) {
+            e = zbtCursorEntry(&cur);
+            vector[j].obj = createStringObject(e->ele,sdslen(e->ele));
+            vector[j].u.score = 0;
+            vector[j].u.cmpobj = NULL;
+            j++;
+            if (desc) zbtPrev(&cur); else zbtNext(&cur);
+        }
+        /* Fix start/end: output code is not aware of this optimization. */
+        end -= start;
+        start = 0;
     } else if (sortval->type == OBJ_ZSET && dontsort) {
         /* Special handling for a sorted set, if 'dontsort' is true.
          * This makes sure we return elements in the sorted set original
@@ -465,7 +491,7 @@ void sortCommand(client *c) {
                 if (sdsEncodedObject(byval)) {
                     char *eptr;
 
-                    vector[j].u.score = strtod(byval->ptr,&eptr);
+                    vector[j].u.score = fastStrtod(byval->ptr,&eptr);
                     if (eptr[0] != '\0' || errno == ERANGE ||
                         isnan(vector[j].u.score))
                     {
@@ -476,6 +502,12 @@ void sortCommand(client *c) {
                      * integer-encoded (the only encoding supported) so
                      * far. We can just cast it */
                     vector[j].u.score = (long)byval->ptr;
+                } else if (byval->encoding == OBJ_ENCODING_DOUBLE) {
+                    vector[j].u.score = getDoubleEncodedValue(byval);
+                } else if (byval->encoding == OBJ_ENCODING_COMPRESSED ||
+                           byval->encoding == OBJ_ENCODING_CHUNKED) {
+                    if (getDoubleFromObject(byval,&vector[j].u.score) !=
+                        C_OK) int_convertion_error = 1;
                 } else {
                     serverAssertWithInfo(c,sortval,1 != 1);
                 }
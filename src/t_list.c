@@ -28,6 +28,7 @@
  */
 
 #include "server.h"
+#include "bio.h"
 
 /*-----------------------------------------------------------------------------
  * List API
@@ -190,6 +191,19 @@ void listTypeConvert(robj *subject, int enc) {
     }
 }
 
+/* Submit the compression of a quicklist node to the background thread. */
+static void listTypeCompressInBackground(quicklistCompressJob *job) {
+    bioCreateBackgroundJob(BIO_QUICKLIST_COMPRESS,job,NULL,NULL);
+}
+
+/* Apply the list-compress-codec and list-compress-async options to the
+ * quicklist library, that uses them for all the lists. */
+void listTypeUpdateCompressOptions(void) {
+    quicklistSetCompressCodec(server.list_compress_codec);
+    quicklistSetAsyncCompress(server.list_compress_async ?
+                              listTypeCompressInBackground : NULL);
+}
+
 /*-----------------------------------------------------------------------------
  * List Commands
  *----------------------------------------------------------------------------*/
@@ -785,16 +785,21 @@ int qsortCompareSetsByRevCardinality(const void *s1, const void *s2) {
     return  (o2 ? setTypeSize(o2) : 0) - (o1 ? setTypeSize(o1) : 0);
 }
 
+/* Implements SINTER, SINTERSTORE and SINTERCARD. When 'cardinality_only' is
+ * true only the number of elements of the intersection is replied, and the
+ * computation stops as soon as 'limit' elements are found (if not zero). */
 void sinterGenericCommand(client *c, robj **setkeys,
-                          unsigned long setnum, robj *dstkey) {
+                          unsigned long setnum, robj *dstkey,
+                          int cardinality_only, unsigned long limit) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
+    uint32_t *pos;
     setTypeIterator *si;
     robj *dstset = NULL;
     sds elesds;
     int64_t intobj;
     void *replylen = NULL;
     unsigned long j, cardinality = 0;
-    int encoding;
+    int encoding, exhausted = 0;
 
     for (j = 0; j < setnum; j++) {
         robj *setobj = dstkey ?
@@ -808,6 +813,8 @@ void sinterGenericCommand(client *c, robj **setkeys,
                     server.dirty++;
                 }
                 addReply(c,shared.czero);
+            } else if (cardinality_only) {
+                addReply(c,shared.czero);
             } else {
                 addReply(c,shared.emptymultibulk);
             }
@@ -828,26 +835,36 @@ void sinterGenericCommand(client *c, robj **setkeys,
      * the intersection set size, so we use a trick, append an empty object
      * to the output list and save the pointer to later modify it with the
      * right length */
-    if (!dstkey) {
-        replylen = addDeferredMultiBulkLength(c);
-    } else {
+    if (dstkey) {
         /* If we have a target key where to store the resulting set
          * create this key with an empty set inside */
         dstset = createIntsetObject();
+    } else if (!cardinality_only) {
+        replylen = addDeferredMultiBulkLength(c);
     }
 
     /* Iterate all the elements of the first (smallest) set, and test
      * the element against all the other sets, if at least one set does
-     * not include the element it is discarded */
+     * not include the element it is discarded.
+     *
+     * Intsets are iterated in ascending order, so when the first set is
+     * an intset we remember, for every other intset, the position where
+     * the last element was searched: the next search starts from there
+     * using intsetSearchFrom(), so that intersecting intsets of similar
+     * sizes works like a merge, and we can stop as soon as one of them is
+     * exhausted. */
+    pos = zcalloc(sizeof(uint32_t)*setnum);
     si = setTypeInitIterator(sets[0]);
-    while((encoding = setTypeNext(si,&elesds,&intobj)) != -1) {
+    while(!exhausted && (encoding = setTypeNext(si,&elesds,&intobj)) != -1) {
         for (j = 1; j < setnum; j++) {
             if (sets[j] == sets[0]) continue;
             if (encoding == OBJ_ENCODING_INTSET) {
                 /* intset with intset is simple... and fast */
                 if (sets[j]->encoding == OBJ_ENCODING_INTSET &&
-                    !intsetFind((intset*)sets[j]->ptr,intobj))
+                    !intsetSearchFrom((intset*)sets[j]->ptr,intobj,&pos[j]))
                 {
+                    if (pos[j] == intsetLen((intset*)sets[j]->ptr))
+                        exhausted = 1;
                     break;
                 /* in order to compare an integer with an object we
                  * have to use the generic function, creating an object
@@ -869,7 +886,10 @@ void sinterGenericCommand(client *c, robj **setkeys,
 
         /* Only take action when all sets contain the member */
         if (j == setnum) {
-            if (!dstkey) {
+            if (cardinality_only) {
+                cardinality++;
+                if (limit && cardinality >= limit) break;
+            } else if (!dstkey) {
                 if (encoding == OBJ_ENCODING_HT)
                     addReplyBulkCBuffer(c,elesds,sdslen(elesds));
                 else
@@ -887,8 +907,11 @@ void sinterGenericCommand(client *c, robj **setkeys,
         }
     }
     setTypeReleaseIterator(si);
+    zfree(pos);
 
-    if (dstkey) {
+    if (cardinality_only) {
+        addReplyLongLong(c,cardinality);
+    } else if (dstkey) {
         /* Store the resulting set into the target, if the intersection
          * is not an empty set. */
         int deleted = dbDelete(c->db,dstkey);
@@ -913,24 +936,234 @@ void sinterGenericCommand(client *c, robj **setkeys,
 }
 
 void sinterCommand(client *c) {
-    sinterGenericCommand(c,c->argv+1,c->argc-1,NULL);
+    sinterGenericCommand(c,c->argv+1,c->argc-1,NULL,0,0);
 }
 
 void sinterstoreCommand(client *c) {
-    sinterGenericCommand(c,c->argv+2,c->argc-2,c->argv[1]);
+    sinterGenericCommand(c,c->argv+2,c->argc-2,c->argv[1],0,0);
+}
+
+/* SINTERCARD numkeys key [key ...] [LIMIT limit] */
+void sintercardCommand(client *c) {
+    long numkeys, limit = 0;
+    int j;
+
+    if (getLongFromObjectOrReply(c,c->argv[1],&numkeys,NULL) != C_OK)
+        return;
+    if (numkeys < 1) {
+        addReplyError(c,"numkeys should be greater than 0");
+        return;
+    }
+    if (numkeys > c->argc-2) {
+        addReplyError(c,"Number of keys can't be greater than number of args");
+        return;
+    }
+
+    for (j = 2+numkeys; j < c->argc; j++) {
+        if (!strcasecmp(c->argv[j]->ptr,"limit") && j+1 < c->argc) {
+            if (getLongFromObjectOrReply(c,c->argv[j+1],&limit,NULL) != C_OK)
+                return;
+            if (limit < 0) {
+                addReplyError(c,"LIMIT can't be negative");
+                return;
+            }
+            j++;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    sinterGenericCommand(c,c->argv+2,numkeys,NULL,1,limit);
 }
 
 #define SET_OP_UNION 0
 #define SET_OP_DIFF 1
 #define SET_OP_INTER 2
 
+/* Cost of adding an element to the temporary set used to compute SUNION
+ * and SDIFF, in units of set membership tests. Used by the planner below
+ * to compare the different strategies. */
+#define SET_OP_ADD_COST 4
+
+/* Number of elements sampled to estimate the result cardinality. */
+#define SET_OP_SAMPLES 32
+
+/* Return true if 'ele', returned by setTypeNext() or setTypeRandomElement()
+ * with the specified encoding, is a member of 'set'. */
+static int setOpIsMember(robj *set, int encoding, sds ele, int64_t llele) {
+    if (encoding == OBJ_ENCODING_INTSET) {
+        if (set->encoding == OBJ_ENCODING_INTSET)
+            return intsetFind(set->ptr,llele);
+        ele = sdsfromlonglong(llele);
+        int retval = setTypeIsMember(set,ele);
+        sdsfree(ele);
+        return retval;
+    }
+    return setTypeIsMember(set,ele);
+}
+
+/* Estimate the cardinality of the result of SUNION or SDIFF, sampling a
+ * few random elements. For SDIFF we check how many elements of the first
+ * set are not found in the other sets. For SUNION, where sets are ordered
+ * by decreasing size, every set contributes the fraction of its elements
+ * that are not found in the first (largest) one: overlaps between the
+ * other sets are not considered, so the estimate errs on the large side. */
+static unsigned long setOpEstimateCard(robj **sets, int setnum, int op) {
+    unsigned long estimate = 0, size;
+    int j, k, s, samples, found, encoding;
+    int64_t llele;
+    sds ele;
+
+    if (sets[0] == NULL) return 0;
+    estimate = setTypeSize(sets[0]);
+    for (j = (op == SET_OP_UNION); j < setnum; j++) {
+        if (!sets[j] || (op == SET_OP_UNION && sets[j] == sets[0])) continue;
+        size = setTypeSize(sets[j]);
+        samples = size < SET_OP_SAMPLES ? size : SET_OP_SAMPLES;
+        found = 0;
+        for (s = 0; s < samples; s++) {
+            encoding = setTypeRandomElement(sets[j],&ele,&llele);
+            if (op == SET_OP_UNION) {
+                found += setOpIsMember(sets[0],encoding,ele,llele);
+                continue;
+            }
+            for (k = 1; k < setnum; k++) {
+                if (sets[k] && setOpIsMember(sets[k],encoding,ele,llele)) {
+                    found++;
+                    break;
+                }
+            }
+        }
+        if (samples == 0) continue;
+        if (op == SET_OP_UNION)
+            estimate += size - size*found/samples;
+        else
+            return size - size*found/samples;
+    }
+    return estimate;
+}
+
+/* Add an element to the result of SUNION/SDIFF. When the result grows too
+ * big to be an intset and is converted to a hash table, the table is
+ * presized to the estimated result cardinality to avoid rehashing. */
+static int setOpAdd(robj *dstset, sds ele, unsigned long estimate) {
+    int encoding = dstset->encoding, retval;
+
+    retval = setTypeAdd(dstset,ele);
+    if (encoding != dstset->encoding) dictExpand(dstset->ptr,estimate);
+    return retval;
+}
+
+/* Sift down helper for the heap used by setOpIntsets(). */
+static void setOpHeapDown(int *heap, int heaplen, int64_t *head, int i) {
+    while (1) {
+        int min = i, l = 2*i+1, r = 2*i+2, tmp;
+
+        if (l < heaplen && head[heap[l]] < head[heap[min]]) min = l;
+        if (r < heaplen && head[heap[r]] < head[heap[min]]) min = r;
+        if (min == i) break;
+        tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+/* SUNION/SDIFF when all the input sets are intsets. Intsets are sorted, so
+ * the union is a k-way merge, and the difference is computed searching
+ * every element of the first set in the other sets starting from the
+ * position of the previous search (see intsetSearchFrom()). Either way the
+ * result is produced in ascending order into an array, that is then
+ * replied or turned into an intset without any further lookup. The number
+ * of elements is returned, the array by reference. */
+static unsigned long setOpIntsets(robj **sets, int setnum, int op,
+                                  int64_t **result)
+{
+    unsigned long count = 0, total = 0;
+    uint32_t *pos = zcalloc(sizeof(uint32_t)*setnum);
+    int64_t *res, value, prev = 0;
+    int j;
+
+    for (j = 0; j < setnum; j++)
+        if (sets[j]) total += intsetLen(sets[j]->ptr);
+    res = zmalloc(sizeof(int64_t)*(total ? total : 1));
+
+    if (op == SET_OP_UNION) {
+        /* Binary min-heap of the sets not yet exhausted, ordered by the
+         * value at their current position. */
+        int *heap = zmalloc(sizeof(int)*setnum), heaplen = 0;
+        int64_t *head = zmalloc(sizeof(int64_t)*setnum);
+
+        for (j = 0; j < setnum; j++) {
+            if (sets[j] && intsetGet(sets[j]->ptr,0,&head[j]))
+                heap[heaplen++] = j;
+        }
+        for (j = heaplen/2-1; j >= 0; j--) setOpHeapDown(heap,heaplen,head,j);
+
+        while (heaplen) {
+            int top = heap[0];
+
+            value = head[top];
+            if (count == 0 || value != prev) res[count++] = value;
+            prev = value;
+            if (intsetGet(sets[top]->ptr,++pos[top],&head[top]) == 0)
+                heap[0] = heap[--heaplen];
+            setOpHeapDown(heap,heaplen,head,0);
+        }
+        zfree(heap);
+        zfree(head);
+    } else if (op == SET_OP_DIFF && sets[0]) {
+        uint32_t i, len = intsetLen(sets[0]->ptr);
+
+        for (i = 0; i < len; i++) {
+            intsetGet(sets[0]->ptr,i,&value);
+            for (j = 1; j < setnum; j++) {
+                if (!sets[j]) continue;
+                if (sets[j] == sets[0]) break;
+                if (intsetSearchFrom(sets[j]->ptr,value,&pos[j])) break;
+            }
+            if (j == setnum) res[count++] = value;
+        }
+    }
+    zfree(pos);
+    *result = res;
+    return count;
+}
+
+/* Store the result of a set operation into the target key, or delete
+ * the target key if the result is empty. */
+static void setOpStore(client *c, robj *dstkey, robj *dstset, int op) {
+    int deleted = dbDelete(c->db,dstkey);
+
+    if (setTypeSize(dstset) > 0) {
+        dbAdd(c->db,dstkey,dstset);
+        addReplyLongLong(c,setTypeSize(dstset));
+        notifyKeyspaceEvent(NOTIFY_SET,
+            op == SET_OP_UNION ? "sunionstore" : "sdiffstore",
+            dstkey,c->db->id);
+    } else {
+        decrRefCount(dstset);
+        addReply(c,shared.czero);
+        if (deleted)
+            notifyKeyspaceEvent(NOTIFY_GENERIC,"del",
+                dstkey,c->db->id);
+    }
+    signalModifiedKey(c->db,dstkey);
+    server.dirty++;
+}
+
 void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
                               robj *dstkey, int op) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
     setTypeIterator *si;
     robj *dstset = NULL;
     sds ele;
-    int j, cardinality = 0;
+    int64_t llele;
+    void *replylen = NULL;
+    unsigned long cardinality = 0, total = 0, maxsize = 0, estimate = 0;
+    long long stream_work = 0, build_work = 0;
+    int j, k, encoding, allintset = 1, stream = 0, others = 0;
     int diff_algo = 1;
 
     for (j = 0; j < setnum; j++) {
@@ -946,56 +1179,142 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
             return;
         }
         sets[j] = setobj;
+        total += setTypeSize(setobj);
+        if (setTypeSize(setobj) > maxsize) maxsize = setTypeSize(setobj);
+        if (setobj->encoding != OBJ_ENCODING_INTSET) allintset = 0;
     }
 
-    /* Select what DIFF algorithm to use.
-     *
-     * Algorithm 1 is O(N*M) where N is the size of the element first set
-     * and M the total number of sets.
-     *
-     * Algorithm 2 is O(N) where N is the total number of elements in all
-     * the sets.
-     *
-     * We compute what is the best bet with the current input here. */
-    if (op == SET_OP_DIFF && sets[0]) {
-        long long algo_one_work = 0, algo_two_work = 0;
+    /* Intsets only: the result is computed in order with a sorted merge,
+     * and has the intset encoding unless it is too big. */
+    if (allintset) {
+        int64_t *res;
+        unsigned long i, count = setOpIntsets(sets,setnum,op,&res);
+
+        if (!dstkey) {
+            addReplyMultiBulkLen(c,count);
+            for (i = 0; i < count; i++) addReplyBulkLongLong(c,res[i]);
+        } else {
+            dstset = createIntsetObject();
+            zfree(dstset->ptr);
+            dstset->ptr = intsetNewFromSorted(res,count);
+            if (count > server.set_max_intset_entries)
+                setTypeConvert(dstset,OBJ_ENCODING_HT);
+            setOpStore(c,dstkey,dstset,op);
+        }
+        zfree(res);
+        zfree(sets);
+        return;
+    }
 
+    /* Plan the execution: the result can be built into a temporary set,
+     * or, when not storing it, streamed directly to the client if this
+     * requires less work. The work is estimated in set lookups. */
+    if (op == SET_OP_UNION) {
+        /* Process the sets by decreasing size. When streaming, elements of
+         * the first set are emitted as they are, while the elements of the
+         * other sets are only emitted if not found in the previous ones:
+         * starting from the largest sets makes duplicates found early. */
+        qsort(sets,setnum,sizeof(robj*),qsortCompareSetsByRevCardinality);
         for (j = 0; j < setnum; j++) {
+            if (!sets[j]) continue;
+            stream_work += (long long)setTypeSize(sets[j])*others;
+            others++;
+        }
+        build_work = (long long)total*SET_OP_ADD_COST;
+        stream = !dstkey && stream_work <= build_work;
+    } else if (op == SET_OP_DIFF && sets[0]) {
+        /* DIFF Algorithm 1 looks up every element of the first set in the
+         * other sets, so it costs N*M where N is the size of the first set
+         * and M the number of other sets. The result can be streamed.
+         *
+         * DIFF Algorithm 2 adds all the elements of the first set to the
+         * result, then removes the elements of all the other sets from it,
+         * so it is O(N) where N is the total number of elements. */
+        for (j = 1; j < setnum; j++) {
             if (sets[j] == NULL) continue;
-
-            algo_one_work += setTypeSize(sets[0]);
-            algo_two_work += setTypeSize(sets[j]);
+            if (sets[j] == sets[0]) {
+                /* Subtracting a set from itself: the result is empty. */
+                others = -1;
+                break;
+            }
+            others++;
+        }
+        if (others < 0) {
+            sets[0] = NULL;
+        } else {
+            long long algo_one_work, algo_two_work;
+
+            algo_one_work = (long long)setTypeSize(sets[0])*others;
+            algo_two_work = (long long)setTypeSize(sets[0])*SET_OP_ADD_COST +
+                            (total-setTypeSize(sets[0]));
+            diff_algo = (algo_one_work <= algo_two_work) ? 1 : 2;
+            stream = !dstkey && diff_algo == 1;
+
+            if (diff_algo == 1 && setnum > 1) {
+                /* With algorithm 1 it is better to order the sets to
+                 * subtract by decreasing size, so that we are more likely
+                 * to find duplicated elements ASAP. */
+                qsort(sets+1,setnum-1,sizeof(robj*),
+                    qsortCompareSetsByRevCardinality);
+            }
         }
+    }
 
-        /* Algorithm 1 has better constant times and performs less operations
-         * if there are elements in common. Give it some advantage. */
-        algo_one_work /= 2;
-        diff_algo = (algo_one_work <= algo_two_work) ? 1 : 2;
-
-        if (diff_algo == 1 && setnum > 1) {
-            /* With algorithm 1 it is better to order the sets to subtract
-             * by decreasing size, so that we are more likely to find
-             * duplicated elements ASAP. */
-            qsort(sets+1,setnum-1,sizeof(robj*),
-                qsortCompareSetsByRevCardinality);
+    if (stream) {
+        replylen = addDeferredMultiBulkLength(c);
+    } else {
+        /* We need a temp set object to store the result. If the dstkey
+         * is not NULL (that is, we are inside a STORE operation) then this
+         * set object will be the resulting object to set into the target
+         * key. The result is an intset unless some element is not an
+         * integer or it has too many elements: a union bigger than the
+         * maximum intset size starts directly as a presized hash table,
+         * otherwise the table is presized when the intset is converted. */
+        estimate = setOpEstimateCard(sets,setnum,op);
+        if (op == SET_OP_UNION && maxsize > server.set_max_intset_entries) {
+            dstset = createSetObject();
+            dictExpand(dstset->ptr,estimate);
+        } else {
+            dstset = createIntsetObject();
         }
     }
 
-    /* We need a temp set object to store our union. If the dstkey
-     * is not NULL (that is, we are inside an SUNIONSTORE operation) then
-     * this set object will be the resulting object to set into the target key*/
-    dstset = createIntsetObject();
+    if (op == SET_OP_UNION && stream) {
+        for (j = 0; j < setnum; j++) {
+            if (!sets[j]) continue; /* non existing keys are like empty sets */
 
-    if (op == SET_OP_UNION) {
+            for (k = 0; k < j; k++)
+                if (sets[k] == sets[j]) break;
+            if (k < j) continue; /* same set already emitted */
+
+            si = setTypeInitIterator(sets[j]);
+            while((encoding = setTypeNext(si,&ele,&llele)) != -1) {
+                for (k = 0; k < j; k++) {
+                    if (sets[k] && setOpIsMember(sets[k],encoding,ele,llele))
+                        break;
+                }
+                if (k < j) continue;
+                if (encoding == OBJ_ENCODING_HT)
+                    addReplyBulkCBuffer(c,ele,sdslen(ele));
+                else
+                    addReplyBulkLongLong(c,llele);
+                cardinality++;
+            }
+            setTypeReleaseIterator(si);
+        }
+    } else if (op == SET_OP_UNION) {
         /* Union is trivial, just add every element of every set to the
          * temporary set. */
         for (j = 0; j < setnum; j++) {
             if (!sets[j]) continue; /* non existing keys are like empty sets */
 
             si = setTypeInitIterator(sets[j]);
-            while((ele = setTypeNextObject(si)) != NULL) {
-                if (setTypeAdd(dstset,ele)) cardinality++;
-                sdsfree(ele);
+            while((encoding = setTypeNext(si,&ele,&llele)) != -1) {
+                /* setTypeAdd() copies the element only if it is new. */
+                if (encoding == OBJ_ENCODING_INTSET)
+                    ele = sdsfromlonglong(llele);
+                if (setOpAdd(dstset,ele,estimate)) cardinality++;
+                if (encoding == OBJ_ENCODING_INTSET) sdsfree(ele);
             }
             setTypeReleaseIterator(si);
         }
@@ -1003,24 +1322,33 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
         /* DIFF Algorithm 1:
          *
          * We perform the diff by iterating all the elements of the first set,
-         * and only adding it to the target set if the element does not exist
-         * into all the other sets.
+         * and only adding it to the target set (or to the reply) if the
+         * element does not exist into all the other sets.
          *
          * This way we perform at max N*M operations, where N is the size of
          * the first set, and M the number of sets. */
         si = setTypeInitIterator(sets[0]);
-        while((ele = setTypeNextObject(si)) != NULL) {
+        while((encoding = setTypeNext(si,&ele,&llele)) != -1) {
             for (j = 1; j < setnum; j++) {
                 if (!sets[j]) continue; /* no key is an empty set. */
-                if (sets[j] == sets[0]) break; /* same set! */
-                if (setTypeIsMember(sets[j],ele)) break;
+                if (setOpIsMember(sets[j],encoding,ele,llele)) break;
             }
             if (j == setnum) {
                 /* There is no other set with this element. Add it. */
-                setTypeAdd(dstset,ele);
+                if (stream) {
+                    if (encoding == OBJ_ENCODING_HT)
+                        addReplyBulkCBuffer(c,ele,sdslen(ele));
+                    else
+                        addReplyBulkLongLong(c,llele);
+                } else if (encoding == OBJ_ENCODING_HT) {
+                    setOpAdd(dstset,ele,estimate);
+                } else {
+                    ele = sdsfromlonglong(llele);
+                    setOpAdd(dstset,ele,estimate);
+                    sdsfree(ele);
+                }
                 cardinality++;
             }
-            sdsfree(ele);
         }
         setTypeReleaseIterator(si);
     } else if (op == SET_OP_DIFF && sets[0] && diff_algo == 2) {
@@ -1037,7 +1365,7 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
             si = setTypeInitIterator(sets[j]);
             while((ele = setTypeNextObject(si)) != NULL) {
                 if (j == 0) {
-                    if (setTypeAdd(dstset,ele)) cardinality++;
+                    if (setOpAdd(dstset,ele,estimate)) cardinality++;
                 } else {
                     if (setTypeRemove(dstset,ele)) cardinality--;
                 }
@@ -1052,7 +1380,9 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
     }
 
     /* Output the content of the resulting set, if not in STORE mode */
-    if (!dstkey) {
+    if (stream) {
+        setDeferredMultiBulkLength(c,replylen,cardinality);
+    } else if (!dstkey) {
         addReplyMultiBulkLen(c,cardinality);
         si = setTypeInitIterator(dstset);
         while((ele = setTypeNextObject(si)) != NULL) {
@@ -1064,22 +1394,7 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
     } else {
         /* If we have a target key where to store the resulting set
          * create this key with the result set inside */
-        int deleted = dbDelete(c->db,dstkey);
-        if (setTypeSize(dstset) > 0) {
-            dbAdd(c->db,dstkey,dstset);
-            addReplyLongLong(c,setTypeSize(dstset));
-            notifyKeyspaceEvent(NOTIFY_SET,
-                op == SET_OP_UNION ? "sunionstore" : "sdiffstore",
-                dstkey,c->db->id);
-        } else {
-            decrRefCount(dstset);
-            addReply(c,shared.czero);
-            if (deleted)
-                notifyKeyspaceEvent(NOTIFY_GENERIC,"del",
-                    dstkey,c->db->id);
-        }
-        signalModifiedKey(c->db,dstkey);
-        server.dirty++;
+        setOpStore(c,dstkey,dstset,op);
     }
     zfree(sets);
 }
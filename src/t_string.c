@@ -64,6 +64,22 @@ static int checkStringLength(client *c, long long size) {
 #define OBJ_SET_EX (1<<2)     /* Set if time in seconds is given */
 #define OBJ_SET_PX (1<<3)     /* Set if time in ms in given */
 
+/* Store the string 'val' at 'key' like setKey(), sharing it with the
+ * identical values if it is short enough (see string-intern-max-len), or
+ * compressing it if it is long enough (see string-compress-threshold). The
+ * caller keeps its reference to 'val', that is never modified. */
+static void setStringKey(redisDb *db, robj *key, robj *val) {
+    robj *encoded = tryInternStringObject(val);
+
+    if (encoded == NULL) encoded = tryCompressStringObject(val);
+    if (encoded) {
+        setKey(db,key,encoded);
+        decrRefCount(encoded);
+    } else {
+        setKey(db,key,val);
+    }
+}
+
 void setGenericCommand(client *c, int flags, robj *key, robj *val, robj *expire, int unit, robj *ok_reply, robj *abort_reply) {
     long long milliseconds = 0; /* initialized to avoid any harmness warning */
 
@@ -83,7 +99,7 @@ void setGenericCommand(client *c, int flags, robj *key, robj *val, robj *expire,
         addReply(c, abort_reply ? abort_reply : shared.nullbulk);
         return;
     }
-    setKey(c->db,key,val);
+    setStringKey(c->db,key,val);
     server.dirty++;
     if (expire) setExpire(c,c->db,key,mstime()+milliseconds);
     notifyKeyspaceEvent(NOTIFY_STRING,"set",key,c->db->id);
@@ -176,7 +192,7 @@ void getCommand(client *c) {
 void getsetCommand(client *c) {
     if (getGenericCommand(c) == C_ERR) return;
     c->argv[2] = tryObjectEncoding(c->argv[2]);
-    setKey(c->db,c->argv[1],c->argv[2]);
+    setStringKey(c->db,c->argv[1],c->argv[2]);
     notifyKeyspaceEvent(NOTIFY_STRING,"set",c->argv[1],c->db->id);
     server.dirty++;
 }
@@ -206,7 +222,10 @@ void setrangeCommand(client *c) {
         if (checkStringLength(c,offset+sdslen(value)) != C_OK)
             return;
 
-        o = createObject(OBJ_STRING,sdsnewlen(NULL, offset+sdslen(value)));
+        if (stringNeedsChunking(offset+sdslen(value)))
+            o = createChunkedStringObject(NULL,offset+sdslen(value));
+        else
+            o = createObject(OBJ_STRING,sdsnewlen(NULL,offset+sdslen(value)));
         dbAdd(c->db,c->argv[1],o);
     } else {
         size_t olen;
@@ -227,18 +246,26 @@ void setrangeCommand(client *c) {
             return;
 
         /* Create a copy when the object is shared or encoded. */
-        o = dbUnshareStringValue(c->db,c->argv[1],o);
+        if (o->encoding == OBJ_ENCODING_CHUNKED ||
+            stringNeedsChunking(offset+sdslen(value)))
+            o = dbChunkStringValue(c->db,c->argv[1],o);
+        else
+            o = dbUnshareStringValue(c->db,c->argv[1],o);
     }
 
     if (sdslen(value) > 0) {
-        o->ptr = sdsgrowzero(o->ptr,offset+sdslen(value));
-        memcpy((char*)o->ptr+offset,value,sdslen(value));
+        if (o->encoding == OBJ_ENCODING_CHUNKED) {
+            chunkedStringWrite(o->ptr,offset,value,sdslen(value));
+        } else {
+            o->ptr = sdsgrowzero(o->ptr,offset+sdslen(value));
+            memcpy((char*)o->ptr+offset,value,sdslen(value));
+        }
         signalModifiedKey(c->db,c->argv[1]);
         notifyKeyspaceEvent(NOTIFY_STRING,
             "setrange",c->argv[1],c->db->id);
         server.dirty++;
     }
-    addReplyLongLong(c,sdslen(o->ptr));
+    addReplyLongLong(c,stringObjectLen(o));
 }
 
 void getrangeCommand(client *c) {
@@ -257,6 +284,13 @@ void getrangeCommand(client *c) {
     if (o->encoding == OBJ_ENCODING_INT) {
         str = llbuf;
         strlen = ll2string(llbuf,sizeof(llbuf),(long)o->ptr);
+    } else if (o->encoding == OBJ_ENCODING_DOUBLE) {
+        str = llbuf;
+        strlen = getDoubleEncodedString(o,llbuf,sizeof(llbuf));
+    } else if (o->encoding == OBJ_ENCODING_COMPRESSED ||
+               o->encoding == OBJ_ENCODING_CHUNKED) {
+        str = NULL; /* Decompressed or read by chunks below. */
+        strlen = stringObjectLen(o);
     } else {
         str = o->ptr;
         strlen = sdslen(str);
@@ -277,6 +311,14 @@ void getrangeCommand(client *c) {
      * nothing can be returned is: start > end. */
     if (start > end || strlen == 0) {
         addReply(c,shared.emptybulk);
+    } else if (o->encoding == OBJ_ENCODING_CHUNKED) {
+        addReplyLongLongWithPrefix(c,end-start+1,'$');
+        addReplyChunkedString(c,o->ptr,start,end-start+1);
+        addReply(c,shared.crlf);
+    } else if (str == NULL) {
+        robj *decoded = getDecodedObject(o);
+        addReplyBulkCBuffer(c,(char*)decoded->ptr+start,end-start+1);
+        decrRefCount(decoded);
     } else {
         addReplyBulkCBuffer(c,(char*)str+start,end-start+1);
     }
@@ -323,7 +365,7 @@ void msetGenericCommand(client *c, int nx) {
 
     for (j = 1; j < c->argc; j += 2) {
         c->argv[j+1] = tryObjectEncoding(c->argv[j+1]);
-        setKey(c->db,c->argv[j],c->argv[j+1]);
+        setStringKey(c->db,c->argv[j],c->argv[j+1]);
         notifyKeyspaceEvent(NOTIFY_STRING,"set",c->argv[j],c->db->id);
     }
     server.dirty += (c->argc-1)/2;
@@ -413,7 +455,9 @@ void incrbyfloatCommand(client *c) {
         addReplyError(c,"increment would produce NaN or Infinity");
         return;
     }
-    new = createStringObjectFromLongDouble(value,1);
+    /* Results that round trip as doubles are stored double encoded, so that
+     * the next increment does not need to parse them again. */
+    new = tryObjectEncoding(createStringObjectFromLongDouble(value,1));
     if (o)
         dbOverwrite(c->db,c->argv[1],new);
     else
@@ -454,10 +498,18 @@ void appendCommand(client *c) {
         if (checkStringLength(c,totlen) != C_OK)
             return;
 
-        /* Append the value */
-        o = dbUnshareStringValue(c->db,c->argv[1],o);
-        o->ptr = sdscatlen(o->ptr,append->ptr,sdslen(append->ptr));
-        totlen = sdslen(o->ptr);
+        /* Append the value. Large strings are chunked, so that appending
+         * never moves the bytes already stored. */
+        if (o->encoding == OBJ_ENCODING_CHUNKED ||
+            stringNeedsChunking(totlen))
+        {
+            o = dbChunkStringValue(c->db,c->argv[1],o);
+            chunkedStringAppend(o->ptr,append->ptr,sdslen(append->ptr));
+        } else {
+            o = dbUnshareStringValue(c->db,c->argv[1],o);
+            o->ptr = sdscatlen(o->ptr,append->ptr,sdslen(append->ptr));
+            totlen = sdslen(o->ptr);
+        }
     }
     signalModifiedKey(c->db,c->argv[1]);
     notifyKeyspaceEvent(NOTIFY_STRING,"append",c->argv[1],c->db->id);
@@ -186,6 +186,50 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, sds ele) {
     return x;
 }
 
+/* Populate an empty skiplist with 'count' elements already sorted in
+ * (score,ele) order. Since every node is appended at the tail, the whole
+ * list is built in a single pass just remembering the last node (and its
+ * rank) at every level, instead of searching the insertion point of every
+ * element. The skiplist takes ownership of the SDS strings. If 'd' is not
+ * NULL, the value of the dict entry of every element is set to the address
+ * of its score, as the zset dict expects. */
+void zslBulkLoad(zskiplist *zsl, dict *d, zsetBulkEntry *entries,
+                 unsigned long count)
+{
+    zskiplistNode *last[ZSKIPLIST_MAXLEVEL], *x;
+    unsigned long lastrank[ZSKIPLIST_MAXLEVEL], j;
+    int i, level;
+
+    serverAssert(zsl->length == 0);
+    for (i = 0; i < ZSKIPLIST_MAXLEVEL; i++) {
+        last[i] = zsl->header;
+        lastrank[i] = 0;
+    }
+
+    for (j = 0; j < count; j++) {
+        serverAssert(!isnan(entries[j].score));
+        level = zslRandomLevel();
+        if (level > zsl->level) zsl->level = level;
+        x = zslCreateNode(level,entries[j].score,entries[j].ele);
+        for (i = 0; i < level; i++) {
+            last[i]->level[i].forward = x;
+            last[i]->level[i].span = (j+1)-lastrank[i];
+            last[i] = x;
+            lastrank[i] = j+1;
+        }
+        x->backward = zsl->tail;
+        zsl->tail = x;
+        if (d) dictSetVal(d,entries[j].de,&x->score);
+    }
+
+    /* The last node of every level spans up to the end of the list. */
+    for (i = 0; i < zsl->level; i++) {
+        last[i]->level[i].forward = NULL;
+        last[i]->level[i].span = count-lastrank[i];
+    }
+    zsl->length = count;
+}
+
 /* Internal function used by zslDelete, zslDeleteByScore and zslDeleteByRank */
 void zslDeleteNode(zskiplist *zsl, zskiplistNode *x, zskiplistNode **update) {
     int i;
@@ -461,6 +505,22 @@ zskiplistNode* zslGetElementByRank(zskiplist *zsl, unsigned long rank) {
     return NULL;
 }
 
+/* Return the node 'count' positions after 'x', or before 'x' if 'reverse'
+ * is true, or NULL if there is no such node. The rank of 'x' is used in
+ * order to jump to the target node in O(log(N)) instead of walking the
+ * list one node at a time. */
+zskiplistNode *zslSkipNodes(zskiplist *zsl, zskiplistNode *x, unsigned long count, int reverse) {
+    unsigned long rank = zslGetRank(zsl,x->score,x->ele);
+
+    if (reverse) {
+        if (count >= rank) return NULL;
+        return zslGetElementByRank(zsl,rank-count);
+    } else {
+        if (count > zsl->length-rank) return NULL;
+        return zslGetElementByRank(zsl,rank+count);
+    }
+}
+
 /* Populate the rangespec according to the objects min and max. */
 static int zslParseRange(robj *min, robj *max, zrangespec *spec) {
     char *eptr;
@@ -474,11 +534,11 @@ static int zslParseRange(robj *min, robj *max, zrangespec *spec) {
         spec->min = (long)min->ptr;
     } else {
         if (((char*)min->ptr)[0] == '(') {
-            spec->min = strtod((char*)min->ptr+1,&eptr);
+            spec->min = fastStrtod((char*)min->ptr+1,&eptr);
             if (eptr[0] != '\0' || isnan(spec->min)) return C_ERR;
             spec->minex = 1;
         } else {
-            spec->min = strtod((char*)min->ptr,&eptr);
+            spec->min = fastStrtod((char*)min->ptr,&eptr);
             if (eptr[0] != '\0' || isnan(spec->min)) return C_ERR;
         }
     }
@@ -486,11 +546,11 @@ static int zslParseRange(robj *min, robj *max, zrangespec *spec) {
         spec->max = (long)max->ptr;
     } else {
         if (((char*)max->ptr)[0] == '(') {
-            spec->max = strtod((char*)max->ptr+1,&eptr);
+            spec->max = fastStrtod((char*)max->ptr+1,&eptr);
             if (eptr[0] != '\0' || isnan(spec->max)) return C_ERR;
             spec->maxex = 1;
         } else {
-            spec->max = strtod((char*)max->ptr,&eptr);
+            spec->max = fastStrtod((char*)max->ptr,&eptr);
             if (eptr[0] != '\0' || isnan(spec->max)) return C_ERR;
         }
     }
@@ -661,6 +721,737 @@ zskiplistNode *zslLastInLexRange(zskiplist *zsl, zlexrangespec *range) {
     return x;
 }
 
+/*-----------------------------------------------------------------------------
+ * B+tree implementation of the low level API
+ *----------------------------------------------------------------------------*/
+
+/* The B+tree is an alternative to the skiplist for large sorted sets: the
+ * elements are stored inline, sorted by (score,ele), inside leaves holding up
+ * to ZBTREE_MAX_FANOUT entries, and the leaves are linked in a doubly linked
+ * list in order to iterate in both directions. Every inner node stores, for
+ * each child, a lower bound of the elements in the child subtree and the
+ * number of elements stored in it, so that both lookups by element and by
+ * rank only need to touch a few cache friendly nodes per level.
+ *
+ * Like the skiplist, the tree owns the SDS strings of the elements, that are
+ * shared with the dictionary of the sorted set. The separator keys stored in
+ * the inner nodes are private copies instead, since an element may be
+ * removed while its value is still used as a separator. */
+
+/* Path from the root to a leaf: inner node and index of the child taken. */
+typedef struct zbtreePathStep {
+    zbtreeInner *node;
+    int idx;
+} zbtreePathStep;
+
+/* Predicate used to seek inside the tree. It must be true for a (possibly
+ * empty) prefix of the elements in (score,ele) order and false for the
+ * remaining elements. */
+typedef int zbtBeforeProc(zbtreeEntry *e, void *ctx);
+
+static zbtreeLeaf *zbtCreateLeaf(void) {
+    zbtreeLeaf *leaf = zmalloc(sizeof(*leaf));
+    leaf->hdr.leaf = 1;
+    leaf->hdr.count = 0;
+    leaf->prev = leaf->next = NULL;
+    return leaf;
+}
+
+static zbtreeInner *zbtCreateInner(void) {
+    zbtreeInner *in = zmalloc(sizeof(*in));
+    in->hdr.leaf = 0;
+    in->hdr.count = 0;
+    in->keys[0].ele = NULL;
+    return in;
+}
+
+/* Create a new empty B+tree. */
+zbtree *zbtCreate(void) {
+    zbtree *zbt = zmalloc(sizeof(*zbt));
+    zbtreeLeaf *leaf = zbtCreateLeaf();
+
+    zbt->root = (zbtreeNode*)leaf;
+    zbt->head = zbt->tail = leaf;
+    zbt->length = 0;
+    return zbt;
+}
+
+static void zbtFreeNode(zbtreeNode *x) {
+    unsigned int j;
+
+    if (x->leaf) {
+        zbtreeLeaf *leaf = (zbtreeLeaf*)x;
+        for (j = 0; j < x->count; j++) sdsfree(leaf->entries[j].ele);
+    } else {
+        zbtreeInner *in = (zbtreeInner*)x;
+        for (j = 0; j < x->count; j++) {
+            if (j) sdsfree(in->keys[j].ele);
+            zbtFreeNode(in->children[j]);
+        }
+    }
+    zfree(x);
+}
+
+/* Free a whole B+tree, including the elements. */
+void zbtFree(zbtree *zbt) {
+    zbtFreeNode(zbt->root);
+    zfree(zbt);
+}
+
+/* Compare entries in (score,ele) order, like the skiplist does. */
+static int zbtEntryBefore(zbtreeEntry *e, void *ctx) {
+    zbtreeEntry *key = ctx;
+    return e->score < key->score ||
+           (e->score == key->score && sdscmp(e->ele,key->ele) < 0);
+}
+
+static int zbtScoreBeforeMin(zbtreeEntry *e, void *ctx) {
+    return !zslValueGteMin(e->score,ctx);
+}
+
+static int zbtScoreLteMax(zbtreeEntry *e, void *ctx) {
+    return zslValueLteMax(e->score,ctx);
+}
+
+static int zbtLexBeforeMin(zbtreeEntry *e, void *ctx) {
+    return !zslLexValueGteMin(e->ele,ctx);
+}
+
+static int zbtLexLteMax(zbtreeEntry *e, void *ctx) {
+    return zslLexValueLteMax(e->ele,ctx);
+}
+
+/* Descend the tree looking for the first element for which 'before' is
+ * false. The number of elements for which 'before' is true is returned,
+ * that is the 0-based rank of the element found.
+ *
+ * The leaf and the position inside the leaf are returned in 'cur'. Note
+ * that the position may be equal to the number of entries in the leaf, when
+ * the element is the first of the next leaf or when there is no such
+ * element at all: use zbtCursorFix() to get a valid cursor.
+ *
+ * If 'path' is not NULL, the inner nodes traversed are stored there and
+ * the number of levels is returned by reference in '*depth'. */
+static unsigned long zbtSeek(zbtree *zbt, zbtBeforeProc *before, void *ctx,
+                             zbtreeCursor *cur, zbtreePathStep *path,
+                             int *depth)
+{
+    zbtreeNode *x = zbt->root;
+    unsigned long rank = 0;
+    int level = 0, lo, hi, j;
+
+    while (!x->leaf) {
+        zbtreeInner *in = (zbtreeInner*)x;
+
+        /* Find the first separator that is not 'before': the element we
+         * are looking for is in the subtree on its left. */
+        lo = 1;
+        hi = x->count;
+        while (lo < hi) {
+            int mid = (lo+hi)/2;
+            if (before(&in->keys[mid],ctx)) lo = mid+1;
+            else hi = mid;
+        }
+        for (j = 0; j < lo-1; j++) rank += in->sizes[j];
+        if (path) {
+            serverAssert(level < ZBTREE_MAX_DEPTH);
+            path[level].node = in;
+            path[level].idx = lo-1;
+        }
+        level++;
+        x = in->children[lo-1];
+    }
+
+    zbtreeLeaf *leaf = (zbtreeLeaf*)x;
+    lo = 0;
+    hi = x->count;
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        if (before(&leaf->entries[mid],ctx)) lo = mid+1;
+        else hi = mid;
+    }
+    cur->leaf = leaf;
+    cur->idx = lo;
+    if (depth) *depth = level;
+    return rank+lo;
+}
+
+/* Move a cursor returned by zbtSeek() to the next leaf if it points past
+ * the last entry of its leaf. Returns 0 if there is no such element. Only
+ * the root leaf can be empty, so the next leaf always has a first entry. */
+static int zbtCursorFix(zbtreeCursor *cur) {
+    if (cur->idx < cur->leaf->hdr.count) return 1;
+    cur->leaf = cur->leaf->next;
+    cur->idx = 0;
+    return cur->leaf != NULL;
+}
+
+/* Add a new child 'right' (with its separator key and number of elements)
+ * after 'left', that was split at the specified level of the path. Inner
+ * nodes are split in turn while full, up to the root. */
+static void zbtInsertChild(zbtree *zbt, zbtreePathStep *path, int level,
+                           zbtreeNode *left, zbtreeNode *right,
+                           zbtreeEntry sep, unsigned long rsize)
+{
+    while (level > 0) {
+        zbtreeInner *p = path[--level].node;
+        int i = path[level].idx+1, count = p->hdr.count;
+
+        /* The elements of 'right' were accounted for in 'left' so far. */
+        p->sizes[i-1] -= rsize;
+
+        if (count < ZBTREE_MAX_FANOUT) {
+            memmove(p->keys+i+1,p->keys+i,sizeof(zbtreeEntry)*(count-i));
+            memmove(p->sizes+i+1,p->sizes+i,sizeof(unsigned long)*(count-i));
+            memmove(p->children+i+1,p->children+i,
+                    sizeof(zbtreeNode*)*(count-i));
+            p->keys[i] = sep;
+            p->sizes[i] = rsize;
+            p->children[i] = right;
+            p->hdr.count++;
+            return;
+        }
+
+        /* The parent is full as well: split it in two halves, moving the
+         * first key of the right half one level up. */
+        zbtreeEntry keys[ZBTREE_MAX_FANOUT+1];
+        unsigned long sizes[ZBTREE_MAX_FANOUT+1];
+        zbtreeNode *children[ZBTREE_MAX_FANOUT+1];
+        zbtreeInner *np = zbtCreateInner();
+        int total = count+1, half = total/2, j;
+
+        memcpy(keys,p->keys,sizeof(zbtreeEntry)*i);
+        memcpy(sizes,p->sizes,sizeof(unsigned long)*i);
+        memcpy(children,p->children,sizeof(zbtreeNode*)*i);
+        keys[i] = sep;
+        sizes[i] = rsize;
+        children[i] = right;
+        memcpy(keys+i+1,p->keys+i,sizeof(zbtreeEntry)*(count-i));
+        memcpy(sizes+i+1,p->sizes+i,sizeof(unsigned long)*(count-i));
+        memcpy(children+i+1,p->children+i,sizeof(zbtreeNode*)*(count-i));
+
+        memcpy(p->keys,keys,sizeof(zbtreeEntry)*half);
+        memcpy(p->sizes,sizes,sizeof(unsigned long)*half);
+        memcpy(p->children,children,sizeof(zbtreeNode*)*half);
+        p->hdr.count = half;
+        memcpy(np->keys,keys+half,sizeof(zbtreeEntry)*(total-half));
+        memcpy(np->sizes,sizes+half,sizeof(unsigned long)*(total-half));
+        memcpy(np->children,children+half,sizeof(zbtreeNode*)*(total-half));
+        np->hdr.count = total-half;
+
+        sep = np->keys[0];
+        np->keys[0].ele = NULL;
+        rsize = 0;
+        for (j = 0; j < total-half; j++) rsize += np->sizes[j];
+        left = (zbtreeNode*)p;
+        right = (zbtreeNode*)np;
+    }
+
+    /* The root itself was split: the tree grows by one level. */
+    zbtreeInner *root = zbtCreateInner();
+    root->children[0] = left;
+    root->sizes[0] = zbt->length-rsize;
+    root->children[1] = right;
+    root->sizes[1] = rsize;
+    root->keys[1] = sep;
+    root->hdr.count = 2;
+    zbt->root = (zbtreeNode*)root;
+}
+
+/* Insert a new element in the B+tree. The element must not already exist
+ * (the caller should test this using the sorted set dictionary). The SDS
+ * string 'ele' is owned by the tree after the call. */
+void zbtInsert(zbtree *zbt, double score, sds ele) {
+    zbtreePathStep path[ZBTREE_MAX_DEPTH];
+    zbtreeEntry key = {ele,score};
+    zbtreeCursor cur;
+    zbtreeLeaf *leaf, *right;
+    unsigned int idx, count, split;
+    int depth, j;
+
+    serverAssert(!isnan(score));
+    zbtSeek(zbt,zbtEntryBefore,&key,&cur,path,&depth);
+    for (j = 0; j < depth; j++) path[j].node->sizes[path[j].idx]++;
+    zbt->length++;
+
+    leaf = cur.leaf;
+    idx = cur.idx;
+    count = leaf->hdr.count;
+    if (count < ZBTREE_MAX_FANOUT) {
+        memmove(leaf->entries+idx+1,leaf->entries+idx,
+                sizeof(zbtreeEntry)*(count-idx));
+        leaf->entries[idx] = key;
+        leaf->hdr.count++;
+        return;
+    }
+
+    /* The leaf is full and must be split. When appending to the tail, as it
+     * happens when elements are added in score order, the old leaf is left
+     * full and only the new element goes into the new leaf. */
+    split = (leaf == zbt->tail && idx == count) ? count : count/2;
+    right = zbtCreateLeaf();
+    memcpy(right->entries,leaf->entries+split,
+           sizeof(zbtreeEntry)*(count-split));
+    right->hdr.count = count-split;
+    leaf->hdr.count = split;
+    if (idx < split) {
+        memmove(leaf->entries+idx+1,leaf->entries+idx,
+                sizeof(zbtreeEntry)*(split-idx));
+        leaf->entries[idx] = key;
+        leaf->hdr.count++;
+    } else {
+        idx -= split;
+        memmove(right->entries+idx+1,right->entries+idx,
+                sizeof(zbtreeEntry)*(count-split-idx));
+        right->entries[idx] = key;
+        right->hdr.count++;
+    }
+
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next) leaf->next->prev = right;
+    else zbt->tail = right;
+    leaf->next = right;
+
+    zbtreeEntry sep = {sdsdup(right->entries[0].ele),right->entries[0].score};
+    zbtInsertChild(zbt,path,depth,(zbtreeNode*)leaf,(zbtreeNode*)right,
+                   sep,right->hdr.count);
+}
+
+/* Populate an empty B+tree with 'count' elements already sorted in
+ * (score,ele) order, building it bottom up one level at a time. Elements
+ * and children are spread evenly among the nodes of every level, so that
+ * all the nodes are at least half full. The tree takes ownership of the
+ * SDS strings. */
+void zbtBulkLoad(zbtree *zbt, zsetBulkEntry *entries, unsigned long count) {
+    zbtreeNode **nodes;
+    zbtreeEntry *firsts;    /* First element under every node. */
+    unsigned long *sizes, groups, len, pos, j, k, n;
+    zbtreeLeaf *prev = NULL;
+
+    serverAssert(zbt->length == 0);
+    if (count == 0) return;
+
+    groups = (count+ZBTREE_MAX_FANOUT-1)/ZBTREE_MAX_FANOUT;
+    nodes = zmalloc(sizeof(zbtreeNode*)*groups);
+    firsts = zmalloc(sizeof(zbtreeEntry)*groups);
+    sizes = zmalloc(sizeof(unsigned long)*groups);
+
+    /* The empty root leaf is replaced by the new leaves. */
+    zfree(zbt->root);
+    for (j = 0, pos = 0; j < groups; j++) {
+        zbtreeLeaf *leaf = zbtCreateLeaf();
+
+        len = count/groups + (j < count%groups);
+        for (k = 0; k < len; k++, pos++) {
+            serverAssert(!isnan(entries[pos].score));
+            leaf->entries[k].ele = entries[pos].ele;
+            leaf->entries[k].score = entries[pos].score;
+        }
+        leaf->hdr.count = len;
+        leaf->prev = prev;
+        if (prev) prev->next = leaf;
+        else zbt->head = leaf;
+        prev = leaf;
+
+        nodes[j] = (zbtreeNode*)leaf;
+        firsts[j] = leaf->entries[0];
+        sizes[j] = len;
+    }
+    zbt->tail = prev;
+
+    /* Group the nodes of every level under new inner nodes until a single
+     * root is left. The arrays are reused in place, since the nodes of the
+     * j-th group are always stored at positions >= j. */
+    for (n = groups; n > 1; n = groups) {
+        groups = (n+ZBTREE_MAX_FANOUT-1)/ZBTREE_MAX_FANOUT;
+        for (j = 0, pos = 0; j < groups; j++) {
+            zbtreeInner *in = zbtCreateInner();
+            zbtreeEntry first = firsts[pos];
+            unsigned long total = 0;
+
+            len = n/groups + (j < n%groups);
+            for (k = 0; k < len; k++, pos++) {
+                if (k) {
+                    in->keys[k].ele = sdsdup(firsts[pos].ele);
+                    in->keys[k].score = firsts[pos].score;
+                }
+                in->sizes[k] = sizes[pos];
+                in->children[k] = nodes[pos];
+                total += sizes[pos];
+            }
+            in->hdr.count = len;
+
+            nodes[j] = (zbtreeNode*)in;
+            firsts[j] = first;
+            sizes[j] = total;
+        }
+    }
+    zbt->root = nodes[0];
+    zbt->length = count;
+
+    zfree(nodes);
+    zfree(firsts);
+    zfree(sizes);
+}
+
+/* Remove the children li+1 of 'p', after merging it into its left
+ * sibling. */
+static void zbtMergeChildren(zbtree *zbt, zbtreeInner *p, int li) {
+    zbtreeNode *l = p->children[li], *r = p->children[li+1];
+    int count = p->hdr.count;
+
+    if (l->leaf) {
+        zbtreeLeaf *ll = (zbtreeLeaf*)l, *rl = (zbtreeLeaf*)r;
+        memcpy(ll->entries+l->count,rl->entries,
+               sizeof(zbtreeEntry)*r->count);
+        ll->next = rl->next;
+        if (rl->next) rl->next->prev = ll;
+        else zbt->tail = ll;
+        sdsfree(p->keys[li+1].ele);
+    } else {
+        /* The separator in the parent becomes the key of the first child
+         * of the right node. */
+        zbtreeInner *il = (zbtreeInner*)l, *ir = (zbtreeInner*)r;
+        ir->keys[0] = p->keys[li+1];
+        memcpy(il->keys+l->count,ir->keys,sizeof(zbtreeEntry)*r->count);
+        memcpy(il->sizes+l->count,ir->sizes,sizeof(unsigned long)*r->count);
+        memcpy(il->children+l->count,ir->children,
+               sizeof(zbtreeNode*)*r->count);
+    }
+    l->count += r->count;
+    zfree(r);
+
+    p->sizes[li] += p->sizes[li+1];
+    memmove(p->keys+li+1,p->keys+li+2,sizeof(zbtreeEntry)*(count-li-2));
+    memmove(p->sizes+li+1,p->sizes+li+2,sizeof(unsigned long)*(count-li-2));
+    memmove(p->children+li+1,p->children+li+2,
+            sizeof(zbtreeNode*)*(count-li-2));
+    p->hdr.count--;
+}
+
+/* Move entries or children between the two siblings li and li+1 of 'p' so
+ * that they end with about the same number of them. */
+static void zbtRedistribute(zbtreeInner *p, int li) {
+    zbtreeNode *l = p->children[li], *r = p->children[li+1];
+
+    if (l->leaf) {
+        zbtreeLeaf *ll = (zbtreeLeaf*)l, *rl = (zbtreeLeaf*)r;
+        unsigned int half = (l->count+r->count)/2, n;
+
+        if (l->count > half) {
+            n = l->count-half;
+            memmove(rl->entries+n,rl->entries,sizeof(zbtreeEntry)*r->count);
+            memcpy(rl->entries,ll->entries+half,sizeof(zbtreeEntry)*n);
+            l->count -= n;
+            r->count += n;
+            p->sizes[li] -= n;
+            p->sizes[li+1] += n;
+        } else {
+            n = half-l->count;
+            memcpy(ll->entries+l->count,rl->entries,sizeof(zbtreeEntry)*n);
+            memmove(rl->entries,rl->entries+n,
+                    sizeof(zbtreeEntry)*(r->count-n));
+            l->count += n;
+            r->count -= n;
+            p->sizes[li] += n;
+            p->sizes[li+1] -= n;
+        }
+        sdsfree(p->keys[li+1].ele);
+        p->keys[li+1].ele = sdsdup(rl->entries[0].ele);
+        p->keys[li+1].score = rl->entries[0].score;
+        return;
+    }
+
+    /* Inner nodes: rotate one child at a time through the parent. */
+    zbtreeInner *il = (zbtreeInner*)l, *ir = (zbtreeInner*)r;
+    while (l->count > r->count+1) {
+        unsigned int last = l->count-1;
+        memmove(ir->keys+1,ir->keys,sizeof(zbtreeEntry)*r->count);
+        memmove(ir->sizes+1,ir->sizes,sizeof(unsigned long)*r->count);
+        memmove(ir->children+1,ir->children,sizeof(zbtreeNode*)*r->count);
+        ir->keys[1] = p->keys[li+1];
+        ir->keys[0].ele = NULL;
+        ir->sizes[0] = il->sizes[last];
+        ir->children[0] = il->children[last];
+        p->keys[li+1] = il->keys[last];
+        p->sizes[li] -= il->sizes[last];
+        p->sizes[li+1] += il->sizes[last];
+        l->count--;
+        r->count++;
+    }
+    while (r->count > l->count+1) {
+        unsigned int end = l->count;
+        il->keys[end] = p->keys[li+1];
+        il->sizes[end] = ir->sizes[0];
+        il->children[end] = ir->children[0];
+        p->keys[li+1] = ir->keys[1];
+        p->sizes[li] += ir->sizes[0];
+        p->sizes[li+1] -= ir->sizes[0];
+        memmove(ir->keys,ir->keys+1,sizeof(zbtreeEntry)*(r->count-1));
+        memmove(ir->sizes,ir->sizes+1,sizeof(unsigned long)*(r->count-1));
+        memmove(ir->children,ir->children+1,
+                sizeof(zbtreeNode*)*(r->count-1));
+        ir->keys[0].ele = NULL;
+        l->count++;
+        r->count--;
+    }
+}
+
+/* Remove the element with the specified 0-based rank from the tree, and
+ * return its SDS string, that the caller should free. */
+static sds zbtDeleteByRank(zbtree *zbt, unsigned long rank) {
+    zbtreePathStep path[ZBTREE_MAX_DEPTH];
+    zbtreeNode *x = zbt->root;
+    zbtreeLeaf *leaf;
+    int level = 0;
+    sds ele;
+
+    serverAssert(rank < zbt->length);
+    while (!x->leaf) {
+        zbtreeInner *in = (zbtreeInner*)x;
+        int i = 0;
+
+        while (rank >= in->sizes[i]) rank -= in->sizes[i++];
+        in->sizes[i]--;
+        serverAssert(level < ZBTREE_MAX_DEPTH);
+        path[level].node = in;
+        path[level].idx = i;
+        level++;
+        x = in->children[i];
+    }
+
+    leaf = (zbtreeLeaf*)x;
+    ele = leaf->entries[rank].ele;
+    memmove(leaf->entries+rank,leaf->entries+rank+1,
+            sizeof(zbtreeEntry)*(x->count-rank-1));
+    x->count--;
+    zbt->length--;
+
+    /* Merge or refill the nodes left with too few entries, going up. */
+    while (level > 0 && x->count < ZBTREE_MIN_FANOUT) {
+        zbtreeInner *p = path[--level].node;
+        int li = path[level].idx ? path[level].idx-1 : 0;
+
+        if (p->children[li]->count+p->children[li+1]->count <=
+            ZBTREE_MAX_FANOUT)
+        {
+            zbtMergeChildren(zbt,p,li);
+            x = (zbtreeNode*)p;
+        } else {
+            zbtRedistribute(p,li);
+            break;
+        }
+    }
+
+    /* Remove root levels with a single child. */
+    while (!zbt->root->leaf && zbt->root->count == 1) {
+        zbtreeInner *root = (zbtreeInner*)zbt->root;
+        zbt->root = root->children[0];
+        zfree(root);
+    }
+    return ele;
+}
+
+/* Delete an element with matching score/element from the B+tree.
+ * The function returns 1 if the element was found and deleted, otherwise
+ * 0 is returned.
+ *
+ * If 'oldele' is NULL the deleted element SDS string is freed, otherwise
+ * it is returned by reference, so that the caller can reuse it. */
+int zbtDelete(zbtree *zbt, double score, sds ele, sds *oldele) {
+    zbtreeEntry key = {ele,score};
+    zbtreeCursor cur;
+    zbtreeEntry *e;
+    unsigned long rank;
+
+    rank = zbtSeek(zbt,zbtEntryBefore,&key,&cur,NULL,NULL);
+    if (!zbtCursorFix(&cur)) return 0;
+    e = zbtCursorEntry(&cur);
+    if (e->score != score || sdscmp(e->ele,ele) != 0) return 0;
+
+    ele = zbtDeleteByRank(zbt,rank);
+    if (oldele) *oldele = ele;
+    else sdsfree(ele);
+    return 1;
+}
+
+/* Find the first element in the specified score range. Returns its 1-based
+ * rank and sets the cursor, or returns 0 if the range is empty. */
+unsigned long zbtFirstInRange(zbtree *zbt, zrangespec *range,
+                              zbtreeCursor *cur)
+{
+    unsigned long rank;
+
+    rank = zbtSeek(zbt,zbtScoreBeforeMin,range,cur,NULL,NULL);
+    if (!zbtCursorFix(cur)) return 0;
+    if (!zslValueLteMax(zbtCursorEntry(cur)->score,range)) return 0;
+    return rank+1;
+}
+
+/* Like zbtFirstInRange() but seeks the last element in the range. */
+unsigned long zbtLastInRange(zbtree *zbt, zrangespec *range,
+                             zbtreeCursor *cur)
+{
+    unsigned long rank;
+
+    rank = zbtSeek(zbt,zbtScoreLteMax,range,cur,NULL,NULL);
+    if (rank == 0) return 0;
+    zbtPrev(cur);
+    if (!zslValueGteMin(zbtCursorEntry(cur)->score,range)) return 0;
+    return rank;
+}
+
+/* Find the first element in the specified lex range. Returns its 1-based
+ * rank and sets the cursor, or returns 0 if the range is empty. */
+unsigned long zbtFirstInLexRange(zbtree *zbt, zlexrangespec *range,
+                                 zbtreeCursor *cur)
+{
+    unsigned long rank;
+
+    rank = zbtSeek(zbt,zbtLexBeforeMin,range,cur,NULL,NULL);
+    if (!zbtCursorFix(cur)) return 0;
+    if (!zslLexValueLteMax(zbtCursorEntry(cur)->ele,range)) return 0;
+    return rank+1;
+}
+
+/* Like zbtFirstInLexRange() but seeks the last element in the range. */
+unsigned long zbtLastInLexRange(zbtree *zbt, zlexrangespec *range,
+                                zbtreeCursor *cur)
+{
+    unsigned long rank;
+
+    rank = zbtSeek(zbt,zbtLexLteMax,range,cur,NULL,NULL);
+    if (rank == 0) return 0;
+    zbtPrev(cur);
+    if (!zslLexValueGteMin(zbtCursorEntry(cur)->ele,range)) return 0;
+    return rank;
+}
+
+/* Delete all the elements with rank between start and end from the B+tree
+ * and the dictionary. Start and end are inclusive and 1-based. */
+static unsigned long zbtDeleteRange(zbtree *zbt, unsigned long start,
+                                    unsigned long end, dict *dict)
+{
+    unsigned long removed;
+
+    for (removed = 0; removed < end-start+1; removed++) {
+        sds ele = zbtDeleteByRank(zbt,start-1);
+        dictDelete(dict,ele);
+        sdsfree(ele);
+    }
+    return removed;
+}
+
+unsigned long zbtDeleteRangeByScore(zbtree *zbt, zrangespec *range,
+                                    dict *dict)
+{
+    zbtreeCursor cur;
+    unsigned long start, end;
+
+    if ((start = zbtFirstInRange(zbt,range,&cur)) == 0) return 0;
+    end = zbtSeek(zbt,zbtScoreLteMax,range,&cur,NULL,NULL);
+    return zbtDeleteRange(zbt,start,end,dict);
+}
+
+unsigned long zbtDeleteRangeByLex(zbtree *zbt, zlexrangespec *range,
+                                  dict *dict)
+{
+    zbtreeCursor cur;
+    unsigned long start, end;
+
+    if ((start = zbtFirstInLexRange(zbt,range,&cur)) == 0) return 0;
+    end = zbtSeek(zbt,zbtLexLteMax,range,&cur,NULL,NULL);
+    return zbtDeleteRange(zbt,start,end,dict);
+}
+
+unsigned long zbtDeleteRangeByRank(zbtree *zbt, unsigned int start,
+                                   unsigned int end, dict *dict)
+{
+    return zbtDeleteRange(zbt,start,end,dict);
+}
+
+/* Find the rank for an element by both score and key.
+ * Returns 0 when the element cannot be found, rank otherwise.
+ * Note that the rank is 1-based like in the skiplist implementation. */
+unsigned long zbtGetRank(zbtree *zbt, double score, sds ele) {
+    zbtreeEntry key = {ele,score};
+    zbtreeCursor cur;
+    zbtreeEntry *e;
+    unsigned long rank;
+
+    rank = zbtSeek(zbt,zbtEntryBefore,&key,&cur,NULL,NULL);
+    if (!zbtCursorFix(&cur)) return 0;
+    e = zbtCursorEntry(&cur);
+    if (e->score != score || sdscmp(e->ele,ele) != 0) return 0;
+    return rank+1;
+}
+
+/* Return a reference to the SDS string of the specified element as stored
+ * in the B+tree, or NULL if the element is not there. Used by the active
+ * defragmentation in order to replace the string shared with the dict. */
+sds *zbtFindElement(zbtree *zbt, double score, sds ele) {
+    zbtreeEntry key = {ele,score};
+    zbtreeCursor cur;
+    zbtreeEntry *e;
+
+    zbtSeek(zbt,zbtEntryBefore,&key,&cur,NULL,NULL);
+    if (!zbtCursorFix(&cur)) return NULL;
+    e = zbtCursorEntry(&cur);
+    if (e->score != score || sdscmp(e->ele,ele) != 0) return NULL;
+    return &e->ele;
+}
+
+/* Set the cursor to the element with the specified 1-based rank. Returns
+ * 0 if the rank is out of range. */
+int zbtGetElementByRank(zbtree *zbt, unsigned long rank, zbtreeCursor *cur) {
+    zbtreeNode *x = zbt->root;
+
+    if (rank == 0 || rank > zbt->length) return 0;
+    rank--;
+    while (!x->leaf) {
+        zbtreeInner *in = (zbtreeInner*)x;
+        int i = 0;
+
+        while (rank >= in->sizes[i]) rank -= in->sizes[i++];
+        x = in->children[i];
+    }
+    cur->leaf = (zbtreeLeaf*)x;
+    cur->idx = rank;
+    return 1;
+}
+
+/* Cursor helpers. All of them return 0 when there is no such element. */
+int zbtFirst(zbtree *zbt, zbtreeCursor *cur) {
+    cur->leaf = zbt->head;
+    cur->idx = 0;
+    return zbt->length != 0;
+}
+
+int zbtLast(zbtree *zbt, zbtreeCursor *cur) {
+    cur->leaf = zbt->tail;
+    cur->idx = zbt->tail->hdr.count ? zbt->tail->hdr.count-1 : 0;
+    return zbt->length != 0;
+}
+
+int zbtNext(zbtreeCursor *cur) {
+    if (++cur->idx < cur->leaf->hdr.count) return 1;
+    cur->leaf = cur->leaf->next;
+    cur->idx = 0;
+    return cur->leaf != NULL;
+}
+
+int zbtPrev(zbtreeCursor *cur) {
+    if (cur->idx > 0) {
+        cur->idx--;
+        return 1;
+    }
+    cur->leaf = cur->leaf->prev;
+    if (cur->leaf == NULL) return 0;
+    cur->idx = cur->leaf->hdr.count-1;
+    return 1;
+}
+
 /*-----------------------------------------------------------------------------
  * Ziplist-backed sorted set API
  *----------------------------------------------------------------------------*/
@@ -678,7 +1469,7 @@ double zzlGetScore(unsigned char *sptr) {
     if (vstr) {
         memcpy(buf,vstr,vlen);
         buf[vlen] = '\0';
-        score = strtod(buf,NULL);
+        score = fastStrtod(buf,NULL);
     } else {
         score = vlong;
     }
@@ -1106,15 +1897,86 @@ unsigned int zsetLength(const robj *zobj) {
         length = zzlLength(zobj->ptr);
     } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
         length = ((const zset*)zobj->ptr)->zsl->length;
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        length = ((const zset*)zobj->ptr)->zbt->length;
     } else {
         serverPanic("Unknown sorted set encoding");
     }
     return length;
 }
 
+/* Return true if 'encoding' is one of the encodings used for large sorted
+ * sets, that is, a dict plus a skiplist or a B+tree. */
+int zsetIsLargeEncoding(int encoding) {
+    return encoding == OBJ_ENCODING_SKIPLIST || encoding == OBJ_ENCODING_BTREE;
+}
+
+/* Create the dict + skiplist or dict + B+tree representation of an empty
+ * sorted set, according to 'encoding'. */
+zset *zsetCreate(int encoding) {
+    zset *zs = zmalloc(sizeof(*zs));
+
+    zs->dict = dictCreate(&zsetDictType,NULL);
+    zs->zsl = NULL;
+    zs->zbt = NULL;
+    if (encoding == OBJ_ENCODING_SKIPLIST)
+        zs->zsl = zslCreate();
+    else if (encoding == OBJ_ENCODING_BTREE)
+        zs->zbt = zbtCreate();
+    else
+        serverPanic("Unknown sorted set encoding");
+    return zs;
+}
+
+/* Add an element to a skiplist or B+tree encoded sorted set, without
+ * checking if the element is already there: if it is C_ERR is returned
+ * and nothing is done, otherwise C_OK is returned and the SDS string 'ele'
+ * is owned by the sorted set. Used when populating new sorted sets. */
+int zsetInsertNew(zset *zs, double score, sds ele) {
+    dictEntry *de = dictAddRaw(zs->dict,ele,NULL);
+
+    if (de == NULL) return C_ERR;
+    if (zs->zbt) {
+        dictSetDoubleVal(de,score);
+        zbtInsert(zs->zbt,score,ele);
+    } else {
+        zskiplistNode *znode = zslInsert(zs->zsl,score,ele);
+        dictSetVal(zs->dict,de,&znode->score);
+    }
+    return C_OK;
+}
+
+static int zsetBulkEntryCompare(const void *a, const void *b) {
+    const zsetBulkEntry *ea = a, *eb = b;
+
+    if (ea->score < eb->score) return -1;
+    if (ea->score > eb->score) return 1;
+    return sdscmp(ea->ele,eb->ele);
+}
+
+/* Populate the skiplist or the B+tree of the empty sorted set 'zs' with
+ * 'count' elements, in any order. The elements must already be in the
+ * sorted set dict, and 'de' must point to their dict entry: the dict values
+ * are set by this function. The array is sorted by (score,ele), then the
+ * ordered structure is built in a single pass, which is a lot faster than
+ * inserting one element at a time when building big sorted sets. */
+void zsetBulkLoad(zset *zs, zsetBulkEntry *entries, unsigned long count) {
+    unsigned long j;
+
+    qsort(entries,count,sizeof(zsetBulkEntry),zsetBulkEntryCompare);
+    if (zs->zbt) {
+        for (j = 0; j < count; j++)
+            dictSetDoubleVal(entries[j].de,entries[j].score);
+        zbtBulkLoad(zs->zbt,entries,count);
+    } else {
+        zslBulkLoad(zs->zsl,zs->dict,entries,count);
+    }
+}
+
 void zsetConvert(robj *zobj, int encoding) {
     zset *zs;
     zskiplistNode *node, *next;
+    zbtreeCursor cur;
     sds ele;
     double score;
 
@@ -1126,12 +1988,10 @@ void zsetConvert(robj *zobj, int encoding) {
         unsigned int vlen;
         long long vlong;
 
-        if (encoding != OBJ_ENCODING_SKIPLIST)
+        if (!zsetIsLargeEncoding(encoding))
             serverPanic("Unknown target encoding");
 
-        zs = zmalloc(sizeof(*zs));
-        zs->dict = dictCreate(&zsetDictType,NULL);
-        zs->zsl = zslCreate();
+        zs = zsetCreate(encoding);
 
         eptr = ziplistIndex(zl,0);
         serverAssertWithInfo(NULL,zobj,eptr != NULL);
@@ -1146,40 +2006,79 @@ void zsetConvert(robj *zobj, int encoding) {
             else
                 ele = sdsnewlen((char*)vstr,vlen);
 
-            node = zslInsert(zs->zsl,score,ele);
-            serverAssert(dictAdd(zs->dict,ele,&node->score) == DICT_OK);
+            serverAssert(zsetInsertNew(zs,score,ele) == C_OK);
             zzlNext(zl,&eptr,&sptr);
         }
 
         zfree(zobj->ptr);
         zobj->ptr = zs;
-        zobj->encoding = OBJ_ENCODING_SKIPLIST;
-    } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
+        zobj->encoding = encoding;
+    } else if (encoding == OBJ_ENCODING_ZIPLIST) {
         unsigned char *zl = ziplistNew();
 
-        if (encoding != OBJ_ENCODING_ZIPLIST)
-            serverPanic("Unknown target encoding");
-
-        /* Approach similar to zslFree(), since we want to free the skiplist at
-         * the same time as creating the ziplist. */
         zs = zobj->ptr;
-        dictRelease(zs->dict);
-        node = zs->zsl->header->level[0].forward;
-        zfree(zs->zsl->header);
-        zfree(zs->zsl);
-
-        while (node) {
-            zl = zzlInsertAt(zl,NULL,node->ele,node->score);
-            next = node->level[0].forward;
-            zslFreeNode(node);
-            node = next;
+        if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
+            /* Approach similar to zslFree(), since we want to free the
+             * skiplist at the same time as creating the ziplist. */
+            dictRelease(zs->dict);
+            node = zs->zsl->header->level[0].forward;
+            zfree(zs->zsl->header);
+            zfree(zs->zsl);
+
+            while (node) {
+                zl = zzlInsertAt(zl,NULL,node->ele,node->score);
+                next = node->level[0].forward;
+                zslFreeNode(node);
+                node = next;
+            }
+        } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+            dictRelease(zs->dict);
+            if (zbtFirst(zs->zbt,&cur)) {
+                do {
+                    zbtreeEntry *e = zbtCursorEntry(&cur);
+                    zl = zzlInsertAt(zl,NULL,e->ele,e->score);
+                } while (zbtNext(&cur));
+            }
+            zbtFree(zs->zbt);
+        } else {
+            serverPanic("Unknown sorted set encoding");
         }
 
         zfree(zs);
         zobj->ptr = zl;
         zobj->encoding = OBJ_ENCODING_ZIPLIST;
+    } else if (zsetIsLargeEncoding(encoding)) {
+        /* Switch between the skiplist and the B+tree: copy the elements
+         * in order, then release the old representation. */
+        zset *src = zobj->ptr;
+
+        zs = zsetCreate(encoding);
+        if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
+            node = src->zsl->header->level[0].forward;
+            while (node) {
+                serverAssert(zsetInsertNew(zs,node->score,
+                                           sdsdup(node->ele)) == C_OK);
+                node = node->level[0].forward;
+            }
+            zslFree(src->zsl);
+        } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+            if (zbtFirst(src->zbt,&cur)) {
+                do {
+                    zbtreeEntry *e = zbtCursorEntry(&cur);
+                    serverAssert(zsetInsertNew(zs,e->score,
+                                               sdsdup(e->ele)) == C_OK);
+                } while (zbtNext(&cur));
+            }
+            zbtFree(src->zbt);
+        } else {
+            serverPanic("Unknown sorted set encoding");
+        }
+        dictRelease(src->dict);
+        zfree(src);
+        zobj->ptr = zs;
+        zobj->encoding = encoding;
     } else {
-        serverPanic("Unknown sorted set encoding");
+        serverPanic("Unknown target encoding");
     }
 }
 
@@ -1188,9 +2087,7 @@ void zsetConvert(robj *zobj, int encoding) {
  * expected ranges. */
 void zsetConvertToZiplistIfNeeded(robj *zobj, size_t maxelelen) {
     if (zobj->encoding == OBJ_ENCODING_ZIPLIST) return;
-    zset *zset = zobj->ptr;
-
-    if (zset->zsl->length <= server.zset_max_ziplist_entries &&
+    if (zsetLength(zobj) <= server.zset_max_ziplist_entries &&
         maxelelen <= server.zset_max_ziplist_value)
             zsetConvert(zobj,OBJ_ENCODING_ZIPLIST);
 }
@@ -1204,11 +2101,11 @@ int zsetScore(robj *zobj, sds member, double *score) {
 
     if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
         if (zzlFind(zobj->ptr, member, score) == NULL) return C_ERR;
-    } else if (zobj->encoding == OBJ_ENCODING_SKIPLIST) {
+    } else if (zsetIsLargeEncoding(zobj->encoding)) {
         zset *zs = zobj->ptr;
         dictEntry *de = dictFind(zs->dict, member);
         if (de == NULL) return C_ERR;
-        *score = *(double*)dictGetVal(de);
+        *score = zsetDictGetScore(zobj,de);
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -1252,7 +2149,8 @@ int zsetScore(robj *zobj, sds member, double *score) {
  * start.
  *
  * The commad as a side effect of adding a new element may convert the sorted
- * set internal encoding from ziplist to hashtable+skiplist.
+ * set internal encoding from ziplist to hashtable+skiplist (or B+tree, see
+ * the zset-large-encoding configuration option).
  *
  * Memory managemnet of 'ele':
  *
@@ -1305,9 +2203,9 @@ int zsetAdd(robj *zobj, double score, sds ele, int *flags, double *newscore) {
              * becomes too long *before* executing zzlInsert. */
             zobj->ptr = zzlInsert(zobj->ptr,ele,score);
             if (zzlLength(zobj->ptr) > server.zset_max_ziplist_entries)
-                zsetConvert(zobj,OBJ_ENCODING_SKIPLIST);
+                zsetConvert(zobj,server.zset_large_encoding);
             if (sdslen(ele) > server.zset_max_ziplist_value)
-                zsetConvert(zobj,OBJ_ENCODING_SKIPLIST);
+                zsetConvert(zobj,server.zset_large_encoding);
             if (newscore) *newscore = score;
             *flags |= ZADD_ADDED;
             return 1;
@@ -1366,6 +2264,48 @@ int zsetAdd(robj *zobj, double score, sds ele, int *flags, double *newscore) {
             *flags |= ZADD_NOP;
             return 1;
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        dictEntry *de;
+
+        de = dictFind(zs->dict,ele);
+        if (de != NULL) {
+            /* NX? Return, same element already exists. */
+            if (nx) {
+                *flags |= ZADD_NOP;
+                return 1;
+            }
+            curscore = dictGetDoubleVal(de);
+
+            /* Prepare the score for the increment if needed. */
+            if (incr) {
+                score += curscore;
+                if (isnan(score)) {
+                    *flags |= ZADD_NAN;
+                    return 0;
+                }
+                if (newscore) *newscore = score;
+            }
+
+            /* Remove and re-insert when score changes, reusing the SDS
+             * string shared with the hash table. */
+            if (score != curscore) {
+                sds oldele;
+                serverAssert(zbtDelete(zs->zbt,curscore,ele,&oldele));
+                zbtInsert(zs->zbt,score,oldele);
+                dictSetDoubleVal(de,score);
+                *flags |= ZADD_UPDATED;
+            }
+            return 1;
+        } else if (!xx) {
+            serverAssert(zsetInsertNew(zs,score,sdsdup(ele)) == C_OK);
+            *flags |= ZADD_ADDED;
+            if (newscore) *newscore = score;
+            return 1;
+        } else {
+            *flags |= ZADD_NOP;
+            return 1;
+        }
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -1403,6 +2343,23 @@ int zsetDel(robj *zobj, sds ele) {
             int retval = zslDelete(zs->zsl,score,ele,NULL);
             serverAssert(retval);
 
+            if (htNeedsResize(zs->dict)) dictResize(zs->dict);
+            return 1;
+        }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        dictEntry *de;
+        double score;
+
+        de = dictUnlink(zs->dict,ele);
+        if (de != NULL) {
+            /* Same as above: the B+tree releases the shared SDS string. */
+            score = dictGetDoubleVal(de);
+            dictFreeUnlinkedEntry(zs->dict,de);
+
+            int retval = zbtDelete(zs->zbt,score,ele,NULL);
+            serverAssert(retval);
+
             if (htNeedsResize(zs->dict)) dictResize(zs->dict);
             return 1;
         }
@@ -1473,6 +2430,21 @@ long zsetRank(robj *zobj, sds ele, int reverse) {
         } else {
             return -1;
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        dictEntry *de;
+
+        de = dictFind(zs->dict,ele);
+        if (de != NULL) {
+            rank = zbtGetRank(zs->zbt,dictGetDoubleVal(de),ele);
+            serverAssert(rank != 0);
+            if (reverse)
+                return llen-rank;
+            else
+                return rank-1;
+        } else {
+            return -1;
+        }
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -1482,6 +2454,93 @@ long zsetRank(robj *zobj, sds ele, int reverse) {
  * Sorted set commands
  *----------------------------------------------------------------------------*/
 
+/* Bulk version of the ZADD loop, used when many elements are added to a
+ * sorted set that is empty or still ziplist encoded. The elements already in
+ * the sorted set and the new ones are collected in the dict of a new zset,
+ * that is then populated in a single pass by zsetBulkLoad(). Elements
+ * specified multiple times are handled like zsetAdd() does when called for
+ * every pair: the last score wins, or the first one with NX.
+ *
+ * The number of added and updated elements is returned by reference. The
+ * object is converted back to a ziplist if the result is small enough. */
+static void zaddBulk(client *c, robj *zobj, int scoreidx, double *scores,
+                     int elements, int nx, int *added, int *updated)
+{
+    unsigned long count = 0, existing = zsetLength(zobj);
+    zsetBulkEntry *entries;
+    size_t maxelelen = 0;
+    dictEntry *de, *old;
+    zset *zs;
+    sds ele;
+    int j;
+
+    if (zobj->encoding == OBJ_ENCODING_ZIPLIST)
+        zs = zsetCreate(server.zset_large_encoding);
+    else
+        zs = zobj->ptr; /* Empty, can be populated directly. */
+    dictExpand(zs->dict,existing+elements);
+    entries = zmalloc(sizeof(zsetBulkEntry)*(existing+elements));
+
+    /* While collecting the elements, the dict values are the positions of
+     * the elements inside the array. */
+    if (zobj->encoding == OBJ_ENCODING_ZIPLIST && existing) {
+        unsigned char *zl = zobj->ptr, *eptr, *sptr, *vstr;
+        unsigned int vlen;
+        long long vlong;
+
+        eptr = ziplistIndex(zl,0);
+        sptr = ziplistNext(zl,eptr);
+        while (eptr != NULL) {
+            serverAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            if (vstr == NULL)
+                ele = sdsfromlonglong(vlong);
+            else
+                ele = sdsnewlen((char*)vstr,vlen);
+            if (sdslen(ele) > maxelelen) maxelelen = sdslen(ele);
+
+            de = dictAddRaw(zs->dict,ele,NULL);
+            serverAssertWithInfo(c,zobj,de != NULL);
+            dictSetUnsignedIntegerVal(de,count);
+            entries[count].ele = ele;
+            entries[count].score = zzlGetScore(sptr);
+            entries[count].de = de;
+            count++;
+            zzlNext(zl,&eptr,&sptr);
+        }
+    }
+
+    for (j = 0; j < elements; j++) {
+        ele = c->argv[scoreidx+1+j*2]->ptr;
+        de = dictAddRaw(zs->dict,ele,&old);
+        if (de) {
+            ele = sdsdup(ele);
+            if (sdslen(ele) > maxelelen) maxelelen = sdslen(ele);
+            dictSetKey(zs->dict,de,ele);
+            dictSetUnsignedIntegerVal(de,count);
+            entries[count].ele = ele;
+            entries[count].score = scores[j];
+            entries[count].de = de;
+            count++;
+            (*added)++;
+        } else if (!nx) {
+            zsetBulkEntry *e = entries+dictGetUnsignedIntegerVal(old);
+            if (e->score != scores[j]) {
+                e->score = scores[j];
+                (*updated)++;
+            }
+        }
+    }
+
+    zsetBulkLoad(zs,entries,count);
+    zfree(entries);
+    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+        zfree(zobj->ptr);
+        zobj->ptr = zs;
+        zobj->encoding = server.zset_large_encoding;
+    }
+    zsetConvertToZiplistIfNeeded(zobj,maxelelen);
+}
+
 /* This generic command implements both ZADD and ZINCRBY. */
 void zaddGenericCommand(client *c, int flags) {
     static char *nanerr = "resulting score is not a number (NaN)";
@@ -1568,6 +2627,17 @@ void zaddGenericCommand(client *c, int flags) {
         }
     }
 
+    /* Many elements added to an empty or small sorted set: build the
+     * resulting sorted set in bulk instead of one element at a time. */
+    if (!incr && !xx && elements >= ZSET_BULK_LOAD_MIN &&
+        (zobj->encoding == OBJ_ENCODING_ZIPLIST || zsetLength(zobj) == 0) &&
+        zsetLength(zobj)+elements > server.zset_max_ziplist_entries)
+    {
+        zaddBulk(c,zobj,scoreidx,scores,elements,nx,&added,&updated);
+        server.dirty += (added+updated);
+        goto reply_to_client;
+    }
+
     for (j = 0; j < elements; j++) {
         double newscore;
         score = scores[j];
@@ -1725,6 +2795,24 @@ void zremrangeGenericCommand(client *c, int rangetype) {
             dbDelete(c->db,key);
             keyremoved = 1;
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        switch(rangetype) {
+        case ZRANGE_RANK:
+            deleted = zbtDeleteRangeByRank(zs->zbt,start+1,end+1,zs->dict);
+            break;
+        case ZRANGE_SCORE:
+            deleted = zbtDeleteRangeByScore(zs->zbt,&range,zs->dict);
+            break;
+        case ZRANGE_LEX:
+            deleted = zbtDeleteRangeByLex(zs->zbt,&lexrange,zs->dict);
+            break;
+        }
+        if (htNeedsResize(zs->dict)) dictResize(zs->dict);
+        if (dictSize(zs->dict) == 0) {
+            dbDelete(c->db,key);
+            keyremoved = 1;
+        }
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -1786,6 +2874,11 @@ typedef struct {
                 zset *zs;
                 zskiplistNode *node;
             } sl;
+            struct {
+                zset *zs;
+                zbtreeCursor cur;
+                int valid;
+            } bt;
         } zset;
     } iter;
 } zsetopsrc;
@@ -1843,6 +2936,9 @@ void zuiInitIterator(zsetopsrc *op) {
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
             it->sl.zs = op->subject->ptr;
             it->sl.node = it->sl.zs->zsl->header->level[0].forward;
+        } else if (op->encoding == OBJ_ENCODING_BTREE) {
+            it->bt.zs = op->subject->ptr;
+            it->bt.valid = zbtFirst(it->bt.zs->zbt,&it->bt.cur);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -1868,7 +2964,8 @@ void zuiClearIterator(zsetopsrc *op) {
         iterzset *it = &op->iter.zset;
         if (op->encoding == OBJ_ENCODING_ZIPLIST) {
             UNUSED(it); /* skip */
-        } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
+        } else if (op->encoding == OBJ_ENCODING_SKIPLIST ||
+                   op->encoding == OBJ_ENCODING_BTREE) {
             UNUSED(it); /* skip */
         } else {
             serverPanic("Unknown sorted set encoding");
@@ -1897,6 +2994,9 @@ int zuiLength(zsetopsrc *op) {
         } else if (op->encoding == OBJ_ENCODING_SKIPLIST) {
             zset *zs = op->subject->ptr;
             return zs->zsl->length;
+        } else if (op->encoding == OBJ_ENCODING_BTREE) {
+            zset *zs = op->subject->ptr;
+            return zs->zbt->length;
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -1959,6 +3059,15 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
 
             /* Move to next element. */
             it->sl.node = it->sl.node->level[0].forward;
+        } else if (op->encoding == OBJ_ENCODING_BTREE) {
+            if (!it->bt.valid)
+                return 0;
+            zbtreeEntry *e = zbtCursorEntry(&it->bt.cur);
+            val->ele = e->ele;
+            val->score = e->score;
+
+            /* Move to next element. */
+            it->bt.valid = zbtNext(&it->bt.cur);
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -2076,6 +3185,15 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
             } else {
                 return 0;
             }
+        } else if (op->encoding == OBJ_ENCODING_BTREE) {
+            zset *zs = op->subject->ptr;
+            dictEntry *de;
+            if ((de = dictFind(zs->dict,val->ele)) != NULL) {
+                *score = dictGetDoubleVal(de);
+                return 1;
+            } else {
+                return 0;
+            }
         } else {
             serverPanic("Unknown sorted set encoding");
         }
@@ -2132,7 +3250,8 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
     unsigned int maxelelen = 0;
     robj *dstobj;
     zset *dstzset;
-    zskiplistNode *znode;
+    zsetBulkEntry *entries;
+    unsigned long count = 0;
     int touched = 0;
 
     /* expect setnum input keys to be given */
@@ -2227,6 +3346,7 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
         if (zuiLength(&src[0]) > 0) {
             /* Precondition: as src[0] is non-empty and the inputs are ordered
              * by size, all src[i > 0] are non-empty too. */
+            entries = zmalloc(sizeof(zsetBulkEntry)*zuiLength(&src[0]));
             zuiInitIterator(&src[0]);
             while (zuiNext(&src[0],&zval)) {
                 double score, value;
@@ -2251,12 +3371,18 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
                 /* Only continue when present in every input. */
                 if (j == setnum) {
                     tmp = zuiNewSdsFromValue(&zval);
-                    znode = zslInsert(dstzset->zsl,score,tmp);
-                    dictAdd(dstzset->dict,tmp,&znode->score);
+                    entries[count].ele = tmp;
+                    entries[count].score = score;
+                    entries[count].de = dictAddRaw(dstzset->dict,tmp,NULL);
+                    count++;
                     if (sdslen(tmp) > maxelelen) maxelelen = sdslen(tmp);
                 }
             }
             zuiClearIterator(&src[0]);
+
+            /* Build the skiplist or B+tree in a single pass. */
+            zsetBulkLoad(dstzset,entries,count);
+            zfree(entries);
         }
     } else if (op == SET_OP_UNION) {
         dict *accumulator = dictCreate(&setAccumulatorDictType,NULL);
@@ -2313,22 +3439,28 @@ void zunionInterGenericCommand(client *c, robj *dstkey, int op) {
          * let's resize the dictionary embedded inside the sorted set to the
          * right size, in order to save rehashing time. */
         dictExpand(dstzset->dict,dictSize(accumulator));
+        entries = zmalloc(sizeof(zsetBulkEntry)*dictSize(accumulator));
 
         while((de = dictNext(di)) != NULL) {
             sds ele = dictGetKey(de);
-            score = dictGetDoubleVal(de);
-            znode = zslInsert(dstzset->zsl,score,ele);
-            dictAdd(dstzset->dict,ele,&znode->score);
+            entries[count].ele = ele;
+            entries[count].score = dictGetDoubleVal(de);
+            entries[count].de = dictAddRaw(dstzset->dict,ele,NULL);
+            count++;
         }
         dictReleaseIterator(di);
         dictRelease(accumulator);
+
+        /* Build the skiplist or B+tree in a single pass. */
+        zsetBulkLoad(dstzset,entries,count);
+        zfree(entries);
     } else {
         serverPanic("Unknown operator");
     }
 
     if (dbDelete(c->db,dstkey))
         touched = 1;
-    if (dstzset->zsl->length) {
+    if (zsetLength(dstobj)) {
         zsetConvertToZiplistIfNeeded(dstobj,maxelelen);
         dbAdd(c->db,dstkey,dstobj);
         addReplyLongLong(c,zsetLength(dstobj));
@@ -2454,6 +3586,25 @@ void zrangeGenericCommand(client *c, int reverse) {
                 addReplyDouble(c,ln->score);
             ln = reverse ? ln->backward : ln->level[0].forward;
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreeCursor cur;
+        zbtreeEntry *e;
+
+        serverAssertWithInfo(c,zobj,zbtGetElementByRank(zs->zbt,
+            reverse ? (unsigned long)(llen-start) :
+                      (unsigned long)(start+1),&cur));
+
+        while(rangelen--) {
+            e = zbtCursorEntry(&cur);
+            addReplyBulkCBuffer(c,e->ele,sdslen(e->ele));
+            if (withscores)
+                addReplyDouble(c,e->score);
+            if (reverse)
+                zbtPrev(&cur);
+            else
+                zbtNext(&cur);
+        }
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -2616,15 +3767,11 @@ void genericZrangebyscoreCommand(client *c, int reverse) {
          * length in the output buffer, and will "fix" it later */
         replylen = addDeferredMultiBulkLength(c);
 
-        /* If there is an offset, just traverse the number of elements without
-         * checking the score because that is done in the next loop. */
-        while (ln && offset--) {
-            if (reverse) {
-                ln = ln->backward;
-            } else {
-                ln = ln->level[0].forward;
-            }
-        }
+        /* If there is an offset, use the rank of the first node to jump
+         * directly to the right node, without checking the score because
+         * that is done in the next loop. */
+        if (offset > 0) ln = zslSkipNodes(zsl,ln,offset,reverse);
+        else if (offset < 0) ln = NULL;
 
         while (ln && limit--) {
             /* Abort when the node is no longer in range. */
@@ -2648,6 +3795,63 @@ void genericZrangebyscoreCommand(client *c, int reverse) {
                 ln = ln->level[0].forward;
             }
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreeCursor cur;
+        zbtreeEntry *e;
+        unsigned long rank;
+        int valid = 1;
+
+        /* If reversed, get the last element in range as starting point. */
+        if (reverse) {
+            rank = zbtLastInRange(zs->zbt,&range,&cur);
+        } else {
+            rank = zbtFirstInRange(zs->zbt,&range,&cur);
+        }
+
+        /* No "first" element in the specified interval. */
+        if (rank == 0) {
+            addReply(c, shared.emptymultibulk);
+            return;
+        }
+
+        /* We don't know in advance how many matching elements there are in the
+         * list, so we push this object that will represent the multi-bulk
+         * length in the output buffer, and will "fix" it later */
+        replylen = addDeferredMultiBulkLength(c);
+
+        /* Use the rank of the starting point to seek the offset directly,
+         * the score is checked in the next loop. */
+        if (offset < 0) {
+            valid = 0;
+        } else if (offset > 0) {
+            if (reverse)
+                valid = (unsigned long)offset < rank &&
+                        zbtGetElementByRank(zs->zbt,rank-offset,&cur);
+            else
+                valid = zbtGetElementByRank(zs->zbt,rank+offset,&cur);
+        }
+
+        while (valid && limit--) {
+            e = zbtCursorEntry(&cur);
+
+            /* Abort when the element is no longer in range. */
+            if (reverse) {
+                if (!zslValueGteMin(e->score,&range)) break;
+            } else {
+                if (!zslValueLteMax(e->score,&range)) break;
+            }
+
+            rangelen++;
+            addReplyBulkCBuffer(c,e->ele,sdslen(e->ele));
+
+            if (withscores) {
+                addReplyDouble(c,e->score);
+            }
+
+            /* Move to next element */
+            valid = reverse ? zbtPrev(&cur) : zbtNext(&cur);
+        }
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -2737,6 +3941,17 @@ void zcountCommand(client *c) {
                 count -= (zsl->length - rank);
             }
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreeCursor cur;
+        unsigned long first, last;
+
+        /* The B+tree returns the rank of the range boundaries directly. */
+        first = zbtFirstInRange(zs->zbt, &range, &cur);
+        if (first != 0) {
+            last = zbtLastInRange(zs->zbt, &range, &cur);
+            count = last-first+1;
+        }
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -2815,6 +4030,16 @@ void zlexcountCommand(client *c) {
                 count -= (zsl->length - rank);
             }
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreeCursor cur;
+        unsigned long first, last;
+
+        first = zbtFirstInLexRange(zs->zbt, &range, &cur);
+        if (first != 0) {
+            last = zbtLastInLexRange(zs->zbt, &range, &cur);
+            count = last-first+1;
+        }
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -2964,15 +4189,11 @@ void genericZrangebylexCommand(client *c, int reverse) {
          * length in the output buffer, and will "fix" it later */
         replylen = addDeferredMultiBulkLength(c);
 
-        /* If there is an offset, just traverse the number of elements without
-         * checking the score because that is done in the next loop. */
-        while (ln && offset--) {
-            if (reverse) {
-                ln = ln->backward;
-            } else {
-                ln = ln->level[0].forward;
-            }
-        }
+        /* If there is an offset, use the rank of the first node to jump
+         * directly to the right node, without checking the range because
+         * that is done in the next loop. */
+        if (offset > 0) ln = zslSkipNodes(zsl,ln,offset,reverse);
+        else if (offset < 0) ln = NULL;
 
         while (ln && limit--) {
             /* Abort when the node is no longer in range. */
@@ -2992,6 +4213,60 @@ void genericZrangebylexCommand(client *c, int reverse) {
                 ln = ln->level[0].forward;
             }
         }
+    } else if (zobj->encoding == OBJ_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreeCursor cur;
+        zbtreeEntry *e;
+        unsigned long rank;
+        int valid = 1;
+
+        /* If reversed, get the last element in range as starting point. */
+        if (reverse) {
+            rank = zbtLastInLexRange(zs->zbt,&range,&cur);
+        } else {
+            rank = zbtFirstInLexRange(zs->zbt,&range,&cur);
+        }
+
+        /* No "first" element in the specified interval. */
+        if (rank == 0) {
+            addReply(c, shared.emptymultibulk);
+            zslFreeLexRange(&range);
+            return;
+        }
+
+        /* We don't know in advance how many matching elements there are in the
+         * list, so we push this object that will represent the multi-bulk
+         * length in the output buffer, and will "fix" it later */
+        replylen = addDeferredMultiBulkLength(c);
+
+        /* Use the rank of the starting point to seek the offset directly,
+         * the range is checked in the next loop. */
+        if (offset < 0) {
+            valid = 0;
+        } else if (offset > 0) {
+            if (reverse)
+                valid = (unsigned long)offset < rank &&
+                        zbtGetElementByRank(zs->zbt,rank-offset,&cur);
+            else
+                valid = zbtGetElementByRank(zs->zbt,rank+offset,&cur);
+        }
+
+        while (valid && limit--) {
+            e = zbtCursorEntry(&cur);
+
+            /* Abort when the element is no longer in range. */
+            if (reverse) {
+                if (!zslLexValueGteMin(e->ele,&range)) break;
+            } else {
+                if (!zslLexValueLteMax(e->ele,&range)) break;
+            }
+
+            rangelen++;
+            addReplyBulkCBuffer(c,e->ele,sdslen(e->ele));
+
+            /* Move to next element */
+            valid = reverse ? zbtPrev(&cur) : zbtNext(&cur);
+        }
     } else {
         serverPanic("Unknown sorted set encoding");
     }
@@ -0,0 +1,703 @@
+/* Value tiering: spill cold values to a local file.
+ *
+ * When value-tiering is enabled, tieringCron() samples the keyspace looking
+ * for cold values: not accessed since value-tiering-min-idle seconds (or,
+ * with the LFU policies, with an access counter decayed below the one of
+ * new keys) and larger than value-tiering-min-size bytes. Such a value is
+ * serialized in the RDB format and appended to the tiering file, and the
+ * object in the keyspace is replaced by a small stub of the same type, with
+ * encoding OBJ_ENCODING_TIERED and the same LRU/LFU field, whose ptr is a
+ * tieredValue telling where the record is. So the keyspace dictionary itself
+ * is the index of the file.
+ *
+ * Accessing a spilled value reads it back from the file:
+ *
+ * 1. Before a command of a normal client is executed, its keys are checked:
+ *    if some of them are spilled, the client is blocked (BLOCKED_TIERING)
+ *    while the records are read by a bio thread, so that only this client
+ *    waits for the disk. Once all its values are back in memory the command
+ *    is processed again from the start.
+ * 2. lookupKey() reads synchronously the values that are still spilled, that
+ *    is, keys not declared by the command (scripts), commands from our
+ *    master, and every other access from inside the server.
+ *
+ * RDB and AOF files always contain all the values: spilled values are read
+ * back, or copied as they are in the case of RDB, while the file is saved.
+ *
+ * Records are never rewritten: values read back or deleted just leave
+ * garbage in the file. There are two files, one of them active: when the
+ * active file is mostly garbage the other one becomes active, and the live
+ * records are moved to it incrementally, after which the old file has no
+ * live records and is truncated. The files are unlinked just after being
+ * created, since they are just an extension of the memory of this process.
+ *
+ * Record format: <RDB type><RDB serialized value><crc64 of the previous bytes>
+ */
+
+#include "server.h"
+#include "bio.h"
+#include "crc64.h"
+#include "endianconv.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define TIERING_FILES 2
+#define TIERING_CRC_LEN 8
+#define TIERING_SAMPLES 16              /* Keys sampled per DB and round. */
+#define TIERING_MIN_ROUNDS 4            /* Sampling rounds per cron call. */
+#define TIERING_CRON_TIME_LIMIT 1000    /* Microseconds per cron call. */
+#define TIERING_COMPACT_MIN_SIZE (1024*1024) /* Min file size to compact. */
+
+typedef struct tieringFile {
+    int fd;
+    off_t size;                     /* Bytes written, offset of next record. */
+    unsigned long long live_keys;   /* Number of stubs pointing here. */
+    unsigned long long live_bytes;  /* Total length of their records. */
+    int reads;                      /* Reads in flight in the bio thread. */
+} tieringFile;
+
+static tieringFile TieringFiles[TIERING_FILES];
+static int TieringFilesOpen = 0;
+static int TieringActive = 0;       /* File receiving the new records. */
+static unsigned long long TieringNextId = 1;
+
+/* Stubs may be freed by the lazy free thread, so the live counters of the
+ * files are protected by this mutex. */
+static pthread_mutex_t TieringStatsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Compaction state: while compacting, the live records of the file that is
+ * not active are moved to the active one, scanning all the databases. */
+static int TieringCompacting = 0;
+static int TieringCompactDb;
+static unsigned long TieringCompactCursor;
+static int TieringCompactError;
+
+/* A value being read back by the bio thread, for one or more clients. */
+typedef struct tieringRead {
+    unsigned long long id;      /* ID of the stub. */
+    int file;
+    off_t offset;
+    size_t len;
+    int dbid;
+    sds key;
+    sds payload;                /* Set by the bio thread, NULL on error. */
+    list *clients;              /* Clients waiting for this value. */
+    struct tieringRead *next;   /* Link in the list of completed reads. */
+} tieringRead;
+
+/* Reads in flight by stub ID, and completed reads, waiting to be handled by
+ * tieringHandleCompletedReads(). */
+static rax *TieringReads;
+static tieringRead *TieringReadsDone = NULL;
+static pthread_mutex_t TieringReadsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* -----------------------------------------------------------------------------
+ * Files and records
+ * -------------------------------------------------------------------------- */
+
+static void tieringUpdateLive(int file, long long keys, long long bytes) {
+    pthread_mutex_lock(&TieringStatsMutex);
+    TieringFiles[file].live_keys += keys;
+    TieringFiles[file].live_bytes += bytes;
+    pthread_mutex_unlock(&TieringStatsMutex);
+}
+
+static void tieringGetLive(int file, unsigned long long *keys,
+                           unsigned long long *bytes)
+{
+    pthread_mutex_lock(&TieringStatsMutex);
+    *keys = TieringFiles[file].live_keys;
+    if (bytes) *bytes = TieringFiles[file].live_bytes;
+    pthread_mutex_unlock(&TieringStatsMutex);
+}
+
+/* Open the tiering files if not already open. Returns C_ERR and logs the
+ * reason on error. */
+int tieringOpenFiles(void) {
+    int j;
+
+    if (TieringFilesOpen) return C_OK;
+    for (j = 0; j < TIERING_FILES; j++) {
+        sds path = sdscatprintf(sdsempty(),"%s.%d",
+            server.value_tiering_file,j);
+
+        TieringFiles[j].fd = open(path,O_RDWR|O_CREAT|O_TRUNC,0600);
+        if (TieringFiles[j].fd == -1) {
+            serverLog(LL_WARNING,"Can't open the value tiering file %s: %s",
+                path, strerror(errno));
+            sdsfree(path);
+            while (j--) close(TieringFiles[j].fd);
+            return C_ERR;
+        }
+        unlink(path);
+        sdsfree(path);
+        TieringFiles[j].size = 0;
+        TieringFiles[j].live_keys = 0;
+        TieringFiles[j].live_bytes = 0;
+        TieringFiles[j].reads = 0;
+    }
+    TieringFilesOpen = 1;
+    return C_OK;
+}
+
+/* Read the record at 'offset' and return its payload, that is, the record
+ * without the checksum. Returns NULL on I/O error or checksum mismatch.
+ * This function is called by the bio thread too. */
+static sds tieringReadRecord(int file, off_t offset, size_t len) {
+    sds buf;
+    size_t nread = 0;
+    uint64_t crc;
+
+    if (len <= TIERING_CRC_LEN) return NULL;
+    buf = sdsnewlen(NULL,len);
+    while (nread < len) {
+        ssize_t n = pread(TieringFiles[file].fd,buf+nread,len-nread,
+                          offset+nread);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) goto err;
+        nread += n;
+    }
+    memcpy(&crc,buf+len-TIERING_CRC_LEN,TIERING_CRC_LEN);
+    memrev64ifbe(&crc);
+    if (crc64(0,(unsigned char*)buf,len-TIERING_CRC_LEN) != crc) {
+        errno = EINVAL;
+        goto err;
+    }
+    sdsIncrLen(buf,-TIERING_CRC_LEN);
+    return buf;
+
+err:
+    sdsfree(buf);
+    return NULL;
+}
+
+/* Append a record with the payload '*payload' to the active file, filling
+ * the location fields of 'tv'. The checksum is appended to the payload sds
+ * itself, so '*payload' may change. Returns C_ERR on write error. */
+static int tieringAppendRecord(sds *payload, tieredValue *tv) {
+    static time_t last_log = 0;
+    tieringFile *f = TieringFiles+TieringActive;
+    uint64_t crc = crc64(0,(unsigned char*)*payload,sdslen(*payload));
+    size_t len, nwritten = 0;
+
+    memrev64ifbe(&crc);
+    *payload = sdscatlen(*payload,&crc,TIERING_CRC_LEN);
+    len = sdslen(*payload);
+    while (nwritten < len) {
+        ssize_t n = pwrite(f->fd,*payload+nwritten,len-nwritten,
+                           f->size+nwritten);
+
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (server.unixtime - last_log > 60) {
+                serverLog(LL_WARNING,
+                    "Error writing to the value tiering file: %s",
+                    n == -1 ? strerror(errno) : "short write");
+                last_log = server.unixtime;
+            }
+            return C_ERR;
+        }
+        nwritten += n;
+    }
+    tv->file = TieringActive;
+    tv->offset = f->size;
+    tv->len = len;
+    f->size += len;
+    tieringUpdateLive(tv->file,1,tv->len);
+    return C_OK;
+}
+
+/* Return the payload of the record of a stub, or NULL on error. */
+sds tieringReadPayload(robj *stub) {
+    tieredValue *tv = stub->ptr;
+    sds payload = tieringReadRecord(tv->file,tv->offset,tv->len);
+
+    if (payload == NULL)
+        serverLog(LL_WARNING,
+            "Error reading back a value from the value tiering file: %s",
+            strerror(errno));
+    return payload;
+}
+
+/* Create a value from a record payload, freeing the payload. Returns NULL if
+ * the payload can't be decoded. */
+static robj *tieringDecodePayload(sds payload) {
+    robj *o = NULL;
+    rio rdb;
+    int type;
+
+    rioInitWithBuffer(&rdb,payload);
+    if ((type = rdbLoadObjectType(&rdb)) != -1)
+        o = rdbLoadObject(type,&rdb);
+    sdsfree(payload);
+    return o;
+}
+
+/* Return a copy of the spilled value, or NULL on error. The stub is left
+ * untouched: this is used to save the value while the stub stays in the
+ * keyspace, possibly in a child process. */
+robj *tieringReadValue(robj *stub) {
+    sds payload = tieringReadPayload(stub);
+
+    return payload ? tieringDecodePayload(payload) : NULL;
+}
+
+/* Called by decrRefCount() to free the ptr of a stub. The record is now
+ * garbage. */
+void tieringFreeStub(robj *stub) {
+    tieredValue *tv = stub->ptr;
+
+    tieringUpdateLive(tv->file,-1,-(long long)tv->len);
+    zfree(tv);
+}
+
+/* -----------------------------------------------------------------------------
+ * Spilling and reading back
+ * -------------------------------------------------------------------------- */
+
+/* Return true if the value 'o' should be spilled. Shared objects and module
+ * values are never spilled. */
+static int tieringIsCold(robj *o) {
+    if (o->encoding == OBJ_ENCODING_TIERED || o->refcount != 1 ||
+        o->type == OBJ_MODULE) return 0;
+    if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
+        if (LFUDecrAndReturn(o) >= LFU_INIT_VAL) return 0;
+    } else {
+        if (estimateObjectIdleTime(o)/1000 <
+            (unsigned long long)server.value_tiering_min_idle) return 0;
+    }
+    return objectComputeSize(o,OBJ_COMPUTE_SIZE_DEF_SAMPLES) >=
+           (size_t)server.value_tiering_min_size;
+}
+
+/* Replace the value of 'key' with 'val', keeping the LRU/LFU field. */
+static void tieringReplaceValue(redisDb *db, robj *key, robj *old, robj *val) {
+    val->lru = old->lru;
+    dbOverwrite(db,key,val);
+}
+
+/* Spill the value of the dictionary entry 'de' of 'db' to the active file.
+ * Returns C_ERR if the value can't be written. */
+static int tieringSpillEntry(redisDb *db, dictEntry *de) {
+    robj *o = dictGetVal(de), *stub, keyobj;
+    tieredValue *tv = zmalloc(sizeof(*tv));
+    sds payload = sdsempty();
+    rio rdb;
+
+    rioInitWithBuffer(&rdb,payload);
+    if (rdbSaveObjectType(&rdb,o) == -1 || rdbSaveObject(&rdb,o) == -1 ||
+        tieringAppendRecord(&rdb.io.buffer.ptr,tv) == C_ERR)
+    {
+        sdsfree(rdb.io.buffer.ptr);
+        zfree(tv);
+        return C_ERR;
+    }
+    sdsfree(rdb.io.buffer.ptr);
+    tv->id = TieringNextId++;
+    stub = createObject(o->type,tv);
+    stub->encoding = OBJ_ENCODING_TIERED;
+    initStaticStringObject(keyobj,dictGetKey(de));
+    tieringReplaceValue(db,&keyobj,o,stub);
+    server.stat_tiering_spilled++;
+    return C_OK;
+}
+
+/* Spill the value of 'key' whatever its idle time and size, as long as it
+ * can be spilled at all. Used by DEBUG TIERING-SPILL. */
+int tieringSpillKey(redisDb *db, robj *key) {
+    dictEntry *de = dictFind(db->dict,key->ptr);
+    robj *o;
+
+    if (!server.value_tiering || !TieringFilesOpen || de == NULL)
+        return C_ERR;
+    o = dictGetVal(de);
+    if (o->encoding == OBJ_ENCODING_TIERED || o->refcount != 1 ||
+        o->type == OBJ_MODULE) return C_ERR;
+    return tieringSpillEntry(db,de);
+}
+
+/* Return the length of the serialized value of a stub, that is, the length
+ * of the record without type and checksum. */
+size_t tieringSerializedLen(robj *stub) {
+    return ((tieredValue*)stub->ptr)->len-1-TIERING_CRC_LEN;
+}
+
+/* Called by lookupKey() when the value of 'key' is the stub 'stub': read it
+ * back synchronously and put it in the keyspace in place of the stub. A
+ * value that can't be read back is lost, and there is no sane way to
+ * continue without it. */
+robj *tieringLoadKey(redisDb *db, robj *key, robj *stub) {
+    robj *val = tieringReadValue(stub);
+
+    if (val == NULL)
+        serverPanic("Unable to read back a value from the value tiering file");
+    tieringReplaceValue(db,key,stub,val);
+    server.stat_tiering_loads_sync++;
+    return val;
+}
+
+/* Encode the stub ID as a rax key. */
+static void tieringReadKey(unsigned char *buf, unsigned long long id) {
+    int j;
+
+    for (j = 0; j < 8; j++) buf[j] = (id >> (56-j*8)) & 0xff;
+}
+
+/* Make 'c' wait for the value of the stub 'stub' of 'key', creating the read
+ * job if needed. Returns 1 if the client now waits for one more value, 0 if
+ * it was already waiting for this one. */
+static int tieringWaitValue(client *c, robj *key, robj *stub) {
+    tieredValue *tv = stub->ptr;
+    unsigned char id[8];
+    tieringRead *r;
+
+    tieringReadKey(id,tv->id);
+    r = raxFind(TieringReads,id,sizeof(id));
+    if (r == raxNotFound) {
+        r = zmalloc(sizeof(*r));
+        r->id = tv->id;
+        r->file = tv->file;
+        r->offset = tv->offset;
+        r->len = tv->len;
+        r->dbid = c->db->id;
+        r->key = sdsdup(key->ptr);
+        r->payload = NULL;
+        r->clients = listCreate();
+        r->next = NULL;
+        raxInsert(TieringReads,id,sizeof(id),r,NULL);
+        TieringFiles[r->file].reads++;
+        bioCreateBackgroundJob(BIO_TIERING_READ,r,NULL,NULL);
+    } else if (listSearchKey(r->clients,c)) {
+        return 0;
+    }
+    listAddNodeTail(r->clients,c);
+    return 1;
+}
+
+/* Start reading back the spilled values among the keys of the command,
+ * returning the number of values the client waits for. */
+static int tieringWaitKeys(client *c, struct redisCommand *cmd, robj **argv,
+                           int argc)
+{
+    int *keys, numkeys, j, waiting = 0;
+
+    keys = getKeysFromCommand(cmd,argv,argc,&numkeys);
+    for (j = 0; j < numkeys; j++) {
+        robj *key = argv[keys[j]];
+        dictEntry *de = dictFind(c->db->dict,key->ptr);
+
+        if (de && ((robj*)dictGetVal(de))->encoding == OBJ_ENCODING_TIERED)
+            waiting += tieringWaitValue(c,key,dictGetVal(de));
+    }
+    getKeysFreeResult(keys);
+    return waiting;
+}
+
+/* Called by processCommand() before executing the command of 'c': if some
+ * keys of the command are spilled, read them back in the background and
+ * block the client, returning 1. The command is processed again when the
+ * client is unblocked. Otherwise 0 is returned and the command can be
+ * executed. */
+int tieringBlockForKeys(client *c) {
+    unsigned long long live0, live1;
+    int waiting = 0;
+
+    if (!TieringFilesOpen || c->flags & CLIENT_MASTER) return 0;
+    /* The reads are completed before sleeping, that does not happen while
+     * a slave serves the old dataset during a full sync: read in place. */
+    if (server.async_loading) return 0;
+    /* Deleting a key or inspecting its object does not need its value. */
+    if (c->cmd->proc == delCommand || c->cmd->proc == unlinkCommand ||
+        c->cmd->proc == objectCommand) return 0;
+    tieringGetLive(0,&live0,NULL);
+    tieringGetLive(1,&live1,NULL);
+    if (live0+live1 == 0) return 0;
+
+    if (c->cmd->proc == execCommand) {
+        int j;
+
+        if (!(c->flags & CLIENT_MULTI) ||
+            c->flags & (CLIENT_DIRTY_CAS|CLIENT_DIRTY_EXEC)) return 0;
+        for (j = 0; j < c->mstate.count; j++) {
+            multiCmd *mc = c->mstate.commands+j;
+            waiting += tieringWaitKeys(c,mc->cmd,mc->argv,mc->argc);
+        }
+    } else {
+        waiting = tieringWaitKeys(c,c->cmd,c->argv,c->argc);
+    }
+    if (waiting == 0) return 0;
+
+    c->bpop.tiering_reads = waiting;
+    c->bpop.timeout = 0;
+    c->flags |= CLIENT_PENDING_COMMAND;
+    blockClient(c,BLOCKED_TIERING);
+    return 1;
+}
+
+/* Called by unblockClient(): if the client is still waiting for some value,
+ * as when it is disconnected, remove it from the reads in flight. */
+void tieringUnblockClient(client *c) {
+    raxIterator ri;
+
+    if (c->bpop.tiering_reads == 0) return;
+    raxStart(&ri,TieringReads);
+    raxSeek(&ri,"^",NULL,0);
+    while (raxNext(&ri)) {
+        tieringRead *r = ri.data;
+        listNode *ln = listSearchKey(r->clients,c);
+
+        if (ln) listDelNode(r->clients,ln);
+    }
+    raxStop(&ri);
+    c->bpop.tiering_reads = 0;
+}
+
+/* Read a record in the bio thread. Only the job itself is accessed, then it
+ * is queued for tieringHandleCompletedReads(). */
+void tieringReadJobRun(void *arg) {
+    tieringRead *r = arg;
+
+    r->payload = tieringReadRecord(r->file,r->offset,r->len);
+    pthread_mutex_lock(&TieringReadsMutex);
+    r->next = TieringReadsDone;
+    TieringReadsDone = r;
+    pthread_mutex_unlock(&TieringReadsMutex);
+    /* Awake the event loop. If the pipe is full it is already awake. */
+    if (write(server.tiering_pipe[1],"A",1) != 1) {
+        /* Ignore the error. */
+    }
+}
+
+/* The pipe just awakes the event loop, the completed reads are handled by
+ * tieringHandleCompletedReads() in beforeSleep(). It is drained here, and
+ * not there, since a byte may be written after the read it signals was
+ * already handled: left in the pipe, it would make the event fire forever. */
+static void tieringPipeReadable(aeEventLoop *el, int fd, void *privdata,
+                                int mask)
+{
+    char buf[64];
+    UNUSED(el);
+    UNUSED(privdata);
+    UNUSED(mask);
+
+    while (read(fd,buf,sizeof(buf)) > 0);
+}
+
+/* Put the values read back by the bio thread in the keyspace, unless the
+ * key was modified or deleted in the meantime, and unblock the clients that
+ * are no longer waiting for any value. Called in beforeSleep(). */
+void tieringHandleCompletedReads(void) {
+    tieringRead *r, *next;
+
+    if (TieringReads == NULL || TieringReads->numele == 0) return;
+    pthread_mutex_lock(&TieringReadsMutex);
+    r = TieringReadsDone;
+    TieringReadsDone = NULL;
+    pthread_mutex_unlock(&TieringReadsMutex);
+
+    for (; r; r = next) {
+        redisDb *db = server.db+r->dbid;
+        dictEntry *de = dictFind(db->dict,r->key);
+        unsigned char id[8];
+
+        next = r->next;
+        tieringReadKey(id,r->id);
+        raxRemove(TieringReads,id,sizeof(id),NULL);
+        TieringFiles[r->file].reads--;
+        if (de) {
+            robj *stub = dictGetVal(de), keyobj, *val = NULL;
+
+            initStaticStringObject(keyobj,r->key);
+            if (stub->encoding == OBJ_ENCODING_TIERED &&
+                ((tieredValue*)stub->ptr)->id == r->id)
+            {
+                if (r->payload) val = tieringDecodePayload(r->payload);
+                r->payload = NULL;
+                if (val) {
+                    tieringReplaceValue(db,&keyobj,stub,val);
+                    server.stat_tiering_loads_async++;
+                } else {
+                    /* Retry synchronously, for a sane failure. */
+                    tieringLoadKey(db,&keyobj,stub);
+                }
+            }
+        }
+        while (listLength(r->clients)) {
+            listNode *ln = listFirst(r->clients);
+            client *c = listNodeValue(ln);
+
+            listDelNode(r->clients,ln);
+            if (--c->bpop.tiering_reads == 0) unblockClient(c);
+        }
+        listRelease(r->clients);
+        sdsfree(r->key);
+        sdsfree(r->payload);
+        zfree(r);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Cron: spilling, compaction and truncation
+ * -------------------------------------------------------------------------- */
+
+/* dictScan() callback moving the record of a stub in the old file to the
+ * active one. Only the stub is modified, not the dictionary. */
+static void tieringCompactCallback(void *privdata, const dictEntry *de) {
+    robj *o = dictGetVal(de);
+    tieredValue *tv, moved;
+    sds payload;
+    UNUSED(privdata);
+
+    if (o->encoding != OBJ_ENCODING_TIERED || TieringCompactError) return;
+    tv = o->ptr;
+    if (tv->file == TieringActive) return;
+    if ((payload = tieringReadPayload(o)) == NULL ||
+        tieringAppendRecord(&payload,&moved) == C_ERR)
+    {
+        /* Leave the record where it is, to report the error when the value
+         * is accessed or to retry at the next cron call. */
+        TieringCompactError = 1;
+        sdsfree(payload);
+        return;
+    }
+    sdsfree(payload);
+    tieringUpdateLive(tv->file,-1,-(long long)tv->len);
+    tv->file = moved.file;
+    tv->offset = moved.offset;
+    tv->len = moved.len;
+}
+
+/* Start a compaction if the active file is mostly garbage and the other one
+ * is empty, then perform steps of the current compaction until the time
+ * limit is reached. */
+static void tieringCompactCycle(long long deadline) {
+    int other = !TieringActive, steps = 0;
+    unsigned long long live_keys, live_bytes;
+
+    if (!TieringCompacting) {
+        tieringFile *f = TieringFiles+TieringActive;
+
+        if (TieringFiles[other].size != 0 ||
+            f->size < TIERING_COMPACT_MIN_SIZE) return;
+        tieringGetLive(TieringActive,&live_keys,&live_bytes);
+        if (live_bytes*2 >= (unsigned long long)f->size) return;
+        TieringActive = other;
+        TieringCompacting = 1;
+        TieringCompactDb = 0;
+        TieringCompactCursor = 0;
+    }
+
+    TieringCompactError = 0;
+    while (!TieringCompactError) {
+        dict *d = server.db[TieringCompactDb].dict;
+
+        if ((++steps & 15) == 0 && ustime() > deadline) break;
+        TieringCompactCursor = dictScan(d,TieringCompactCursor,
+            tieringCompactCallback,NULL,NULL);
+        if (TieringCompactCursor) continue;
+        if (++TieringCompactDb < server.dbnum) continue;
+
+        /* All the databases were scanned: the compaction is complete if
+         * the old file has no longer live records, otherwise scan again,
+         * since a stub may have been moved to an already scanned DB. */
+        TieringCompactDb = 0;
+        tieringGetLive(!TieringActive,&live_keys,NULL);
+        if (live_keys == 0) {
+            TieringCompacting = 0;
+            break;
+        }
+    }
+}
+
+/* Spill cold values, sampling all the databases in a round robin fashion,
+ * for TIERING_MIN_ROUNDS rounds and then until a round does not find any
+ * cold value, or the time limit is reached. */
+static void tieringSpillCycle(long long deadline) {
+    static unsigned int current_db = 0;
+    int spilled, rounds = 0, j, k;
+
+    do {
+        spilled = 0;
+        for (j = 0; j < server.dbnum; j++) {
+            redisDb *db = server.db+(current_db++ % server.dbnum);
+            dictEntry *samples[TIERING_SAMPLES];
+            int count;
+
+            if (dictSize(db->dict) == 0) continue;
+            count = dictGetSomeKeys(db->dict,samples,TIERING_SAMPLES);
+            for (k = 0; k < count; k++) {
+                if (!tieringIsCold(dictGetVal(samples[k]))) continue;
+                if (tieringSpillEntry(db,samples[k]) == C_ERR) return;
+                spilled++;
+            }
+            if (ustime() > deadline) return;
+        }
+    } while (spilled || ++rounds < TIERING_MIN_ROUNDS);
+}
+
+/* Called by serverCron(). Nothing is done while a child is saving, both to
+ * avoid copy on write and because the child reads the files. */
+void tieringCron(void) {
+    long long deadline = ustime()+TIERING_CRON_TIME_LIMIT;
+    int j;
+
+    if (!TieringFilesOpen || server.loading ||
+        server.rdb_child_pid != -1 || server.aof_child_pid != -1) return;
+
+    /* Truncate the files without live records. */
+    for (j = 0; j < TIERING_FILES; j++) {
+        tieringFile *f = TieringFiles+j;
+        unsigned long long live_keys;
+
+        tieringGetLive(j,&live_keys,NULL);
+        if (f->size == 0 || live_keys != 0 || f->reads != 0) continue;
+        if (ftruncate(f->fd,0) == -1) {
+            serverLog(LL_WARNING,
+                "Error truncating the value tiering file: %s",
+                strerror(errno));
+            continue;
+        }
+        f->size = 0;
+    }
+
+    tieringCompactCycle(deadline);
+    if (server.value_tiering) tieringSpillCycle(deadline);
+}
+
+/* Initialize the tiering state, opening the files if value-tiering is
+ * enabled in the configuration. Called once at startup. */
+void tieringInit(void) {
+    TieringReads = raxNew();
+    if (pipe(server.tiering_pipe) == -1) {
+        serverLog(LL_WARNING,
+            "Can't create the pipe for value tiering: %s", strerror(errno));
+        exit(1);
+    }
+    anetNonBlock(NULL,server.tiering_pipe[0]);
+    anetNonBlock(NULL,server.tiering_pipe[1]);
+    if (aeCreateFileEvent(server.el,server.tiering_pipe[0],AE_READABLE,
+        tieringPipeReadable,NULL) == AE_ERR)
+    {
+        serverPanic("Error registering the value tiering pipe.");
+    }
+    if (server.value_tiering && tieringOpenFiles() == C_ERR) exit(1);
+}
+
+/* Fill the fields about the tiering files for INFO. */
+void tieringGetInfo(unsigned long long *keys, unsigned long long *bytes,
+                    unsigned long long *file_size)
+{
+    int j;
+
+    *keys = *bytes = *file_size = 0;
+    if (!TieringFilesOpen) return;
+    for (j = 0; j < TIERING_FILES; j++) {
+        unsigned long long live_keys, live_bytes;
+
+        tieringGetLive(j,&live_keys,&live_bytes);
+        *keys += live_keys;
+        *bytes += live_bytes;
+        *file_size += TieringFiles[j].size;
+    }
+}
@@ -448,6 +448,410 @@ int string2ld(const char *s, size_t slen, long double *dp) {
     return 1;
 }
 
+/* ------------------------- Fast double conversions --------------------------
+ *
+ * Formatting and parsing doubles with the libc is slow, because the libc has
+ * to handle any value and precision using arbitrary precision arithmetic.
+ * Redis does it all the time for sorted set scores, GEO coordinates and
+ * float strings, so the functions below handle the common cases directly:
+ *
+ * A positive finite double is m*2^e with an integer mantissa 'm' of 53 bits.
+ * Multiplied by a power of ten 10^k it is the fraction num/den where
+ *
+ *   num = m*5^k*2^(e+k), den = 1            if k >= 0 and e+k >= 0
+ *   num = m*5^k,         den = 2^-(e+k)     if k >= 0 and e+k < 0
+ *   num = m*2^e,         den = 10^-k        if k < 0 and e >= 0
+ *   num = m,             den = 2^-e*10^-k   if k < 0 and e < 0
+ *
+ * As long as these numbers fit in 128 bits we can round value*10^k to an
+ * integer exactly as printf() does (to nearest, ties to even), that is,
+ * compute the first digits of the value. We can also check if such digits
+ * convert back to the same double, that is if they are nearer to the value
+ * than to the next and previous doubles, without calling strtod(): the
+ * distance between two doubles is 2^e, that scaled like num/den is 5^k*2^t
+ * in the first two cases, where t = max(e+k,0), and 2^max(e,0) in the other
+ * two cases.
+ *
+ * This covers 17 digits doubles in the range from about 1e-11 to 1e22, that
+ * is, practically all the scores, coordinates and so forth. Other values are
+ * handled by the libc. Parsing is done exactly with a single floating point
+ * operation when the digits and the power of ten are exact doubles, that is
+ * the classic fast path of strtod(). */
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 u128;
+
+static const uint64_t pow5_u64[] = {
+    1ULL, 5ULL, 25ULL, 125ULL, 625ULL, 3125ULL, 15625ULL, 78125ULL,
+    390625ULL, 1953125ULL, 9765625ULL, 48828125ULL, 244140625ULL,
+    1220703125ULL, 6103515625ULL, 30517578125ULL, 152587890625ULL,
+    762939453125ULL, 3814697265625ULL, 19073486328125ULL,
+    95367431640625ULL, 476837158203125ULL, 2384185791015625ULL,
+    11920928955078125ULL, 59604644775390625ULL, 298023223876953125ULL,
+    1490116119384765625ULL, 7450580596923828125ULL
+};
+#endif
+
+static const uint64_t pow10_u64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL
+};
+
+/* Exact powers of ten as doubles. */
+static const double pow10_double[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#ifdef __SIZEOF_INT128__
+/* A positive finite double multiplied by 10^k, as described above. */
+typedef struct dScaled {
+    u128 num, den;  /* value*10^k = num/den. */
+    u128 gap;       /* Distance to the next double, scaled by 10^k*den. */
+    int shift;      /* den = 2^shift, or -1 if den is not a power of two. */
+    uint64_t m;     /* Mantissa. */
+    int e;          /* Binary exponent, value = m*2^e. */
+} dScaled;
+
+/* Fill 'ds' with 'value' multiplied by 10^k. Returns 0 if the numbers do not
+ * fit in 128 bits. */
+static int dScale(double value, int k, dScaled *ds) {
+    uint64_t bits, m;
+    int e, t;
+
+    memcpy(&bits,&value,sizeof(bits));
+    e = (bits >> 52) & 0x7ff;
+    m = bits & ((1ULL << 52)-1);
+    if (e) {
+        m |= 1ULL << 52;
+        e -= 1075;
+    } else {
+        e = -1074; /* Denormal. */
+    }
+    ds->m = m;
+    ds->e = e;
+
+    if (k >= 0) {
+        if (k >= (int)(sizeof(pow5_u64)/sizeof(pow5_u64[0]))) return 0;
+        ds->num = (u128)m*pow5_u64[k]; /* Less than 2^116. */
+        t = e+k;
+        if (t >= 0) {
+            if (t > 10) return 0;
+            ds->num <<= t;
+            ds->den = 1;
+            ds->shift = 0;
+            ds->gap = (u128)pow5_u64[k] << t;
+        } else {
+            if (t < -124) return 0;
+            ds->den = (u128)1 << -t;
+            ds->shift = -t;
+            ds->gap = pow5_u64[k];
+        }
+    } else {
+        if (-k >= (int)(sizeof(pow10_u64)/sizeof(pow10_u64[0]))) return 0;
+        ds->shift = -1;
+        if (e >= 0) {
+            if (e > 70) return 0;
+            ds->num = (u128)m << e;
+            ds->den = pow10_u64[-k];
+            ds->gap = (u128)1 << e;
+        } else {
+            if (e < -60) return 0;
+            ds->num = m;
+            ds->den = ((u128)1 << -e)*pow10_u64[-k];
+            ds->gap = 1;
+        }
+    }
+    return 1;
+}
+
+/* Compare the decimal q/10^k with the double scaled in 'ds' by 10^k.
+ * Returns 0 if the decimal converts to such double, that is if it is nearer
+ * to it than half the gap to the adjacent doubles, or exactly at half the
+ * gap and the mantissa is even (ties to even). Below a power of two the
+ * previous double is nearer, at half the gap. Otherwise -1 is returned if
+ * the decimal is smaller than the double, 1 if it is greater.
+ *
+ * 'q' must be near num/den, so that q*den fits in 128 bits. */
+static int dCompareDecimal(const dScaled *ds, uint64_t q) {
+    u128 prod = (u128)q*ds->den, diff;
+    int mult = 2, cmp;
+
+    if (prod >= ds->num) {
+        diff = prod-ds->num;
+        cmp = 1;
+    } else {
+        diff = ds->num-prod;
+        if (ds->m == (1ULL << 52) && ds->e > -1074) mult = 4;
+        cmp = -1;
+    }
+    diff *= mult;
+    if (diff < ds->gap || (diff == ds->gap && !(ds->m & 1))) return 0;
+    return cmp;
+}
+#endif
+
+/* Round the positive finite double 'value' multiplied by 10^k to the nearest
+ * integer, ties to even, storing it at '*q'. If 'roundtrip' is not NULL it
+ * is set to 1 if q/10^k converts back to 'value', otherwise to 0.
+ *
+ * Returns 1 on success, or 0 if the computation does not fit in 128 bits or
+ * the result does not fit in 64 bits. */
+static int dScaleRound(double value, int k, uint64_t *q, int *roundtrip) {
+#ifdef __SIZEOF_INT128__
+    dScaled ds;
+    u128 quot, rem;
+
+    if (!dScale(value,k,&ds)) return 0;
+    if (ds.shift >= 0) {
+        /* Avoid the slow 128 bit division. */
+        quot = ds.num >> ds.shift;
+        rem = ds.num & (ds.den-1);
+    } else {
+        quot = ds.num/ds.den;
+        rem = ds.num%ds.den;
+    }
+    if (rem*2 > ds.den || (rem*2 == ds.den && (quot & 1))) quot++;
+    if (quot > UINT64_MAX) return 0;
+    *q = (uint64_t)quot;
+    if (roundtrip) *roundtrip = dCompareDecimal(&ds,*q) == 0;
+    return 1;
+#else
+    (void)value;
+    (void)k;
+    (void)q;
+    (void)roundtrip;
+    return 0;
+#endif
+}
+
+/* Compute the 'precision' significant digits of the positive finite double
+ * 'value' as an integer of exactly 'precision' digits stored at '*q', and
+ * the decimal exponent of the first digit at '*exp10', so that the value
+ * rounded to such digits is q*10^(exp10-precision+1).
+ *
+ * Returns 1 on success, 0 if dScaleRound() can't handle the value. */
+static int dDigits(double value, int precision, uint64_t *q, int *exp10,
+                   int *roundtrip)
+{
+    uint64_t bits;
+    int e2, x, j;
+
+    /* floor(log10(value)) is floor(e2*log10(2)) or one more, where e2 is
+     * the binary exponent: 78913/2^18 approximates log10(2) well enough
+     * for all the doubles. */
+    memcpy(&bits,&value,sizeof(bits));
+    e2 = (int)((bits >> 52) & 0x7ff)-1023;
+    x = (e2*78913) >> 18;
+    for (j = 0; j < 2; j++, x++) {
+        if (!dScaleRound(value,precision-1-x,q,roundtrip)) return 0;
+        if (*q < pow10_u64[precision]) {
+            *exp10 = x;
+            return 1;
+        }
+        /* The value has one more digit, or rounding added one. */
+    }
+    return 0;
+}
+
+/* Print the digits computed by dDigits() like the %.<precision>g printf()
+ * format does. Returns the length of the string, or zero if there was not
+ * enough buffer room to store it. */
+static int dFormatDigits(char *buf, size_t len, int neg, uint64_t q, int x,
+                         int precision)
+{
+    char digits[24];
+    int n, l = 0, j;
+
+    n = ll2string(digits,sizeof(digits),(long long)q);
+    while (n > 1 && digits[n-1] == '0') n--; /* %g removes trailing zeros. */
+
+    if (x >= -4 && x < precision) {
+        /* Fixed point notation. */
+        int intdigits = x >= 0 ? x+1 : 1;
+        int fracdigits = x >= 0 ? (n > x+1 ? n-x-1 : 0) : n-x-1;
+
+        if (len < (size_t)(neg+intdigits+(fracdigits ? fracdigits+1 : 0)+1))
+            return 0;
+        if (neg) buf[l++] = '-';
+        if (x >= 0) {
+            for (j = 0; j <= x; j++) buf[l++] = j < n ? digits[j] : '0';
+            if (fracdigits) {
+                buf[l++] = '.';
+                memcpy(buf+l,digits+x+1,fracdigits);
+                l += fracdigits;
+            }
+        } else {
+            buf[l++] = '0';
+            buf[l++] = '.';
+            for (j = 0; j < -x-1; j++) buf[l++] = '0';
+            memcpy(buf+l,digits,n);
+            l += n;
+        }
+    } else {
+        /* Exponential notation, the exponent has at least two digits. */
+        int ax = x < 0 ? -x : x;
+
+        if (len < (size_t)(neg+n+1+6+1)) return 0;
+        if (neg) buf[l++] = '-';
+        buf[l++] = digits[0];
+        if (n > 1) {
+            buf[l++] = '.';
+            memcpy(buf+l,digits+1,n-1);
+            l += n-1;
+        }
+        buf[l++] = 'e';
+        buf[l++] = x < 0 ? '-' : '+';
+        if (ax >= 100) buf[l++] = '0'+ax/100;
+        buf[l++] = '0'+(ax/10)%10;
+        buf[l++] = '0'+ax%10;
+    }
+    buf[l] = '\0';
+    return l;
+}
+
+/* Convert a double into a string like snprintf() with the %.<precision>g
+ * format does, byte by byte, but much faster for the common values (see
+ * the comment above). Returns the length of the string, or zero if there
+ * was not enough buffer room to store it. */
+int d2gstring(char *buf, size_t len, double value, int precision) {
+    uint64_t q;
+    int x, l;
+
+    if (isfinite(value) && value != 0 && precision >= 1 && precision <= 17 &&
+        dDigits(fabs(value),precision,&q,&x,NULL))
+        return dFormatDigits(buf,len,value < 0,q,x,precision);
+    if (value == 0 && precision >= 1 && len >= 3) {
+        if (signbit(value)) {
+            memcpy(buf,"-0",3);
+            return 2;
+        }
+        memcpy(buf,"0",2);
+        return 1;
+    }
+    l = snprintf(buf,len,"%.*g",precision,value);
+    if (l < 0 || (size_t)l+1 > len) return 0; /* No room. */
+    return l;
+}
+
+/* Convert a double into a string like snprintf() with the %.<decimals>f
+ * format does, but faster for values that are not too large. Returns the
+ * length of the string, or zero if there was not enough buffer room. */
+int d2fstring(char *buf, size_t len, double value, int decimals) {
+    char digits[24];
+    uint64_t q, ip;
+    int n, l = 0;
+
+    if (isfinite(value) && decimals >= 0 && decimals <= 8 &&
+        fabs(value) < 1e10 && (value == 0 ||
+        dScaleRound(fabs(value),decimals,&q,NULL)))
+    {
+        if (value == 0) q = 0;
+        ip = q/pow10_u64[decimals];
+        n = ll2string(digits,sizeof(digits),(long long)ip);
+        if (len < (size_t)(1+n+1+decimals+1)) return 0; /* No room. */
+        if (signbit(value)) buf[l++] = '-';
+        memcpy(buf+l,digits,n);
+        l += n;
+        if (decimals) {
+            uint64_t frac = q-ip*pow10_u64[decimals];
+            int j;
+
+            buf[l++] = '.';
+            for (j = decimals-1; j >= 0; j--) {
+                buf[l+j] = '0'+frac%10;
+                frac /= 10;
+            }
+            l += decimals;
+        }
+        buf[l] = '\0';
+        return l;
+    }
+    l = snprintf(buf,len,"%.*f",decimals,value);
+    if (l < 0 || (size_t)l+1 > len) return 0; /* No room. */
+    return l;
+}
+
+/* Parse a double like strtod(3) does, returning exactly the same value and
+ * end pointer, but without calling strtod() for plain decimal numbers like
+ * "-12.5" or "3e10" with up to 19 significant digits, and a decimal exponent
+ * that makes the power of ten exact. If the digits are below 2^53 this is
+ * a single exact floating point operation, otherwise the result is checked
+ * and corrected with dCompareDecimal(). */
+double fastStrtod(const char *nptr, char **endptr) {
+    const char *p = nptr;
+    uint64_t mantissa = 0;
+    int neg = 0, digits = 0, fracdigits = 0, exp10 = 0, sawdot = 0;
+    int sawdigit = 0;
+    double value;
+
+    if (*p == '-' || *p == '+') neg = (*p++ == '-');
+    for (;; p++) {
+        if (*p >= '0' && *p <= '9') {
+            if (digits == 19) goto slowpath;
+            if (mantissa || *p != '0') digits++;
+            sawdigit = 1;
+            mantissa = mantissa*10+(*p-'0');
+            fracdigits += sawdot;
+        } else if (*p == '.' && !sawdot) {
+            sawdot = 1;
+        } else {
+            break;
+        }
+    }
+    if (!sawdigit) goto slowpath;
+    if (*p == 'e' || *p == 'E') {
+        const char *e = p+1;
+        int eneg = 0, explicitexp = 0;
+
+        if (*e == '-' || *e == '+') eneg = (*e++ == '-');
+        if (!(*e >= '0' && *e <= '9')) goto slowpath;
+        while (*e >= '0' && *e <= '9') {
+            if (explicitexp > 1000) goto slowpath;
+            explicitexp = explicitexp*10+(*e++ - '0');
+        }
+        exp10 = eneg ? -explicitexp : explicitexp;
+        p = e;
+    }
+    /* Let strtod() handle hex numbers, "infinity" and so forth, and what
+     * follows the number in general, to always return the same end. */
+    if (isalnum((unsigned char)*p) || *p == '.' || *p == '_') goto slowpath;
+    exp10 -= fracdigits;
+    if (exp10 < -22 || exp10 > 22) goto slowpath;
+
+    value = (double)mantissa;
+    if (exp10 < 0)
+        value /= pow10_double[-exp10];
+    else
+        value *= pow10_double[exp10];
+    if (mantissa > (1ULL << 53)) {
+#ifdef __SIZEOF_INT128__
+        /* The mantissa was rounded, so the result may be off by a unit in
+         * the last place: check it and move to the right double. */
+        dScaled ds;
+        int j, cmp;
+
+        for (j = 0; j < 3; j++) {
+            if (!dScale(value,-exp10,&ds)) goto slowpath;
+            if ((cmp = dCompareDecimal(&ds,mantissa)) == 0) break;
+            value = nextafter(value,cmp > 0 ? INFINITY : 0);
+        }
+        if (j == 3) goto slowpath;
+#else
+        goto slowpath;
+#endif
+    }
+    if (endptr) *endptr = (char*)p;
+    return neg ? -value : value;
+
+slowpath:
+    return strtod(nptr,endptr);
+}
+
 /* Convert a double to a string representation. Returns the number of bytes
  * required. The representation should always be parsable by strtod(3).
  * This function does not support human-friendly formatting like ld2string
@@ -484,12 +888,81 @@ int d2string(char *buf, size_t len, double value) {
             len = ll2string(buf,len,(long long)value);
         else
 #endif
-            len = snprintf(buf,len,"%.17g",value);
+            len = d2gstring(buf,len,value,17);
     }
 
     return len;
 }
 
+/* Convert a finite double into the shortest string that converts back to
+ * the same double with strtod(3), that is, what the %g format prints with
+ * the first precision among 15, 16 and 17 that gives such a string. Returns
+ * the length of the string, or zero if there was not enough buffer room to
+ * store it.
+ *
+ * Doubles that are the nearest to a decimal with up to 15 significant
+ * digits, between 1e-4 and 1e15, are printed without computing the digits
+ * exactly: for such a decimal r/10^k, with r < 10^15 and k <= 22, both r
+ * and 10^k are exact doubles, so r/10^k is correctly rounded and compares
+ * equal to the value only if r/10^k is what strtod() returns. With at most
+ * 15 digits the decimal is also the one %.15g prints, in fixed point
+ * notation. */
+int d2shortstring(char *buf, size_t len, double value) {
+    double a = fabs(value);
+    uint64_t q;
+    int precision, x, roundtrip, l = 0;
+
+    if (a >= 1e-4 && a < 1e15) {
+        char digits[32];
+        int k, n;
+
+        for (k = 0; k <= 19; k++) {
+            double r = floor(a*pow10_double[k]+0.5);
+
+            if (r >= 1e15) break;
+            if (r/pow10_double[k] != a) continue;
+            /* Found: print r with a decimal point k digits from the
+             * right, adding "0." and zeros if r has not enough digits. */
+            n = ll2string(digits,sizeof(digits),(long long)r);
+            if (len < (size_t)(value < 0)+(n > k ? n : k+1)+(k != 0)+1)
+                return 0; /* No room. */
+            if (value < 0) buf[l++] = '-';
+            if (n > k) {
+                memcpy(buf+l,digits,n-k);
+                l += n-k;
+            } else {
+                buf[l++] = '0';
+            }
+            if (k) {
+                buf[l++] = '.';
+                if (k > n) {
+                    memset(buf+l,'0',k-n);
+                    l += k-n;
+                }
+                memcpy(buf+l,digits+(n > k ? n-k : 0),n > k ? k : n);
+                l += n > k ? k : n;
+            }
+            buf[l] = '\0';
+            return l;
+        }
+    }
+
+    if (a != 0) {
+        for (precision = 15; precision <= 17; precision++) {
+            if (!dDigits(a,precision,&q,&x,&roundtrip)) break;
+            if (roundtrip)
+                return dFormatDigits(buf,len,value < 0,q,x,precision);
+        }
+    }
+
+    for (precision = 15; precision <= 17; precision++) {
+        l = snprintf(buf,len,"%.*g",precision,value);
+        if (l < 0 || (size_t)l+1 > len) return 0; /* No room. */
+        if (strtod(buf,NULL) == value) break;
+    }
+    return l;
+}
+
 /* Convert a long double into a string. If humanfriendly is non-zero
  * it does not use exponential format and trims trailing zeroes at the end,
  * however this results in loss of precision. Otherwise exp format is used
@@ -822,6 +1295,99 @@ static void test_ll2string(void) {
 }
 
 #define UNUSED(x) (void)(x)
+static void test_d2shortstring(void) {
+    char buf[32], ref[32];
+    double v;
+    int j, sz, precision;
+
+    v = 3.14;
+    sz = d2shortstring(buf, sizeof buf, v);
+    assert(sz == 4);
+    assert(!strcmp(buf, "3.14"));
+
+    v = -0.0001;
+    sz = d2shortstring(buf, sizeof buf, v);
+    assert(sz == 7);
+    assert(!strcmp(buf, "-0.0001"));
+
+    v = 0.1+0.2;
+    sz = d2shortstring(buf, sizeof buf, v);
+    assert(sz == 19);
+    assert(!strcmp(buf, "0.30000000000000004"));
+
+    /* The fast path must print what the %g formats print. */
+    for (j = 0; j < 100000; j++) {
+        v = (double)(rand() % 1000000000) / pow(10,rand() % 20);
+        if (j & 1) v = (float)v;
+        if (j & 2) v = -v;
+        for (precision = 15; precision <= 17; precision++) {
+            snprintf(ref, sizeof ref, "%.*g", precision, v);
+            if (strtod(ref,NULL) == v) break;
+        }
+        sz = d2shortstring(buf, sizeof buf, v);
+        assert(sz == (int)strlen(ref));
+        assert(!strcmp(buf, ref));
+    }
+}
+
+static void test_d2gstring(void) {
+    char buf[64], ref[64];
+    double v;
+    int j, sz, precision;
+
+    v = 0.1;
+    sz = d2gstring(buf, sizeof buf, v, 17);
+    assert(sz == 19);
+    assert(!strcmp(buf, "0.10000000000000001"));
+
+    v = -1e-5;
+    sz = d2gstring(buf, sizeof buf, v, 17);
+    assert(sz == 23);
+    assert(!strcmp(buf, "-1.0000000000000001e-05"));
+
+    /* Compare with the libc for many precisions and magnitudes. */
+    for (j = 0; j < 100000; j++) {
+        v = ldexp((double)rand()*rand(), rand() % 160 - 110);
+        if (j & 1) v = -v;
+        precision = 1 + rand() % 17;
+        snprintf(ref, sizeof ref, "%.*g", precision, v);
+        sz = d2gstring(buf, sizeof buf, v, precision);
+        assert(sz == (int)strlen(ref));
+        assert(!strcmp(buf, ref));
+
+        snprintf(ref, sizeof ref, "%.4f", v);
+        sz = d2fstring(buf, sizeof buf, v, 4);
+        assert(sz == (int)strlen(ref));
+        assert(!strcmp(buf, ref));
+    }
+}
+
+static void test_fastStrtod(void) {
+    char buf[64], *end, *refend;
+    const char *special[] = {"1.5", "-0", "+.5e-3", "5.", ".", "-", "1e",
+        "1e+", " 1", "inf", "-nan", "0x1p3", "12abc", "1.5 ", "1e400",
+        "00012.5000", "123456789012345678901234", NULL};
+    double v, ref;
+    int j;
+
+    for (j = 0; special[j]; j++) {
+        v = fastStrtod(special[j], &end);
+        ref = strtod(special[j], &refend);
+        assert(end == refend);
+        assert(v == ref || (isnan(v) && isnan(ref)));
+    }
+
+    /* Parse what the libc prints with 17 and less digits. */
+    for (j = 0; j < 100000; j++) {
+        v = ldexp((double)rand()*rand(), rand() % 160 - 110);
+        snprintf(buf, sizeof buf, "%.*g", 1 + rand() % 17, v);
+        v = fastStrtod(buf, &end);
+        ref = strtod(buf, &refend);
+        assert(end == refend);
+        assert(memcmp(&v, &ref, sizeof(v)) == 0);
+    }
+}
+
 int utilTest(int argc, char **argv) {
     UNUSED(argc);
     UNUSED(argv);
@@ -829,6 +1395,9 @@ int utilTest(int argc, char **argv) {
     test_string2ll();
     test_string2l();
     test_ll2string();
+    test_d2shortstring();
+    test_d2gstring();
+    test_fastStrtod();
     return 0;
 }
 #endif
@@ -43,6 +43,10 @@ int string2ll(const char *s, size_t slen, long long *value);
 int string2l(const char *s, size_t slen, long *value);
 int string2ld(const char *s, size_t slen, long double *dp);
 int d2string(char *buf, size_t len, double value);
+int d2shortstring(char *buf, size_t len, double value);
+int d2gstring(char *buf, size_t len, double value, int precision);
+int d2fstring(char *buf, size_t len, double value, int decimals);
+double fastStrtod(const char *nptr, char **endptr);
 int ld2string(char *buf, size_t len, long double value, int humanfriendly);
 sds getAbsolutePath(char *filename);
 int pathIsBaseName(char *path);
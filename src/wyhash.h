@@ -0,0 +1,23 @@
+#ifndef __WYHASH_H
+#define __WYHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* wyhash needs 128 bit multiplications: when the compiler does not
+ * provide them, the dict falls back to SipHash. */
+#if defined(__SIZEOF_INT128__) && defined(__GNUC__)
+#define WYHASH_ENABLED 1
+#endif
+
+typedef struct wyhashKey {
+    uint64_t seed;
+    uint64_t secret[4];
+} wyhashKey;
+
+void wyhash_init_key(wyhashKey *key, const uint8_t *k);
+uint64_t wyhash(const uint8_t *in, const size_t inlen, const wyhashKey *key);
+uint64_t wyhash_nocase(const uint8_t *in, const size_t inlen,
+                       const wyhashKey *key);
+
+#endif
@@ -153,3 +153,41 @@ start_server {tags {"repl"}} {
         }
     }
 }
+
+start_server {tags {"repl"}} {
+    start_server {} {
+        set master [srv -1 client]
+        set master_host [srv -1 host]
+        set master_port [srv -1 port]
+        set slave [srv 0 client]
+
+        test {Slave with slave-async-load serves the old dataset while loading} {
+            $master debug populate 1000000
+            $master set newkey newval
+            $slave set oldkey oldval
+            $slave config set slave-async-load yes
+            $slave slaveof $master_host $master_port
+            wait_for_condition 10000 1 {
+                [s 0 async_loading] == 1
+            } else {
+                fail "Slave not loading the dataset aside"
+            }
+            # Read only commands see the old dataset, other commands are
+            # still refused while loading.
+            assert_equal oldval [$slave get oldkey]
+            assert_equal 1 [$slave dbsize]
+            catch {$slave debug digest} e
+            assert_match {LOADING*} $e
+
+            wait_for_condition 500 100 {
+                [s 0 master_link_status] eq {up}
+            } else {
+                fail "Replication not started."
+            }
+            assert_equal 0 [s 0 async_loading]
+            assert_equal {} [$slave get oldkey]
+            assert_equal newval [$slave get newkey]
+            assert_equal [$master debug digest] [$slave debug digest]
+        }
+    }
+}
@@ -47,6 +47,7 @@ set ::all_tests {
     unit/slowlog
     unit/scripting
     unit/maxmemory
+    unit/tiering
     unit/introspection
     unit/introspection-2
     unit/limits
@@ -204,4 +204,147 @@ start_server {tags {"expire"}} {
         catch {r expire foo ""} e
         set e
     } {*not an integer*}
+
+    test {Actively expired keys are propagated with multi key DELs} {
+        r flushdb
+        r debug set-active-expire 0
+        for {set j 0} {$j < 10} {incr j} {
+            r psetex key:$j 100 value
+        }
+        set repl [attach_to_replication_stream]
+        after 200
+        r debug set-active-expire 1
+        wait_for_condition 50 100 {
+            [r dbsize] == 0
+        } else {
+            fail "Keys not reclaimed by the active expire cycle"
+        }
+        r set last value
+        # The expire cycle may need more than one run to sample all the
+        # keys, but every run propagates a single DEL. The master may also
+        # PING the replication stream meanwhile.
+        set keys {}
+        set dels 0
+        while 1 {
+            set cmd [read_from_replication_stream $repl]
+            if {$cmd eq {set last value}} break
+            if {$cmd eq {ping} || [lindex $cmd 0] eq {select}} continue
+            assert_equal del [lindex $cmd 0]
+            lappend keys {*}[lrange $cmd 1 end]
+            incr dels
+        }
+        close_replication_stream $repl
+        assert {$dels < 10}
+        lsort $keys
+    } {key:0 key:1 key:2 key:3 key:4 key:5 key:6 key:7 key:8 key:9}
+}
+
+start_server {tags {"expire"} overrides {active-expire-index yes}} {
+    test {Active expire with the TTL index reclaims all the due keys} {
+        r flushall
+        r debug set-active-expire 0
+        for {set j 0} {$j < 1000} {incr j} {
+            r psetex short:$j [expr {100+$j%100}] value
+            r setex long:$j 100 value
+        }
+        after 300
+        r debug set-active-expire 1
+        wait_for_condition 50 100 {
+            [r dbsize] == 1000
+        } else {
+            fail "Due keys not reclaimed by the active expire cycle"
+        }
+        assert {[s expired_keys] == 1000}
+        r dbsize
+    } {1000}
+
+    test {TTL index follows expire updates, PERSIST and overwrites} {
+        r flushall
+        r set a 1 px 100
+        r set b 1 px 100
+        r set c 1 px 100
+        r set d 1 px 100
+        r pexpire a 100000
+        r persist b
+        r set c 2
+        r rename d e
+        after 300
+        wait_for_condition 50 100 {
+            [r dbsize] == 3
+        } else {
+            fail "Key e not expired"
+        }
+        lsort [r keys *]
+    } {a b c}
+
+    test {TTL index is moved by SWAPDB and MOVE} {
+        r flushall
+        r select 10
+        r set x 1 px 100
+        r set y 1 px 100
+        r move y 11
+        r swapdb 9 10
+        after 300
+        wait_for_condition 50 100 {
+            [r dbsize] == 0
+        } else {
+            fail "Swapped key not expired"
+        }
+        r select 11
+        wait_for_condition 50 100 {
+            [r dbsize] == 0
+        } else {
+            fail "Moved key not expired"
+        }
+        r select 9
+        r dbsize
+    } {0}
+
+    test {TTL index survives FLUSHALL ASYNC and DEBUG RELOAD} {
+        r flushall
+        r set x 1 px 100
+        r flushall async
+        r set y 1 px 100
+        r set z 1 ex 100
+        r debug reload
+        after 300
+        wait_for_condition 50 100 {
+            [r dbsize] == 1
+        } else {
+            fail "Key y not expired"
+        }
+        r keys *
+    } {z}
+
+    test {TTL index can be enabled and disabled at runtime} {
+        r flushall
+        r config set active-expire-index no
+        r set x 1 px 100
+        r config set active-expire-index yes
+        r set y 1 px 100
+        after 300
+        wait_for_condition 50 100 {
+            [r dbsize] == 0
+        } else {
+            fail "Keys not expired"
+        }
+        r config set active-expire-index no
+        r set z 1 px 100
+        after 300
+        wait_for_condition 50 100 {
+            [r dbsize] == 0
+        } else {
+            fail "Keys not expired without the index"
+        }
+        r config get active-expire-index
+    } {active-expire-index no}
+
+    test {INFO reports the active expire cycle stats} {
+        r config set active-expire-index yes
+        set info [r info stats]
+        foreach field {expire_cycle_keys expire_cycle_bytes
+                       expire_cycle_backlog_keys expire_cycle_backlog_ms} {
+            assert_match "*$field:*" $info
+        }
+    }
 }
@@ -166,6 +166,29 @@ start_server {tags {"hll"}} {
         assert {$err < (double($card)/100)*5}
     }
 
+    test {PFCOUNT multiple-keys matches PFMERGE with dense HLLs} {
+        r del hll hll1 hll2 hll3
+        r config set hll-sparse-max-bytes 0
+        for {set j 1} {$j <= 3} {incr j} {
+            set elements {}
+            for {set x 0} {$x < 5000} {incr x} {lappend elements "$j-$x"}
+            r pfadd hll$j {*}$elements
+            assert {[r pfdebug encoding hll$j] eq {dense}}
+        }
+        r config set hll-sparse-max-bytes 3000
+        r pfmerge hll hll1 hll2 hll3
+        assert {[r pfcount hll1 hll2 hll3] == [r pfcount hll]}
+        assert {[r pfcount hll1 hll2 hll1 hll3 nokey] == [r pfcount hll]}
+    }
+
+    test {PFCOUNT multiple-keys with a single existing HLL} {
+        r del hll nokey1 nokey2
+        r pfadd hll a b c d e
+        set card [r pfcount hll]
+        list [r pfcount hll nokey1 nokey2] [r pfcount hll hll] \
+             [r pfcount nokey1 nokey2]
+    } {5 5 0}
+
     test {PFDEBUG GETREG returns the HyperLogLog raw registers} {
         r del hll
         r pfadd hll 1 2 3
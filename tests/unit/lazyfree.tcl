@@ -36,4 +36,90 @@ start_server {tags {"lazyfree"}} {
             fail "Memory is not reclaimed by FLUSHDB ASYNC"
         }
     }
+
+    test "Overwritten values are freed in background with lazyfree-lazy-server-del" {
+        r flushall
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Pending lazyfree objects not released"
+        }
+        r config resetstat
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        r config set lazyfree-lazy-server-del no
+        r set myset foo
+        assert_equal 0 [s lazyfreed_objects]
+
+        r config set lazyfree-lazy-server-del yes
+        r sadd myset2 {*}$args
+        set peak_mem [s used_memory]
+        r set myset2 foo
+        wait_for_condition 50 100 {
+            [s lazyfreed_objects] == 1 &&
+            [s used_memory] < $peak_mem
+        } else {
+            fail "Overwritten value not freed in background"
+        }
+        # Small values are still freed synchronously.
+        r set myset2 bar
+        assert_equal 1 [s lazyfreed_objects]
+        r config set lazyfree-lazy-server-del no
+    }
+
+    test "Values replaced by RENAME, SORT STORE, SUNIONSTORE and RESTORE are freed in background" {
+        r flushall
+        r config resetstat
+        r config set lazyfree-lazy-server-del yes
+        set args {}
+        for {set i 0} {$i < 1000} {incr i} {
+            lappend args e$i
+        }
+        set expected 0
+        foreach cmd {rename sort sunionstore restore} {
+            r del src dst
+            r sadd src {*}$args
+            r sadd dst {*}$args
+            switch $cmd {
+                rename {r rename src dst}
+                sort {r sort src alpha store dst}
+                sunionstore {r sunionstore dst src}
+                restore {r restore dst 0 [r dump src] replace}
+            }
+            incr expected
+            wait_for_condition 50 100 {
+                [s lazyfreed_objects] == $expected
+            } else {
+                fail "Value replaced by $cmd not freed in background"
+            }
+        }
+        r config set lazyfree-lazy-server-del no
+    }
+}
+
+start_server {tags {"lazyfree"} overrides {bio-threads {lazy-free 4}}} {
+    test "Objects can be freed by multiple lazyfree threads" {
+        assert_match {*lazy-free 4 *} [lindex [r config get bio-threads] 1]
+        r config resetstat
+        set args {}
+        for {set i 0} {$i < 1000} {incr i} {
+            lappend args e$i
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            r sadd myset$j {*}$args
+        }
+        for {set j 0} {$j < 100} {incr j} {
+            r unlink myset$j
+        }
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Objects not freed by the lazyfree threads"
+        }
+        assert_match {workers=4,pending=0,processed=100,*} [s bio_lazy_free]
+        assert_equal 100 [s lazyfreed_objects]
+    }
 }
@@ -141,4 +141,244 @@ start_server {tags {"maxmemory"}} {
             }
         }
     }
+
+    test "maxmemory - keys are evicted in the background above the soft watermark" {
+        r flushall
+        r config set maxmemory 0
+        set used [s used_memory]
+        r debug populate 20000 key 100
+        set populated [s used_memory]
+        # Put the soft watermark in the middle of the populated memory,
+        # while the hard limit is never reached.
+        set limit [expr {$populated+1024*1024}]
+        set soft [expr {$used+($populated-$used)/2}]
+        set watermark [expr {$soft*100/$limit+1}]
+        r config resetstat
+        r config set maxmemory-policy allkeys-random
+        r config set maxmemory-soft-watermark $watermark
+        r config set maxmemory $limit
+        # INFO itself uses some memory for the client buffers.
+        wait_for_condition 50 100 {
+            [s used_memory] < $limit*$watermark/100+64*1024
+        } else {
+            fail "Background eviction did not reach the soft watermark"
+        }
+        r config set maxmemory-soft-watermark 0
+        r config set maxmemory 0
+        assert {[r dbsize] > 0 && [r dbsize] < 20000}
+        assert {[s evicted_keys_background] > 0}
+        assert_equal [s evicted_keys] [s evicted_keys_background]
+    }
+}
+
+# Return the field of MEMORY MRC for the simulated size 'ratio'.
+proc mrc_field {ratio field} {
+    foreach entry [r memory mrc] {
+        if {[dict get $entry ratio] == $ratio} {
+            return [dict get $entry $field]
+        }
+    }
+}
+
+start_server {tags {"maxmemory"} overrides {maxmemory-mrc yes maxmemory-policy allkeys-lru}} {
+    test "MEMORY MRC reports the simulated maxmemory sizes" {
+        set ratios {}
+        foreach entry [r memory mrc] {
+            lappend ratios [dict get $entry ratio]
+            assert_equal 0 [dict get $entry hits]
+            assert_equal 0 [dict get $entry misses]
+        }
+        set ratios
+    } {0.5 0.75 1 1.25 1.5 2}
+
+    test "MEMORY MRC estimates the hit ratio of smaller and larger sizes" {
+        r debug populate 20000 key 100
+        # A sequential scan hits in the caches holding all the keys.
+        set scan "for i=0,19999 do redis.call('get','key:'..i) end"
+        r eval $scan 0
+        r memory mrc reset
+        r eval $scan 0
+        assert {[mrc_field 2 hits] > 100}
+        assert {[mrc_field 2 hit-ratio] == 1}
+        assert {[mrc_field 0.5 hit-ratio] < 0.9}
+    }
+
+    test "MEMORY MRC counts the evicted keys as hits for larger sizes" {
+        r config set maxmemory [expr {[s used_memory]*3/4}]
+        r config set maxmemory 0
+        assert {[r dbsize] < 20000}
+        r config resetstat
+        r memory mrc reset
+        r eval "for i=0,19999 do redis.call('get','key:'..i) end" 0
+        assert {[s keyspace_misses] > 0}
+        assert {[mrc_field 2 hit-ratio] == 1}
+    }
+
+    test "MEMORY MRC forgets the deleted keys" {
+        r memory mrc reset
+        for {set j 0} {$j < 20000} {incr j 1000} {
+            r eval "for i=$j,[expr {$j+999}] do redis.call('del','key:'..i) end" 0
+        }
+        r eval "for i=0,19999 do redis.call('get','key:'..i) end" 0
+        list [mrc_field 2 hits] [expr {[mrc_field 2 misses] > 0}]
+    } {0 1}
+
+    test "MEMORY MRC forgets the keys removed by other commands" {
+        set gets "for i=0,1999 do redis.call('get','key:'..i) end"
+        set llens "for i=0,1999 do redis.call('llen','list:'..i) end"
+        set hits {}
+        # FLUSHDB
+        r debug populate 2000 key 100
+        r eval $gets 0
+        r flushdb
+        r memory mrc reset
+        r eval $gets 0
+        lappend hits [mrc_field 2 hits]
+        # SWAPDB
+        r debug populate 2000 key 100
+        r eval $gets 0
+        r swapdb 9 10
+        r memory mrc reset
+        r eval $gets 0
+        lappend hits [mrc_field 2 hits]
+        r swapdb 9 10
+        r flushall
+        # RENAME
+        r debug populate 2000 key 100
+        r eval $gets 0
+        r eval "for i=0,1999 do redis.call('rename','key:'..i,'new:'..i) end" 0
+        r memory mrc reset
+        r eval $gets 0
+        lappend hits [mrc_field 2 hits]
+        # Lists emptied by LPOP
+        r eval "for i=0,1999 do redis.call('rpush','list:'..i,'a') end" 0
+        r eval $llens 0
+        r eval "for i=0,1999 do redis.call('lpop','list:'..i) end" 0
+        r memory mrc reset
+        r eval $llens 0
+        lappend hits [mrc_field 2 hits]
+    } {0 0 0 0}
+
+    test "MEMORY MRC is an error when disabled" {
+        r config set maxmemory-mrc no
+        catch {r memory mrc} e
+        set e
+    } {*disabled*}
+}
+
+start_server {tags {"maxmemory"} overrides {maxmemory-policy allkeys-lfu lfu-admission-filter yes}} {
+    test "LFU admission filter protects the keys from one time writes" {
+        set val [string repeat x 500]
+        for {set j 0} {$j < 2000} {incr j} {
+            r set warm:$j $val
+        }
+        r config set maxmemory [expr {[s used_memory]+100*1024}]
+        for {set j 0} {$j < 4000} {incr j} {
+            r set scan:$j $val
+        }
+        set warm 0
+        for {set j 0} {$j < 2000} {incr j} {
+            incr warm [r exists warm:$j]
+        }
+        r config set maxmemory 0
+        assert {[s admission_rejected_keys] > 0}
+        assert {$warm > 1800}
+    }
+
+    test "LFU admission filter admits the keys accessed often" {
+        r flushall
+        r config resetstat
+        set val [string repeat x 500]
+        for {set j 0} {$j < 2000} {incr j} {
+            r set old:$j $val
+        }
+        r config set maxmemory [s used_memory]
+        # The new keys are requested a few times before being written, like
+        # a cache populated after some misses, so they win against the old
+        # keys written just once.
+        for {set j 0} {$j < 100} {incr j} {
+            r get new:$j
+            r get new:$j
+            r get new:$j
+            r set new:$j $val
+        }
+        set new 0
+        for {set j 0} {$j < 100} {incr j} {
+            incr new [r exists new:$j]
+        }
+        r config set maxmemory 0
+        assert {[s evicted_keys] > 50}
+        assert {[s admission_rejected_keys] < 10}
+        assert {$new > 90}
+    }
+}
+
+start_server {tags {"maxmemory"}} {
+    proc keyspace_field {db field} {
+        if {[regexp "\r\ndb$db:\[^\r\]*,$field=(\[0-9\]+)" [r info keyspace] - val]} {
+            return $val
+        }
+        return {}
+    }
+
+    test "Per DB memory usage is reported when a maxmemory-db limit is set" {
+        r set foo bar
+        assert_equal {} [keyspace_field 9 used_memory]
+        r config set maxmemory-db "9 10mb"
+        assert_equal {9 10485760} [lindex [r config get maxmemory-db] 1]
+        assert_equal 10485760 [keyspace_field 9 maxmemory]
+        set empty [keyspace_field 9 used_memory]
+        assert {$empty > 0 && $empty < 200}
+
+        # Values modified in place are accounted as well.
+        r rpush mylist [string repeat x 1000]
+        set before [keyspace_field 9 used_memory]
+        for {set j 0} {$j < 100} {incr j} {
+            r rpush mylist [string repeat x 1000]
+        }
+        r append foo [string repeat x 10000]
+        assert {[keyspace_field 9 used_memory] > $before+100000}
+        r del mylist
+        r del foo
+        assert {[keyspace_field 9 used_memory] < $empty}
+    }
+
+    test "Keys are evicted only from the DB over its maxmemory-db limit" {
+        r flushall
+        r config set maxmemory-policy allkeys-lru
+        r config set maxmemory-db "9 200kb"
+        r select 10
+        for {set j 0} {$j < 1000} {incr j} {
+            r set key:$j [string repeat x 500]
+        }
+        r select 9
+        for {set j 0} {$j < 1000} {incr j} {
+            r set key:$j [string repeat x 500]
+        }
+        assert {[keyspace_field 9 used_memory] <= 204800}
+        assert {[r dbsize] < 500}
+        assert {[s evicted_keys] > 500}
+        r select 10
+        assert_equal 1000 [r dbsize]
+        r select 9
+    }
+
+    test "Writes are refused over maxmemory-db with the noeviction policy" {
+        r config set maxmemory-policy noeviction
+        for {set j 0} {$j < 1000} {incr j} {
+            if {[catch {r set new:$j [string repeat x 500]} e]} break
+        }
+        r config set maxmemory-policy allkeys-lru
+        assert_match {OOM*} $e
+        # Reads and deletions are still allowed.
+        r get key:999
+        r flushdb
+        r set new:0 bar
+    } {OK}
+
+    test "Removing the last maxmemory-db limit stops the accounting" {
+        r config set maxmemory-db "9 0"
+        assert_equal {} [lindex [r config get maxmemory-db] 1]
+        assert_equal {} [keyspace_field 9 used_memory]
+    }
 }
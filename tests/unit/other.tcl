@@ -244,3 +244,31 @@ start_server {tags {"other"}} {
         r save
     } {OK}
 }
+
+start_server {tags {"other"} overrides {hash-function wyhash}} {
+    test {CONFIG GET hash-function} {
+        r config get hash-function
+    } {hash-function wyhash}
+
+    test {Keys, Sets, Sorted Sets and Hashes survive a reload with wyhash} {
+        r config set set-max-intset-entries 0
+        r config set zset-max-ziplist-entries 0
+        r config set hash-max-ziplist-entries 0
+        for {set j 0} {$j < 1000} {incr j} {
+            r set key:$j $j
+            r sadd myset m:$j
+            r zadd myzset $j m:$j
+            r hset myhash f:$j $j
+        }
+        r debug reload
+        set res {}
+        lappend res [r dbsize] [r get key:500] [r sismember myset m:999]
+        lappend res [r zscore myzset m:123] [r hget myhash f:7]
+        lappend res [r object encoding myset] [r object encoding myhash]
+    } {1003 500 1 123 7 hashtable hashtable}
+
+    test {Commands are looked up case insensitively} {
+        r SeT foo bar
+        r GET foo
+    } {bar}
+}
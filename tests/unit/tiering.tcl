@@ -0,0 +1,248 @@
+start_server {tags {"tiering"} overrides {value-tiering yes}} {
+    proc spill_all {} {
+        foreach key [r keys *] {
+            assert_equal OK [r debug tiering-spill $key]
+        }
+    }
+
+    test "Spilled values are read back on access" {
+        set val [randstring 1000 1000 alpha]
+        r set foo $val
+        r debug tiering-spill foo
+        assert_equal tiered [r object encoding foo]
+        assert_equal 1 [s tiered_keys]
+        assert {[s tiering_file_size] > 1000}
+        assert_equal $val [r get foo]
+        assert_equal raw [r object encoding foo]
+        assert_equal 0 [s tiered_keys]
+    }
+
+    test "Values that are already spilled or shared can't be spilled" {
+        r set foo bar
+        r debug tiering-spill foo
+        catch {r debug tiering-spill foo} e1
+        r set small 1
+        catch {r debug tiering-spill small} e2
+        catch {r debug tiering-spill nokey} e3
+        list $e1 $e2 $e3
+    } {{ERR Value not spilled*} {ERR Value not spilled*} {ERR Value not spilled*}}
+
+    test "Spilling values of every type does not change the dataset" {
+        r flushall
+        r set string [string repeat abc 100]
+        r set int 123456
+        r rpush list a b c 1 2 3
+        r rpush biglist {*}[lrepeat 200 [string repeat x 100]]
+        r sadd intset 1 2 3
+        r sadd set a b c
+        r zadd zset 1 a 2 b 3 c
+        r zadd bigzset {*}[lrepeat 200 1.5 [string repeat y 100]]
+        r hmset hash a 1 b 2
+        r hset bighash field [string repeat z 100]
+        for {set j 0} {$j < 200} {incr j} {r hset bighash f$j $j}
+        r expire hash 1000
+        set digest [r debug digest]
+        spill_all
+        foreach key [r keys *] {
+            assert_equal tiered [r object encoding $key]
+        }
+        assert_equal $digest [r debug digest]
+        assert_equal 10 [s tiered_keys]
+        assert_equal [string repeat abc 100] [r get string]
+        assert_equal 123457 [r incr int]
+        assert_equal {a b c 1 2 3} [r lrange list 0 -1]
+        assert_equal 200 [r llen biglist]
+        assert_equal {1 2 3} [lsort [r smembers intset]]
+        assert_equal {a b c} [lsort [r smembers set]]
+        assert_equal {a 1 b 2 c 3} [r zrange zset 0 -1 withscores]
+        assert_equal 1 [r zcard bigzset]
+        assert_equal {a 1 b 2} [r hgetall hash]
+        assert_equal 201 [r hlen bighash]
+        assert {[r ttl hash] > 900}
+        assert_equal 0 [s tiered_keys]
+    }
+
+    test "RDB and AOF files contain the spilled values" {
+        r flushall
+        r set string [string repeat abc 100]
+        r rpush list a b c
+        r hmset hash a 1 b 2
+        r zadd zset 1 a 2 b
+        set digest [r debug digest]
+        spill_all
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal 0 [s tiered_keys]
+
+        r config set appendonly yes
+        waitForBgrewriteaof r
+        spill_all
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal $digest [r debug digest]
+        r config set appendonly no
+    }
+
+    test "Clients wait for the values read back in background" {
+        r flushall
+        r config resetstat
+        r set foo [string repeat x 1000]
+        r set bar [string repeat y 1000]
+        r debug tiering-spill foo
+        r debug tiering-spill bar
+        assert_equal [list [string repeat x 1000] [string repeat y 1000]] \
+            [r mget foo bar]
+        assert_equal 2 [s tiering_async_loads]
+        assert_equal 0 [s tiering_sync_loads]
+    }
+
+    test "Values of keys not declared by scripts are read back synchronously" {
+        r debug tiering-spill foo
+        assert_equal [string repeat x 1000] \
+            [r eval {return redis.call('get','foo')} 0]
+        assert_equal 2 [s tiering_async_loads]
+        assert_equal 1 [s tiering_sync_loads]
+    }
+
+    test "MULTI/EXEC waits for the values of all the queued commands" {
+        r debug tiering-spill foo
+        r debug tiering-spill bar
+        r multi
+        r strlen foo
+        r append bar z
+        set res [r exec]
+        list $res [s tiering_async_loads]
+    } {{1000 1001} 4}
+
+    test "Deleting a spilled key does not read its value back" {
+        r debug tiering-spill foo
+        assert_equal 1 [r del foo]
+        assert_equal 0 [s tiered_keys]
+        assert_equal 4 [s tiering_async_loads]
+    }
+
+    test "Pipelined commands are executed in order around the reads" {
+        r set foo [string repeat x 1000]
+        r debug tiering-spill foo
+        set fd [r channel]
+        puts -nonewline $fd "APPEND foo y\r\nSTRLEN foo\r\nPING\r\n"
+        flush $fd
+        list [r read] [r read] [r read]
+    } {1001 1001 PONG}
+
+    test "Commands waiting for values are not executed while clients are paused" {
+        r set foo [string repeat x 1000]
+        r debug tiering-spill foo
+        set sleeper [redis_deferring_client]
+        set reader [redis_deferring_client]
+        set pauser [redis_deferring_client]
+        # While the server sleeps, queue a command reading the spilled value
+        # and then CLIENT PAUSE, so that the value is read during the pause.
+        $sleeper debug sleep 0.5
+        after 100
+        $reader strlen foo
+        after 100
+        $pauser client pause 2000
+        assert_equal OK [$pauser read]
+        set start [clock milliseconds]
+        assert_equal 1000 [$reader read]
+        set elapsed [expr {[clock milliseconds]-$start}]
+        $sleeper read
+        $sleeper close
+        $reader close
+        $pauser close
+        assert {$elapsed > 1000}
+    }
+
+    test "Cold values are spilled in background" {
+        r flushall
+        r config set value-tiering-min-idle 0
+        r config set value-tiering-min-size 500
+        for {set j 0} {$j < 100} {incr j} {
+            r set key:$j [string repeat x 1000]
+            r set small:$j [string repeat x 10]
+        }
+        wait_for_condition 100 100 {
+            [s tiered_keys] == 100
+        } else {
+            fail "Cold values not spilled"
+        }
+        r config set value-tiering-min-idle 3600
+        assert_equal tiered [r object encoding key:0]
+        assert_equal embstr [r object encoding small:0]
+        for {set j 0} {$j < 100} {incr j} {
+            assert_equal [string repeat x 1000] [r get key:$j]
+        }
+        assert_equal 0 [s tiered_keys]
+    }
+
+    test "The tiering file is truncated when it has no live values" {
+        wait_for_condition 50 100 {
+            [s tiering_file_size] == 0
+        } else {
+            fail "Tiering file not truncated"
+        }
+    }
+
+    test "Live values are moved when the tiering file is mostly garbage" {
+        r flushall
+        set val [randstring 1000 1000 alpha]
+        for {set j 0} {$j < 2000} {incr j} {
+            r set key:$j $val
+            r debug tiering-spill key:$j
+        }
+        assert {[s tiering_file_size] > 2000000}
+        # Read back three values every four.
+        for {set j 0} {$j < 2000} {incr j} {
+            if {$j % 4} {r get key:$j}
+        }
+        assert_equal 500 [s tiered_keys]
+        wait_for_condition 50 100 {
+            [s tiering_file_size] < 1000000
+        } else {
+            fail "Tiering file not compacted"
+        }
+        assert_equal 500 [s tiered_keys]
+        for {set j 0} {$j < 2000} {incr j 4} {
+            assert_equal tiered [r object encoding key:$j]
+            assert_equal $val [r get key:$j]
+        }
+    }
+
+    if {[string match {*jemalloc*} [s mem_allocator]]} {
+        test "Active defrag moves the stubs of spilled values" {
+            r flushall
+            set val [randstring 1000 1000 alpha]
+            for {set j 0} {$j < 100} {incr j} {
+                r set key:$j $val
+                r rpush list:$j $val
+                r debug tiering-spill key:$j
+                r debug tiering-spill list:$j
+            }
+            r config resetstat
+            r config set active-defrag-threshold-lower 0
+            r config set active-defrag-ignore-bytes 1
+            r config set activedefrag yes
+            wait_for_condition 50 100 {
+                [s active_defrag_key_hits]+[s active_defrag_key_misses] >= 200
+            } else {
+                fail "Active defrag did not scan the keyspace"
+            }
+            r config set activedefrag no
+            assert_equal 200 [s tiered_keys]
+            for {set j 0} {$j < 100} {incr j} {
+                assert_equal $val [r get key:$j]
+                assert_equal $val [r lindex list:$j 0]
+            }
+            assert_equal 0 [s tiered_keys]
+        }
+    }
+
+    test "Disabling value tiering stops spilling" {
+        r config set value-tiering no
+        catch {r debug tiering-spill key:0} e
+        r config set value-tiering yes
+        set e
+    } {ERR Value not spilled*}
+}
@@ -144,4 +144,45 @@ start_server {tags {"incr"}} {
         r set foo 1
         roundFloat [r incrbyfloat foo -1.1]
     } {-0.1}
+
+    test {Float strings that round trip use the double encoding} {
+        set res {}
+        foreach v {3.14 -0.5 0.0001 1e+20 0.30000000000000004 -2.5e-05} {
+            r set foo $v
+            lappend res [r object encoding foo] [r get foo]
+        }
+        set res
+    } {double 3.14 double -0.5 double 0.0001 double 1e+20 double 0.30000000000000004 double -2.5e-05}
+
+    test {Float strings that don't round trip are not double encoded} {
+        set res {}
+        foreach v {1.0 3.140 1e20 .5 00.5 0.00001 +1.5 1.5x 0.1000000000000000055} {
+            r set foo $v
+            assert_equal $v [r get foo]
+            lappend res [r object encoding foo]
+        }
+        lsort -unique $res
+    } {embstr}
+
+    test {INCRBYFLOAT stores double encoded values} {
+        r set foo 10.5
+        list [r incrbyfloat foo 0.1] [r object encoding foo] \
+             [r incrbyfloat foo 0.1] [r incrbyfloat foo 1.25] \
+             [r incrbyfloat foo -12.05] [r get foo]
+    } {10.6 double 10.7 11.95 -0.1 -0.1}
+
+    test {Double encoded values behave like strings} {
+        r set foo 1234.5678
+        assert_equal double [r object encoding foo]
+        assert_equal 9 [r strlen foo]
+        assert_equal 34.5 [r getrange foo 2 5]
+        assert_equal 3 [r bitcount foo 0 0]
+        r debug reload
+        assert_equal double [r object encoding foo]
+        assert_equal 1234.5678 [r get foo]
+        r append foo 9
+        assert_equal 1234.56789 [r get foo]
+        r setbit foo 6 1
+        r get foo
+    } {3234.56789}
 }
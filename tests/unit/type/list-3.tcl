@@ -120,3 +120,80 @@ start_server {
         }
     }
 }
+
+start_server {
+    tags {list compression}
+    overrides {
+        "list-max-ziplist-size" 16
+        "list-compress-depth" 1
+    }
+} {
+    proc list_uncompressed_size {key} {
+        regexp {ql_uncompressed_size:([0-9]+)} [r debug object $key] _ size
+        return $size
+    }
+
+    foreach codec {lzf lz4} {
+        foreach async {no yes} {
+            test "Compressed lists are consistent - $codec, async $async" {
+                r config set list-compress-codec $codec
+                r config set list-compress-async $async
+                r del l
+                set model {}
+                for {set j 0} {$j < 5000} {incr j} {
+                    set ele "element:[randomInt 100]:$j"
+                    if {[randomInt 2]} {
+                        r rpush l $ele
+                        lappend model $ele
+                    } else {
+                        r lpush l $ele
+                        set model [linsert $model 0 $ele]
+                    }
+                }
+
+                # Interior nodes are compressed, possibly in background.
+                wait_for_condition 50 100 {
+                    [r memory usage l samples 0] <
+                    [list_uncompressed_size l]
+                } else {
+                    fail "List nodes were not compressed"
+                }
+                assert_equal $model [r lrange l 0 -1]
+
+                # Access and modify compressed nodes, and nodes that may be
+                # waiting for the background thread.
+                for {set j 0} {$j < 500} {incr j} {
+                    set idx [randomInt [llength $model]]
+                    assert_equal [lindex $model $idx] [r lindex l $idx]
+                    set idx [randomInt [llength $model]]
+                    r lset l $idx new:$j
+                    lset model $idx new:$j
+                    if {$j % 10 == 0} {
+                        r linsert l before new:$j ins:$j
+                        set model [linsert $model $idx ins:$j]
+                    }
+                }
+                assert_equal $model [r lrange l 0 -1]
+
+                r debug reload
+                assert_equal $model [r lrange l 0 -1]
+                r config set list-compress-async no
+                r config set list-compress-codec lzf
+            }
+        }
+    }
+
+    test "Lists with nodes being compressed in background can be freed" {
+        r config set list-compress-codec lz4
+        r config set list-compress-async yes
+        for {set k 0} {$k < 20} {incr k} {
+            for {set j 0} {$j < 2000} {incr j} {
+                r rpush l$k "element:[randomInt 100]:$j"
+            }
+            if {$k % 2} {r unlink l$k} else {r del l$k}
+        }
+        r config set list-compress-async no
+        r config set list-compress-codec lzf
+        r ping
+    } {PONG}
+}
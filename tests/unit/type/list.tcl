@@ -834,4 +834,74 @@ start_server {
         $rd2 close
         r ping
     } {PONG}
+
+    test "LINDEX/LSET/LRANGE consistency on long lists under mutations" {
+        # Enough nodes for lookups to use the quicklist skip index.
+        r del mylist
+        set model {}
+        for {set j 0} {$j < 3000} {incr j} {
+            r rpush mylist $j
+            lappend model $j
+        }
+        set next 3000
+        for {set i 0} {$i < 2000} {incr i} {
+            set len [llength $model]
+            set op [randomInt 9]
+            switch $op {
+                0 {r lpush mylist $next; set model [linsert $model 0 $next]}
+                1 {r rpush mylist $next; lappend model $next}
+                2 {
+                    if {$len > 1000} {
+                        assert_equal [lindex $model 0] [r lpop mylist]
+                        set model [lrange $model 1 end]
+                    }
+                }
+                3 {
+                    if {$len > 1000} {
+                        assert_equal [lindex $model end] [r rpop mylist]
+                        set model [lrange $model 0 end-1]
+                    }
+                }
+                4 {
+                    set pivot [lindex $model [randomInt $len]]
+                    r linsert mylist after $pivot $next
+                    set pos [lsearch -exact $model $pivot]
+                    set model [linsert $model [expr {$pos+1}] $next]
+                }
+                5 {
+                    set idx [randomInt $len]
+                    r lset mylist $idx $next
+                    lset model $idx $next
+                }
+                6 {
+                    set n [randomInt 20]
+                    if {$len > 1000} {
+                        if {[randomInt 2]} {
+                            r ltrim mylist $n -1
+                            set model [lrange $model $n end]
+                        } else {
+                            r ltrim mylist 0 [expr {-1-$n}]
+                            set model [lrange $model 0 end-$n]
+                        }
+                    }
+                }
+                7 {
+                    set ele [lindex $model [randomInt $len]]
+                    r lrem mylist 0 $ele
+                    set model [lsearch -all -inline -not -exact $model $ele]
+                }
+                8 {r rpoplpush mylist mylist
+                    set model [linsert [lrange $model 0 end-1] 0 [lindex $model end]]}
+            }
+            incr next
+            set len [llength $model]
+            set idx [randomInt $len]
+            assert_equal [lindex $model $idx] [r lindex mylist $idx]
+            assert_equal [lindex $model end-$idx] [r lindex mylist [expr {-1-$idx}]]
+            if {$i % 100 == 0} {
+                assert_equal $model [r lrange mylist 0 -1]
+            }
+        }
+        assert_equal $model [r lrange mylist 0 -1]
+    }
 }
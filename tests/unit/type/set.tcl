@@ -184,6 +184,18 @@ start_server {
             assert_equal [list 195 199 $large] [lsort [r smembers setres]]
         }
 
+        test "SINTERCARD with two and three sets - $type" {
+            assert_equal 6 [r sintercard 2 set1 set2]
+            assert_equal 3 [r sintercard 3 set1 set2 set3]
+        }
+
+        test "SINTERCARD with LIMIT - $type" {
+            assert_equal 2 [r sintercard 2 set1 set2 limit 2]
+            assert_equal 6 [r sintercard 2 set1 set2 limit 6]
+            assert_equal 6 [r sintercard 2 set1 set2 limit 100]
+            assert_equal 6 [r sintercard 2 set1 set2 limit 0]
+        }
+
         test "SUNION with non existing keys - $type" {
             set expected [lsort -uniq "[r smembers set1] [r smembers set2]"]
             assert_equal $expected [lsort [r sunion nokey1 set1 set2 nokey2]]
@@ -246,6 +258,66 @@ start_server {
         }
     }
 
+    test "SUNION/SDIFF and their STORE variants fuzzing" {
+        for {set j 0} {$j < 100} {incr j} {
+            unset -nocomplain u d
+            array set u {}
+            array set d {}
+            set args {}
+            # Up to 20 sets, so that both the streaming and the temporary
+            # set plans are used, with intsets only or mixed encodings.
+            set num_sets [expr {[randomInt 20]+1}]
+            set intonly [randomInt 2]
+            for {set i 0} {$i < $num_sets} {incr i} {
+                # Some keys are missing, or repeated.
+                if {$i > 0 && [randomInt 10] == 0} {
+                    lappend args [lindex $args [randomInt $i]]
+                    continue
+                }
+                set num_elements [randomInt 200]
+                r del set_$i
+                lappend args set_$i
+                while {$num_elements} {
+                    if {$intonly || [randomInt 2]} {
+                        set ele [randomInt 500]
+                    } else {
+                        set ele [randomValue]
+                    }
+                    r sadd set_$i $ele
+                    incr num_elements -1
+                }
+            }
+            foreach key $args {
+                foreach ele [r smembers $key] {set u($ele) x}
+            }
+            foreach ele [r smembers [lindex $args 0]] {set d($ele) x}
+            foreach key [lrange $args 1 end] {
+                foreach ele [r smembers $key] {unset -nocomplain d($ele)}
+            }
+            assert_equal [lsort [array names u]] [lsort [r sunion {*}$args]]
+            assert_equal [lsort [array names d]] [lsort [r sdiff {*}$args]]
+            r sunionstore setres {*}$args
+            assert_equal [lsort [array names u]] [lsort [r smembers setres]]
+            r sdiffstore setres {*}$args
+            assert_equal [lsort [array names d]] [lsort [r smembers setres]]
+        }
+    }
+
+    test "SUNIONSTORE of intsets bigger than set-max-intset-entries" {
+        r del set1 set2 setres
+        for {set i 0} {$i < 400} {incr i} {
+            r sadd set1 $i
+            r sadd set2 [expr {$i+300}]
+        }
+        assert_encoding intset set1
+        assert_encoding intset set2
+        assert_equal 700 [r sunionstore setres set1 set2]
+        assert_encoding hashtable setres
+        assert_equal 700 [llength [r sunion set1 set2]]
+        assert_equal 300 [r sdiffstore setres set1 set2]
+        assert_encoding intset setres
+    }
+
     test "SINTER against non-set should throw error" {
         r set key1 x
         assert_error "WRONGTYPE*" {r sinter key1 noset}
@@ -273,6 +345,47 @@ start_server {
         lsort [r sinter set1 set2]
     } {1 2 3}
 
+    test "SINTERCARD against non existing key and wrong arguments" {
+        r del set1 set2
+        r sadd set1 a b c
+        assert_equal 0 [r sintercard 2 set1 set2]
+        assert_equal 0 [r sintercard 1 set2]
+        assert_error "*greater than 0*" {r sintercard 0 set1}
+        assert_error "*number of args*" {r sintercard 3 set1 set2}
+        assert_error "*syntax*" {r sintercard 1 set1 foo}
+        assert_error "*negative*" {r sintercard 1 set1 limit -1}
+        r set key1 x
+        assert_error "WRONGTYPE*" {r sintercard 2 set1 key1}
+    }
+
+    test "SINTER fuzzing with intsets of different sizes" {
+        for {set j 0} {$j < 50} {incr j} {
+            set num_sets [expr {[randomInt 3]+2}]
+            set args {}
+            set hargs {}
+            for {set i 0} {$i < $num_sets} {incr i} {
+                # Very different sizes exercise the galloping search.
+                set size [expr {[randomInt 2] ? [randomInt 10] : [randomInt 400]}]
+                set range [expr {[randomInt 1000]+1}]
+                r del iset_$i hset_$i
+                r sadd hset_$i foo
+                for {set k 0} {$k < $size} {incr k} {
+                    set ele [randomInt $range]
+                    r sadd iset_$i $ele
+                    r sadd hset_$i $ele
+                }
+                r srem hset_$i foo
+                lappend args iset_$i
+                lappend hargs hset_$i
+            }
+            set expected [lsort [r sinter {*}$hargs]]
+            assert_equal $expected [lsort [r sinter {*}$args]]
+            assert_equal [llength $expected] [r sintercard $num_sets {*}$args]
+            r sinterstore setres {*}$args
+            assert_equal $expected [lsort [r smembers setres]]
+        }
+    }
+
     test "SINTERSTORE against non existing keys should delete dstkey" {
         r set setres xxx
         assert_equal 0 [r sinterstore setres foo111 bar222]
@@ -420,3 +420,297 @@ start_server {tags {"string"}} {
         r getrange foo 0 4294967297
     } {bar}
 }
+
+start_server {tags {"string"} overrides {string-compress-threshold 64}} {
+    set big [string repeat "hello world " 100]
+
+    test {Large compressible values are stored compressed} {
+        r set foo $big
+        assert_encoding compressed foo
+        assert_equal $big [r get foo]
+        assert_equal [string length $big] [r strlen foo]
+        r set small [string repeat a 10]
+        assert_encoding embstr small
+        r set random [randstring 1000 1000 binary]
+        assert {[r object encoding random] ne {compressed}}
+    }
+
+    test {MSET, GETSET and SETEX compress values} {
+        r mset k1 $big k2 $big
+        assert_encoding compressed k1
+        assert_encoding compressed k2
+        assert_equal $big [r getset k1 "x$big"]
+        assert_encoding compressed k1
+        r setex k3 100 $big
+        assert_encoding compressed k3
+        assert_equal "x$big" [r get k1]
+    }
+
+    test {GETRANGE on compressed values} {
+        r set foo $big
+        list [r getrange foo 0 10] [r getrange foo -6 -2] [r getrange foo 5000 6000]
+    } {{hello world} world {}}
+
+    test {APPEND and SETRANGE on compressed values} {
+        r set foo $big
+        r append foo "!"
+        assert_equal "$big!" [r get foo]
+        r set foo $big
+        r setrange foo 0 "HELLO"
+        assert_equal "HELLO[string range $big 5 end]" [r get foo]
+    }
+
+    test {Bit commands on compressed values} {
+        r set foo $big
+        assert_equal [r bitcount foo] [r bitcount foo 0 -1]
+        assert_equal 0 [r getbit foo 0]
+        assert_equal 1 [r getbit foo 1]
+        r setbit foo 0 1
+        assert_equal "\xe8[string range $big 1 end]" [r get foo]
+    }
+
+    test {INCR and INCRBYFLOAT against compressed values} {
+        r set foo $big
+        assert_error "*not an integer*" {r incr foo}
+        assert_error "*not a valid float*" {r incrbyfloat foo 1}
+    }
+
+    test {Compressed values use less memory} {
+        r set foo $big
+        assert {[r memory usage foo] < [string length $big]/2}
+    }
+
+    test {Compressed values survive DEBUG RELOAD and DUMP/RESTORE} {
+        r flushall
+        r set foo $big
+        set digest [r debug digest]
+        r debug reload
+        assert_encoding compressed foo
+        assert_equal $digest [r debug digest]
+        set dump [r dump foo]
+        r del foo
+        r restore foo 0 $dump
+        assert_encoding compressed foo
+        assert_equal $big [r get foo]
+    }
+
+    test {Compressed values are rewritten in the AOF} {
+        r flushall
+        r set foo $big
+        r config set appendonly yes
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal $big [r get foo]
+        r config set appendonly no
+    }
+
+    test {string-compress-threshold 0 disables compression} {
+        r config set string-compress-threshold 0
+        r set foo $big
+        set enc [r object encoding foo]
+        r config set string-compress-threshold 64
+        set enc
+    } {raw}
+}
+
+start_server {tags {"string"} overrides {string-chunk-threshold 1000}} {
+    test {APPEND over string-chunk-threshold creates a chunked string} {
+        r del log
+        set expected {}
+        for {set j 0} {$j < 100} {incr j} {
+            set line "line $j [string repeat x [expr {$j*37}]]\n"
+            r append log $line
+            append expected $line
+        }
+        assert_encoding chunked log
+        assert_equal [string length $expected] [r strlen log]
+        assert_equal $expected [r get log]
+    }
+
+    test {GETRANGE on chunked strings across chunk boundaries} {
+        set len [r strlen log]
+        foreach {start end} [list 0 10 16380 16390 16384 32768 \
+                             -20 -1 100 [expr {$len*2}] 50 40] {
+            set s $start
+            set e $end
+            if {$s < 0} {set s [expr {$len+$s}]}
+            if {$e < 0} {set e [expr {$len+$e}]}
+            assert_equal [string range $expected $s $e] \
+                [r getrange log $start $end]
+        }
+    }
+
+    test {SETRANGE on chunked strings} {
+        r setrange log 16380 [string repeat Y 10]
+        set expected [string replace $expected 16380 16389 \
+            [string repeat Y 10]]
+        assert_equal $expected [r get log]
+        set len [string length $expected]
+        r setrange log [expr {$len+40000}] "end"
+        append expected [string repeat \x00 40000] "end"
+        assert_equal [string length $expected] [r strlen log]
+        assert_equal $expected [r get log]
+        assert_encoding chunked log
+    }
+
+    test {SETRANGE creates chunked strings over the threshold} {
+        r del foo
+        assert_equal 50003 [r setrange foo 50000 "abc"]
+        assert_encoding chunked foo
+        r getrange foo 49999 -1
+    } "\x00abc"
+
+    test {Bit commands on chunked strings} {
+        r del bits
+        r setbit bits 200000 1
+        assert_encoding chunked bits
+        r setbit bits 131071 1
+        r setbit bits 131072 1
+        r setbit bits 7 1
+        assert_equal 1 [r getbit bits 131072]
+        assert_equal 0 [r getbit bits 131073]
+        assert_equal 4 [r bitcount bits]
+        assert_equal 2 [r bitcount bits 16383 16384]
+        assert_equal 7 [r bitpos bits 1]
+        assert_equal 131071 [r bitpos bits 1 1]
+        assert_equal 0 [r bitpos bits 0]
+        assert_equal 131064 [r bitpos bits 0 16383]
+        assert_equal -1 [r bitpos bits 1 16385 24999]
+    }
+
+    test {BITFIELD on chunked strings across chunk boundaries} {
+        set offset [expr {16384*8*2-12}]
+        assert_equal {0 0} [r bitfield bits get u32 $offset get i64 $offset]
+        r bitfield bits set u32 $offset 0
+        assert_equal {0} [r bitfield bits set u32 $offset 3735928559]
+        assert_equal {3735928559} [r bitfield bits get u32 $offset]
+        assert_equal {3735928560} [r bitfield bits incrby u32 $offset 1]
+        assert_encoding chunked bits
+        set flat [r get bits]
+        r del flat
+        r set flat $flat
+        r config set string-chunk-threshold 0
+        set res [r bitfield flat get u32 $offset]
+        r config set string-chunk-threshold 1000
+        set res
+    } {3735928560}
+
+    test {INCR and GET on short chunked strings} {
+        r del n
+        r config set string-chunk-threshold 1
+        r append n 12
+        r append n 3
+        set enc [r object encoding n]
+        r config set string-chunk-threshold 1000
+        assert_equal chunked $enc
+        list [r incr n] [r incrbyfloat n 0.5]
+    } {124 124.5}
+
+    test {Chunked strings survive DEBUG RELOAD, AOF rewrite and DUMP/RESTORE} {
+        set digest [r debug digest]
+        r config set rdbcompression no
+        r debug reload
+        assert_equal $digest [r debug digest]
+        r config set rdbcompression yes
+        r debug reload
+        assert_equal $digest [r debug digest]
+        r config set appendonly yes
+        waitForBgrewriteaof r
+        r debug loadaof
+        r config set appendonly no
+        assert_equal $digest [r debug digest]
+        set dump [r dump log]
+        r del log
+        r restore log 0 $dump
+        assert_equal $expected [r get log]
+    }
+
+    test {Chunked strings do not preallocate space like sds} {
+        r del log
+        r append log [string repeat x 2000000]
+        r append log "x"
+        assert_encoding chunked log
+        assert {[r memory usage log] < 2000000 + 16384*2}
+    }
+}
+
+start_server {tags {"string"} overrides {string-intern-max-len 64}} {
+    test {Identical string values share an interned object} {
+        r mset a payload-xyz b payload-xyz
+        r set c payload-xyz
+        r getset d payload-xyz
+        list [r object refcount a] [r object refcount d] [r get d]
+    } {5 5 payload-xyz}
+
+    test {Modifying an interned value does not affect other keys} {
+        r append a "!"
+        r setrange b 0 P
+        r setbit c 0 1
+        list [r get a] [r get b] [r getbit c 0] [r get d] [r object refcount d]
+    } {payload-xyz! Payload-xyz 1 payload-xyz 2}
+
+    test {Long values and integers are not interned} {
+        r set long1 [string repeat x 100]
+        r set long2 [string repeat x 100]
+        r set n1 123456
+        list [r object refcount long1] [r object encoding n1]
+    } {1 int}
+
+    test {INFO reports the intern pool and unused values are released} {
+        r flushall
+        r mset a v1 b v1 c v1 d v2
+        wait_for_condition 50 100 {
+            [s intern_pool_refs] == 4
+        } else {
+            fail "intern_pool_refs not updated"
+        }
+        assert_equal 2 [s intern_pool_values]
+        assert_equal 2.00 [s intern_dedup_ratio]
+        r del d
+        wait_for_condition 50 100 {
+            [s intern_pool_values] == 1
+        } else {
+            fail "unused interned value not released"
+        }
+    }
+
+    test {Interned values stay shared after DEBUG RELOAD} {
+        r debug reload
+        r object refcount a
+    } {4}
+
+    test {Interned values shared with other DBs survive FLUSHDB ASYNC} {
+        r flushall
+        for {set j 0} {$j < 1000} {incr j} {
+            r set key:$j shared-value
+        }
+        r select 10
+        for {set j 0} {$j < 1000} {incr j} {
+            r set key:$j shared-value
+        }
+        r flushdb async
+        r select 9
+        wait_for_condition 50 100 {
+            [r object refcount key:0] == 1001
+        } else {
+            fail "References of the flushed DB not dropped"
+        }
+        assert_equal shared-value [r get key:999]
+        r flushall async
+        wait_for_condition 50 100 {
+            [s intern_pool_values] == 0
+        } else {
+            fail "Interned values not released after FLUSHALL ASYNC"
+        }
+    }
+
+    test {Values are not interned with an LRU maxmemory policy} {
+        r config set maxmemory 1gb
+        r config set maxmemory-policy allkeys-lru
+        r mset x lru-value y lru-value
+        set refcount [r object refcount x]
+        r config set maxmemory 0
+        r config set maxmemory-policy noeviction
+        set refcount
+    } {1}
+}
@@ -13,6 +13,11 @@ start_server {tags {"zset"}} {
         } elseif {$encoding == "skiplist"} {
             r config set zset-max-ziplist-entries 0
             r config set zset-max-ziplist-value 0
+            r config set zset-large-encoding skiplist
+        } elseif {$encoding == "btree"} {
+            r config set zset-max-ziplist-entries 0
+            r config set zset-max-ziplist-value 0
+            r config set zset-large-encoding btree
         } else {
             puts "Unknown sorted set encoding"
             exit
@@ -652,6 +657,54 @@ start_server {tags {"zset"}} {
 
     basics ziplist
     basics skiplist
+    basics btree
+    r config set zset-large-encoding skiplist
+
+    test {ZSET btree and skiplist encodings are consistent} {
+        r config set zset-max-ziplist-entries 0
+        r config set zset-max-ziplist-value 0
+        r del zsl zbt
+        foreach enc {skiplist btree} key {zsl zbt} {
+            r config set zset-large-encoding $enc
+            r zadd $key 0 dummy
+        }
+        assert_encoding skiplist zsl
+        assert_encoding btree zbt
+        for {set j 0} {$j < 20000} {incr j} {
+            set ele [randomInt 5000]
+            set score [randomInt 100]
+            if {[randomInt 4] == 0} {
+                r zrem zsl $ele
+                r zrem zbt $ele
+            } else {
+                r zadd zsl $score $ele
+                r zadd zbt $score $ele
+            }
+        }
+        assert_equal [r zrange zsl 0 -1 withscores] [r zrange zbt 0 -1 withscores]
+        assert_equal [r zrevrange zsl 0 -1] [r zrevrange zbt 0 -1]
+        for {set j 0} {$j < 100} {incr j} {
+            set min [randomInt 100]
+            set max [expr {$min+[randomInt 10]}]
+            set ele [randomInt 5000]
+            assert_equal [r zrank zsl $ele] [r zrank zbt $ele]
+            assert_equal [r zcount zsl $min $max] [r zcount zbt $min $max]
+            assert_equal [r zrangebyscore zsl $min $max] \
+                         [r zrangebyscore zbt $min $max]
+            assert_equal [r zrevrangebyscore zsl ($max $min limit 3 20] \
+                         [r zrevrangebyscore zbt ($max $min limit 3 20]
+        }
+        # Remove most of the elements in order to exercise node merges.
+        foreach key {zsl zbt} {
+            r zremrangebyscore $key 10 80
+            r zremrangebyrank $key 100 -100
+        }
+        assert_equal [r zrange zsl 0 -1 withscores] [r zrange zbt 0 -1 withscores]
+        r debug reload
+        assert_encoding btree zbt
+        assert_equal [r zrange zsl 0 -1 withscores] [r zrange zbt 0 -1 withscores]
+        r config set zset-large-encoding skiplist
+    }
 
     test {ZINTERSTORE regression with two sets, intset+hashtable} {
         r del seta setb setc
@@ -696,6 +749,91 @@ start_server {tags {"zset"}} {
         }
     }
 
+    foreach enc {skiplist btree} {
+        test "Bulk ZADD is consistent with element by element ZADD - $enc" {
+            r config set zset-max-ziplist-entries 128
+            r config set zset-max-ziplist-value 64
+            r config set zset-large-encoding $enc
+            foreach opts {{} {nx} {ch} {nx ch}} {
+                foreach existing {0 50} {
+                    r del bulk single
+                    for {set j 0} {$j < $existing} {incr j} {
+                        set ele [randomInt 300]
+                        set score [randomInt 100]
+                        r zadd bulk $score $ele
+                        r zadd single $score $ele
+                    }
+                    set pairs {}
+                    for {set j 0} {$j < 500} {incr j} {
+                        lappend pairs [randomInt 100] [randomInt 300]
+                    }
+                    set bulkret [r zadd bulk {*}$opts {*}$pairs]
+                    set singleret 0
+                    foreach {score ele} $pairs {
+                        incr singleret [r zadd single {*}$opts $score $ele]
+                    }
+                    assert_encoding $enc bulk
+                    assert_equal $singleret $bulkret
+                    assert_equal [r zrange single 0 -1 withscores] \
+                                 [r zrange bulk 0 -1 withscores]
+                    assert_equal [r zrevrange single 0 -1] \
+                                 [r zrevrange bulk 0 -1]
+                    foreach ele [r zrange single 0 -1] {
+                        assert_equal [r zrank single $ele] [r zrank bulk $ele]
+                    }
+                    assert_equal [r zrangebyscore single 20 40 limit 5 10] \
+                                 [r zrangebyscore bulk 20 40 limit 5 10]
+                }
+            }
+            # The bulk built sorted set must stay valid after updates.
+            for {set j 0} {$j < 1000} {incr j} {
+                set ele [randomInt 400]
+                if {[randomInt 3] == 0} {
+                    r zrem bulk $ele
+                    r zrem single $ele
+                } else {
+                    set score [randomInt 100]
+                    r zadd bulk $score $ele
+                    r zadd single $score $ele
+                }
+            }
+            assert_equal [r zrange single 0 -1 withscores] \
+                         [r zrange bulk 0 -1 withscores]
+            r debug reload
+            assert_equal [r zrange single 0 -1 withscores] \
+                         [r zrange bulk 0 -1 withscores]
+        }
+
+        test "ZUNIONSTORE/ZINTERSTORE build large results in bulk - $enc" {
+            r config set zset-large-encoding $enc
+            r del one two dest
+            for {set j 0} {$j < 1000} {incr j} {
+                r zadd one [randomInt 50] [randomInt 1500]
+                r zadd two [randomInt 50] [randomInt 1500]
+            }
+            foreach cmd {zunionstore zinterstore} {
+                r $cmd dest 2 one two
+                assert_encoding $enc dest
+                set expected {}
+                foreach ele [r zrange dest 0 -1] {
+                    lappend expected [list [r zscore dest $ele] $ele]
+                }
+                set expected [lsort -command {apply {{a b} {
+                    set d [expr {[lindex $a 0]-[lindex $b 0]}]
+                    if {$d != 0} {return [expr {$d < 0 ? -1 : 1}]}
+                    string compare [lindex $a 1] [lindex $b 1]
+                }}} $expected]
+                set i 0
+                foreach pair $expected {
+                    assert_equal [lindex $pair 1] [r zrange dest $i $i]
+                    assert_equal $i [r zrank dest [lindex $pair 1]]
+                    incr i
+                }
+            }
+        }
+    }
+    r config set zset-large-encoding skiplist
+
     proc stressers {encoding} {
         if {$encoding == "ziplist"} {
             # Little extra to allow proper fuzzing in the sorting stresser
@@ -705,7 +843,14 @@ start_server {tags {"zset"}} {
         } elseif {$encoding == "skiplist"} {
             r config set zset-max-ziplist-entries 0
             r config set zset-max-ziplist-value 0
+            r config set zset-large-encoding skiplist
             if {$::accurate} {set elements 1000} else {set elements 100}
+        } elseif {$encoding == "btree"} {
+            # Enough elements to get a few levels of inner nodes.
+            r config set zset-max-ziplist-entries 0
+            r config set zset-max-ziplist-value 0
+            r config set zset-large-encoding btree
+            if {$::accurate} {set elements 10000} else {set elements 1000}
         } else {
             puts "Unknown sorted set encoding"
             exit
@@ -977,6 +1122,75 @@ start_server {tags {"zset"}} {
             }
         }
 
+        test "ZRANGEBYSCORE/ZRANGEBYLEX with deep LIMIT offsets - $encoding" {
+            r del zset lexzset
+            for {set i 0} {$i < $elements} {incr i} {
+                r zadd zset [expr {$i/3}] $i
+                r zadd lexzset 0 [format "%06d" $i]
+            }
+            assert_encoding $encoding zset
+            set all [r zrange zset 0 -1]
+            set lexall [r zrange lexzset 0 -1]
+            for {set j 0} {$j < 100} {incr j} {
+                set min [randomInt [expr {$elements/3}]]
+                set max [expr {$min+[randomInt [expr {$elements/3}]]}]
+                set offset [randomInt $elements]
+                set count [randomInt 10]
+
+                # The range starts at the first element with score >= min,
+                # that has rank min*3.
+                set first [expr {$min*3}]
+                set last [expr {min($max*3+2,$elements-1)}]
+                set expected [lrange $all [expr {$first+$offset}] \
+                    [expr {min($first+$offset+$count-1,$last)}]]
+                assert_equal $expected \
+                    [r zrangebyscore zset $min $max LIMIT $offset $count]
+                set expected [lreverse [lrange $all \
+                    [expr {max($last-$offset-$count+1,$first)}] \
+                    [expr {$last-$offset}]]]
+                if {$offset > $last-$first} {set expected {}}
+                assert_equal $expected \
+                    [r zrevrangebyscore zset $max $min LIMIT $offset $count]
+
+                set lmin [format "%06d" $first]
+                set expected [lrange $lexall [expr {$first+$offset}] \
+                    [expr {$first+$offset+$count-1}]]
+                assert_equal $expected \
+                    [r zrangebylex lexzset \[$lmin + LIMIT $offset $count]
+                set expected [lreverse [lrange $lexall \
+                    [expr {max($first-$offset-$count+1,0)}] \
+                    [expr {$first-$offset}]]]
+                if {$offset > $first} {set expected {}}
+                assert_equal $expected \
+                    [r zrevrangebylex lexzset \[$lmin - LIMIT $offset $count]
+            }
+            assert_equal {} [r zrangebyscore zset -inf +inf LIMIT -1 10]
+            assert_equal {} [r zrangebylex lexzset - + LIMIT $elements 10]
+        }
+
+        if {$encoding ne "ziplist"} {
+            test "Deep LIMIT offsets return the right elements - $encoding" {
+                r del zset
+                set args {}
+                for {set i 0} {$i < 100000} {incr i} {
+                    lappend args $i $i
+                    if {[llength $args] == 2000} {
+                        r zadd zset {*}$args
+                        set args {}
+                    }
+                }
+                assert_encoding $encoding zset
+                assert_equal {99950 99951} \
+                    [r zrangebyscore zset -inf +inf LIMIT 99950 2]
+                assert_equal {49 48} \
+                    [r zrevrangebyscore zset +inf -inf LIMIT 99950 2]
+                assert_equal {1050 1051} \
+                    [r zrangebyscore zset (999 +inf LIMIT 50 2]
+                assert_equal {} \
+                    [r zrangebyscore zset -inf +inf LIMIT 100000 1]
+            }
+        }
+
         test "ZSETs skiplist implementation backlink consistency test - $encoding" {
             set diff 0
             for {set j 0} {$j < $elements} {incr j} {
@@ -1026,5 +1240,7 @@ start_server {tags {"zset"}} {
     tags {"slow"} {
         stressers ziplist
         stressers skiplist
+        stressers btree
+        r config set zset-large-encoding skiplist
     }
 }
@@ -0,0 +1,110 @@
+#!/usr/bin/env tclsh8.5
+# Benchmark ZRANGEBYSCORE, ZREVRANGEBYSCORE, ZRANGEBYLEX and ZREVRANGEBYLEX
+# with growing LIMIT offsets, for both the large sorted set encodings.
+#
+# The offset is applied using the ranks of the sorted set, so the time per
+# call should not grow with the offset. Nothing is asserted: compare the
+# columns of the output, or the output of different builds.
+#
+# Usage: cd utils; ./zset-limit-bench.tcl [--host <host>] [--port <port>]
+#                                         [--elements <n>] [--calls <n>]
+#
+# The keys __zset_limit_bench_score and __zset_limit_bench_lex of the DB 9
+# of the target server are overwritten and deleted at the end.
+
+source ../tests/support/redis.tcl
+set ::host 127.0.0.1
+set ::port 6379
+set ::elements 1000000
+set ::calls 1000
+set ::count 10
+
+proc populate {r key lex} {
+    $r del $key
+    set args {}
+    for {set j 0} {$j < $::elements} {incr j} {
+        lappend args [expr {$lex ? 0 : $j}] [format "m:%09d" $j]
+        if {[llength $args] == 2000 || $j == $::elements-1} {
+            $r zadd $key {*}$args
+            set args {}
+        }
+    }
+}
+
+# Return the average time of a call of 'cmd' in microseconds.
+proc bench {r cmd} {
+    set start [clock microseconds]
+    for {set j 0} {$j < $::calls} {incr j} {
+        $r {*}$cmd
+    }
+    expr {double([clock microseconds]-$start)/$::calls}
+}
+
+proc main {} {
+    set r [redis $::host $::port]
+    $r select 9
+    set orig [lindex [$r config get zset-large-encoding] 1]
+    set score __zset_limit_bench_score
+    set lex __zset_limit_bench_lex
+    set offsets [list 0 [expr {$::elements/4}] [expr {$::elements/2}] \
+                      [expr {$::elements-$::count}]]
+
+    puts [format "# elements=%d calls=%d count=%d, usec per call" \
+        $::elements $::calls $::count]
+    foreach encoding {skiplist btree} {
+        $r config set zset-large-encoding $encoding
+        populate $r $score 0
+        populate $r $lex 1
+        puts "\n$encoding"
+        set line [format "%-18s" offset]
+        foreach offset $offsets {append line [format "%12d" $offset]}
+        puts $line
+        foreach {name cmd} [list \
+            zrangebyscore [list zrangebyscore $score -inf +inf] \
+            zrevrangebyscore [list zrevrangebyscore $score +inf -inf] \
+            zrangebylex [list zrangebylex $lex - +] \
+            zrevrangebylex [list zrevrangebylex $lex + -]] \
+        {
+            set line [format "%-18s" $name]
+            foreach offset $offsets {
+                set usec [bench $r [concat $cmd limit $offset $::count]]
+                append line [format "%12.2f" $usec]
+            }
+            puts $line
+        }
+    }
+    $r del $score $lex
+    $r config set zset-large-encoding $orig
+    $r close
+}
+
+# Force the user to run the script from the 'utils' directory.
+if {![file exists zset-limit-bench.tcl]} {
+    puts "Please make sure to run zset-limit-bench.tcl while inside /utils."
+    puts "Example: cd utils; ./zset-limit-bench.tcl"
+    exit 1
+}
+
+# parse arguments
+for {set j 0} {$j < [llength $argv]} {incr j} {
+    set opt [lindex $argv $j]
+    set arg [lindex $argv [expr $j+1]]
+    if {$opt eq {--host}} {
+        set ::host $arg
+        incr j
+    } elseif {$opt eq {--port}} {
+        set ::port $arg
+        incr j
+    } elseif {$opt eq {--elements}} {
+        set ::elements $arg
+        incr j
+    } elseif {$opt eq {--calls}} {
+        set ::calls $arg
+        incr j
+    } else {
+        puts "Wrong argument: $opt"
+        exit 1
+    }
+}
+
+main